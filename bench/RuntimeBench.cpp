@@ -0,0 +1,391 @@
+// Runtime micro-benchmarks against synthetic backends. Results go to stdout
+// as JSON lines (one object per measurement), progress to stderr:
+//   CppDeepSeekBench [--quick] [--filter <name>] [--out <file.jsonl>]
+//                    [--latency-ms <ms>] [--tokens-per-second <n>]
+//                    [--output-tokens <n>] [--max-store-mb <mb>]
+#include "AgentRuntime.hpp"
+#include "LogicGate.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <unistd.h>
+#endif
+
+namespace {
+
+namespace fs = std::filesystem;
+using Clock = std::chrono::steady_clock;
+
+// Results are accumulated here so the measured calls are not optimized away.
+volatile size_t g_sink = 0;
+
+struct BenchOptions {
+  bool quick = false;
+  std::string filter;
+  std::string out_path;
+  // Fake backend: time to first token, then generation at a fixed rate.
+  double latency_ms = 20.0;
+  double tokens_per_second = 1000.0;
+  int output_tokens = 32;
+  int max_store_mb = 1024;
+};
+
+// A ChatBackend that produces `output_tokens` copies of "tok " after
+// `latency_ms`, at `tokens_per_second`; streaming delivers one token per
+// callback. Zero latency and an unlimited rate measure pure runtime overhead.
+app::ChatBackend FakeBackend(double latency_ms, double tokens_per_second, int output_tokens) {
+  const auto token_delay = std::chrono::duration<double, std::milli>(
+      tokens_per_second > 0 ? 1000.0 / tokens_per_second : 0.0);
+  const auto first_delay = std::chrono::duration<double, std::milli>(latency_ms);
+  app::ChatBackend backend;
+  backend.chat = [=](const std::vector<deepseek::Message>&, std::string_view, app::CallContext*,
+                     std::string*) -> std::optional<deepseek::ChatResponse> {
+    const auto total = first_delay + token_delay * output_tokens;
+    if (total.count() > 0) {
+      std::this_thread::sleep_for(total);
+    }
+    deepseek::ChatResponse resp;
+    resp.content.reserve(static_cast<size_t>(output_tokens) * 4);
+    for (int i = 0; i < output_tokens; ++i) {
+      resp.content += "tok ";
+    }
+    return resp;
+  };
+  backend.stream = [=](const std::vector<deepseek::Message>&, std::string_view,
+                       const app::ChatBackend::StreamCallback& on_delta, app::CallContext*,
+                       std::string*) {
+    if (first_delay.count() > 0) {
+      std::this_thread::sleep_for(first_delay);
+    }
+    for (int i = 0; i < output_tokens; ++i) {
+      if (token_delay.count() > 0) {
+        std::this_thread::sleep_for(token_delay);
+      }
+      on_delta("", "tok ");
+    }
+    return true;
+  };
+  return backend;
+}
+
+std::string Filler(size_t bytes, size_t seed) {
+  static const char* const kWords[] = {"latency", "cache", "agent", "tradeoff", "thread",
+                                       "memory",  "queue", "token", "prefill",  "decode"};
+  std::string text;
+  text.reserve(bytes + 16);
+  while (text.size() < bytes) {
+    text += kWords[(seed++ * 7) % 10];
+    text += ' ';
+  }
+  text.resize(bytes);
+  return text;
+}
+
+std::vector<app::Agent> MakeAgents(size_t count, size_t messages, size_t message_bytes) {
+  std::vector<app::Agent> agents;
+  agents.reserve(count);
+  for (size_t a = 0; a < count; ++a) {
+    app::Agent agent{"Agent" + std::to_string(a), "You are agent " + std::to_string(a) + ".", {}};
+    agent.memory.reserve(messages);
+    for (size_t m = 0; m < messages; ++m) {
+      agent.memory.push_back({m % 2 == 0 ? "user" : "assistant", Filler(message_bytes, a + m),
+                              m % 2 == 0 ? "" : Filler(message_bytes / 4, m)});
+    }
+    agents.push_back(std::move(agent));
+  }
+  return agents;
+}
+
+class Reporter {
+ public:
+  explicit Reporter(const BenchOptions& options) : options_(options) {
+    if (!options.out_path.empty()) {
+      file_.open(options.out_path, std::ios::trunc);
+    }
+  }
+
+  bool Enabled(std::string_view bench) const {
+    return options_.filter.empty() || bench.find(options_.filter) != std::string_view::npos;
+  }
+
+  void Emit(nlohmann::json result) {
+    const std::string line = result.dump();
+    std::cout << line << "\n" << std::flush;
+    if (file_) {
+      file_ << line << "\n" << std::flush;
+    }
+  }
+
+ private:
+  const BenchOptions& options_;
+  std::ofstream file_;
+};
+
+// Repeats `op` until `min_seconds` have passed; returns ns per call.
+double NsPerOp(const std::function<void()>& op, double min_seconds, size_t* iterations) {
+  op();  // Warm up.
+  size_t n = 0;
+  size_t batch = 1;
+  const auto start = Clock::now();
+  std::chrono::duration<double> elapsed{};
+  while (elapsed.count() < min_seconds) {
+    for (size_t i = 0; i < batch; ++i) {
+      op();
+    }
+    n += batch;
+    batch = std::min<size_t>(batch * 2, 1 << 20);
+    elapsed = Clock::now() - start;
+  }
+  *iterations = n;
+  return elapsed.count() * 1e9 / static_cast<double>(n);
+}
+
+// Wall time of `repeats` runs: {min, median} in ms.
+std::pair<double, double> WallMs(const std::function<void()>& op, int repeats) {
+  std::vector<double> times;
+  for (int i = 0; i < repeats; ++i) {
+    const auto start = Clock::now();
+    op();
+    times.push_back(std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+  }
+  std::sort(times.begin(), times.end());
+  return {times.front(), times[times.size() / 2]};
+}
+
+void BenchBuildPrompt(const BenchOptions& options, Reporter& reporter) {
+  const double min_seconds = options.quick ? 0.02 : 0.3;
+  const std::vector<size_t> sizes = options.quick ? std::vector<size_t>{10, 100}
+                                                  : std::vector<size_t>{10, 100, 1000, 10000};
+  for (size_t messages : sizes) {
+    const auto agents = MakeAgents(1, messages, 256);
+    size_t iterations = 0;
+    const double ns = NsPerOp(
+        [&]() { g_sink = g_sink + app::BuildPrompt(agents[0], "next topic").size(); },
+        min_seconds, &iterations);
+    reporter.Emit({{"bench", "BuildPrompt"},
+                   {"messages", messages},
+                   {"iterations", iterations},
+                   {"ns_per_op", ns},
+                   {"ns_per_message", ns / static_cast<double>(messages + 1)}});
+  }
+}
+
+void BenchRunAgentsConcurrent(const BenchOptions& options, Reporter& reporter) {
+  const std::vector<size_t> counts = options.quick ? std::vector<size_t>{1, 8}
+                                                   : std::vector<size_t>{1, 10, 100, 1000};
+  const int repeats = options.quick ? 1 : 3;
+  for (bool stream : {false, true}) {
+    auto backend =
+        FakeBackend(options.latency_ms, options.tokens_per_second, options.output_tokens);
+    // One agent's call on an idle machine; the rest is runtime overhead.
+    const double ideal_ms =
+        options.latency_ms + (options.tokens_per_second > 0
+                                  ? options.output_tokens * 1000.0 / options.tokens_per_second
+                                  : 0.0);
+    for (size_t count : counts) {
+      auto agents = MakeAgents(count, 4, 128);
+      std::cerr << "RunAgentsConcurrent " << count << " agents" << (stream ? " (stream)" : "")
+                << "\n";
+      const auto [min_ms, median_ms] = WallMs(
+          [&]() {
+            for (auto& agent : agents) {
+              agent.memory.resize(4);
+            }
+            // Streamed deltas are echoed to stdout; keep them out of the results.
+            std::cout.setstate(std::ios::failbit);
+            app::RunAgentsConcurrent(backend, agents, "topic", stream);
+            std::cout.clear();
+          },
+          repeats);
+      reporter.Emit({{"bench", "RunAgentsConcurrent"},
+                     {"agents", count},
+                     {"stream", stream},
+                     {"latency_ms", options.latency_ms},
+                     {"output_tokens", options.output_tokens},
+                     {"ideal_ms", ideal_ms},
+                     {"min_ms", min_ms},
+                     {"median_ms", median_ms},
+                     {"overhead_ms", min_ms - ideal_ms}});
+    }
+  }
+}
+
+void BenchRunDebateRounds(const BenchOptions& options, Reporter& reporter) {
+  const double min_seconds = options.quick ? 0.02 : 0.3;
+  // Zero-latency backend: only runtime bookkeeping is measured.
+  auto backend = FakeBackend(0.0, 0.0, options.output_tokens);
+  for (int rounds : {1, 4, 16}) {
+    auto agents = MakeAgents(3, 0, 0);
+    size_t iterations = 0;
+    const double ns = NsPerOp(
+        [&]() {
+          for (auto& agent : agents) {
+            agent.memory.clear();
+          }
+          app::RunDebateRounds(backend, agents, "topic", rounds, false);
+        },
+        min_seconds, &iterations);
+    const double turns = static_cast<double>(rounds) * static_cast<double>(agents.size());
+    reporter.Emit({{"bench", "RunDebateRounds"},
+                   {"agents", agents.size()},
+                   {"rounds", rounds},
+                   {"iterations", iterations},
+                   {"ns_per_debate", ns},
+                   {"ns_per_turn", ns / turns}});
+  }
+}
+
+void BenchParseDecision(const BenchOptions& options, Reporter& reporter) {
+  const double min_seconds = options.quick ? 0.02 : 0.3;
+  const std::vector<std::pair<std::string, std::string>> inputs{
+      {"first_word", "YES"},
+      {"punctuated", "  no, this is not an engineering topic."},
+      {"fallback", Filler(2000, 3) + " so the answer is YES"},
+      {"undecided", Filler(2000, 5)},
+  };
+  for (const auto& [label, text] : inputs) {
+    size_t iterations = 0;
+    const double ns = NsPerOp([&]() { g_sink = g_sink + app::ParseDecision(text).has_value(); },
+                              min_seconds, &iterations);
+    reporter.Emit({{"bench", "ParseDecision"},
+                   {"input", label},
+                   {"bytes", text.size()},
+                   {"iterations", iterations},
+                   {"ns_per_op", ns}});
+  }
+}
+
+void BenchPersistence(const BenchOptions& options, Reporter& reporter) {
+  std::vector<size_t> sizes_mb = options.quick ? std::vector<size_t>{1}
+                                               : std::vector<size_t>{1, 16, 256, 1024};
+  sizes_mb.erase(std::remove_if(sizes_mb.begin(), sizes_mb.end(),
+                                [&](size_t mb) { return mb > (size_t)options.max_store_mb; }),
+                 sizes_mb.end());
+#if defined(_WIN32)
+  const std::string tag = "bench";
+#else
+  const std::string tag = "bench-" + std::to_string(::getpid());
+#endif
+  const int repeats = options.quick ? 1 : 3;
+  constexpr size_t kAgents = 8;
+  constexpr size_t kMessageBytes = 1024;
+  for (size_t mb : sizes_mb) {
+    // Content plus reasoning is ~1.25 KiB per message.
+    const size_t messages =
+        std::max<size_t>(1, mb * 1024 * 1024 / (kAgents * (kMessageBytes + kMessageBytes / 4)));
+    std::cerr << "SaveAgents/LoadAgents " << mb << " MB\n";
+    const auto agents = MakeAgents(kAgents, messages, kMessageBytes);
+    for (const char* extension : {".json", ".snap"}) {
+      const fs::path path = fs::temp_directory_path() / ("cppdeepseek-" + tag + extension);
+      std::string error;
+      const auto [save_min, save_median] = WallMs(
+          [&]() {
+            if (!app::SaveAgents(agents, path.string(), &error)) {
+              std::cerr << "SaveAgents failed: " << error << "\n";
+            }
+          },
+          repeats);
+      const auto file_bytes = fs::file_size(path);
+      std::vector<app::Agent> loaded;
+      const auto [load_min, load_median] = WallMs(
+          [&]() {
+            loaded.clear();
+            if (!app::LoadAgents(&loaded, path.string(), &error)) {
+              std::cerr << "LoadAgents failed: " << error << "\n";
+            }
+          },
+          repeats);
+      fs::remove(path);
+      const double file_mb = static_cast<double>(file_bytes) / (1024.0 * 1024.0);
+      reporter.Emit({{"bench", "SaveAgents"},
+                     {"format", extension + 1},
+                     {"target_mb", mb},
+                     {"file_bytes", file_bytes},
+                     {"min_ms", save_min},
+                     {"median_ms", save_median},
+                     {"mb_per_s", file_mb / (save_min / 1000.0)}});
+      reporter.Emit({{"bench", "LoadAgents"},
+                     {"format", extension + 1},
+                     {"target_mb", mb},
+                     {"file_bytes", file_bytes},
+                     {"min_ms", load_min},
+                     {"median_ms", load_median},
+                     {"mb_per_s", file_mb / (load_min / 1000.0)}});
+    }
+  }
+}
+
+bool ParseArgs(int argc, char** argv, BenchOptions* options) {
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg == "--quick") {
+      options->quick = true;
+      continue;
+    }
+    if (i + 1 >= argc) {
+      std::cerr << "Unknown or incomplete option: " << arg << "\n";
+      return false;
+    }
+    const std::string value = argv[++i];
+    try {
+      if (arg == "--filter") {
+        options->filter = value;
+      } else if (arg == "--out") {
+        options->out_path = value;
+      } else if (arg == "--latency-ms") {
+        options->latency_ms = std::stod(value);
+      } else if (arg == "--tokens-per-second") {
+        options->tokens_per_second = std::stod(value);
+      } else if (arg == "--output-tokens") {
+        options->output_tokens = std::stoi(value);
+      } else if (arg == "--max-store-mb") {
+        options->max_store_mb = std::stoi(value);
+      } else {
+        std::cerr << "Unknown option: " << arg << "\n";
+        return false;
+      }
+    } catch (...) {
+      std::cerr << "Invalid value for " << arg << ": " << value << "\n";
+      return false;
+    }
+  }
+  if (options->quick) {
+    options->latency_ms = std::min(options->latency_ms, 2.0);
+  }
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  BenchOptions options;
+  if (!ParseArgs(argc, argv, &options)) {
+    return 1;
+  }
+  Reporter reporter(options);
+  const std::vector<std::pair<std::string, void (*)(const BenchOptions&, Reporter&)>> benches{
+      {"BuildPrompt", BenchBuildPrompt},
+      {"RunAgentsConcurrent", BenchRunAgentsConcurrent},
+      {"RunDebateRounds", BenchRunDebateRounds},
+      {"ParseDecision", BenchParseDecision},
+      {"SaveAgents/LoadAgents", BenchPersistence},
+  };
+  for (const auto& [name, bench] : benches) {
+    if (reporter.Enabled(name)) {
+      bench(options, reporter);
+    }
+  }
+  return 0;
+}
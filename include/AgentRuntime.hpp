@@ -1,9 +1,14 @@
 #pragma once
 
+#include "Cancellation.hpp"
 #include "DeepSeekClient.hpp"
 
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <functional>
 #include <future>
+#include <memory>
 #include <mutex>
 #include <optional>
 #include <string>
@@ -12,28 +17,131 @@
 
 namespace app {
 
+class AgentSnapshot;
+class ContextManager;
+class MetricsRegistry;
+class RetrievalMemory;
+template <typename Value>
+class SemanticCache;
+
 struct Agent {
   std::string name;
   std::string system_prompt;
   std::vector<deepseek::Message> memory;
+  // Older turns left in a mapped snapshot by LoadAgentsRecent. They precede
+  // `memory`, are not sent to the backend, and are written back by SaveAgents.
+  std::shared_ptr<const AgentSnapshot> archive = nullptr;
+  size_t archive_index = 0;
+  size_t archived_messages = 0;
 };
 
 struct AgentResult {
   std::string name;
   deepseek::ChatResponse response;
+  // Set when the answer was replayed from a similar earlier topic.
+  std::optional<float> cache_score;
+  // Of the backend call that produced the answer (zero when replayed).
+  deepseek::CallMetrics metrics;
+};
+
+// What a call is for, so a routing backend can treat classes differently.
+enum class CallKind { kAgent, kGate };
+
+// Per-call state passed along with a backend request; may be null.
+struct CallContext {
+  CallKind kind = CallKind::kAgent;
+  // Filled in by the backend.
+  deepseek::CallMetrics metrics;
+  // When set, the backend should stop generating once it is cancelled or the
+  // deadline has passed; see cancelled().
+  const CancelToken* cancel = nullptr;
+  std::optional<std::chrono::steady_clock::time_point> deadline;
+  // Set by the backend when it cut a call short because it was cancelled.
+  bool stopped = false;
+  // Asks the backend to score its answer. Backends that can fill in
+  // `confidence`: the geometric mean probability of the generated tokens.
+  bool want_confidence = false;
+  std::optional<double> confidence;
+
+  bool deadline_exceeded() const {
+    return deadline && std::chrono::steady_clock::now() >= *deadline;
+  }
+  bool cancelled() const { return (cancel && cancel->cancelled()) || deadline_exceeded(); }
 };
 
 struct ChatBackend {
   using StreamCallback =
       std::function<void(std::string_view reasoning_delta, std::string_view content_delta)>;
   std::function<std::optional<deepseek::ChatResponse>(
-      const std::vector<deepseek::Message>&, std::string_view, std::string*)>
+      const std::vector<deepseek::Message>&, std::string_view, CallContext*, std::string*)>
       chat;
   std::function<bool(const std::vector<deepseek::Message>&,
                      std::string_view,
                      const StreamCallback&,
+                     CallContext*,
                      std::string*)>
       stream;
+  // Optional: answers several prompts at once, typically branches sharing a
+  // long prefix (see RunBranches). `calls` has one entry per prompt.
+  std::function<std::optional<std::vector<deepseek::ChatResponse>>(
+      const std::vector<std::vector<deepseek::Message>>& prompts,
+      std::string_view system_prompt,
+      std::vector<CallContext>* calls,
+      std::string*)>
+      chat_batch;
+  // Optional: prompt tokens of `text` for this backend's tokenizer.
+  std::function<size_t(std::string_view text)> count_tokens;
+  // Optional: embedding vector of `text` (see RetrievalMemory).
+  std::function<std::optional<std::vector<float>>(std::string_view text, std::string*)> embed;
+  // Optional: computes the state of `messages` ahead of time, so a later call
+  // whose prompt starts with them only prefills the rest. Yields (keeping
+  // what it computed) once `cancel` is cancelled or a call needs the backend.
+  // Returns whether the whole state is ready.
+  std::function<bool(const std::vector<deepseek::Message>& messages,
+                     std::string_view system_prompt,
+                     const CancelToken* cancel)>
+      prefill;
+};
+
+using AgentDeltaCallback = std::function<void(const std::string& agent_name,
+                                               std::string_view reasoning_delta,
+                                               std::string_view content_delta)>;
+
+enum class DebateMode {
+  // Each agent answers the previous agent's answer, one call at a time.
+  kSequential,
+  // Every agent answers the previous round's answers at once, so a round
+  // takes about as long as its slowest call.
+  kAllToAll,
+};
+
+struct RunOptions {
+  bool stream = false;
+  // When set, streamed deltas are echoed to stdout under this lock.
+  std::mutex* print_mutex = nullptr;
+  // Receives streamed deltas tagged with the agent that produced them.
+  AgentDeltaCallback on_delta;
+  // When set, prompts are fitted to its token budget before each call.
+  ContextManager* context = nullptr;
+  // When set, older history is only sent when relevant to the input.
+  RetrievalMemory* retrieval = nullptr;
+  // When set (and the backend can embed), RunDebateRounds replays the
+  // results of an earlier debate on a similar topic with the same agents.
+  // Replayed answers ignore history added since they were generated.
+  SemanticCache<std::vector<AgentResult>>* answer_cache = nullptr;
+  // When set, the metrics of every agent call are recorded here.
+  MetricsRegistry* metrics = nullptr;
+  // When set, calls stop once it is cancelled and RunAgent throws
+  // CancelledError.
+  const CancelToken* cancel = nullptr;
+  // End-to-end deadline shared by every call made with these options; calls
+  // still running at the deadline throw DeadlineExceededError.
+  std::optional<std::chrono::steady_clock::time_point> deadline;
+  // How RunDebateRounds passes answers between agents.
+  DebateMode debate_mode = DebateMode::kSequential;
+  // kAllToAll: how many of the other agents' answers each agent reads per
+  // round (0 = all of them).
+  size_t fan_in = 0;
 };
 
 std::vector<deepseek::Message> BuildPrompt(const Agent& agent, std::string_view user_input);
@@ -44,23 +152,139 @@ AgentResult RunAgent(ChatBackend& backend,
                      bool stream,
                      std::mutex* print_mutex);
 
+AgentResult RunAgent(ChatBackend& backend,
+                     Agent& agent,
+                     std::string_view user_input,
+                     const RunOptions& options);
+
 std::vector<AgentResult> RunAgentsConcurrent(ChatBackend& backend,
                                              std::vector<Agent>& agents,
                                              std::string_view user_input,
                                              bool stream);
 
+// Copies of `agent` whose memory is cut after its first `at` messages, named
+// "<name>/1", "<name>/2", ... Archived turns are shared, not copied.
+std::vector<Agent> ForkAgent(const Agent& agent, size_t count, size_t at = SIZE_MAX);
+
+// Answers `inputs[i]` with `branches[i]` (usually forks of one agent), all
+// concurrently. Backends with chat_batch answer them in one call, so a local
+// backend prefills their common history once; streamed runs and other
+// backends run one RunAgent per branch. Streamed runs without on_delta print
+// their deltas.
+std::vector<AgentResult> RunBranches(ChatBackend& backend,
+                                     std::vector<Agent>& branches,
+                                     const std::vector<std::string>& inputs,
+                                     const RunOptions& options = {});
+
+// When RunAgentsQuorum stops waiting for the remaining agents.
+struct QuorumPolicy {
+  enum class Mode {
+    // Every agent (like RunAgentsConcurrent).
+    kAll,
+    // The first `k` successful answers.
+    kFirstK,
+    // More than half of all agents agree on the normalized answer.
+    kMajority,
+  };
+  Mode mode = Mode::kAll;
+  size_t k = 1;
+  // 0 = none. Agents still running at the deadline are cancelled.
+  std::chrono::milliseconds deadline{0};
+  // Maps an answer to the key votes are counted on; NormalizeAnswer when
+  // unset.
+  std::function<std::string(std::string_view content)> normalize;
+};
+
+struct QuorumResult {
+  // Successful answers in completion order. Agents that finished while the
+  // rest were being cancelled are included, so this can exceed `k`.
+  std::vector<AgentResult> results;
+  bool satisfied = false;
+  // kMajority: the winning normalized answer and its votes.
+  std::optional<std::string> consensus;
+  size_t votes = 0;
+  size_t failed = 0;
+  size_t cancelled = 0;
+};
+
+// Lowercases, collapses whitespace and trims surrounding whitespace and
+// punctuation, so "Yes." and " yes" vote together.
+std::string NormalizeAnswer(std::string_view content);
+
+// Runs every agent concurrently and returns as soon as `policy` is met (or can
+// no longer be met), cancelling agents still in flight through their
+// CallContext. Cancelled and failed agents keep their memory unchanged.
+// `options.cancel` cancels the whole fan-out.
+QuorumResult RunAgentsQuorum(ChatBackend& backend,
+                             std::vector<Agent>& agents,
+                             std::string_view user_input,
+                             const QuorumPolicy& policy,
+                             const RunOptions& options = {});
+
 std::vector<AgentResult> RunDebateRounds(ChatBackend& backend,
                                          std::vector<Agent>& agents,
                                          std::string_view topic,
                                          int rounds,
                                          bool stream);
 
+// Results are in round order, agents in their original order within a
+// round. In kAllToAll rounds every agent first answers the topic, then the
+// answers of the `fan_in` agents after it (wrapping around) from the round
+// before, all through RunBranches.
+std::vector<AgentResult> RunDebateRounds(ChatBackend& backend,
+                                         std::vector<Agent>& agents,
+                                         std::string_view topic,
+                                         int rounds,
+                                         const RunOptions& options);
+
+// Starts the debate while `admit` (usually a gate) decides whether it may
+// run, so the gate's latency hides behind the first turn. The first turn
+// runs on copies of `agents` and later turns wait for the decision; deltas
+// for `options.on_delta` are held back until then and nothing is printed.
+// When `admit` returns false (or throws) the debate is cancelled, `agents`
+// are left unchanged and std::nullopt is returned (or the exception
+// rethrown). Otherwise the copies replace `agents` once the debate
+// finishes; a debate that fails leaves `agents` unchanged.
+std::optional<std::vector<AgentResult>> RunDebateRoundsSpeculative(
+    ChatBackend& backend,
+    std::vector<Agent>& agents,
+    std::string_view topic,
+    int rounds,
+    const std::function<bool()>& admit,
+    const RunOptions& options = {});
+
+// Prefills each agent's system prompt and history on backends that support
+// it, so its next turn only prefills the new input. Meant for idle time:
+// stops once `cancel` is cancelled. Returns the number of agents whose
+// history is ready.
+size_t PrefillAgents(ChatBackend& backend,
+                     const std::vector<Agent>& agents,
+                     const CancelToken* cancel = nullptr);
+
+// Writes JSON, or a binary snapshot when the path ends in ".snap". The file is
+// replaced atomically, so saving over a store that is still mapped is safe.
 bool SaveAgents(const std::vector<Agent>& agents,
                 std::string_view path,
                 std::string* error_out = nullptr);
 
+// Loads a JSON store or a binary snapshot (detected by content) and
+// materializes the full history of every agent.
 bool LoadAgents(std::vector<Agent>* agents,
                 std::string_view path,
                 std::string* error_out = nullptr);
 
+// Like LoadAgents, but snapshot stores only copy the last `max_history`
+// messages of each agent into `memory`; the rest stay mapped in
+// `Agent::archive`. JSON stores are always materialized in full.
+bool LoadAgentsRecent(std::vector<Agent>* agents,
+                      std::string_view path,
+                      size_t max_history,
+                      std::string* error_out = nullptr);
+
+// Converts between JSON and snapshot stores; the output format follows the
+// output path (see SaveAgents).
+bool ConvertAgentStore(std::string_view in_path,
+                       std::string_view out_path,
+                       std::string* error_out = nullptr);
+
 }  // namespace app
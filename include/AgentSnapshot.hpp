@@ -0,0 +1,81 @@
+#pragma once
+
+#include "AgentRuntime.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace app {
+
+struct MessageView {
+  std::string_view role;
+  std::string_view content;
+  std::string_view reasoning;
+};
+
+// Read-only view of a binary agent store (version 1, native byte order).
+//
+// Layout: a fixed header, a table of agent records, a table of message records
+// and one text section. Records reference text by (offset, size), so the file
+// can be mapped and read in place. Opening validates the header and the agent
+// table only; message records are bounds-checked when accessed, which keeps
+// Open() independent of the amount of history stored.
+class AgentSnapshot {
+ public:
+  static std::shared_ptr<const AgentSnapshot> Open(std::string_view path,
+                                                   std::string* error_out = nullptr);
+  ~AgentSnapshot();
+
+  AgentSnapshot(const AgentSnapshot&) = delete;
+  AgentSnapshot& operator=(const AgentSnapshot&) = delete;
+
+  size_t agent_count() const { return agent_count_; }
+  std::string_view name(size_t agent) const;
+  std::string_view system_prompt(size_t agent) const;
+  size_t message_count(size_t agent) const;
+
+  // Returns std::nullopt if the record points outside the text section.
+  std::optional<MessageView> message(size_t agent, size_t index) const;
+
+ private:
+  AgentSnapshot() = default;
+
+  std::optional<std::string_view> Text(const uint8_t* ref) const;
+
+  const uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+  bool mapped_ = false;
+  std::vector<uint8_t> buffer_;
+  size_t agent_count_ = 0;
+  size_t message_total_ = 0;
+  const uint8_t* agents_ = nullptr;
+  const uint8_t* messages_ = nullptr;
+  const char* text_ = nullptr;
+  size_t text_size_ = 0;
+};
+
+// True if the file starts with the snapshot magic.
+bool IsAgentSnapshot(std::string_view path);
+
+// Paths ending in ".snap" are written as snapshots by SaveAgents.
+bool IsSnapshotPath(std::string_view path);
+
+// Visits an agent's full history: archived turns first, then `memory`.
+// Returns false if the archive holds a corrupt record.
+bool ForEachHistoryMessage(const Agent& agent,
+                           const std::function<void(const MessageView&)>& fn,
+                           std::string* error_out = nullptr);
+
+// Streams agents (including archived history) in snapshot format.
+bool WriteAgentSnapshot(const std::vector<Agent>& agents,
+                        std::ostream& out,
+                        std::string* error_out = nullptr);
+
+}  // namespace app
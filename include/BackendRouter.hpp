@@ -0,0 +1,96 @@
+#pragma once
+
+#include "AgentRuntime.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace app {
+
+struct RouterOptions {
+  // Local calls that run at once (LlamaOptions::n_contexts); further calls
+  // wait for a context.
+  size_t local_slots = 1;
+  // Prompts longer than this go remote (0 = no limit).
+  size_t max_local_prompt_tokens = 0;
+  // A queued call goes remote once its expected local latency exceeds this
+  // multiple of the remote latency. Remote calls cost money and local ones
+  // only time; gate calls hold up their whole topic and use gate_remote_cost.
+  double remote_cost = 2.0;
+  double gate_remote_cost = 1.0;
+  // A backend whose call failed is avoided for this long.
+  std::chrono::milliseconds failure_cooldown{30000};
+  // Weight of the newest call in the latency averages.
+  double smoothing = 0.2;
+};
+
+enum class Route { kLocal, kRemote };
+
+struct RouterStats {
+  size_t local = 0;
+  size_t remote = 0;
+  // Calls retried on the other backend after an error.
+  size_t failovers = 0;
+  // Calls that failed on both backends (or could not fail over).
+  size_t failed = 0;
+};
+
+// A ChatBackend that sends each call to a local or a remote backend. Local
+// capacity is free but limited, so calls go local while a context is free
+// and burst to the remote backend only when the local queue would make them
+// slower than the API by the configured cost factor. The estimate uses the
+// live queue depth, the prompt size and latencies observed on both sides.
+// A failed call is retried once on the other backend, and the failed side
+// is avoided for a while. CallMetrics::route records each decision.
+// Thread-safe.
+class BackendRouter {
+ public:
+  BackendRouter(ChatBackend local, ChatBackend remote, RouterOptions options = {});
+
+  BackendRouter(const BackendRouter&) = delete;
+  BackendRouter& operator=(const BackendRouter&) = delete;
+
+  // Routes chat and stream, and chat_batch when either side has it: a batch
+  // is routed as one call, and a side without chat_batch answers it with a
+  // chat call per prompt. count_tokens and embed come from the local backend
+  // when it has them, prefill always does. The router must outlive the
+  // returned backend.
+  ChatBackend Backend();
+
+  // Picks a backend for a call of `kind` with `prompt_tokens` and explains
+  // the choice in `reason`.
+  Route Choose(size_t prompt_tokens, CallKind kind, std::string* reason) const;
+
+  RouterStats stats() const;
+
+ private:
+  struct Side {
+    ChatBackend backend;
+    size_t in_flight = 0;
+    // Smoothed latencies; zero until the first successful call.
+    double prefill_ms_per_token = 0.0;
+    double call_ms = 0.0;
+    std::chrono::steady_clock::time_point down_until{};
+  };
+
+  template <typename Attempt>
+  bool Run(size_t prompt_tokens, CallContext* call, std::string* error_out, Attempt attempt);
+  size_t PromptTokens(const std::vector<deepseek::Message>& messages,
+                      std::string_view system_prompt) const;
+  void Begin(Route route);
+  void Finish(Route route, bool ok, bool cancelled, const CallContext& call);
+
+  Side& side(Route route) { return route == Route::kLocal ? local_ : remote_; }
+
+  RouterOptions options_;
+  mutable std::mutex mutex_;
+  Side local_;
+  Side remote_;
+  RouterStats stats_;
+};
+
+}  // namespace app
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "AgentRuntime.hpp"
+
+#include <cstddef>
+#include <functional>
+#include <iosfwd>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace app {
+
+// One input line. A line is either a JSON object
+//   {"id":..,"topic":..,"rounds":..,"agents":[{"name":..,"system_prompt":..}]}
+// (only "topic" is required) or plain text taken as the topic.
+struct BatchItem {
+  // Defaults to the 1-based line number.
+  std::string id;
+  size_t line = 0;
+  std::string topic;
+  // 0 = BatchOptions::rounds.
+  int rounds = 0;
+  // Empty = the default agents.
+  std::vector<Agent> agents;
+};
+
+// Returns false (with `error_out`) for malformed lines.
+bool ParseBatchItem(std::string_view text, size_t line, BatchItem* item, std::string* error_out);
+
+struct BatchOptions {
+  // Items in flight at once.
+  size_t concurrency = 4;
+  int rounds = 1;
+};
+
+struct BatchStats {
+  size_t items = 0;
+  // Includes the cancelled items.
+  size_t failed = 0;
+  size_t cancelled = 0;
+  double elapsed_ms = 0.0;
+};
+
+// Gates and runs one item with its own agents; returning false reports the
+// item as failed with `error_out`. A CancelledError (e.g. a deadline) marks it
+// "cancelled".
+using BatchHandler = std::function<bool(const BatchItem& item,
+                                        std::vector<Agent>& agents,
+                                        std::vector<AgentResult>* results,
+                                        std::string* error_out)>;
+
+// Reads items from `in` as they are needed and runs up to `concurrency` of
+// them at once; each item gets fresh agents (its own, or `make_agents()`).
+// Every item produces one JSON line on `out` as soon as it finishes:
+//   {"id":..,"line":..,"ok":..,"cancelled":..,"error":..,"start_ms":..,"elapsed_ms":..,
+//    "results":[{"agent":..,"content":..,"reasoning":..,"ttft_ms":..,
+//                "total_ms":..,"prefill_tokens":..,"decode_tokens":..}]}
+// `start_ms` counts from the start of the batch.
+BatchStats RunBatch(std::istream& in,
+                    std::ostream& out,
+                    const BatchOptions& options,
+                    const std::function<std::vector<Agent>()>& make_agents,
+                    const BatchHandler& handler);
+
+}  // namespace app
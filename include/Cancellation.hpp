@@ -0,0 +1,42 @@
+#pragma once
+
+#include <atomic>
+#include <stdexcept>
+
+namespace app {
+
+// Cooperative cancellation flag shared between a caller and the work it
+// started. A token is also cancelled when its parent is, so a fan-out can
+// cancel its own calls without cancelling the caller's other work.
+class CancelToken {
+ public:
+  explicit CancelToken(const CancelToken* parent = nullptr) : parent_(parent) {}
+
+  CancelToken(const CancelToken&) = delete;
+  CancelToken& operator=(const CancelToken&) = delete;
+
+  void Cancel() { cancelled_.store(true, std::memory_order_release); }
+
+  bool cancelled() const {
+    return cancelled_.load(std::memory_order_acquire) || (parent_ && parent_->cancelled());
+  }
+
+ private:
+  const CancelToken* parent_;
+  std::atomic<bool> cancelled_{false};
+};
+
+// Thrown by RunAgent when its call was cancelled; the agent's memory is left
+// unchanged.
+class CancelledError : public std::runtime_error {
+ public:
+  using std::runtime_error::runtime_error;
+};
+
+// A CancelledError caused by the call's deadline rather than its token.
+class DeadlineExceededError : public CancelledError {
+ public:
+  using CancelledError::CancelledError;
+};
+
+}  // namespace app
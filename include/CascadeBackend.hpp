@@ -0,0 +1,66 @@
+#pragma once
+
+#include "AgentRuntime.hpp"
+
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace app {
+
+struct CascadeTier {
+  std::string name;
+  ChatBackend backend;
+  // Answers scored below this confidence (or not scored at all) go to the
+  // next tier. Ignored for the last tier, whose answers are always used.
+  double min_confidence = 0.8;
+};
+
+struct CascadeTierStats {
+  std::string name;
+  // Calls that reached this tier and the ones it answered.
+  size_t calls = 0;
+  size_t answered = 0;
+};
+
+// A ChatBackend that asks its tiers in order, cheapest first, and returns
+// the first answer confident enough (see CallContext::confidence). Errors
+// also move the call up a tier; cancellation ends it. Lower tiers run
+// unstreamed and a confident answer is delivered as a single delta, so
+// discarded answers never reach the caller. The returned metrics are the
+// answering tier's, with the time spent in lower tiers added to ttft_ms and
+// total_ms. Thread-safe.
+class CascadeBackend {
+ public:
+  explicit CascadeBackend(std::vector<CascadeTier> tiers);
+
+  CascadeBackend(const CascadeBackend&) = delete;
+  CascadeBackend& operator=(const CascadeBackend&) = delete;
+
+  // chat_batch is offered when the last tier has it: lower tiers answer each
+  // prompt on its own and the escalated ones are batched on the last tier.
+  // count_tokens and embed come from the last tier; prefill runs on every
+  // tier that has it. The cascade must outlive the returned backend.
+  ChatBackend Backend();
+
+  std::vector<CascadeTierStats> stats() const;
+
+ private:
+  // Runs the tiers below the last on `call`. Returns the index of the tier
+  // that answered into `response`, or tiers_.size() - 1 when the last tier
+  // has to. Returns SIZE_MAX when the call was cancelled.
+  size_t AskLowerTiers(const std::vector<deepseek::Message>& messages,
+                       std::string_view system_prompt,
+                       CallContext* call,
+                       deepseek::ChatResponse* response,
+                       double* spent_ms,
+                       std::string* error_out);
+  void Finish(size_t tier, CallContext* call, double spent_ms);
+
+  std::vector<CascadeTier> tiers_;
+  mutable std::mutex mutex_;
+  std::vector<CascadeTierStats> stats_;
+};
+
+}  // namespace app
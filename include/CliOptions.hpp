@@ -10,13 +10,88 @@ struct CliOptions {
   bool topic_set = false;
   std::string model = "deepseek-reasoner";
   int rounds = 1;
+  // Run every agent at once each round on the previous round's answers,
+  // reading fan_in of the other agents' answers (0 = all).
+  bool all_to_all = false;
+  int fan_in = 0;
+  // Start the first debate turn while the topic gate runs and keep it only
+  // if the gate allows the topic.
+  bool optimistic_gate = false;
   bool stream = true;
   bool help = false;
   bool local_only = true;
+  // Load the local model and also use the API: each call goes to whichever
+  // backend is expected to answer sooner, preferring local (see
+  // BackendRouter). Prompts over local_prompt_limit tokens always go remote.
+  bool hybrid = false;
+  int local_prompt_limit = 0;
   int gpu_layers = 0;
   bool gpu_layers_auto = false;
   std::string load_path;
   std::string save_path;
+  // Messages per agent materialized from a snapshot store; -1 keeps all.
+  int history = -1;
+  bool convert = false;
+  bool kv_state = true;
+  // Interactive mode: prefill each agent's history on the local backend
+  // while waiting for the user.
+  bool idle_prefill = true;
+  // Resident daemon / thin client over a Unix domain socket.
+  bool daemon = false;
+  bool connect = false;
+  std::string socket_path;
+  std::string session = "default";
+  // Benchmark thread/batch settings for the local model and save a profile.
+  bool autotune = false;
+  // Local backend: contexts sharing the loaded model, optionally per NUMA node.
+  int contexts = 1;
+  bool numa = false;
+  // Local KV cache: context size (0 = sized from the model and RAM), element
+  // types, flash attention (auto/on/off) and GPU offload of the cache.
+  int ctx_size = 0;
+  std::string cache_type_k = "f16";
+  std::string cache_type_v = "f16";
+  std::string flash_attn = "auto";
+  bool kv_offload = true;
+  // Host memory (MiB) for KV states of prefilled prompts reused across agents
+  // and sessions (0 = off).
+  int prefix_cache_mb = 0;
+  // Local speculative decoding: a small GGUF sharing the chat model's
+  // vocabulary (a path, or a model name in the model home) proposes up to
+  // draft_max tokens per step for the chat model to verify.
+  std::string draft_model;
+  int draft_max = 8;
+  // Model cascade: a small local GGUF (path or model name) answers first and
+  // calls it scores below cascade_threshold go to the main backend.
+  std::string cascade_model;
+  float cascade_threshold = 0.8f;
+  // Prompt token budget per agent call (0 = the local context size, or a
+  // fixed default for the API) and whether old turns are summarized or dropped.
+  int context_budget = 0;
+  bool summarize = true;
+  // Send only the recent window plus the K most relevant older messages,
+  // using embeddings from the local model or --embed-model (also used by the
+  // semantic cache).
+  bool retrieval = false;
+  int retrieval_k = 4;
+  // Keep retrieval prompts' prefixes identical between turns so the API's
+  // prompt cache (and --prefix-cache-mb locally) can reuse them.
+  bool stable_prefix = false;
+  std::string embed_model;
+  // Reuse gate decisions and debate answers for inputs at least this similar
+  // to an earlier one (0 = off).
+  float semantic_cache = 0.0f;
+  // Per-call metrics export, written on exit: Prometheus text for .prom/.txt,
+  // JSON otherwise. --metrics-summary prints latency percentiles per topic.
+  std::string metrics_path;
+  bool metrics_summary = false;
+  // Chrome/Perfetto trace of the whole run, written on exit.
+  std::string trace_path;
+  // Headless JSONL batch ("-" = stdin) with this many topics in flight.
+  std::string batch_path;
+  int concurrency = 4;
+  // End-to-end time limit per topic, gate included (0 = none).
+  int deadline_ms = 0;
 };
 
 std::string Usage();
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "AgentRuntime.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace app {
+
+struct ContextBudget {
+  // Prompt tokens per request (system prompt and messages); 0 = unlimited.
+  size_t max_tokens = 0;
+  // The most recent messages are always sent verbatim.
+  size_t keep_recent = 4;
+  // Old turns are compacted this many messages at a time, so the prompt
+  // prefix (and the KV cache behind it) stays stable between compactions.
+  size_t compact_step = 8;
+  // Replace compacted turns with a summary instead of dropping them.
+  bool summarize = true;
+  // Tokens set aside for the summary message.
+  size_t summary_tokens = 256;
+  // Prompt tokens per summarizer request; longer compacted histories are
+  // folded in over several requests. 0 = unlimited.
+  size_t summarizer_tokens = 0;
+};
+
+struct ContextStats {
+  size_t tokens = 0;
+  // Oldest messages dropped or folded into the summary.
+  size_t compacted = 0;
+  bool summarized = false;
+  // Compacted messages the summary does not cover because the summarizer
+  // failed; they are left out of the prompt and retried on the next call.
+  size_t unsummarized = 0;
+};
+
+// Keeps agent prompts within a token budget. Token counts are cached per
+// message; summaries are cached per compacted prefix and built incrementally
+// from the previous one. Safe to share between concurrently running agents.
+class ContextManager {
+ public:
+  // `summarizer` writes the summaries (a cheap model is enough); without one
+  // compacted turns are dropped.
+  explicit ContextManager(ContextBudget budget, ChatBackend* summarizer = nullptr);
+
+  const ContextBudget& budget() const { return budget_; }
+
+  // Tokens of one message as `backend` counts them (ChatBackend::count_tokens,
+  // or about four bytes per token), including a small per-message overhead.
+  size_t CountTokens(const ChatBackend& backend, const deepseek::Message& message);
+
+  // Returns `messages` (oldest first) with the oldest turns dropped or
+  // summarized until they fit the budget next to `system_prompt`.
+  std::vector<deepseek::Message> Fit(const ChatBackend& backend,
+                                     std::string_view system_prompt,
+                                     std::vector<deepseek::Message> messages,
+                                     ContextStats* stats = nullptr);
+
+ private:
+  std::string Summary(const ChatBackend& backend,
+                      std::string_view system_prompt,
+                      const std::vector<deepseek::Message>& messages,
+                      const std::vector<size_t>& counts,
+                      size_t cut,
+                      size_t* unsummarized);
+
+  ContextBudget budget_;
+  ChatBackend* summarizer_;
+  std::mutex mutex_;
+  std::unordered_map<uint64_t, size_t> token_counts_;
+  // Keyed by a hash of the system prompt and the summarized messages.
+  std::unordered_map<uint64_t, std::string> summaries_;
+};
+
+}  // namespace app
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "AgentRuntime.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace app {
+
+// One client request. On the wire each request and each reply event is a
+// single line of JSON:
+//   request: {"session":..,"topic":..,"rounds":..,"stream":..,"reset":..,
+//             "deadline_ms":..}
+//   events:  {"type":"delta","agent":..,"reasoning":..,"content":..}
+//            {"type":"result","agent":..,"reasoning":..,"content":..}
+//            {"type":"done","ok":true|false,"cancelled":..,"error":..}
+struct DaemonRequest {
+  std::string session = "default";
+  std::string topic;
+  int rounds = 1;
+  bool stream = true;
+  // Discard the session's agent memory before running the topic.
+  bool reset = false;
+  // 0 = the daemon's default.
+  int deadline_ms = 0;
+};
+
+struct DaemonEvents {
+  AgentDeltaCallback on_delta;
+  std::function<void(const AgentResult&)> on_result;
+  // Server side: cancelled when the client disconnects, so the handler can
+  // pass it on as RunOptions::cancel.
+  const CancelToken* cancel = nullptr;
+};
+
+// Runs one request against a session's agents. Deltas and results are
+// reported through `events`; returning false ends the request with `error_out`.
+// A CancelledError ends it with "cancelled": true.
+using DaemonHandler = std::function<bool(const DaemonRequest& request,
+                                         std::vector<Agent>& agents,
+                                         const DaemonEvents& events,
+                                         std::string* error_out)>;
+
+// Serves requests on a Unix domain socket. Backends stay loaded for the
+// lifetime of the server; each named session keeps its own agent set, and
+// requests on the same session are serialized.
+class DaemonServer {
+ public:
+  DaemonServer(std::string socket_path,
+               std::function<std::vector<Agent>()> make_agents,
+               DaemonHandler handler);
+  ~DaemonServer();
+
+  DaemonServer(const DaemonServer&) = delete;
+  DaemonServer& operator=(const DaemonServer&) = delete;
+
+  // Binds the socket and starts accepting connections in the background.
+  bool Start(std::string* error_out = nullptr);
+  // Stops accepting, waits for in-flight requests and removes the socket.
+  void Stop();
+  // Blocks until Stop() is called or `stop_flag` becomes true.
+  void Wait(const std::atomic<bool>* stop_flag = nullptr);
+
+  // Seeds or replaces a session's agents (e.g. from --load).
+  void SetAgents(const std::string& session, std::vector<Agent> agents);
+  // Copies a session's agents, e.g. to save them on shutdown.
+  std::vector<Agent> Agents(const std::string& session);
+
+ private:
+  struct Session {
+    std::mutex mutex;
+    std::vector<Agent> agents;
+  };
+
+  std::shared_ptr<Session> GetSession(const std::string& name);
+  void AcceptLoop();
+  void Serve(int fd);
+
+  std::string socket_path_;
+  std::function<std::vector<Agent>()> make_agents_;
+  DaemonHandler handler_;
+  int listen_fd_ = -1;
+  std::atomic<bool> stopping_{false};
+  std::thread accept_thread_;
+  std::mutex sessions_mutex_;
+  std::map<std::string, std::shared_ptr<Session>> sessions_;
+  std::mutex workers_mutex_;
+  std::condition_variable workers_cv_;
+  int active_workers_ = 0;
+};
+
+// Sends one request to a running daemon and dispatches its events as they
+// arrive. Returns false if the daemon is unreachable or the request failed.
+bool RunDaemonClient(std::string_view socket_path,
+                     const DaemonRequest& request,
+                     const DaemonEvents& events,
+                     std::string* error_out = nullptr);
+
+// $XDG_RUNTIME_DIR/cppdeepseek.sock, or /tmp/cppdeepseek-<uid>.sock.
+std::string DefaultDaemonSocketPath();
+
+}  // namespace app
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <chrono>
+#include <cstddef>
 #include <functional>
 #include <optional>
 #include <string>
@@ -14,6 +16,55 @@ struct Message {
   std::string reasoning;
 };
 
+// Timings and sizes of one backend call. Fields a backend cannot measure
+// stay zero.
+struct CallMetrics {
+  // "remote" or "local".
+  std::string backend;
+  // Why a routing backend picked `backend` (see BackendRouter), and how many
+  // times the call moved to the other backend after an error.
+  std::string route;
+  size_t failovers = 0;
+  // Cascade tier that answered and how many tiers below it were unsure (see
+  // CascadeBackend).
+  std::string tier;
+  size_t escalations = 0;
+  // Waiting for a free context before any work started.
+  double queue_ms = 0.0;
+  // Call start to the first generated token (first response byte when not
+  // streaming).
+  double ttft_ms = 0.0;
+  double prefill_ms = 0.0;
+  double decode_ms = 0.0;
+  double total_ms = 0.0;
+  // Prompt tokens actually evaluated; tokens reused from a KV cache are not
+  // counted.
+  size_t prefill_tokens = 0;
+  size_t decode_tokens = 0;
+  // Speculative decoding: tokens proposed by the draft model and how many of
+  // them the main model accepted.
+  size_t draft_tokens = 0;
+  size_t draft_accepted_tokens = 0;
+  size_t bytes_sent = 0;
+  size_t bytes_received = 0;
+  // "usage" block of the API response.
+  size_t prompt_tokens = 0;
+  size_t completion_tokens = 0;
+  size_t reasoning_tokens = 0;
+  size_t cache_hit_tokens = 0;
+  size_t cache_miss_tokens = 0;
+};
+
+// Ends a call early. The transfer is aborted as soon as `cancelled` returns
+// true or the deadline passes; both are optional.
+struct CallControl {
+  std::function<bool()> cancelled;
+  std::optional<std::chrono::steady_clock::time_point> deadline;
+
+  bool deadline_exceeded() const;
+  bool should_stop() const;
+};
+
 struct ChatResponse {
   std::string reasoning;
   std::string content;
@@ -32,13 +83,20 @@ class DeepSeekClient {
 
   void set_timeout_ms(long timeout_ms);
 
+  // `metrics`, when set, receives timings, transfer sizes and usage.
+  // `control`, when set, can stop the call early; `error_out` then reads
+  // "Cancelled." or "Deadline exceeded.".
   std::optional<ChatResponse> chat(const std::vector<Message>& messages,
                                    std::string_view system_prompt,
+                                   CallMetrics* metrics = nullptr,
+                                   const CallControl* control = nullptr,
                                    std::string* error_out = nullptr) const;
 
   bool stream_chat(const std::vector<Message>& messages,
                    std::string_view system_prompt,
                    const StreamCallback& on_delta,
+                   CallMetrics* metrics = nullptr,
+                   const CallControl* control = nullptr,
                    std::string* error_out = nullptr) const;
 
  private:
@@ -1,34 +1,259 @@
 #pragma once
 
 #include "AgentRuntime.hpp"
+#include "PrefixCache.hpp"
+#include "ThreadTuning.hpp"
 
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <vector>
 
+struct ggml_threadpool;
 struct llama_context;
 struct llama_model;
 struct llama_sampler;
 
 namespace app {
 
+struct LlamaOptions {
+  int n_ctx = 4096;
+  int n_gpu_layers = 0;
+  // Zero fields are taken from the saved thread profile for this CPU and
+  // model (see Autotune), falling back to one thread per physical core and
+  // llama.cpp's batch defaults.
+  int n_threads = 0;
+  int n_threads_batch = 0;
+  int n_batch = 0;
+  int n_ubatch = 0;
+  bool pin_threads = false;
+  bool pin_threads_batch = false;
+  bool use_thread_profile = true;
+  // Contexts sharing the loaded weights; requests lease one each, so up to
+  // n_contexts generations run in parallel. Threads are split between them.
+  int n_contexts = 1;
+  // Spread contexts over NUMA nodes, keeping each context's threads and KV
+  // cache on its node.
+  bool numa = false;
+  // KV cache element types ("f16", "q8_0", "q4_0", ...). Quantized V needs
+  // flash attention.
+  std::string cache_type_k = "f16";
+  std::string cache_type_v = "f16";
+  // "auto", "on" or "off".
+  std::string flash_attn = "auto";
+  // Keep the KV cache of offloaded layers on the GPU.
+  bool offload_kqv = true;
+  // When a prompt drops turns from the middle of a cached sequence (see
+  // ContextManager), shift the KV of the retained history into place
+  // instead of decoding it again.
+  bool kv_shift = true;
+  // GGUF model for ChatBackend::embed; empty runs the chat model itself in
+  // embedding mode.
+  std::string embedding_model;
+  // Host memory for KV states of prefilled prompts shared by all contexts
+  // (see PrefixCache); 0 disables it.
+  size_t prefix_cache_bytes = 0;
+  // Small GGUF model sharing the chat model's vocabulary. When set, it
+  // proposes up to draft_max tokens per step and the chat model checks them
+  // in one batch, keeping the longest prefix matching its own greedy picks.
+  std::string draft_model;
+  int draft_max = 8;
+};
+
+// Mean-pooled text embeddings from a GGUF model, one text at a time.
+class LlamaEmbedder {
+ public:
+  // Loads a dedicated (usually small) embedding model on the CPU.
+  explicit LlamaEmbedder(const std::string& model_path, int n_threads = 0);
+  // Runs an already loaded model in embedding mode; `model` must outlive
+  // the embedder.
+  LlamaEmbedder(llama_model* model, int n_threads);
+  ~LlamaEmbedder();
+  LlamaEmbedder(const LlamaEmbedder&) = delete;
+  LlamaEmbedder& operator=(const LlamaEmbedder&) = delete;
+
+  // Texts longer than the embedding context are truncated.
+  std::vector<float> Embed(std::string_view text);
+
+ private:
+  void CreateContext(int n_threads);
+
+  llama_model* model_ = nullptr;
+  bool owns_model_ = false;
+  llama_context* ctx_ = nullptr;
+  std::mutex mutex_;
+};
+
 class LlamaBackend {
  public:
   LlamaBackend(std::string model_path,
                int n_ctx = 4096,
                int n_threads = 0,
                int n_gpu_layers = 0);
+  LlamaBackend(std::string model_path, const LlamaOptions& options);
   ~LlamaBackend();
 
   ChatBackend Backend();
 
+  // Settings in effect after the thread profile and defaults were applied.
+  const LlamaOptions& Options() const { return options_; }
+
+  // Null when LlamaOptions::prefix_cache_bytes is 0.
+  const PrefixCache* prefix_cache() const { return prefix_cache_.get(); }
+
+  // Speculative decoding totals over all calls; all zero without a draft
+  // model.
+  struct DraftStats {
+    // Batched verifications of the main model.
+    size_t steps = 0;
+    size_t drafted = 0;
+    size_t accepted = 0;
+  };
+  DraftStats draft_stats() const;
+
+  // Ahead-of-time prefills (ChatBackend::prefill) over all calls.
+  struct PrefillStats {
+    size_t calls = 0;
+    size_t tokens = 0;
+    // Calls that yielded to real work before finishing.
+    size_t preempted = 0;
+  };
+  PrefillStats prefill_stats() const;
+
+  // Measures prefill and decode tokens/s for each TuneCandidates() entry,
+  // reports every sample, and switches this backend to the best profile.
+  // The returned profile is not saved; see SaveThreadProfile.
+  ThreadProfile Autotune(const std::function<void(const TuneSample&)>& on_sample = {});
+
+  // Writes the KV state of the sequences holding each agent's history to
+  // `path`. Records are keyed by the model file identity and a hash of the
+  // prompt tokens they cover. Agents without a cached sequence are skipped.
+  bool SaveAgentStates(const std::vector<Agent>& agents,
+                       std::string_view path,
+                       std::string* error_out = nullptr);
+
+  // Restores records written by SaveAgentStates whose tokens are a prefix of
+  // an agent's rendered history. Returns the number of agents restored; stale
+  // or mismatched records are ignored and those agents re-prefill as usual.
+  int LoadAgentStates(const std::vector<Agent>& agents,
+                      std::string_view path,
+                      std::string* error_out = nullptr);
+
  private:
+  // One llama sequence in a context's KV cache and the tokens it holds.
+  struct Slot {
+    std::vector<int32_t> tokens;
+    uint64_t last_used = 0;
+  };
+
+  // A pooled context with its own sampler, threads and sequences.
+  struct Context {
+    ContextPlacement placement;
+    llama_context* ctx = nullptr;
+    llama_sampler* sampler = nullptr;
+    // Draft model context (single sequence) and the tokens it holds.
+    llama_context* draft_ctx = nullptr;
+    llama_sampler* draft_sampler = nullptr;
+    std::vector<int32_t> draft_tokens;
+    ggml_threadpool* threadpool = nullptr;
+    ggml_threadpool* threadpool_batch = nullptr;
+    std::vector<Slot> slots;
+    uint64_t clock = 0;
+    uint64_t last_leased = 0;
+    bool busy = false;
+  };
+
+  // Returns a leased context to the pool on scope exit.
+  struct LeaseGuard {
+    LlamaBackend* self;
+    Context* c;
+    ~LeaseGuard() { self->Release(*c); }
+  };
+
+  std::vector<int32_t> Tokenize(std::string_view text) const;
+  Context& Lease(const std::vector<int32_t>& tokens);
+  // Like Lease, but returns nullptr instead of waiting, and while any call
+  // waits for a context.
+  Context* TryLease(const std::vector<int32_t>& tokens);
+  // The idle context to lease for `tokens`, or nullptr; pool_mutex_ held.
+  Context* IdleContext(const std::vector<int32_t>& tokens);
+  void Release(Context& c);
+  size_t LeastRecentSlot(const Context& c, size_t exclude) const;
+  size_t AcquireSlot(Context& c, const std::vector<int32_t>& tokens, size_t* reuse);
+  void ReserveCells(Context& c, size_t slot, size_t needed);
+  size_t ShiftCached(Context& c, size_t slot, const std::vector<int32_t>& tokens, size_t n_past);
+  void DecodeTokens(Context& c,
+                    size_t slot,
+                    const std::vector<int32_t>& tokens,
+                    size_t from,
+                    size_t to);
+  // Restores the cached state sharing the longest prefix with `tokens` into
+  // `slot` when it covers more than the `reuse` tokens already there, and
+  // returns the tokens now reusable.
+  size_t RestorePrefix(Context& c, size_t slot, const std::vector<int32_t>& tokens, size_t reuse);
+  // Copies the state of a freshly prefilled `slot` into the prefix cache.
+  void StorePrefix(Context& c, size_t slot, size_t prefilled);
+  // Decodes `text` into a sequence of an idle context without generating,
+  // one batch at a time, and stops early once `cancel` is cancelled or a
+  // call waits for a context. Returns whether all of `text` is cached.
+  bool Prefill(std::string_view text, const CancelToken* cancel);
+  std::string Generate(std::string_view prompt,
+                       int max_tokens,
+                       const std::function<void(std::string_view)>& on_piece,
+                       CallContext* call = nullptr);
+  // Generates a reply to each prompt, decoding up to kMaxSequences of them
+  // together in one context. Their common token prefix is prefilled once and
+  // forked into each branch's sequence. `calls`, when set, has one entry per
+  // prompt.
+  std::vector<std::string> GenerateBranches(const std::vector<std::string>& prompts,
+                                            int max_tokens,
+                                            std::vector<CallContext>* calls = nullptr);
+  // Greedy decode loop of Generate with the draft model, starting from the
+  // first sampled token `id`. Returns the number of tokens generated.
+  // `scores`, when set, receives the log-probability of each sampled token.
+  int DecodeSpeculative(Context& c,
+                        size_t slot,
+                        int32_t id,
+                        int max_tokens,
+                        const std::function<void(std::string_view)>& on_piece,
+                        CallContext* call,
+                        std::string* output,
+                        std::vector<float>* scores);
+  std::string ModelIdentity() const;
+  void CreateContexts();
+  void CreateContext(Context& c);
+  void DestroyContext(Context& c);
+  TuneSample Measure(Context& c, const TuneCandidate& candidate, bool measure_decode);
+  LlamaEmbedder& Embedder();
+
   std::string model_path_;
-  int n_ctx_;
-  int n_threads_;
-  int n_gpu_layers_;
+  LlamaOptions options_;
+  CpuTopology topology_;
   llama_model* model_ = nullptr;
-  llama_context* ctx_ = nullptr;
-  llama_sampler* sampler_ = nullptr;
+  llama_model* draft_model_ = nullptr;
+  std::vector<Context> contexts_;
+  // Guards the lease flags; whole-pool operations hold it while no context
+  // is leased.
+  std::mutex pool_mutex_;
+  std::condition_variable pool_cv_;
+  uint64_t lease_clock_ = 0;
+  // Calls waiting in Lease; prefills yield to them.
+  std::atomic<size_t> lease_waiters_{0};
+  std::unique_ptr<PrefixCache> prefix_cache_;
+  std::atomic<size_t> draft_steps_{0};
+  std::atomic<size_t> drafted_{0};
+  std::atomic<size_t> draft_accepted_{0};
+  std::atomic<size_t> prefill_calls_{0};
+  std::atomic<size_t> prefill_tokens_{0};
+  std::atomic<size_t> prefill_preempted_{0};
+  // Created on the first embedding request.
+  std::unique_ptr<LlamaEmbedder> embedder_;
+  std::mutex embedder_mutex_;
 };
 
 }  // namespace app
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "AgentRuntime.hpp"
+#include "SemanticCache.hpp"
 
 #include <optional>
 #include <string>
@@ -13,14 +14,27 @@ struct GateResult {
   bool allow = false;
   std::string content;
   std::string reasoning;
+  // Set when the decision was reused from a similar earlier input.
+  std::optional<float> cache_score;
+  std::string cached_input;
+  // Of the backend call that made the decision (zero when reused).
+  deepseek::CallMetrics metrics;
 };
 
+// YES/NO from a gate reply: the first word, else a standalone YES or NO
+// anywhere (case-insensitive).
+std::optional<bool> ParseDecision(std::string_view content);
+
 class LogicGate {
  public:
   explicit LogicGate(std::string rule);
 
   const std::string& rule() const { return rule_; }
 
+  // Reuse decisions for inputs similar to earlier ones (needs
+  // ChatBackend::embed). The cache may be shared between gates.
+  void SetCache(SemanticCache<GateResult>* cache) { cache_ = cache; }
+
   std::optional<GateResult> Evaluate(ChatBackend& backend,
                                      std::string_view input,
                                      bool stream,
@@ -28,6 +42,7 @@ class LogicGate {
 
  private:
   std::string rule_;
+  SemanticCache<GateResult>* cache_ = nullptr;
 };
 
 }  // namespace app
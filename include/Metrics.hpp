@@ -0,0 +1,68 @@
+#pragma once
+
+#include "DeepSeekClient.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace app {
+
+// Fixed-bucket histogram (Prometheus "le" semantics: a value lands in the
+// first bucket whose upper bound is >= the value; the last bucket is +Inf).
+class Histogram {
+ public:
+  explicit Histogram(std::vector<double> bounds);
+
+  void Observe(double value);
+
+  const std::vector<double>& bounds() const { return bounds_; }
+  // Per-bucket counts, one more than `bounds()`.
+  const std::vector<uint64_t>& counts() const { return counts_; }
+  uint64_t count() const { return count_; }
+  double sum() const { return sum_; }
+  // Estimated `q` quantile, interpolated inside the bucket; 0 when empty.
+  double Quantile(double q) const;
+
+ private:
+  std::vector<double> bounds_;
+  std::vector<uint64_t> counts_;
+  uint64_t count_ = 0;
+  double sum_ = 0.0;
+};
+
+// Aggregates per-call metrics by call kind ("agent", "gate", ...) and
+// backend, for export as Prometheus text or JSON. Thread-safe.
+class MetricsRegistry {
+ public:
+  void Record(std::string_view kind, const deepseek::CallMetrics& metrics);
+
+  // Calls recorded so far, all series together.
+  uint64_t calls() const;
+  // Total of a counter ("cache_hit_tokens", ...) over all series; 0 for
+  // unknown names.
+  uint64_t counter(std::string_view name) const;
+
+  std::string ToPrometheus() const;
+  std::string ToJson() const;
+  // Prometheus text when the path ends in ".prom" or ".txt", JSON otherwise.
+  bool Write(std::string_view path, std::string* error_out = nullptr) const;
+
+ private:
+  struct Series {
+    uint64_t calls = 0;
+    std::vector<Histogram> histograms;
+    std::vector<uint64_t> counters;
+  };
+
+  mutable std::mutex mutex_;
+  // Keyed by (kind, backend).
+  std::map<std::pair<std::string, std::string>, Series> series_;
+};
+
+}  // namespace app
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+namespace app {
+
+// Host copies of KV sequence states, keyed by the prompt tokens they cover and
+// shared by every context of a backend (so by all agents and sessions).
+// Lookups walk a radix tree over token ids to the stored state sharing the
+// longest prefix with a prompt; restoring it and dropping the cells past that
+// prefix replaces prefilling those tokens. The least recently used states are
+// evicted to stay under the byte budget. Thread-safe.
+class PrefixCache {
+ public:
+  struct Entry {
+    std::vector<int32_t> tokens;
+    std::vector<uint8_t> state;
+  };
+
+  struct Match {
+    // Leading tokens of the prompt that `entry` also starts with.
+    size_t prefix = 0;
+    std::shared_ptr<const Entry> entry;
+  };
+
+  struct Stats {
+    size_t entries = 0;
+    size_t bytes = 0;
+    size_t lookups = 0;
+    size_t hits = 0;
+    // Prompt tokens covered by hits.
+    size_t hit_tokens = 0;
+    size_t evictions = 0;
+  };
+
+  explicit PrefixCache(size_t budget_bytes);
+  ~PrefixCache();
+
+  PrefixCache(const PrefixCache&) = delete;
+  PrefixCache& operator=(const PrefixCache&) = delete;
+
+  size_t budget_bytes() const { return budget_bytes_; }
+
+  std::optional<Match> Lookup(const std::vector<int32_t>& tokens);
+
+  // Stores the state for `tokens`. Entries for a strict prefix of `tokens`
+  // are dropped, since the new entry covers them. States larger than the
+  // whole budget are not stored.
+  void Insert(std::vector<int32_t> tokens, std::vector<uint8_t> state);
+
+  Stats stats() const;
+
+ private:
+  struct Node;
+
+  void RemoveEntry(Node* node, bool prune);
+  void EvictTo(size_t budget, const Node* keep);
+
+  const size_t budget_bytes_;
+  mutable std::mutex mutex_;
+  std::unique_ptr<Node> root_;
+  uint64_t clock_ = 0;
+  Stats stats_;
+};
+
+}  // namespace app
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "AgentRuntime.hpp"
+#include "VectorIndex.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace app {
+
+struct RetrievalOptions {
+  // The most recent messages are always sent.
+  size_t recent = 8;
+  // Older messages added by similarity to the new input.
+  size_t top_k = 4;
+  float min_score = 0.2f;
+  // Keep the prompt prefix byte-identical between turns so server-side
+  // prefix caches (the DeepSeek API's, or PrefixCache locally) hit: the
+  // window starts on a multiple of `recent` messages, and relevant older
+  // messages are quoted in the new user message instead of preceding the
+  // window.
+  bool stable_prefix = false;
+};
+
+// Per-agent embedding index over `Agent::memory`, used to send the recent
+// window plus the older messages relevant to the current input instead of
+// the whole history. Rows are keyed by message position and checked against
+// a content hash, so edited or replaced histories are re-embedded.
+class RetrievalMemory {
+ public:
+  explicit RetrievalMemory(RetrievalOptions options = {});
+
+  const RetrievalOptions& options() const { return options_; }
+
+  // Embeds the messages of `agent.memory` that are not indexed yet with
+  // ChatBackend::embed.
+  bool Index(const ChatBackend& backend, const Agent& agent, std::string* error_out = nullptr);
+
+  // Like BuildPrompt(agent, user_input), but older messages outside the
+  // recent window are only included when relevant. Falls back to the full
+  // history when the backend cannot embed.
+  std::vector<deepseek::Message> BuildPrompt(const ChatBackend& backend,
+                                             const Agent& agent,
+                                             std::string_view user_input,
+                                             std::string* error_out = nullptr);
+
+  // Indexed messages of one agent (for diagnostics and tests).
+  size_t Indexed(const std::string& agent_name) const;
+
+  // Binary file, conventionally "<agent store>.vec".
+  bool Save(std::string_view path, std::string* error_out = nullptr) const;
+  bool Load(std::string_view path, std::string* error_out = nullptr);
+
+ private:
+  struct AgentIndex {
+    VectorIndex index;
+    // Content hash of the message at each indexed position.
+    std::vector<uint64_t> hashes;
+  };
+
+  RetrievalOptions options_;
+  mutable std::mutex mutex_;
+  std::map<std::string, AgentIndex> agents_;
+};
+
+}  // namespace app
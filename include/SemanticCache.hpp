@@ -0,0 +1,92 @@
+#pragma once
+
+#include "VectorIndex.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace app {
+
+struct SemanticCacheOptions {
+  // Minimum cosine similarity between inputs for a hit.
+  float threshold = 0.92f;
+  // The oldest quarter is evicted when the cache is full.
+  size_t capacity = 4096;
+};
+
+template <typename Value>
+struct SemanticHit {
+  Value value;
+  // Similarity between the new input and `input`.
+  float score = 0.0f;
+  std::string input;
+};
+
+// Maps input embeddings to values, returning the value of the most similar
+// earlier input above the threshold. `scope` separates entries that must
+// never answer each other (different gate rules, agent rosters, ...).
+// Lookups scan an int8 VectorIndex, which beats tree or graph indexes at the
+// few thousand entries this holds. Thread-safe.
+template <typename Value>
+class SemanticCache {
+ public:
+  explicit SemanticCache(SemanticCacheOptions options = {}) : options_(options) {}
+
+  const SemanticCacheOptions& options() const { return options_; }
+
+  std::optional<SemanticHit<Value>> Lookup(const std::vector<float>& embedding,
+                                           uint64_t scope) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto matches =
+        index_.Search(embedding, 1, options_.threshold,
+                      [&](uint64_t id) { return entries_[Row(id)].scope == scope; });
+    if (matches.empty()) {
+      return std::nullopt;
+    }
+    const Entry& entry = entries_[Row(matches[0].id)];
+    return SemanticHit<Value>{entry.value, matches[0].score, entry.input};
+  }
+
+  void Insert(const std::vector<float>& embedding, uint64_t scope, std::string input, Value value) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (options_.capacity > 0 && entries_.size() >= options_.capacity) {
+      const size_t evict = std::max<size_t>(1, entries_.size() / 4);
+      index_.EraseFront(evict);
+      entries_.erase(entries_.begin(), entries_.begin() + static_cast<std::ptrdiff_t>(evict));
+      first_id_ += evict;
+    }
+    if (index_.Add(first_id_ + entries_.size(), embedding)) {
+      entries_.push_back({scope, std::move(input), std::move(value)});
+    }
+  }
+
+  size_t size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+  }
+
+ private:
+  struct Entry {
+    uint64_t scope;
+    std::string input;
+    Value value;
+  };
+
+  size_t Row(uint64_t id) const { return static_cast<size_t>(id - first_id_); }
+
+  SemanticCacheOptions options_;
+  mutable std::mutex mutex_;
+  VectorIndex index_;
+  std::deque<Entry> entries_;
+  // Id of entries_.front(); ids grow with every insert.
+  uint64_t first_id_ = 0;
+};
+
+}  // namespace app
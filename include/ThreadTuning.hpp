@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace app {
+
+struct CpuTopology {
+  std::string cpu_model;
+  int logical_cpus = 0;
+  // One logical CPU id per physical core (its first SMT sibling).
+  std::vector<int> core_cpus;
+  // core_cpus grouped by NUMA node; empty when sysfs has no node info.
+  std::vector<std::vector<int>> numa_nodes;
+
+  int physical_cores() const {
+    return core_cpus.empty() ? logical_cpus : static_cast<int>(core_cpus.size());
+  }
+};
+
+// Reads core/package ids and NUMA node cpulists from sysfs and the CPU model from /proc/cpuinfo.
+// Missing files leave the fields at their fallbacks (hardware_concurrency,
+// no per-core list), so the result is always usable.
+CpuTopology DetectCpuTopology(const std::string& sysfs_cpu_dir = "/sys/devices/system/cpu",
+                              const std::string& cpuinfo_path = "/proc/cpuinfo");
+
+// Where one context of a pool runs: its NUMA node (-1 if not placed), the
+// cores its threads may be pinned to, and its share of the threads.
+struct ContextPlacement {
+  int numa_node = -1;
+  std::vector<int> cpus;
+  int n_threads = 1;
+  int n_threads_batch = 1;
+};
+
+// Splits `n_threads`/`n_threads_batch` and the physical cores between
+// `n_contexts` contexts. With `numa`, contexts are spread round-robin over
+// the nodes and each one only gets cores of its own node.
+std::vector<ContextPlacement> PlanContextPlacement(const CpuTopology& topology,
+                                                   int n_contexts,
+                                                   int n_threads,
+                                                   int n_threads_batch,
+                                                   bool numa);
+
+// Best measured llama.cpp threading setup for one CPU and model file.
+// Decode (n_threads) and prefill (n_threads_batch, n_batch) are tuned
+// separately; pinning binds threads to one CPU per physical core.
+struct ThreadProfile {
+  std::string cpu_model;
+  std::string model;
+  uint64_t model_bytes = 0;
+  int n_threads = 0;
+  int n_threads_batch = 0;
+  int n_batch = 0;
+  int n_ubatch = 0;
+  bool pin_threads = false;
+  bool pin_threads_batch = false;
+  double decode_tps = 0.0;
+  double prefill_tps = 0.0;
+};
+
+struct TuneCandidate {
+  int threads = 0;
+  int n_batch = 0;
+  bool pin = false;
+};
+
+struct TuneSample {
+  TuneCandidate candidate;
+  double prefill_tps = 0.0;
+  // 0 when decode was not measured for this candidate.
+  double decode_tps = 0.0;
+};
+
+// Thread counts, batch sizes and pinning worth measuring on this machine,
+// grouped by batch size (each batch size needs a fresh llama context).
+std::vector<TuneCandidate> TuneCandidates(const CpuTopology& topology, int n_ctx);
+
+// Picks the fastest decode and the fastest prefill setup from the samples
+// and stamps the profile with the CPU and model file it applies to.
+ThreadProfile SelectThreadProfile(const std::vector<TuneSample>& samples,
+                                  const CpuTopology& topology,
+                                  std::string_view model_path);
+
+// <model home>/profiles/<cpu>--<model file>.json
+std::string ThreadProfilePath(const CpuTopology& topology, std::string_view model_path);
+
+bool SaveThreadProfile(const ThreadProfile& profile,
+                       std::string_view path,
+                       std::string* error_out = nullptr);
+
+// Returns the profile at `path` if it was measured for this model file
+// (same name and size); std::nullopt otherwise.
+std::optional<ThreadProfile> LoadThreadProfile(std::string_view path,
+                                               std::string_view model_path,
+                                               std::string* error_out = nullptr);
+
+}  // namespace app
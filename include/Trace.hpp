@@ -0,0 +1,44 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <string_view>
+
+namespace app {
+
+// Process-wide span tracer that writes Chrome/Perfetto trace-event JSON
+// (load it in chrome://tracing or ui.perfetto.dev). Each thread appends to
+// its own buffer, so spans from concurrent agents only contend when the
+// trace is written. While tracing is off a span costs one atomic load.
+
+// Discards earlier spans and starts recording.
+void StartTracing();
+void StopTracing();
+bool TracingEnabled();
+
+// Writes every span recorded since StartTracing().
+bool WriteTrace(std::string_view path, std::string* error_out = nullptr);
+
+// Names the calling thread in the trace (e.g. "main", "daemon worker").
+void SetTraceThreadName(std::string_view name);
+
+// Records [construction, End() or destruction) as one complete event.
+// `name` must outlive the trace (string literals); `detail` is copied and
+// shown as an argument, e.g. the agent name.
+class TraceSpan {
+ public:
+  explicit TraceSpan(const char* name, std::string_view detail = {});
+  ~TraceSpan() { End(); }
+
+  TraceSpan(const TraceSpan&) = delete;
+  TraceSpan& operator=(const TraceSpan&) = delete;
+
+  void End();
+
+ private:
+  const char* name_ = nullptr;
+  std::string detail_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+}  // namespace app
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <vector>
+
+namespace app {
+
+struct VectorMatch {
+  uint64_t id = 0;
+  // Cosine similarity, [-1, 1].
+  float score = 0.0f;
+};
+
+// Flat cosine-similarity index. Vectors are normalized and quantized to int8
+// with one scale per row, so a row costs `dim` bytes; search is a linear
+// SIMD scan over the contiguous rows.
+class VectorIndex {
+ public:
+  // dim 0 takes the dimension of the first vector added.
+  explicit VectorIndex(size_t dim = 0);
+
+  size_t dim() const { return dim_; }
+  size_t size() const { return ids_.size(); }
+  uint64_t id(size_t row) const { return ids_[row]; }
+
+  // Returns false (and adds nothing) if the dimension does not match.
+  bool Add(uint64_t id, const std::vector<float>& vector);
+  // Keeps the first `rows` rows.
+  void Truncate(size_t rows);
+  // Removes the first `rows` rows (the oldest ones).
+  void EraseFront(size_t rows);
+  // Removes all rows; the next Add sets the dimension again.
+  void Clear();
+
+  // The best `k` rows by similarity to `query`, best first. Rows scoring
+  // below `min_score` or rejected by `accept` are skipped.
+  std::vector<VectorMatch> Search(const std::vector<float>& query,
+                                  size_t k,
+                                  float min_score = -1.0f,
+                                  const std::function<bool(uint64_t id)>& accept = {}) const;
+
+  bool Write(std::ostream& out) const;
+  bool Read(std::istream& in);
+
+ private:
+  size_t dim_ = 0;
+  std::vector<uint64_t> ids_;
+  std::vector<float> scales_;
+  std::vector<int8_t> rows_;
+};
+
+}  // namespace app
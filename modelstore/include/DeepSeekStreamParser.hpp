@@ -11,14 +11,28 @@ class DeepSeekStreamParser {
   using DeltaCallback =
       std::function<void(std::string_view reasoning_delta, std::string_view content_delta)>;
 
-  explicit DeepSeekStreamParser(DeltaCallback on_delta);
+  // Polled before each event; returning true stops the stream.
+  using StopCallback = std::function<bool()>;
 
-  // Feeds a raw stream chunk. Returns false on parse error.
+  explicit DeepSeekStreamParser(DeltaCallback on_delta, StopCallback should_stop = {});
+
+  // Feeds a raw stream chunk. Returns false on parse error, or once
+  // `should_stop` returned true (see stopped()); no deltas are delivered
+  // after that.
   bool Feed(std::string_view chunk, std::string* error_out = nullptr);
 
+  bool stopped() const { return stopped_; }
+
+  // JSON of the last "usage" object seen (sent when the request sets
+  // stream_options.include_usage), or empty.
+  const std::string& usage() const { return usage_; }
+
  private:
   DeltaCallback on_delta_;
+  StopCallback should_stop_;
+  bool stopped_ = false;
   std::string buffer_;
+  std::string usage_;
 };
 
 }  // namespace deepseek
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace deepseek {
+
+struct GgufTensorInfo {
+  std::string name;
+  std::vector<uint64_t> shape;
+  uint32_t type = 0;  // ggml_type id
+  uint64_t offset = 0;
+  uint64_t bytes = 0;  // 0 if the type is unknown to this reader
+};
+
+// Model description read from a GGUF header. Only the header, metadata and
+// tensor table are read; weights are never touched.
+struct GgufInfo {
+  uint32_t version = 0;
+  std::string architecture;
+  std::string name;
+  uint32_t block_count = 0;
+  uint32_t embedding_length = 0;
+  uint32_t feed_forward_length = 0;
+  uint32_t head_count = 0;
+  uint32_t head_count_kv = 0;
+  uint32_t key_length = 0;
+  uint32_t value_length = 0;
+  uint32_t context_length = 0;
+  uint64_t file_size = 0;
+  uint64_t data_offset = 0;
+  std::vector<GgufTensorInfo> tensors;
+
+  uint64_t TensorBytes() const;
+  // Bytes of the tensors named "blk.<layer>.*".
+  uint64_t LayerBytes(uint32_t layer) const;
+};
+
+std::optional<GgufInfo> ReadGgufInfo(std::string_view path, std::string* error_out = nullptr);
+
+// Name of a ggml tensor type ("f16", "q4_K", ...), or "unknown".
+std::string_view GgmlTypeName(uint32_t type);
+
+// Inverse of GgmlTypeName.
+std::optional<uint32_t> GgmlTypeFromName(std::string_view name);
+
+// Storage size of `elements` values of a ggml type; 0 if the type is unknown.
+uint64_t GgmlTypeBytes(uint32_t type, uint64_t elements);
+
+// Average bytes per value including block scales (q8_0: 1.0625); 0 if unknown.
+double GgmlTypeElementBytes(uint32_t type);
+
+}  // namespace deepseek
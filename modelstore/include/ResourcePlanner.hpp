@@ -0,0 +1,49 @@
+#pragma once
+
+#include "GgufInfo.hpp"
+
+#include <cstdint>
+
+namespace deepseek {
+
+struct ResourceBudget {
+  // Memory available for weights and KV cache; 0 means unknown.
+  uint64_t host_memory_bytes = 0;
+  // Memory a GPU backend may use for offloaded layers; 0 means CPU only.
+  uint64_t device_memory_bytes = 0;
+  int physical_cores = 0;
+  // Fixed context size; 0 lets the planner choose.
+  int requested_ctx = 0;
+  // Upper bound for a chosen context, even if more would fit.
+  int max_ctx = 16384;
+  // Bytes per K and V cache element (f16: 2.0, q8_0: 1.0625, q4_0: 0.5625;
+  // see GgmlTypeElementBytes).
+  double k_bytes_per_element = 2.0;
+  double v_bytes_per_element = 2.0;
+  // Whether the KV cache of offloaded layers lives on the device too.
+  bool offload_kv = true;
+  // Number of KV caches of n_ctx tokens allocated (one per pooled context).
+  int kv_caches = 1;
+  // Fraction of each budget kept free for the OS, compute buffers, etc.
+  double headroom = 0.2;
+};
+
+struct ResourcePlan {
+  uint64_t kv_bytes_per_token = 0;
+  uint64_t weight_bytes = 0;
+  // Largest single repeating layer, and everything outside the layers
+  // (embeddings, output head, norms).
+  uint64_t layer_bytes = 0;
+  uint64_t non_layer_bytes = 0;
+  int n_ctx = 0;
+  int gpu_layers = 0;
+  int threads = 0;
+
+  uint64_t KvBytes() const { return kv_bytes_per_token * static_cast<uint64_t>(n_ctx); }
+};
+
+// Computes KV and weight footprints from the GGUF metadata and recommends
+// a context size, GPU offload and thread count for the budget.
+ResourcePlan PlanResources(const GgufInfo& info, const ResourceBudget& budget);
+
+}  // namespace deepseek
@@ -23,10 +23,13 @@ bool ExtractDelta(const nlohmann::json& j, std::string* reasoning, std::string*
 
 }  // namespace
 
-DeepSeekStreamParser::DeepSeekStreamParser(DeltaCallback on_delta)
-    : on_delta_(std::move(on_delta)) {}
+DeepSeekStreamParser::DeepSeekStreamParser(DeltaCallback on_delta, StopCallback should_stop)
+    : on_delta_(std::move(on_delta)), should_stop_(std::move(should_stop)) {}
 
 bool DeepSeekStreamParser::Feed(std::string_view chunk, std::string* error_out) {
+  if (stopped_) {
+    return false;
+  }
   buffer_.append(chunk.data(), chunk.size());
 
   size_t pos = 0;
@@ -52,6 +55,14 @@ bool DeepSeekStreamParser::Feed(std::string_view chunk, std::string* error_out)
     if (payload == "[DONE]") {
       continue;
     }
+    if (should_stop_ && should_stop_()) {
+      stopped_ = true;
+      buffer_.clear();
+      if (error_out) {
+        *error_out = "Cancelled.";
+      }
+      return false;
+    }
 
     nlohmann::json j;
     try {
@@ -63,6 +74,9 @@ bool DeepSeekStreamParser::Feed(std::string_view chunk, std::string* error_out)
       return false;
     }
 
+    if (j.contains("usage") && j["usage"].is_object()) {
+      usage_ = j["usage"].dump();
+    }
     std::string reasoning_delta;
     std::string content_delta;
     if (ExtractDelta(j, &reasoning_delta, &content_delta)) {
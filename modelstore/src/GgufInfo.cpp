@@ -0,0 +1,333 @@
+#include "GgufInfo.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <map>
+
+namespace deepseek {
+namespace {
+
+constexpr uint32_t kGgufMagic = 0x46554747;  // "GGUF" little-endian
+constexpr uint64_t kMaxEntries = 1u << 20;
+constexpr uint64_t kMaxStringBytes = 1u << 26;
+constexpr uint32_t kMaxDims = 4;
+constexpr uint64_t kDefaultAlignment = 32;
+
+enum ValueType : uint32_t {
+  kUint8 = 0,
+  kInt8 = 1,
+  kUint16 = 2,
+  kInt16 = 3,
+  kUint32 = 4,
+  kInt32 = 5,
+  kFloat32 = 6,
+  kBool = 7,
+  kString = 8,
+  kArray = 9,
+  kUint64 = 10,
+  kInt64 = 11,
+  kFloat64 = 12,
+};
+
+struct TypeTraits {
+  std::string_view name;
+  uint32_t block_size;
+  uint32_t type_size;
+};
+
+// ggml_type ids as stored in GGUF tensor infos (see ggml.h).
+const std::map<uint32_t, TypeTraits>& Types() {
+  static const std::map<uint32_t, TypeTraits> types = {
+      {0, {"f32", 1, 4}},         {1, {"f16", 1, 2}},         {2, {"q4_0", 32, 18}},
+      {3, {"q4_1", 32, 20}},      {6, {"q5_0", 32, 22}},      {7, {"q5_1", 32, 24}},
+      {8, {"q8_0", 32, 34}},      {9, {"q8_1", 32, 36}},      {10, {"q2_K", 256, 84}},
+      {11, {"q3_K", 256, 110}},   {12, {"q4_K", 256, 144}},   {13, {"q5_K", 256, 176}},
+      {14, {"q6_K", 256, 210}},   {15, {"q8_K", 256, 292}},   {16, {"iq2_xxs", 256, 66}},
+      {17, {"iq2_xs", 256, 74}},  {18, {"iq3_xxs", 256, 98}}, {19, {"iq1_s", 256, 50}},
+      {20, {"iq4_nl", 32, 18}},   {21, {"iq3_s", 256, 110}},  {22, {"iq2_s", 256, 82}},
+      {23, {"iq4_xs", 256, 136}}, {24, {"i8", 1, 1}},         {25, {"i16", 1, 2}},
+      {26, {"i32", 1, 4}},        {27, {"i64", 1, 8}},        {28, {"f64", 1, 8}},
+      {29, {"iq1_m", 256, 56}},   {30, {"bf16", 1, 2}},       {34, {"tq1_0", 256, 54}},
+      {35, {"tq2_0", 256, 66}},   {39, {"mxfp4", 32, 17}},
+  };
+  return types;
+}
+
+size_t ScalarSize(uint32_t type) {
+  static constexpr std::array<size_t, 13> kSizes = {1, 1, 2, 2, 4, 4, 4, 1, 0, 0, 8, 8, 8};
+  return type < kSizes.size() ? kSizes[type] : 0;
+}
+
+class Reader {
+ public:
+  explicit Reader(std::ifstream& in) : in_(in) {}
+
+  template <typename T>
+  bool Pod(T* value) {
+    return static_cast<bool>(in_.read(reinterpret_cast<char*>(value), sizeof(T)));
+  }
+
+  bool String(std::string* out) {
+    uint64_t size = 0;
+    if (!Pod(&size) || size > kMaxStringBytes) {
+      return false;
+    }
+    out->resize(size);
+    return static_cast<bool>(in_.read(out->data(), static_cast<std::streamsize>(size)));
+  }
+
+  bool Skip(uint64_t bytes) {
+    in_.seekg(static_cast<std::streamoff>(bytes), std::ios::cur);
+    return static_cast<bool>(in_);
+  }
+
+  // Reads a numeric scalar as an unsigned integer (negatives clamp to 0).
+  bool Number(uint32_t type, uint64_t* out) {
+    uint8_t raw[8] = {};
+    const size_t size = ScalarSize(type);
+    if (size == 0 || !in_.read(reinterpret_cast<char*>(raw), static_cast<std::streamsize>(size))) {
+      return false;
+    }
+    int64_t signed_value = 0;
+    double real_value = 0.0;
+    switch (type) {
+      case kInt8: signed_value = static_cast<int8_t>(raw[0]); break;
+      case kInt16: { int16_t v; std::memcpy(&v, raw, 2); signed_value = v; break; }
+      case kInt32: { int32_t v; std::memcpy(&v, raw, 4); signed_value = v; break; }
+      case kInt64: std::memcpy(&signed_value, raw, 8); break;
+      case kFloat32: { float v; std::memcpy(&v, raw, 4); real_value = v; break; }
+      case kFloat64: std::memcpy(&real_value, raw, 8); break;
+      default: {
+        uint64_t v = 0;
+        std::memcpy(&v, raw, size);  // little-endian unsigned
+        *out = v;
+        return true;
+      }
+    }
+    if (type == kFloat32 || type == kFloat64) {
+      *out = real_value > 0 ? static_cast<uint64_t>(real_value) : 0;
+    } else {
+      *out = signed_value > 0 ? static_cast<uint64_t>(signed_value) : 0;
+    }
+    return true;
+  }
+
+  bool SkipValue(uint32_t type) {
+    if (type == kString) {
+      uint64_t size = 0;
+      return Pod(&size) && Skip(size);
+    }
+    if (type == kArray) {
+      uint32_t item_type = 0;
+      uint64_t count = 0;
+      if (!Pod(&item_type) || !Pod(&count)) {
+        return false;
+      }
+      if (ScalarSize(item_type) > 0) {
+        return Skip(count * ScalarSize(item_type));
+      }
+      for (uint64_t i = 0; i < count; ++i) {
+        if (!SkipValue(item_type)) {
+          return false;
+        }
+      }
+      return true;
+    }
+    const size_t size = ScalarSize(type);
+    return size > 0 && Skip(size);
+  }
+
+  uint64_t Position() { return static_cast<uint64_t>(in_.tellg()); }
+
+ private:
+  std::ifstream& in_;
+};
+
+bool Fail(std::string* error_out, std::string message) {
+  if (error_out) {
+    *error_out = std::move(message);
+  }
+  return false;
+}
+
+uint32_t Clamp32(uint64_t value) {
+  return static_cast<uint32_t>(std::min<uint64_t>(value, UINT32_MAX));
+}
+
+}  // namespace
+
+uint64_t GgufInfo::TensorBytes() const {
+  uint64_t total = 0;
+  for (const auto& t : tensors) {
+    total += t.bytes;
+  }
+  return total;
+}
+
+uint64_t GgufInfo::LayerBytes(uint32_t layer) const {
+  const std::string prefix = "blk." + std::to_string(layer) + ".";
+  uint64_t total = 0;
+  for (const auto& t : tensors) {
+    if (t.name.compare(0, prefix.size(), prefix) == 0) {
+      total += t.bytes;
+    }
+  }
+  return total;
+}
+
+std::string_view GgmlTypeName(uint32_t type) {
+  auto it = Types().find(type);
+  return it == Types().end() ? std::string_view("unknown") : it->second.name;
+}
+
+std::optional<uint32_t> GgmlTypeFromName(std::string_view name) {
+  for (const auto& [id, traits] : Types()) {
+    if (traits.name == name) {
+      return id;
+    }
+  }
+  return std::nullopt;
+}
+
+double GgmlTypeElementBytes(uint32_t type) {
+  auto it = Types().find(type);
+  if (it == Types().end()) {
+    return 0.0;
+  }
+  return static_cast<double>(it->second.type_size) / it->second.block_size;
+}
+
+uint64_t GgmlTypeBytes(uint32_t type, uint64_t elements) {
+  auto it = Types().find(type);
+  if (it == Types().end()) {
+    return 0;
+  }
+  return elements / it->second.block_size * it->second.type_size;
+}
+
+std::optional<GgufInfo> ReadGgufInfo(std::string_view path, std::string* error_out) {
+  const std::string path_str(path);
+  std::ifstream in(path_str, std::ios::binary | std::ios::ate);
+  if (!in) {
+    Fail(error_out, "Failed to open model: " + path_str);
+    return std::nullopt;
+  }
+  GgufInfo info;
+  info.file_size = static_cast<uint64_t>(in.tellg());
+  in.seekg(0);
+
+  Reader reader(in);
+  uint32_t magic = 0;
+  uint64_t tensor_count = 0;
+  uint64_t kv_count = 0;
+  if (!reader.Pod(&magic) || magic != kGgufMagic) {
+    Fail(error_out, "Not a GGUF file: " + path_str);
+    return std::nullopt;
+  }
+  if (!reader.Pod(&info.version) || info.version < 2 || !reader.Pod(&tensor_count) ||
+      !reader.Pod(&kv_count) || tensor_count > kMaxEntries || kv_count > kMaxEntries) {
+    Fail(error_out, "Unsupported GGUF header: " + path_str);
+    return std::nullopt;
+  }
+
+  // Numeric metadata by key; per-layer arrays keep their largest value.
+  std::map<std::string, uint64_t> numbers;
+  uint64_t alignment = kDefaultAlignment;
+  for (uint64_t i = 0; i < kv_count; ++i) {
+    std::string key;
+    uint32_t type = 0;
+    if (!reader.String(&key) || !reader.Pod(&type)) {
+      Fail(error_out, "Truncated GGUF metadata: " + path_str);
+      return std::nullopt;
+    }
+    bool ok = true;
+    if (type == kString && (key == "general.architecture" || key == "general.name")) {
+      ok = reader.String(key == "general.name" ? &info.name : &info.architecture);
+    } else if (ScalarSize(type) > 0) {
+      uint64_t value = 0;
+      ok = reader.Number(type, &value);
+      numbers[key] = value;
+    } else if (type == kArray && key.rfind("tokenizer.", 0) != 0) {
+      uint32_t item_type = 0;
+      uint64_t count = 0;
+      ok = reader.Pod(&item_type) && reader.Pod(&count);
+      if (ok && ScalarSize(item_type) > 0 && count <= kMaxEntries) {
+        uint64_t max_value = 0;
+        for (uint64_t n = 0; ok && n < count; ++n) {
+          uint64_t value = 0;
+          ok = reader.Number(item_type, &value);
+          max_value = std::max(max_value, value);
+        }
+        numbers[key] = max_value;
+      } else if (ok) {
+        for (uint64_t n = 0; ok && n < count; ++n) {
+          ok = reader.SkipValue(item_type);
+        }
+      }
+    } else {
+      ok = reader.SkipValue(type);
+    }
+    if (!ok) {
+      Fail(error_out, "Truncated GGUF metadata at key " + key);
+      return std::nullopt;
+    }
+    if (key == "general.alignment" && numbers[key] > 0) {
+      alignment = numbers[key];
+    }
+  }
+
+  const auto arch_value = [&](const std::string& suffix) -> uint64_t {
+    auto it = numbers.find(info.architecture + "." + suffix);
+    return it == numbers.end() ? 0 : it->second;
+  };
+  info.block_count = Clamp32(arch_value("block_count"));
+  info.embedding_length = Clamp32(arch_value("embedding_length"));
+  info.feed_forward_length = Clamp32(arch_value("feed_forward_length"));
+  info.head_count = Clamp32(arch_value("attention.head_count"));
+  info.head_count_kv = Clamp32(arch_value("attention.head_count_kv"));
+  info.key_length = Clamp32(arch_value("attention.key_length"));
+  info.value_length = Clamp32(arch_value("attention.value_length"));
+  info.context_length = Clamp32(arch_value("context_length"));
+  if (info.head_count_kv == 0) {
+    info.head_count_kv = info.head_count;
+  }
+  if (info.key_length == 0 && info.head_count > 0) {
+    info.key_length = info.embedding_length / info.head_count;
+  }
+  if (info.value_length == 0) {
+    info.value_length = info.key_length;
+  }
+
+  info.tensors.reserve(tensor_count);
+  for (uint64_t i = 0; i < tensor_count; ++i) {
+    GgufTensorInfo tensor;
+    uint32_t n_dims = 0;
+    if (!reader.String(&tensor.name) || !reader.Pod(&n_dims) || n_dims > kMaxDims) {
+      Fail(error_out, "Truncated GGUF tensor table: " + path_str);
+      return std::nullopt;
+    }
+    tensor.shape.resize(n_dims);
+    uint64_t elements = 1;
+    for (auto& dim : tensor.shape) {
+      if (!reader.Pod(&dim)) {
+        Fail(error_out, "Truncated GGUF tensor table: " + path_str);
+        return std::nullopt;
+      }
+      elements *= dim;
+    }
+    if (!reader.Pod(&tensor.type) || !reader.Pod(&tensor.offset)) {
+      Fail(error_out, "Truncated GGUF tensor table: " + path_str);
+      return std::nullopt;
+    }
+    tensor.bytes = GgmlTypeBytes(tensor.type, elements);
+    info.tensors.push_back(std::move(tensor));
+  }
+
+  const uint64_t end = reader.Position();
+  info.data_offset = (end + alignment - 1) / alignment * alignment;
+  return info;
+}
+
+}  // namespace deepseek
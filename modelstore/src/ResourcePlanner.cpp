@@ -0,0 +1,94 @@
+#include "ResourcePlanner.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace deepseek {
+namespace {
+
+constexpr int kMinCtx = 512;
+constexpr int kCtxGranularity = 256;
+
+// Layer index of a "blk.<n>.*" tensor name, or -1.
+long LayerIndex(const std::string& name) {
+  if (name.compare(0, 4, "blk.") != 0) {
+    return -1;
+  }
+  char* end = nullptr;
+  const long layer = std::strtol(name.c_str() + 4, &end, 10);
+  return (end && *end == '.') ? layer : -1;
+}
+
+}  // namespace
+
+ResourcePlan PlanResources(const GgufInfo& info, const ResourceBudget& budget) {
+  ResourcePlan plan;
+
+  const double heads = static_cast<double>(info.block_count) * info.head_count_kv;
+  plan.kv_bytes_per_token = static_cast<uint64_t>(
+      std::ceil(heads * (info.key_length * budget.k_bytes_per_element +
+                         info.value_length * budget.v_bytes_per_element)));
+
+  std::vector<uint64_t> layers(info.block_count, 0);
+  for (const auto& tensor : info.tensors) {
+    plan.weight_bytes += tensor.bytes;
+    const long layer = LayerIndex(tensor.name);
+    if (layer >= 0 && static_cast<size_t>(layer) < layers.size()) {
+      layers[layer] += tensor.bytes;
+    } else {
+      plan.non_layer_bytes += tensor.bytes;
+    }
+  }
+  if (!layers.empty()) {
+    plan.layer_bytes = *std::max_element(layers.begin(), layers.end());
+  }
+
+  const double kv_caches = std::max(1, budget.kv_caches);
+
+  // Context: as large as fits next to the weights, up to the trained length.
+  if (budget.requested_ctx > 0) {
+    plan.n_ctx = budget.requested_ctx;
+  } else {
+    int cap = std::max(budget.max_ctx, kMinCtx);
+    if (info.context_length > 0) {
+      cap = std::min<int64_t>(cap, info.context_length);
+    }
+    plan.n_ctx = cap;
+    if (budget.host_memory_bytes > 0 && plan.kv_bytes_per_token > 0) {
+      const double usable = budget.host_memory_bytes * (1.0 - budget.headroom);
+      const double free = std::max(0.0, usable - static_cast<double>(plan.weight_bytes));
+      const double fit = free / (static_cast<double>(plan.kv_bytes_per_token) * kv_caches);
+      int ctx = static_cast<int>(std::min<double>(cap, fit));
+      ctx = ctx / kCtxGranularity * kCtxGranularity;
+      plan.n_ctx = std::max(std::min(kMinCtx, cap), ctx);
+    }
+  }
+
+  // Offload: as many layers as fit with their share of the KV cache.
+  if (budget.device_memory_bytes > 0 && info.block_count > 0 && plan.layer_bytes > 0) {
+    const double usable = budget.device_memory_bytes * (1.0 - budget.headroom);
+    const double kv_per_layer =
+        budget.offload_kv
+            ? static_cast<double>(plan.kv_bytes_per_token) / info.block_count * plan.n_ctx *
+                  kv_caches
+            : 0.0;
+    const double per_layer = static_cast<double>(plan.layer_bytes) + kv_per_layer;
+    const double all_layers = per_layer * info.block_count;
+    if (all_layers + static_cast<double>(plan.non_layer_bytes) <= usable) {
+      // Everything fits: offload the output head as well (llama.cpp counts it
+      // as one extra layer).
+      plan.gpu_layers = static_cast<int>(info.block_count) + 1;
+    } else {
+      plan.gpu_layers = static_cast<int>(
+          std::min<double>(info.block_count, std::floor(usable / per_layer)));
+    }
+  }
+
+  plan.threads = std::max(0, budget.physical_cores);
+  return plan;
+}
+
+}  // namespace deepseek
@@ -0,0 +1,173 @@
+#include "GgufInfo.hpp"
+#include "ResourcePlanner.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+class GgufWriter {
+ public:
+  template <typename T>
+  void Pod(T value) {
+    bytes_.append(reinterpret_cast<const char*>(&value), sizeof(T));
+  }
+
+  void String(const std::string& s) {
+    Pod<uint64_t>(s.size());
+    bytes_ += s;
+  }
+
+  void KvString(const std::string& key, const std::string& value) {
+    String(key);
+    Pod<uint32_t>(8);
+    String(value);
+  }
+
+  void KvU32(const std::string& key, uint32_t value) {
+    String(key);
+    Pod<uint32_t>(4);
+    Pod<uint32_t>(value);
+  }
+
+  void Tensor(const std::string& name, std::vector<uint64_t> shape, uint32_t type, uint64_t offset) {
+    String(name);
+    Pod<uint32_t>(static_cast<uint32_t>(shape.size()));
+    for (auto dim : shape) {
+      Pod<uint64_t>(dim);
+    }
+    Pod<uint32_t>(type);
+    Pod<uint64_t>(offset);
+  }
+
+  const std::string& bytes() const { return bytes_; }
+
+ private:
+  std::string bytes_;
+};
+
+constexpr uint32_t kF32 = 0;
+constexpr uint32_t kF16 = 1;
+constexpr uint32_t kQ4_0 = 2;
+constexpr uint32_t kQ8_0 = 8;
+
+std::string WriteTestModel() {
+  GgufWriter w;
+  w.Pod<uint32_t>(0x46554747);
+  w.Pod<uint32_t>(3);
+  w.Pod<uint64_t>(6);  // tensors
+  w.Pod<uint64_t>(8);  // metadata entries
+
+  w.KvString("general.architecture", "llama");
+  w.KvString("general.name", "tiny");
+  // A string array like the tokenizer vocabulary must be skipped cleanly.
+  w.String("tokenizer.ggml.tokens");
+  w.Pod<uint32_t>(9);
+  w.Pod<uint32_t>(8);
+  w.Pod<uint64_t>(3);
+  w.String("a");
+  w.String("bc");
+  w.String("def");
+  w.KvU32("llama.block_count", 2);
+  w.KvU32("llama.embedding_length", 64);
+  w.KvU32("llama.attention.head_count", 8);
+  // Per-layer head counts are stored as an array; the largest one wins.
+  w.String("llama.attention.head_count_kv");
+  w.Pod<uint32_t>(9);
+  w.Pod<uint32_t>(4);
+  w.Pod<uint64_t>(2);
+  w.Pod<uint32_t>(2);
+  w.Pod<uint32_t>(4);
+  w.KvU32("llama.context_length", 2048);
+
+  w.Tensor("token_embd.weight", {64, 100}, kF16, 0);
+  w.Tensor("blk.0.attn_q.weight", {64, 64}, kQ8_0, 12800);
+  w.Tensor("blk.0.ffn_up.weight", {64, 128}, kQ4_0, 17152);
+  w.Tensor("blk.1.attn_q.weight", {64, 64}, kQ8_0, 21760);
+  w.Tensor("blk.1.attn_norm.weight", {64}, kF32, 26112);
+  w.Tensor("output.weight", {64, 100}, kQ8_0, 26368);
+
+  const std::string path = (fs::temp_directory_path() / "gguf_info_test.gguf").string();
+  std::ofstream out(path, std::ios::binary);
+  out.write(w.bytes().data(), static_cast<std::streamsize>(w.bytes().size()));
+  return path;
+}
+
+}  // namespace
+
+TEST(GgufTests, ReadsMetadataAndTensorTable) {
+  const std::string path = WriteTestModel();
+  std::string error;
+  auto info = deepseek::ReadGgufInfo(path, &error);
+  ASSERT_TRUE(info.has_value()) << error;
+
+  EXPECT_EQ(info->version, 3u);
+  EXPECT_EQ(info->architecture, "llama");
+  EXPECT_EQ(info->name, "tiny");
+  EXPECT_EQ(info->block_count, 2u);
+  EXPECT_EQ(info->head_count, 8u);
+  EXPECT_EQ(info->head_count_kv, 4u);
+  EXPECT_EQ(info->key_length, 8u);
+  EXPECT_EQ(info->value_length, 8u);
+  EXPECT_EQ(info->context_length, 2048u);
+  ASSERT_EQ(info->tensors.size(), 6u);
+  EXPECT_EQ(info->data_offset % 32, 0u);
+
+  EXPECT_EQ(info->tensors[0].bytes, 64u * 100 * 2);
+  EXPECT_EQ(info->tensors[1].bytes, 64u * 64 / 32 * 34);
+  EXPECT_EQ(info->tensors[2].bytes, 64u * 128 / 32 * 18);
+  EXPECT_EQ(info->LayerBytes(0), 4352u + 4608u);
+  EXPECT_EQ(info->LayerBytes(1), 4352u + 256u);
+  EXPECT_EQ(deepseek::GgmlTypeName(kQ4_0), "q4_0");
+
+  fs::remove(path);
+}
+
+TEST(GgufTests, PlansContextAndOffloadFromBudget) {
+  const std::string path = WriteTestModel();
+  auto info = deepseek::ReadGgufInfo(path);
+  ASSERT_TRUE(info.has_value());
+  fs::remove(path);
+
+  deepseek::ResourceBudget budget;
+  budget.physical_cores = 6;
+  budget.headroom = 0.0;
+  auto plan = deepseek::PlanResources(*info, budget);
+  // 2 layers * 4 kv heads * (8 + 8) dims * 2 bytes.
+  EXPECT_EQ(plan.kv_bytes_per_token, 256u);
+  EXPECT_EQ(plan.layer_bytes, 8960u);
+  EXPECT_EQ(plan.weight_bytes, info->TensorBytes());
+  EXPECT_EQ(plan.n_ctx, 2048);  // trained length caps an unlimited budget
+  EXPECT_EQ(plan.gpu_layers, 0);
+  EXPECT_EQ(plan.threads, 6);
+
+  budget.host_memory_bytes = plan.weight_bytes + 256u * 1000;
+  plan = deepseek::PlanResources(*info, budget);
+  EXPECT_EQ(plan.n_ctx, 768);
+
+  budget.requested_ctx = 1024;
+  budget.device_memory_bytes = 8960u + 128u * 1024 + 1;
+  plan = deepseek::PlanResources(*info, budget);
+  EXPECT_EQ(plan.n_ctx, 1024);
+  EXPECT_EQ(plan.gpu_layers, 1);
+
+  budget.device_memory_bytes = 1u << 30;
+  plan = deepseek::PlanResources(*info, budget);
+  EXPECT_EQ(plan.gpu_layers, 3);
+
+  // A q8_0 cache costs 34 bytes per 32 values instead of 64.
+  const auto q8_0 = deepseek::GgmlTypeFromName("q8_0");
+  ASSERT_TRUE(q8_0.has_value());
+  budget.k_bytes_per_element = deepseek::GgmlTypeElementBytes(*q8_0);
+  budget.v_bytes_per_element = deepseek::GgmlTypeElementBytes(*q8_0);
+  plan = deepseek::PlanResources(*info, budget);
+  EXPECT_EQ(plan.kv_bytes_per_token, 136u);
+  EXPECT_EQ(plan.KvBytes(), 136u * 1024);
+}
@@ -38,3 +38,44 @@ TEST(StreamParserTests, ParsesDeltasAcrossChunks) {
   EXPECT_EQ(content[0], "Hel");
   EXPECT_EQ(content[1], "lo");
 }
+
+TEST(StreamParserTests, KeepsUsageFromFinalChunk) {
+  size_t deltas = 0;
+  deepseek::DeepSeekStreamParser parser(
+      [&](std::string_view, std::string_view) { ++deltas; });
+
+  std::string error;
+  ASSERT_TRUE(parser.Feed("data: {\"choices\":[{\"delta\":{\"content\":\"Hi\"}}],"
+                          "\"usage\":null}\n",
+                          &error))
+      << error;
+  EXPECT_TRUE(parser.usage().empty());
+  ASSERT_TRUE(parser.Feed("data: {\"choices\":[],\"usage\":{\"prompt_tokens\":12,"
+                          "\"completion_tokens\":3}}\n"
+                          "data: [DONE]\n",
+                          &error))
+      << error;
+  EXPECT_EQ(deltas, 1u);
+  EXPECT_NE(parser.usage().find("\"prompt_tokens\":12"), std::string::npos);
+}
+
+TEST(StreamParserTests, StopsWhenCancelled) {
+  std::vector<std::string> content;
+  bool stop = false;
+  deepseek::DeepSeekStreamParser parser(
+      [&](std::string_view, std::string_view content_delta) {
+        content.emplace_back(content_delta);
+        stop = true;
+      },
+      [&]() { return stop; });
+
+  std::string error;
+  EXPECT_FALSE(parser.Feed("data: {\"choices\":[{\"delta\":{\"content\":\"A\"}}]}\n"
+                           "data: {\"choices\":[{\"delta\":{\"content\":\"B\"}}]}\n",
+                           &error));
+  EXPECT_TRUE(parser.stopped());
+  EXPECT_EQ(error, "Cancelled.");
+  EXPECT_FALSE(parser.Feed("data: {\"choices\":[{\"delta\":{\"content\":\"C\"}}]}\n", &error));
+  ASSERT_EQ(content.size(), 1u);
+  EXPECT_EQ(content[0], "A");
+}
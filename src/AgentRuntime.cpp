@@ -1,13 +1,92 @@
 #include "AgentRuntime.hpp"
+#include "AgentSnapshot.hpp"
+#include "ContextManager.hpp"
+#include "Metrics.hpp"
+#include "RetrievalMemory.hpp"
+#include "SemanticCache.hpp"
+#include "Trace.hpp"
 #include "rang.hpp"
 
 #include <nlohmann/json.hpp>
 
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <iterator>
 #include <stdexcept>
+#include <unordered_map>
 
 namespace app {
+namespace {
+
+// Debates only answer each other with the same agents and round structure.
+uint64_t DebateScope(const std::vector<Agent>& agents, int rounds, const RunOptions& options) {
+  // FNV-1a.
+  uint64_t hash = 1469598103934665603ull;
+  const auto mix = [&hash](std::string_view text) {
+    for (unsigned char c : text) {
+      hash ^= c;
+      hash *= 1099511628211ull;
+    }
+    hash ^= 0xff;
+    hash *= 1099511628211ull;
+  };
+  mix(std::to_string(rounds));
+  if (options.debate_mode == DebateMode::kAllToAll) {
+    mix("all-to-all/" + std::to_string(options.fan_in));
+  }
+  for (const auto& agent : agents) {
+    mix(agent.name);
+    mix(agent.system_prompt);
+  }
+  return hash;
+}
+
+std::vector<deepseek::Message> PreparePrompt(ChatBackend& backend,
+                                             const Agent& agent,
+                                             std::string_view user_input,
+                                             const RunOptions& options) {
+  TraceSpan prompt_span("BuildPrompt", agent.name);
+  auto messages = options.retrieval ? options.retrieval->BuildPrompt(backend, agent, user_input)
+                                    : BuildPrompt(agent, user_input);
+  if (options.context) {
+    messages = options.context->Fit(backend, agent.system_prompt, std::move(messages));
+  }
+  return messages;
+}
+
+// The input of agent `index` in an all-to-all round: the previous answers of
+// the `fan_in` agents after it, or its own answer when it debates alone.
+std::string AllToAllInput(const std::vector<AgentResult>& previous, size_t index, size_t fan_in) {
+  const size_t count = previous.size();
+  if (count == 1) {
+    return previous.front().response.content;
+  }
+  const size_t others = fan_in == 0 ? count - 1 : std::min(fan_in, count - 1);
+  std::string input;
+  for (size_t k = 1; k <= others; ++k) {
+    const AgentResult& answer = previous[(index + k) % count];
+    if (!input.empty()) {
+      input += "\n\n";
+    }
+    input += answer.name + ": " + answer.response.content;
+  }
+  return input;
+}
+
+[[noreturn]] void ThrowCancelled(const CallContext& call, const std::string& agent_name) {
+  if (call.deadline_exceeded()) {
+    throw DeadlineExceededError("Deadline exceeded (" + agent_name + ")");
+  }
+  throw CancelledError("Cancelled (" + agent_name + ")");
+}
+
+}  // namespace
 
 std::vector<deepseek::Message> BuildPrompt(const Agent& agent, std::string_view user_input) {
   std::vector<deepseek::Message> messages = agent.memory;
@@ -20,20 +99,43 @@ AgentResult RunAgent(ChatBackend& backend,
                      std::string_view user_input,
                      bool stream,
                      std::mutex* print_mutex) {
+  RunOptions options;
+  options.stream = stream;
+  options.print_mutex = print_mutex;
+  return RunAgent(backend, agent, user_input, options);
+}
+
+AgentResult RunAgent(ChatBackend& backend,
+                     Agent& agent,
+                     std::string_view user_input,
+                     const RunOptions& options) {
+  TraceSpan span("RunAgent", agent.name);
   AgentResult result;
   result.name = agent.name;
 
   std::string error;
-  auto messages = BuildPrompt(agent, user_input);
+  const auto messages = PreparePrompt(backend, agent, user_input, options);
 
-  if (stream) {
+  CallContext call;
+  call.cancel = options.cancel;
+  call.deadline = options.deadline;
+  if (call.cancelled()) {
+    ThrowCancelled(call, agent.name);
+  }
+  const auto start = std::chrono::steady_clock::now();
+  if (options.stream) {
     std::string reasoning_accum;
     std::string content_accum;
     bool ok = backend.stream(
         messages, agent.system_prompt,
         [&](std::string_view reasoning_delta, std::string_view content_delta) {
-          if (print_mutex) {
-            std::lock_guard<std::mutex> lock(*print_mutex);
+          if (call.cancelled()) {
+            return;
+          }
+          if (options.print_mutex) {
+            // Includes the wait for the lock shared by all agents.
+            TraceSpan print_span("print");
+            std::lock_guard<std::mutex> lock(*options.print_mutex);
             if (!reasoning_delta.empty()) {
               std::cout << rang::fg::magenta << "[" << agent.name << "][Reasoning] "
                         << rang::fg::reset << reasoning_delta << std::flush;
@@ -43,23 +145,41 @@ AgentResult RunAgent(ChatBackend& backend,
                         << content_delta << std::flush;
             }
           }
+          if (options.on_delta) {
+            options.on_delta(agent.name, reasoning_delta, content_delta);
+          }
           reasoning_accum.append(reasoning_delta);
           content_accum.append(content_delta);
         },
-        &error);
+        &call, &error);
 
+    // A call that completed before the cancellation keeps its answer.
+    if (call.stopped || (!ok && call.cancelled())) {
+      ThrowCancelled(call, agent.name);
+    }
     if (!ok) {
       throw std::runtime_error("Stream error (" + agent.name + "): " + error);
     }
     result.response.reasoning = std::move(reasoning_accum);
     result.response.content = std::move(content_accum);
   } else {
-    auto response = backend.chat(messages, agent.system_prompt, &error);
+    auto response = backend.chat(messages, agent.system_prompt, &call, &error);
+    if (call.stopped || (!response && call.cancelled())) {
+      ThrowCancelled(call, agent.name);
+    }
     if (!response) {
       throw std::runtime_error("Request error (" + agent.name + "): " + error);
     }
     result.response = *response;
   }
+  if (call.metrics.total_ms <= 0.0) {
+    call.metrics.total_ms =
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  }
+  result.metrics = call.metrics;
+  if (options.metrics) {
+    options.metrics->Record("agent", result.metrics);
+  }
 
   agent.memory.push_back({"assistant", result.response.content, result.response.reasoning});
   return result;
@@ -77,6 +197,7 @@ std::vector<AgentResult> RunAgentsConcurrent(ChatBackend& backend,
     Agent* agent_ptr = &agent;
     futures.push_back(
         std::async(std::launch::async, [&backend, agent_ptr, user_input, stream, &print_mutex]() {
+          SetTraceThreadName("agent " + agent_ptr->name);
           return RunAgent(backend, *agent_ptr, user_input, stream, &print_mutex);
         }));
   }
@@ -89,72 +210,471 @@ std::vector<AgentResult> RunAgentsConcurrent(ChatBackend& backend,
   return results;
 }
 
+std::vector<Agent> ForkAgent(const Agent& agent, size_t count, size_t at) {
+  std::vector<Agent> forks;
+  forks.reserve(count);
+  for (size_t i = 0; i < count; ++i) {
+    Agent fork;
+    fork.name = agent.name + "/" + std::to_string(i + 1);
+    fork.system_prompt = agent.system_prompt;
+    fork.memory.assign(agent.memory.begin(),
+                       agent.memory.begin() + std::min(at, agent.memory.size()));
+    fork.archive = agent.archive;
+    fork.archive_index = agent.archive_index;
+    fork.archived_messages = agent.archived_messages;
+    forks.push_back(std::move(fork));
+  }
+  return forks;
+}
+
+std::vector<AgentResult> RunBranches(ChatBackend& backend,
+                                     std::vector<Agent>& branches,
+                                     const std::vector<std::string>& inputs,
+                                     const RunOptions& options) {
+  if (branches.size() != inputs.size()) {
+    throw std::invalid_argument("RunBranches needs one input per branch.");
+  }
+  if (branches.empty()) {
+    return {};
+  }
+  const bool one_system_prompt =
+      std::all_of(branches.begin(), branches.end(), [&](const Agent& agent) {
+        return agent.system_prompt == branches.front().system_prompt;
+      });
+  if (!backend.chat_batch || options.stream || !one_system_prompt) {
+    std::mutex print_mutex;
+    RunOptions run = options;
+    if (run.stream && !run.print_mutex && !run.on_delta) {
+      run.print_mutex = &print_mutex;
+    }
+    std::vector<std::future<AgentResult>> futures;
+    futures.reserve(branches.size());
+    for (size_t i = 0; i < branches.size(); ++i) {
+      Agent* agent_ptr = &branches[i];
+      const std::string* input = &inputs[i];
+      futures.push_back(std::async(std::launch::async, [&backend, agent_ptr, input, &run]() {
+        SetTraceThreadName("agent " + agent_ptr->name);
+        return RunAgent(backend, *agent_ptr, *input, run);
+      }));
+    }
+    std::vector<AgentResult> results;
+    results.reserve(futures.size());
+    for (auto& fut : futures) {
+      results.push_back(fut.get());
+    }
+    return results;
+  }
+
+  TraceSpan span("RunBranches", branches.front().name);
+  std::vector<std::vector<deepseek::Message>> prompts;
+  prompts.reserve(branches.size());
+  for (size_t i = 0; i < branches.size(); ++i) {
+    prompts.push_back(PreparePrompt(backend, branches[i], inputs[i], options));
+  }
+  std::vector<CallContext> calls(branches.size());
+  for (auto& call : calls) {
+    call.cancel = options.cancel;
+    call.deadline = options.deadline;
+  }
+  if (calls.front().cancelled()) {
+    ThrowCancelled(calls.front(), branches.front().name);
+  }
+
+  std::string error;
+  const auto start = std::chrono::steady_clock::now();
+  auto responses = backend.chat_batch(prompts, branches.front().system_prompt, &calls, &error);
+  const double elapsed_ms =
+      std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  // Branches are answered together, so one cancelled branch cancels them all
+  // and no memory is changed.
+  for (size_t i = 0; i < calls.size(); ++i) {
+    if (calls[i].stopped || (!responses && calls[i].cancelled())) {
+      ThrowCancelled(calls[i], branches[i].name);
+    }
+  }
+  if (!responses || responses->size() != branches.size()) {
+    throw std::runtime_error("Request error (" + branches.front().name + "): " + error);
+  }
+
+  std::vector<AgentResult> results(branches.size());
+  for (size_t i = 0; i < branches.size(); ++i) {
+    AgentResult& result = results[i];
+    result.name = branches[i].name;
+    result.response = std::move((*responses)[i]);
+    result.metrics = calls[i].metrics;
+    if (result.metrics.total_ms <= 0.0) {
+      result.metrics.total_ms = elapsed_ms;
+    }
+    if (options.metrics) {
+      options.metrics->Record("agent", result.metrics);
+    }
+    if (options.on_delta) {
+      options.on_delta(result.name, result.response.reasoning, result.response.content);
+    }
+    branches[i].memory.push_back(
+        {"assistant", result.response.content, result.response.reasoning});
+  }
+  return results;
+}
+
+std::string NormalizeAnswer(std::string_view content) {
+  const auto is_edge = [](unsigned char c) { return std::isspace(c) || std::ispunct(c); };
+  size_t begin = 0;
+  size_t end = content.size();
+  while (begin < end && is_edge(content[begin])) {
+    ++begin;
+  }
+  while (end > begin && is_edge(content[end - 1])) {
+    --end;
+  }
+  std::string out;
+  out.reserve(end - begin);
+  bool space = false;
+  for (size_t i = begin; i < end; ++i) {
+    const unsigned char c = content[i];
+    if (std::isspace(c)) {
+      space = true;
+      continue;
+    }
+    if (space) {
+      out.push_back(' ');
+      space = false;
+    }
+    out.push_back(static_cast<char>(std::tolower(c)));
+  }
+  return out;
+}
+
+QuorumResult RunAgentsQuorum(ChatBackend& backend,
+                             std::vector<Agent>& agents,
+                             std::string_view user_input,
+                             const QuorumPolicy& policy,
+                             const RunOptions& options) {
+  using Clock = std::chrono::steady_clock;
+  struct Outcome {
+    std::optional<AgentResult> result;
+    bool cancelled = false;
+  };
+
+  QuorumResult quorum;
+  const size_t total = agents.size();
+  const size_t k = std::clamp<size_t>(policy.k, 1, std::max<size_t>(total, 1));
+  const auto normalize = policy.normalize ? policy.normalize : NormalizeAnswer;
+
+  CancelToken cancel(options.cancel);
+  std::mutex print_mutex;
+  RunOptions run = options;
+  run.cancel = &cancel;
+  if (run.stream && !run.print_mutex) {
+    run.print_mutex = &print_mutex;
+  }
+
+  std::mutex mutex;
+  std::condition_variable done_cv;
+  std::deque<Outcome> finished;
+  std::vector<std::future<void>> futures;
+  futures.reserve(total);
+  for (auto& agent : agents) {
+    Agent* agent_ptr = &agent;
+    futures.push_back(std::async(std::launch::async, [&, agent_ptr]() {
+      SetTraceThreadName("agent " + agent_ptr->name);
+      Outcome outcome;
+      try {
+        outcome.result = RunAgent(backend, *agent_ptr, user_input, run);
+      } catch (const CancelledError&) {
+        outcome.cancelled = true;
+      } catch (const std::exception&) {
+      }
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        finished.push_back(std::move(outcome));
+      }
+      done_cv.notify_one();
+    }));
+  }
+
+  const auto take = [&](Outcome& outcome) {
+    if (outcome.result) {
+      quorum.results.push_back(std::move(*outcome.result));
+    } else if (outcome.cancelled) {
+      ++quorum.cancelled;
+    } else {
+      ++quorum.failed;
+    }
+  };
+
+  std::unordered_map<std::string, size_t> tally;
+  size_t best = 0;
+  size_t pending = total;
+  const auto deadline = Clock::now() + policy.deadline;
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (pending > 0) {
+      const auto ready = [&]() { return !finished.empty(); };
+      if (policy.deadline.count() > 0) {
+        if (!done_cv.wait_until(lock, deadline, ready)) {
+          break;
+        }
+      } else {
+        done_cv.wait(lock, ready);
+      }
+      Outcome outcome = std::move(finished.front());
+      finished.pop_front();
+      --pending;
+      const bool answered = outcome.result.has_value();
+      std::string key = answered ? normalize(outcome.result->response.content) : std::string();
+      take(outcome);
+
+      if (policy.mode == QuorumPolicy::Mode::kFirstK) {
+        quorum.satisfied = quorum.results.size() >= k;
+        if (quorum.satisfied || quorum.results.size() + pending < k) {
+          break;
+        }
+      } else if (policy.mode == QuorumPolicy::Mode::kMajority) {
+        if (answered) {
+          const size_t votes = ++tally[key];
+          if (votes > best) {
+            best = votes;
+          }
+          if (votes * 2 > total) {
+            quorum.satisfied = true;
+            quorum.consensus = std::move(key);
+            quorum.votes = votes;
+            break;
+          }
+        }
+        if ((best + pending) * 2 <= total) {
+          break;
+        }
+      } else {
+        quorum.satisfied = pending == 0 && quorum.results.size() == total;
+      }
+    }
+  }
+
+  // Wait for the cancelled agents: they hold references to `agents`.
+  cancel.Cancel();
+  for (auto& fut : futures) {
+    fut.get();
+  }
+  for (auto& outcome : finished) {
+    take(outcome);
+  }
+  return quorum;
+}
+
 std::vector<AgentResult> RunDebateRounds(ChatBackend& backend,
                                          std::vector<Agent>& agents,
                                          std::string_view topic,
                                          int rounds,
                                          bool stream) {
+  RunOptions options;
+  options.stream = stream;
+  return RunDebateRounds(backend, agents, topic, rounds, options);
+}
+
+namespace {
+
+// RunDebateRounds, calling `after_first_turn` once the first agent (or the
+// first all-to-all round) has answered; it may throw to end the debate.
+std::vector<AgentResult> DebateRounds(ChatBackend& backend,
+                                      std::vector<Agent>& agents,
+                                      std::string_view topic,
+                                      int rounds,
+                                      const RunOptions& options,
+                                      const std::function<void()>& after_first_turn) {
   if (rounds <= 0) {
     return {};
   }
+  std::optional<std::vector<float>> topic_embedding;
+  uint64_t scope = 0;
+  if (options.answer_cache && backend.embed && !agents.empty()) {
+    scope = DebateScope(agents, rounds, options);
+    topic_embedding = backend.embed(topic, nullptr);
+    if (topic_embedding) {
+      if (auto hit = options.answer_cache->Lookup(*topic_embedding, scope)) {
+        for (size_t i = 0; i < hit->value.size(); ++i) {
+          AgentResult& result = hit->value[i];
+          result.cache_score = hit->score;
+          result.metrics = {};
+          agents[i % agents.size()].memory.push_back(
+              {"assistant", result.response.content, result.response.reasoning});
+          if (options.on_delta) {
+            options.on_delta(result.name, result.response.reasoning, result.response.content);
+          }
+        }
+        return std::move(hit->value);
+      }
+    }
+  }
   std::vector<AgentResult> all_results;
   all_results.reserve(static_cast<size_t>(rounds) * agents.size());
 
-  std::string current_prompt = std::string(topic);
-  for (int r = 0; r < rounds; ++r) {
-    for (auto& agent : agents) {
-      auto result = RunAgent(backend, agent, current_prompt, stream, nullptr);
-      // Feed the previous response into the next agent for a simple debate loop.
-      current_prompt = result.response.content;
-      all_results.push_back(std::move(result));
+  if (options.debate_mode == DebateMode::kAllToAll) {
+    std::vector<std::string> inputs(agents.size(), std::string(topic));
+    for (int r = 0; r < rounds; ++r) {
+      auto round = RunBranches(backend, agents, inputs, options);
+      if (r == 0 && after_first_turn) {
+        after_first_turn();
+      }
+      for (size_t i = 0; i < agents.size(); ++i) {
+        inputs[i] = AllToAllInput(round, i, options.fan_in);
+      }
+      std::move(round.begin(), round.end(), std::back_inserter(all_results));
+    }
+  } else {
+    std::string current_prompt = std::string(topic);
+    for (int r = 0; r < rounds; ++r) {
+      for (auto& agent : agents) {
+        auto result = RunAgent(backend, agent, current_prompt, options);
+        // Feed the previous response into the next agent for a simple debate loop.
+        current_prompt = result.response.content;
+        all_results.push_back(std::move(result));
+        if (all_results.size() == 1 && after_first_turn) {
+          after_first_turn();
+        }
+      }
     }
   }
+  if (topic_embedding) {
+    options.answer_cache->Insert(*topic_embedding, scope, std::string(topic), all_results);
+  }
   return all_results;
 }
 
-bool SaveAgents(const std::vector<Agent>& agents,
-                std::string_view path,
-                std::string* error_out) {
+}  // namespace
+
+std::vector<AgentResult> RunDebateRounds(ChatBackend& backend,
+                                         std::vector<Agent>& agents,
+                                         std::string_view topic,
+                                         int rounds,
+                                         const RunOptions& options) {
+  return DebateRounds(backend, agents, topic, rounds, options, nullptr);
+}
+
+std::optional<std::vector<AgentResult>> RunDebateRoundsSpeculative(
+    ChatBackend& backend,
+    std::vector<Agent>& agents,
+    std::string_view topic,
+    int rounds,
+    const std::function<bool()>& admit,
+    const RunOptions& options) {
+  struct HeldDelta {
+    std::string agent;
+    std::string reasoning;
+    std::string content;
+  };
+  CancelToken cancel(options.cancel);
+  std::promise<bool> decision;
+  std::shared_future<bool> admitted = decision.get_future().share();
+  std::mutex delta_mutex;
+  std::vector<HeldDelta> held;
+  bool released = false;
+
+  std::vector<Agent> draft = agents;
+  RunOptions run = options;
+  run.cancel = &cancel;
+  // Printed deltas could not be taken back, so they only go to on_delta.
+  run.print_mutex = nullptr;
+  run.on_delta = [&](const std::string& agent, std::string_view reasoning,
+                     std::string_view content) {
+    std::lock_guard<std::mutex> lock(delta_mutex);
+    if (!released) {
+      held.push_back({agent, std::string(reasoning), std::string(content)});
+    } else if (options.on_delta) {
+      options.on_delta(agent, reasoning, content);
+    }
+  };
+  auto debate = std::async(std::launch::async, [&]() {
+    SetTraceThreadName("speculative debate");
+    return DebateRounds(backend, draft, topic, rounds, run, [&admitted]() {
+      if (!admitted.get()) {
+        throw CancelledError("Cancelled (rejected by the gate)");
+      }
+    });
+  });
+
+  // The debate references locals, so it is always waited for.
+  const auto reject = [&]() {
+    cancel.Cancel();
+    decision.set_value(false);
+    try {
+      debate.get();
+    } catch (const std::exception&) {
+    }
+  };
+  bool allow = false;
+  try {
+    allow = admit();
+  } catch (...) {
+    reject();
+    throw;
+  }
+  if (!allow) {
+    reject();
+    return std::nullopt;
+  }
+  {
+    std::lock_guard<std::mutex> lock(delta_mutex);
+    released = true;
+    if (options.on_delta) {
+      for (const auto& delta : held) {
+        options.on_delta(delta.agent, delta.reasoning, delta.content);
+      }
+    }
+  }
+  decision.set_value(true);
+  auto results = debate.get();
+  agents = std::move(draft);
+  return results;
+}
+
+size_t PrefillAgents(ChatBackend& backend,
+                     const std::vector<Agent>& agents,
+                     const CancelToken* cancel) {
+  if (!backend.prefill) {
+    return 0;
+  }
+  size_t prefilled = 0;
+  for (const auto& agent : agents) {
+    if (cancel && cancel->cancelled()) {
+      break;
+    }
+    TraceSpan span("PrefillAgent", agent.name);
+    if (backend.prefill(agent.memory, agent.system_prompt, cancel)) {
+      ++prefilled;
+    }
+  }
+  return prefilled;
+}
+
+namespace {
+
+bool WriteJsonStore(const std::vector<Agent>& agents, std::ostream& out, std::string* error_out) {
   nlohmann::json root = nlohmann::json::array();
   for (const auto& agent : agents) {
     nlohmann::json a;
     a["name"] = agent.name;
     a["system_prompt"] = agent.system_prompt;
     a["memory"] = nlohmann::json::array();
-    for (const auto& msg : agent.memory) {
-      a["memory"].push_back({{"role", msg.role},
-                             {"content", msg.content},
-                             {"reasoning", msg.reasoning}});
+    bool ok = ForEachHistoryMessage(
+        agent,
+        [&](const MessageView& msg) {
+          a["memory"].push_back({{"role", msg.role},
+                                 {"content", msg.content},
+                                 {"reasoning", msg.reasoning}});
+        },
+        error_out);
+    if (!ok) {
+      return false;
     }
     root.push_back(std::move(a));
   }
-
-  std::ofstream out(std::string(path), std::ios::binary);
-  if (!out) {
-    if (error_out) {
-      *error_out = "Failed to open file for write: " + std::string(path);
-    }
-    return false;
-  }
   out << root.dump(2);
-  if (!out) {
-    if (error_out) {
-      *error_out = "Failed to write file: " + std::string(path);
-    }
-    return false;
-  }
   return true;
 }
 
-bool LoadAgents(std::vector<Agent>* agents,
-                std::string_view path,
-                std::string* error_out) {
-  if (!agents) {
-    if (error_out) {
-      *error_out = "Agents output pointer is null.";
-    }
-    return false;
-  }
+bool LoadJsonStore(std::vector<Agent>* agents, std::string_view path, std::string* error_out) {
   std::ifstream in(std::string(path), std::ios::binary);
   if (!in) {
     if (error_out) {
@@ -199,4 +719,129 @@ bool LoadAgents(std::vector<Agent>* agents,
   return true;
 }
 
+bool LoadSnapshotStore(std::vector<Agent>* agents,
+                       std::string_view path,
+                       std::optional<size_t> max_history,
+                       std::string* error_out) {
+  auto snapshot = AgentSnapshot::Open(path, error_out);
+  if (!snapshot) {
+    return false;
+  }
+
+  std::vector<Agent> loaded;
+  loaded.reserve(snapshot->agent_count());
+  for (size_t i = 0; i < snapshot->agent_count(); ++i) {
+    Agent agent;
+    agent.name = std::string(snapshot->name(i));
+    agent.system_prompt = std::string(snapshot->system_prompt(i));
+
+    const size_t total = snapshot->message_count(i);
+    const size_t keep = max_history ? std::min(*max_history, total) : total;
+    const size_t first = total - keep;
+    agent.memory.reserve(keep);
+    for (size_t m = first; m < total; ++m) {
+      auto msg = snapshot->message(i, m);
+      if (!msg) {
+        if (error_out) {
+          *error_out = "Invalid snapshot: corrupt message " + std::to_string(m) + " for agent " +
+                       agent.name + ".";
+        }
+        return false;
+      }
+      agent.memory.push_back(
+          {std::string(msg->role), std::string(msg->content), std::string(msg->reasoning)});
+    }
+    if (first > 0) {
+      agent.archive = snapshot;
+      agent.archive_index = i;
+      agent.archived_messages = first;
+    }
+    loaded.push_back(std::move(agent));
+  }
+
+  *agents = std::move(loaded);
+  return true;
+}
+
+bool LoadAgentStore(std::vector<Agent>* agents,
+                    std::string_view path,
+                    std::optional<size_t> max_history,
+                    std::string* error_out) {
+  if (!agents) {
+    if (error_out) {
+      *error_out = "Agents output pointer is null.";
+    }
+    return false;
+  }
+  if (IsAgentSnapshot(path)) {
+    return LoadSnapshotStore(agents, path, max_history, error_out);
+  }
+  return LoadJsonStore(agents, path, error_out);
+}
+
+}  // namespace
+
+bool SaveAgents(const std::vector<Agent>& agents,
+                std::string_view path,
+                std::string* error_out) {
+  TraceSpan span("SaveAgents", path);
+  // Write next to the target and rename over it: the old file may still be
+  // mapped by an agent archive, and truncating it in place would fault.
+  const std::string final_path(path);
+  const std::string tmp_path = final_path + ".tmp";
+  {
+    std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+      if (error_out) {
+        *error_out = "Failed to open file for write: " + final_path;
+      }
+      return false;
+    }
+    const bool ok = IsSnapshotPath(path) ? WriteAgentSnapshot(agents, out, error_out)
+                                         : WriteJsonStore(agents, out, error_out);
+    out.close();
+    if (!ok || !out) {
+      if (ok && error_out) {
+        *error_out = "Failed to write file: " + final_path;
+      }
+      std::filesystem::remove(tmp_path);
+      return false;
+    }
+  }
+  std::error_code ec;
+  std::filesystem::rename(tmp_path, final_path, ec);
+  if (ec) {
+    if (error_out) {
+      *error_out = "Failed to replace file: " + final_path + " (" + ec.message() + ")";
+    }
+    std::filesystem::remove(tmp_path);
+    return false;
+  }
+  return true;
+}
+
+bool LoadAgents(std::vector<Agent>* agents,
+                std::string_view path,
+                std::string* error_out) {
+  return LoadAgentStore(agents, path, std::nullopt, error_out);
+}
+
+bool LoadAgentsRecent(std::vector<Agent>* agents,
+                      std::string_view path,
+                      size_t max_history,
+                      std::string* error_out) {
+  return LoadAgentStore(agents, path, max_history, error_out);
+}
+
+bool ConvertAgentStore(std::string_view in_path,
+                       std::string_view out_path,
+                       std::string* error_out) {
+  // Keep snapshot history mapped; SaveAgents streams it straight through.
+  std::vector<Agent> agents;
+  if (!LoadAgentsRecent(&agents, in_path, 0, error_out)) {
+    return false;
+  }
+  return SaveAgents(agents, out_path, error_out);
+}
+
 }  // namespace app
@@ -0,0 +1,322 @@
+#include "AgentSnapshot.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace app {
+namespace {
+
+constexpr char kMagic[4] = {'C', 'D', 'S', 'A'};
+constexpr uint32_t kVersion = 1;
+constexpr uint32_t kByteOrderMark = 0x01020304;
+
+// On-disk records. All fields are 8-byte aligned so the tables can be read in
+// place from the mapping.
+struct TextRef {
+  uint64_t offset;
+  uint64_t size;
+};
+
+struct Header {
+  char magic[4];
+  uint32_t version;
+  uint32_t byte_order;
+  uint32_t reserved;
+  uint64_t agent_count;
+  uint64_t message_count;
+  uint64_t agent_table_offset;
+  uint64_t message_table_offset;
+  uint64_t text_offset;
+  uint64_t text_size;
+};
+
+struct AgentRecord {
+  TextRef name;
+  TextRef system_prompt;
+  uint64_t first_message;
+  uint64_t message_count;
+};
+
+struct MessageRecord {
+  TextRef role;
+  TextRef content;
+  TextRef reasoning;
+};
+
+static_assert(sizeof(Header) == 64);
+static_assert(sizeof(AgentRecord) == 48);
+static_assert(sizeof(MessageRecord) == 48);
+
+template <typename T>
+T ReadRecord(const uint8_t* ptr) {
+  T value;
+  std::memcpy(&value, ptr, sizeof(T));
+  return value;
+}
+
+void SetError(std::string* error_out, std::string message) {
+  if (error_out) {
+    *error_out = std::move(message);
+  }
+}
+
+}  // namespace
+
+std::shared_ptr<const AgentSnapshot> AgentSnapshot::Open(std::string_view path,
+                                                         std::string* error_out) {
+  std::shared_ptr<AgentSnapshot> snap(new AgentSnapshot());
+  const std::string path_str(path);
+
+#if !defined(_WIN32)
+  int fd = ::open(path_str.c_str(), O_RDONLY);
+  if (fd < 0) {
+    SetError(error_out, "Failed to open file for read: " + path_str);
+    return nullptr;
+  }
+  struct stat st {};
+  if (::fstat(fd, &st) != 0) {
+    ::close(fd);
+    SetError(error_out, "Failed to stat file: " + path_str);
+    return nullptr;
+  }
+  snap->size_ = static_cast<size_t>(st.st_size);
+  if (snap->size_ > 0) {
+    void* addr = ::mmap(nullptr, snap->size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) {
+      ::close(fd);
+      SetError(error_out, "Failed to map file: " + path_str);
+      return nullptr;
+    }
+    // History is read from the tail backwards, not sequentially.
+    ::madvise(addr, snap->size_, MADV_RANDOM);
+    snap->data_ = static_cast<const uint8_t*>(addr);
+    snap->mapped_ = true;
+  }
+  ::close(fd);
+#else
+  std::ifstream in(path_str, std::ios::binary);
+  if (!in) {
+    SetError(error_out, "Failed to open file for read: " + path_str);
+    return nullptr;
+  }
+  snap->buffer_.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  snap->data_ = snap->buffer_.data();
+  snap->size_ = snap->buffer_.size();
+#endif
+
+  if (snap->size_ < sizeof(Header)) {
+    SetError(error_out, "Invalid snapshot: file too small.");
+    return nullptr;
+  }
+  const auto header = ReadRecord<Header>(snap->data_);
+  if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0) {
+    SetError(error_out, "Invalid snapshot: bad magic.");
+    return nullptr;
+  }
+  if (header.version != kVersion) {
+    SetError(error_out, "Unsupported snapshot version: " + std::to_string(header.version));
+    return nullptr;
+  }
+  if (header.byte_order != kByteOrderMark) {
+    SetError(error_out, "Invalid snapshot: written with a different byte order.");
+    return nullptr;
+  }
+
+  const uint64_t size = snap->size_;
+  const auto table_fits = [size](uint64_t offset, uint64_t count, uint64_t record_size) {
+    return offset <= size && count <= (size - offset) / record_size;
+  };
+  if (!table_fits(header.agent_table_offset, header.agent_count, sizeof(AgentRecord)) ||
+      !table_fits(header.message_table_offset, header.message_count, sizeof(MessageRecord)) ||
+      header.text_offset > size || header.text_size > size - header.text_offset) {
+    SetError(error_out, "Invalid snapshot: table out of bounds.");
+    return nullptr;
+  }
+
+  snap->agent_count_ = static_cast<size_t>(header.agent_count);
+  snap->message_total_ = static_cast<size_t>(header.message_count);
+  snap->agents_ = snap->data_ + header.agent_table_offset;
+  snap->messages_ = snap->data_ + header.message_table_offset;
+  snap->text_ = reinterpret_cast<const char*>(snap->data_ + header.text_offset);
+  snap->text_size_ = static_cast<size_t>(header.text_size);
+
+  for (size_t i = 0; i < snap->agent_count_; ++i) {
+    const auto rec = ReadRecord<AgentRecord>(snap->agents_ + i * sizeof(AgentRecord));
+    if (rec.first_message > snap->message_total_ ||
+        rec.message_count > snap->message_total_ - rec.first_message ||
+        !snap->Text(snap->agents_ + i * sizeof(AgentRecord) + offsetof(AgentRecord, name)) ||
+        !snap->Text(snap->agents_ + i * sizeof(AgentRecord) +
+                    offsetof(AgentRecord, system_prompt))) {
+      SetError(error_out, "Invalid snapshot: corrupt agent record " + std::to_string(i) + ".");
+      return nullptr;
+    }
+  }
+  return snap;
+}
+
+AgentSnapshot::~AgentSnapshot() {
+#if !defined(_WIN32)
+  if (mapped_) {
+    ::munmap(const_cast<uint8_t*>(data_), size_);
+  }
+#endif
+}
+
+std::optional<std::string_view> AgentSnapshot::Text(const uint8_t* ref) const {
+  const auto text = ReadRecord<TextRef>(ref);
+  if (text.offset > text_size_ || text.size > text_size_ - text.offset) {
+    return std::nullopt;
+  }
+  return std::string_view(text_ + text.offset, static_cast<size_t>(text.size));
+}
+
+std::string_view AgentSnapshot::name(size_t agent) const {
+  return *Text(agents_ + agent * sizeof(AgentRecord) + offsetof(AgentRecord, name));
+}
+
+std::string_view AgentSnapshot::system_prompt(size_t agent) const {
+  return *Text(agents_ + agent * sizeof(AgentRecord) + offsetof(AgentRecord, system_prompt));
+}
+
+size_t AgentSnapshot::message_count(size_t agent) const {
+  return static_cast<size_t>(
+      ReadRecord<AgentRecord>(agents_ + agent * sizeof(AgentRecord)).message_count);
+}
+
+std::optional<MessageView> AgentSnapshot::message(size_t agent, size_t index) const {
+  const auto rec = ReadRecord<AgentRecord>(agents_ + agent * sizeof(AgentRecord));
+  if (index >= rec.message_count) {
+    return std::nullopt;
+  }
+  const uint8_t* msg = messages_ + (rec.first_message + index) * sizeof(MessageRecord);
+  auto role = Text(msg + offsetof(MessageRecord, role));
+  auto content = Text(msg + offsetof(MessageRecord, content));
+  auto reasoning = Text(msg + offsetof(MessageRecord, reasoning));
+  if (!role || !content || !reasoning) {
+    return std::nullopt;
+  }
+  return MessageView{*role, *content, *reasoning};
+}
+
+bool IsAgentSnapshot(std::string_view path) {
+  std::ifstream in(std::string(path), std::ios::binary);
+  char magic[sizeof(kMagic)] = {};
+  if (!in.read(magic, sizeof(magic))) {
+    return false;
+  }
+  return std::memcmp(magic, kMagic, sizeof(kMagic)) == 0;
+}
+
+bool IsSnapshotPath(std::string_view path) {
+  constexpr std::string_view kExt = ".snap";
+  return path.size() >= kExt.size() && path.substr(path.size() - kExt.size()) == kExt;
+}
+
+bool ForEachHistoryMessage(const Agent& agent,
+                           const std::function<void(const MessageView&)>& fn,
+                           std::string* error_out) {
+  if (agent.archive) {
+    for (size_t i = 0; i < agent.archived_messages; ++i) {
+      auto msg = agent.archive->message(agent.archive_index, i);
+      if (!msg) {
+        SetError(error_out, "Corrupt archived message " + std::to_string(i) + " for agent " +
+                                agent.name + ".");
+        return false;
+      }
+      fn(*msg);
+    }
+  }
+  for (const auto& msg : agent.memory) {
+    fn(MessageView{msg.role, msg.content, msg.reasoning});
+  }
+  return true;
+}
+
+bool WriteAgentSnapshot(const std::vector<Agent>& agents,
+                        std::ostream& out,
+                        std::string* error_out) {
+  // First pass: lay out both tables so the text section can be streamed
+  // without holding a second copy of the history in memory.
+  std::vector<AgentRecord> agent_records;
+  std::vector<MessageRecord> message_records;
+  agent_records.reserve(agents.size());
+  uint64_t text_size = 0;
+  const auto place = [&text_size](std::string_view text) {
+    TextRef ref{text_size, text.size()};
+    text_size += text.size();
+    return ref;
+  };
+
+  for (const auto& agent : agents) {
+    AgentRecord rec{};
+    rec.name = place(agent.name);
+    rec.system_prompt = place(agent.system_prompt);
+    rec.first_message = message_records.size();
+    bool ok = ForEachHistoryMessage(
+        agent,
+        [&](const MessageView& msg) {
+          message_records.push_back({place(msg.role), place(msg.content), place(msg.reasoning)});
+        },
+        error_out);
+    if (!ok) {
+      return false;
+    }
+    rec.message_count = message_records.size() - rec.first_message;
+    agent_records.push_back(rec);
+  }
+
+  Header header{};
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.byte_order = kByteOrderMark;
+  header.agent_count = agent_records.size();
+  header.message_count = message_records.size();
+  header.agent_table_offset = sizeof(Header);
+  header.message_table_offset =
+      header.agent_table_offset + agent_records.size() * sizeof(AgentRecord);
+  header.text_offset =
+      header.message_table_offset + message_records.size() * sizeof(MessageRecord);
+  header.text_size = text_size;
+
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  out.write(reinterpret_cast<const char*>(agent_records.data()),
+            static_cast<std::streamsize>(agent_records.size() * sizeof(AgentRecord)));
+  out.write(reinterpret_cast<const char*>(message_records.data()),
+            static_cast<std::streamsize>(message_records.size() * sizeof(MessageRecord)));
+
+  // Second pass: emit text in the same order it was placed.
+  const auto emit = [&out](std::string_view text) {
+    out.write(text.data(), static_cast<std::streamsize>(text.size()));
+  };
+  for (const auto& agent : agents) {
+    emit(agent.name);
+    emit(agent.system_prompt);
+    bool ok = ForEachHistoryMessage(
+        agent,
+        [&](const MessageView& msg) {
+          emit(msg.role);
+          emit(msg.content);
+          emit(msg.reasoning);
+        },
+        error_out);
+    if (!ok) {
+      return false;
+    }
+  }
+
+  if (!out) {
+    SetError(error_out, "Failed to write snapshot.");
+    return false;
+  }
+  return true;
+}
+
+}  // namespace app
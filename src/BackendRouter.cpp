@@ -0,0 +1,293 @@
+#include "BackendRouter.hpp"
+
+#include <algorithm>
+#include <exception>
+#include <future>
+#include <utility>
+
+namespace app {
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const char* RouteName(Route route) {
+  return route == Route::kLocal ? "local" : "remote";
+}
+
+Route Other(Route route) {
+  return route == Route::kLocal ? Route::kRemote : Route::kLocal;
+}
+
+double Smooth(double average, double sample, double weight) {
+  return average > 0.0 ? average + weight * (sample - average) : sample;
+}
+
+// chat_batch for a backend without one: a concurrent chat call per prompt.
+std::optional<std::vector<deepseek::ChatResponse>> ChatEach(
+    const ChatBackend& backend,
+    const std::vector<std::vector<deepseek::Message>>& prompts,
+    std::string_view system_prompt,
+    std::vector<CallContext>* calls,
+    std::string* error_out) {
+  std::vector<std::string> errors(prompts.size());
+  std::vector<std::future<std::optional<deepseek::ChatResponse>>> futures;
+  futures.reserve(prompts.size());
+  for (size_t i = 0; i < prompts.size(); ++i) {
+    futures.push_back(std::async(std::launch::async, [&, i]() {
+      return backend.chat(prompts[i], system_prompt, &(*calls)[i], &errors[i]);
+    }));
+  }
+  std::vector<deepseek::ChatResponse> responses;
+  responses.reserve(prompts.size());
+  bool ok = true;
+  for (size_t i = 0; i < futures.size(); ++i) {
+    auto response = futures[i].get();
+    if (!response) {
+      if (ok && error_out) {
+        *error_out = errors[i];
+      }
+      ok = false;
+      continue;
+    }
+    responses.push_back(std::move(*response));
+  }
+  if (!ok) {
+    return std::nullopt;
+  }
+  return responses;
+}
+
+}  // namespace
+
+BackendRouter::BackendRouter(ChatBackend local, ChatBackend remote, RouterOptions options)
+    : options_(options) {
+  options_.local_slots = std::max<size_t>(1, options_.local_slots);
+  local_.backend = std::move(local);
+  remote_.backend = std::move(remote);
+}
+
+ChatBackend BackendRouter::Backend() {
+  ChatBackend backend;
+  backend.chat = [this](const std::vector<deepseek::Message>& messages,
+                        std::string_view system_prompt,
+                        CallContext* call,
+                        std::string* error_out) -> std::optional<deepseek::ChatResponse> {
+    std::optional<deepseek::ChatResponse> response;
+    Run(PromptTokens(messages, system_prompt), call, error_out,
+        [&](ChatBackend& target, CallContext* attempt_call, std::string* error, bool*) {
+          response = target.chat(messages, system_prompt, attempt_call, error);
+          return response.has_value();
+        });
+    return response;
+  };
+  backend.stream = [this](const std::vector<deepseek::Message>& messages,
+                          std::string_view system_prompt,
+                          const ChatBackend::StreamCallback& on_delta,
+                          CallContext* call,
+                          std::string* error_out) {
+    return Run(PromptTokens(messages, system_prompt), call, error_out,
+               [&](ChatBackend& target, CallContext* attempt_call, std::string* error,
+                   bool* delivered) {
+                 return target.stream(
+                     messages, system_prompt,
+                     [&](std::string_view reasoning_delta, std::string_view content_delta) {
+                       *delivered = true;
+                       on_delta(reasoning_delta, content_delta);
+                     },
+                     attempt_call, error);
+               });
+  };
+  if (local_.backend.chat_batch || remote_.backend.chat_batch) {
+    backend.chat_batch = [this](const std::vector<std::vector<deepseek::Message>>& prompts,
+                                std::string_view system_prompt,
+                                std::vector<CallContext>* calls,
+                                std::string* error_out)
+        -> std::optional<std::vector<deepseek::ChatResponse>> {
+      // One decision for the whole batch, sized by its longest prompt: the
+      // local side answers it in one context.
+      size_t prompt_tokens = 0;
+      for (const auto& messages : prompts) {
+        prompt_tokens = std::max(prompt_tokens, PromptTokens(messages, system_prompt));
+      }
+      CallContext batch;
+      if (!calls->empty()) {
+        batch.kind = calls->front().kind;
+        batch.cancel = calls->front().cancel;
+        batch.deadline = calls->front().deadline;
+      }
+      std::optional<std::vector<deepseek::ChatResponse>> responses;
+      Run(prompt_tokens, &batch, error_out,
+          [&](ChatBackend& target, CallContext* attempt_call, std::string* error, bool*) {
+            for (auto& call : *calls) {
+              call.metrics = {};
+              call.stopped = false;
+            }
+            responses = target.chat_batch
+                            ? target.chat_batch(prompts, system_prompt, calls, error)
+                            : ChatEach(target, prompts, system_prompt, calls, error);
+            attempt_call->stopped = std::any_of(calls->begin(), calls->end(),
+                                                [](const CallContext& c) { return c.stopped; });
+            if (!calls->empty()) {
+              attempt_call->metrics = calls->front().metrics;
+            }
+            return responses.has_value();
+          });
+      for (auto& call : *calls) {
+        call.metrics.route = batch.metrics.route;
+        call.metrics.failovers = batch.metrics.failovers;
+      }
+      return responses;
+    };
+  }
+  const ChatBackend& tokens_from = local_.backend.count_tokens ? local_.backend : remote_.backend;
+  backend.count_tokens = tokens_from.count_tokens;
+  const ChatBackend& embed_from = local_.backend.embed ? local_.backend : remote_.backend;
+  backend.embed = embed_from.embed;
+  // Only the local side keeps state worth computing ahead.
+  backend.prefill = local_.backend.prefill;
+  return backend;
+}
+
+Route BackendRouter::Choose(size_t prompt_tokens, CallKind kind, std::string* reason) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const auto pick = [&](Route route, const char* why) {
+    *reason = std::string(RouteName(route)) + ": " + why;
+    return route;
+  };
+  const auto now = Clock::now();
+  const bool local_up = now >= local_.down_until;
+  const bool remote_up = now >= remote_.down_until;
+  // With both sides down, route as if both were up.
+  if (local_up && !remote_up) {
+    return pick(Route::kLocal, "remote unavailable");
+  }
+  if (remote_up && !local_up) {
+    return pick(Route::kRemote, "local unavailable");
+  }
+  if (options_.max_local_prompt_tokens > 0 && prompt_tokens > options_.max_local_prompt_tokens) {
+    return pick(Route::kRemote, "long prompt");
+  }
+  if (local_.in_flight < options_.local_slots) {
+    return pick(Route::kLocal, "context free");
+  }
+  // Every local context is busy: the call would wait about one call per
+  // slot's worth of queue ahead of it.
+  if (local_.call_ms <= 0.0 || remote_.call_ms <= 0.0) {
+    return pick(Route::kRemote, "local queue");
+  }
+  const double rounds =
+      1.0 + static_cast<double>(local_.in_flight - options_.local_slots + 1) / options_.local_slots;
+  const double local_ms =
+      rounds * (local_.call_ms + local_.prefill_ms_per_token * static_cast<double>(prompt_tokens));
+  const double cost = kind == CallKind::kGate ? options_.gate_remote_cost : options_.remote_cost;
+  if (local_ms > cost * remote_.call_ms) {
+    return pick(Route::kRemote, "local queue");
+  }
+  return pick(Route::kLocal, "queued, remote slower");
+}
+
+RouterStats BackendRouter::stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+template <typename Attempt>
+bool BackendRouter::Run(size_t prompt_tokens,
+                        CallContext* call,
+                        std::string* error_out,
+                        Attempt attempt) {
+  CallContext own;
+  if (!call) {
+    call = &own;
+  }
+  std::string reason;
+  Route route = Choose(prompt_tokens, call->kind, &reason);
+  size_t failovers = 0;
+  while (true) {
+    std::string error;
+    bool delivered = false;
+    Begin(route);
+    bool ok = false;
+    try {
+      ok = attempt(side(route).backend, call, &error, &delivered);
+    } catch (const std::exception& ex) {
+      // Backends that throw (LlamaBackend) fail over like any other error.
+      error = ex.what();
+    }
+    const bool cancelled = call->stopped || call->cancelled();
+    Finish(route, ok, cancelled, *call);
+    call->metrics.route = reason;
+    call->metrics.failovers = failovers;
+    if (ok) {
+      return true;
+    }
+    // Cancelled calls and streams that already printed part of a reply are
+    // not repeated.
+    if (cancelled || delivered || failovers > 0) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      ++stats_.failed;
+      if (error_out) {
+        *error_out = error;
+      }
+      return false;
+    }
+    route = Other(route);
+    reason = std::string(RouteName(route)) + ": failover";
+    ++failovers;
+    call->metrics = {};
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++stats_.failovers;
+  }
+}
+
+size_t BackendRouter::PromptTokens(const std::vector<deepseek::Message>& messages,
+                                   std::string_view system_prompt) const {
+  size_t bytes = system_prompt.size();
+  for (const auto& message : messages) {
+    bytes += message.content.size();
+  }
+  // Counting with the tokenizer would cost as much as a short prefill; four
+  // bytes per token is close enough to compare prompts.
+  return bytes / 4;
+}
+
+void BackendRouter::Begin(Route route) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++side(route).in_flight;
+  if (route == Route::kLocal) {
+    ++stats_.local;
+  } else {
+    ++stats_.remote;
+  }
+}
+
+void BackendRouter::Finish(Route route, bool ok, bool cancelled, const CallContext& call) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Side& s = side(route);
+  --s.in_flight;
+  // A cancelled call says nothing about the backend.
+  if (cancelled) {
+    return;
+  }
+  if (!ok) {
+    s.down_until = Clock::now() + options_.failure_cooldown;
+    return;
+  }
+  const deepseek::CallMetrics& m = call.metrics;
+  if (m.total_ms <= 0.0) {
+    return;
+  }
+  // Local latency is modelled as a per-token prefill cost plus the rest of
+  // the call, without the time spent waiting for a context.
+  if (route == Route::kLocal && m.prefill_tokens > 0 && m.prefill_ms > 0.0) {
+    s.prefill_ms_per_token = Smooth(s.prefill_ms_per_token,
+                                    m.prefill_ms / static_cast<double>(m.prefill_tokens),
+                                    options_.smoothing);
+    s.call_ms = Smooth(s.call_ms, std::max(0.0, m.total_ms - m.queue_ms - m.prefill_ms),
+                       options_.smoothing);
+  } else {
+    s.call_ms = Smooth(s.call_ms, m.total_ms - m.queue_ms, options_.smoothing);
+  }
+}
+
+}  // namespace app
@@ -0,0 +1,188 @@
+#include "BatchRunner.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <istream>
+#include <mutex>
+#include <ostream>
+#include <thread>
+
+namespace app {
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double MsBetween(Clock::time_point from, Clock::time_point to) {
+  return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+bool IsBlank(std::string_view text) {
+  return std::all_of(text.begin(), text.end(),
+                     [](unsigned char c) { return std::isspace(c) != 0; });
+}
+
+nlohmann::json ResultJson(const AgentResult& result) {
+  nlohmann::json j{{"agent", result.name},
+                   {"content", result.response.content},
+                   {"reasoning", result.response.reasoning},
+                   {"ttft_ms", result.metrics.ttft_ms},
+                   {"total_ms", result.metrics.total_ms},
+                   {"prefill_tokens", result.metrics.prefill_tokens},
+                   {"decode_tokens", result.metrics.decode_tokens}};
+  if (result.metrics.cache_hit_tokens + result.metrics.cache_miss_tokens > 0) {
+    j["cache_hit_tokens"] = result.metrics.cache_hit_tokens;
+    j["cache_miss_tokens"] = result.metrics.cache_miss_tokens;
+  }
+  if (result.cache_score) {
+    j["cache_score"] = *result.cache_score;
+  }
+  return j;
+}
+
+}  // namespace
+
+bool ParseBatchItem(std::string_view text, size_t line, BatchItem* item, std::string* error_out) {
+  *item = BatchItem{};
+  item->line = line;
+  item->id = std::to_string(line);
+  const size_t first = text.find_first_not_of(" \t");
+  if (first == std::string_view::npos || text[first] != '{') {
+    item->topic = std::string(text);
+    return true;
+  }
+  try {
+    const auto j = nlohmann::json::parse(text);
+    if (j.contains("id")) {
+      item->id = j["id"].is_string() ? j["id"].get<std::string>() : j["id"].dump();
+    }
+    item->topic = j.value("topic", "");
+    item->rounds = j.value("rounds", 0);
+    if (j.contains("agents")) {
+      for (const auto& a : j.at("agents")) {
+        item->agents.push_back({a.at("name").get<std::string>(),
+                                a.value("system_prompt", ""),
+                                {}});
+      }
+    }
+  } catch (const std::exception& ex) {
+    if (error_out) {
+      *error_out = std::string("Invalid batch item: ") + ex.what();
+    }
+    return false;
+  }
+  if (item->topic.empty()) {
+    if (error_out) {
+      *error_out = "Batch item has no topic.";
+    }
+    return false;
+  }
+  if (item->rounds < 0) {
+    if (error_out) {
+      *error_out = "Batch item rounds must be > 0.";
+    }
+    return false;
+  }
+  return true;
+}
+
+BatchStats RunBatch(std::istream& in,
+                    std::ostream& out,
+                    const BatchOptions& options,
+                    const std::function<std::vector<Agent>()>& make_agents,
+                    const BatchHandler& handler) {
+  const auto batch_start = Clock::now();
+  std::mutex in_mutex;
+  std::mutex out_mutex;
+  size_t line_no = 0;
+  BatchStats stats;
+
+  // Each worker pulls the next line when it is free, so at most
+  // `concurrency` items are read ahead and long items do not hold up short
+  // ones.
+  const auto worker = [&]() {
+    while (true) {
+      std::string text;
+      size_t line = 0;
+      {
+        std::lock_guard<std::mutex> lock(in_mutex);
+        do {
+          if (!std::getline(in, text)) {
+            return;
+          }
+          line = ++line_no;
+        } while (IsBlank(text));
+      }
+
+      const auto start = Clock::now();
+      BatchItem item;
+      std::string error;
+      std::vector<AgentResult> results;
+      bool ok = ParseBatchItem(text, line, &item, &error);
+      bool cancelled = false;
+      if (ok) {
+        if (item.rounds == 0) {
+          item.rounds = options.rounds;
+        }
+        std::vector<Agent> agents = item.agents.empty() ? make_agents() : item.agents;
+        try {
+          ok = handler(item, agents, &results, &error);
+        } catch (const CancelledError& ex) {
+          error = ex.what();
+          ok = false;
+          cancelled = true;
+        } catch (const std::exception& ex) {
+          error = ex.what();
+          ok = false;
+        }
+      }
+      const auto end = Clock::now();
+
+      nlohmann::json j{{"id", item.id},
+                       {"line", line},
+                       {"ok", ok},
+                       {"start_ms", MsBetween(batch_start, start)},
+                       {"elapsed_ms", MsBetween(start, end)}};
+      if (ok) {
+        j["results"] = nlohmann::json::array();
+        for (const auto& result : results) {
+          j["results"].push_back(ResultJson(result));
+        }
+      } else {
+        j["error"] = error;
+        if (cancelled) {
+          j["cancelled"] = true;
+        }
+      }
+      // A reply cut off at the token limit can end mid-character; replace the
+      // broken bytes rather than throwing from the worker thread.
+      const std::string out_line =
+          j.dump(-1, ' ', false, nlohmann::json::error_handler_t::replace) + "\n";
+      std::lock_guard<std::mutex> lock(out_mutex);
+      out << out_line << std::flush;
+      ++stats.items;
+      if (!ok) {
+        ++stats.failed;
+      }
+      if (cancelled) {
+        ++stats.cancelled;
+      }
+    }
+  };
+
+  std::vector<std::thread> workers;
+  const size_t concurrency = std::max<size_t>(1, options.concurrency);
+  workers.reserve(concurrency);
+  for (size_t i = 0; i < concurrency; ++i) {
+    workers.emplace_back(worker);
+  }
+  for (auto& t : workers) {
+    t.join();
+  }
+  stats.elapsed_ms = MsBetween(batch_start, Clock::now());
+  return stats;
+}
+
+}  // namespace app
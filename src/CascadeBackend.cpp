@@ -0,0 +1,210 @@
+#include "CascadeBackend.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <exception>
+#include <future>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+
+namespace app {
+
+CascadeBackend::CascadeBackend(std::vector<CascadeTier> tiers) : tiers_(std::move(tiers)) {
+  if (tiers_.empty()) {
+    throw std::invalid_argument("A cascade needs at least one tier.");
+  }
+  for (const auto& tier : tiers_) {
+    stats_.push_back({tier.name, 0, 0});
+  }
+}
+
+ChatBackend CascadeBackend::Backend() {
+  ChatBackend backend;
+  backend.chat = [this](const std::vector<deepseek::Message>& messages,
+                        std::string_view system_prompt,
+                        CallContext* call,
+                        std::string* error_out) -> std::optional<deepseek::ChatResponse> {
+    CallContext own;
+    if (!call) {
+      call = &own;
+    }
+    deepseek::ChatResponse response;
+    double spent_ms = 0.0;
+    const size_t tier =
+        AskLowerTiers(messages, system_prompt, call, &response, &spent_ms, error_out);
+    if (tier == SIZE_MAX) {
+      return std::nullopt;
+    }
+    if (tier + 1 == tiers_.size()) {
+      auto last = tiers_.back().backend.chat(messages, system_prompt, call, error_out);
+      if (!last) {
+        return std::nullopt;
+      }
+      response = std::move(*last);
+    }
+    Finish(tier, call, spent_ms);
+    return response;
+  };
+  backend.stream = [this](const std::vector<deepseek::Message>& messages,
+                          std::string_view system_prompt,
+                          const ChatBackend::StreamCallback& on_delta,
+                          CallContext* call,
+                          std::string* error_out) {
+    CallContext own;
+    if (!call) {
+      call = &own;
+    }
+    deepseek::ChatResponse response;
+    double spent_ms = 0.0;
+    const size_t tier =
+        AskLowerTiers(messages, system_prompt, call, &response, &spent_ms, error_out);
+    if (tier == SIZE_MAX) {
+      return false;
+    }
+    if (tier + 1 == tiers_.size()) {
+      if (!tiers_.back().backend.stream(messages, system_prompt, on_delta, call, error_out)) {
+        return false;
+      }
+    } else {
+      on_delta(response.reasoning, response.content);
+    }
+    Finish(tier, call, spent_ms);
+    return true;
+  };
+  if (tiers_.back().backend.chat_batch) {
+    backend.chat_batch = [this](const std::vector<std::vector<deepseek::Message>>& prompts,
+                                std::string_view system_prompt,
+                                std::vector<CallContext>* calls,
+                                std::string* error_out)
+        -> std::optional<std::vector<deepseek::ChatResponse>> {
+      // Lower tiers score each prompt on its own; the prompts they pass on
+      // are batched on the last tier, which keeps their shared prefix.
+      std::vector<deepseek::ChatResponse> responses(prompts.size());
+      std::vector<double> spent_ms(prompts.size(), 0.0);
+      std::vector<std::future<size_t>> asks;
+      asks.reserve(prompts.size());
+      for (size_t i = 0; i < prompts.size(); ++i) {
+        asks.push_back(std::async(std::launch::async, [&, i]() {
+          return AskLowerTiers(prompts[i], system_prompt, &(*calls)[i], &responses[i],
+                               &spent_ms[i], nullptr);
+        }));
+      }
+      std::vector<size_t> tiers;
+      tiers.reserve(asks.size());
+      for (auto& ask : asks) {
+        tiers.push_back(ask.get());
+      }
+      if (std::find(tiers.begin(), tiers.end(), SIZE_MAX) != tiers.end()) {
+        if (error_out) {
+          *error_out = "Cancelled.";
+        }
+        return std::nullopt;
+      }
+
+      std::vector<size_t> escalated;
+      std::vector<std::vector<deepseek::Message>> rest;
+      std::vector<CallContext> rest_calls;
+      for (size_t i = 0; i < tiers.size(); ++i) {
+        if (tiers[i] + 1 == tiers_.size()) {
+          escalated.push_back(i);
+          rest.push_back(prompts[i]);
+          rest_calls.push_back((*calls)[i]);
+        }
+      }
+      if (!escalated.empty()) {
+        auto answers =
+            tiers_.back().backend.chat_batch(rest, system_prompt, &rest_calls, error_out);
+        for (size_t j = 0; j < escalated.size(); ++j) {
+          (*calls)[escalated[j]] = std::move(rest_calls[j]);
+        }
+        if (!answers || answers->size() != escalated.size()) {
+          return std::nullopt;
+        }
+        for (size_t j = 0; j < escalated.size(); ++j) {
+          responses[escalated[j]] = std::move((*answers)[j]);
+        }
+      }
+      for (size_t i = 0; i < tiers.size(); ++i) {
+        Finish(tiers[i], &(*calls)[i], spent_ms[i]);
+      }
+      return responses;
+    };
+  }
+  backend.count_tokens = tiers_.back().backend.count_tokens;
+  backend.embed = tiers_.back().backend.embed;
+  backend.prefill = [this](const std::vector<deepseek::Message>& messages,
+                           std::string_view system_prompt,
+                           const CancelToken* cancel) {
+    // Cheapest first: it answers most calls.
+    bool ready = false;
+    for (auto& tier : tiers_) {
+      if (tier.backend.prefill && !(cancel && cancel->cancelled())) {
+        ready = tier.backend.prefill(messages, system_prompt, cancel) || ready;
+      }
+    }
+    return ready;
+  };
+  return backend;
+}
+
+std::vector<CascadeTierStats> CascadeBackend::stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+size_t CascadeBackend::AskLowerTiers(const std::vector<deepseek::Message>& messages,
+                                     std::string_view system_prompt,
+                                     CallContext* call,
+                                     deepseek::ChatResponse* response,
+                                     double* spent_ms,
+                                     std::string* error_out) {
+  for (size_t i = 0; i + 1 < tiers_.size(); ++i) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      ++stats_[i].calls;
+    }
+    CallContext attempt;
+    attempt.kind = call->kind;
+    attempt.cancel = call->cancel;
+    attempt.deadline = call->deadline;
+    attempt.want_confidence = true;
+    std::string error;
+    std::optional<deepseek::ChatResponse> answer;
+    try {
+      answer = tiers_[i].backend.chat(messages, system_prompt, &attempt, &error);
+    } catch (const std::exception& ex) {
+      // LlamaBackend throws, e.g. for prompts beyond its context; escalate.
+      error = ex.what();
+    }
+    if (attempt.stopped || attempt.cancelled()) {
+      call->stopped = true;
+      if (error_out) {
+        *error_out = error.empty() ? "Cancelled." : error;
+      }
+      return SIZE_MAX;
+    }
+    if (answer && attempt.confidence && *attempt.confidence >= tiers_[i].min_confidence) {
+      *response = std::move(*answer);
+      call->metrics = attempt.metrics;
+      call->confidence = attempt.confidence;
+      return i;
+    }
+    *spent_ms += attempt.metrics.total_ms;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++stats_.back().calls;
+  return tiers_.size() - 1;
+}
+
+void CascadeBackend::Finish(size_t tier, CallContext* call, double spent_ms) {
+  // Every tier below the one that answered passed the call on.
+  call->metrics.tier = tiers_[tier].name;
+  call->metrics.escalations = tier;
+  call->metrics.ttft_ms += spent_ms;
+  call->metrics.total_ms += spent_ms;
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++stats_[tier].answered;
+}
+
+}  // namespace app
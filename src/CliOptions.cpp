@@ -1,9 +1,20 @@
 #include "CliOptions.hpp"
 
+#include <algorithm>
 #include <cstdlib>
+#include <iterator>
 #include <sstream>
 
 namespace app {
+namespace {
+
+bool IsCacheType(const std::string& type) {
+  static const char* const kTypes[] = {"f32",  "f16",  "bf16", "q8_0",  "q4_0",
+                                       "q4_1", "q5_0", "q5_1", "iq4_nl"};
+  return std::find(std::begin(kTypes), std::end(kTypes), type) != std::end(kTypes);
+}
+
+}  // namespace
 
 std::string Usage() {
   std::ostringstream out;
@@ -13,13 +24,76 @@ std::string Usage() {
       << "  --topic <text>     Debate topic (otherwise interactive CLI)\n"
       << "  --model <name>     Model name (default: deepseek-reasoner)\n"
       << "  --rounds <n>       Debate rounds (default: 1)\n"
+      << "  --all-to-all       Run each round's agents in parallel on all answers of the\n"
+      << "                     previous round instead of one after another\n"
+      << "  --fan-in <n>       With --all-to-all, answers each agent reads per round\n"
+      << "                     (default: all)\n"
+      << "  --optimistic-gate  Start the debate while the topic gate runs; discard it if\n"
+      << "                     the gate rejects the topic\n"
       << "  --gpu-layers <n|auto>   Offload N layers to GPU (llama.cpp, default: 0)\n"
       << "  --stream           Enable streaming (default)\n"
       << "  --no-stream        Disable streaming\n"
       << "  --local-only       Do not use network; require local backend (default)\n"
       << "  --remote           Use DeepSeek API (requires key)\n"
-      << "  --load <path>      Load agent memory from JSON\n"
-      << "  --save <path>      Save agent memory to JSON\n"
+      << "  --hybrid           Use the local model and burst to the API when local contexts\n"
+      << "                     are busy or fail (requires key)\n"
+      << "  --local-prompt-limit <n>  With --hybrid, send prompts over n tokens to the API\n"
+      << "  --load <path>      Load agent memory from JSON or a binary snapshot\n"
+      << "  --save <path>      Save agent memory to JSON (or a binary snapshot if *.snap)\n"
+      << "  --history <n>      Keep only the last N messages per agent in memory when\n"
+      << "                     loading a snapshot; older turns stay mapped (default: all)\n"
+      << "  --no-kv-state      Do not save/restore llama KV state next to the agent store\n"
+      << "  --no-idle-prefill  Do not prefill agent histories on the local model while\n"
+      << "                     waiting for input\n"
+      << "  --convert          Convert the --load store to the --save format and exit\n"
+      << "  --daemon           Keep the backend loaded and serve clients on a Unix socket\n"
+      << "  --connect          Send topics to a running daemon instead of loading a model\n"
+      << "  --socket <path>    Daemon socket (default: $XDG_RUNTIME_DIR/cppdeepseek.sock)\n"
+      << "  --session <name>   Daemon agent set to use (default: default)\n"
+      << "  --contexts <n>     Local contexts sharing one loaded model; requests run in\n"
+      << "                     parallel up to N (default: 1)\n"
+      << "  --numa             Spread local contexts over NUMA nodes and pin their threads\n"
+      << "  --ctx-size <n>     Local context size in tokens (default: sized from the model\n"
+      << "                     and available memory)\n"
+      << "  --cache-type-k <t> KV cache key type: f16, q8_0, q4_0, ... (default: f16)\n"
+      << "  --cache-type-v <t> KV cache value type; quantized types need flash attention\n"
+      << "  --flash-attn <auto|on|off>  Flash attention for the local backend (default: auto)\n"
+      << "  --no-kv-offload    Keep the KV cache in host memory when offloading layers\n"
+      << "  --prefix-cache-mb <n>  Keep up to n MiB of prefilled prompt KV states in host\n"
+      << "                     memory and reuse them for any prompt sharing a prefix\n"
+      << "  --draft-model <m>  Speculative decoding with a small draft model sharing the\n"
+      << "                     chat model's vocabulary (GGUF path or model name)\n"
+      << "  --draft-max <n>    Tokens the draft model proposes per step (default: 8)\n"
+      << "  --cascade-model <m>  Answer with a small local model first (GGUF path or model\n"
+      << "                     name) and pass unsure answers to the main backend\n"
+      << "  --cascade-threshold <p>  Mean token probability a small-model answer needs\n"
+      << "                     to be kept, in (0, 1] (default: 0.8)\n"
+      << "  --context-budget <n>  Prompt tokens per agent call; older turns are summarized\n"
+      << "                     to fit (default: local context size, 32768 for the API)\n"
+      << "  --no-summarize     Drop old turns that exceed the budget instead of summarizing\n"
+      << "  --retrieval        Send recent turns plus the most relevant older ones instead\n"
+      << "                     of the whole history (index saved as <store>.vec)\n"
+      << "  --retrieval-k <n>  Older messages retrieved per turn (default: 4)\n"
+      << "  --stable-prefix    With --retrieval, keep each prompt's history prefix identical\n"
+      << "                     between turns so prompt caches hit; retrieved turns are\n"
+      << "                     quoted in the new message\n"
+      << "  --embed-model <path>  GGUF embedding model (required for --retrieval with --remote;\n"
+      << "                     default: the local chat model)\n"
+      << "  --semantic-cache <s>  Reuse gate decisions and answers for topics with cosine\n"
+      << "                     similarity >= s to an earlier one, e.g. 0.92 (needs\n"
+      << "                     embeddings, like --retrieval)\n"
+      << "  --metrics <path>   Write per-call latency/token metrics on exit (Prometheus\n"
+      << "                     text for .prom/.txt, JSON otherwise)\n"
+      << "  --batch <path|->   Run JSONL topics (or plain lines) headless and print one JSON\n"
+      << "                     result line per topic as it completes\n"
+      << "  --concurrency <n>  Batch topics in flight at once (default: 4)\n"
+      << "  --deadline-ms <n>  Cancel a topic's remaining calls after n ms (per topic, batch\n"
+      << "                     item and daemon request)\n"
+      << "  --trace <path>     Write a Chrome/Perfetto trace of gate, agent, network, prefill,\n"
+      << "                     decode and save spans on exit\n"
+      << "  --metrics-summary  Print TTFT and tokens/s after every topic\n"
+      << "  --autotune         Benchmark threads/batch sizes for the local model, save the\n"
+      << "                     profile under the model home and exit\n"
       << "  --help             Show this help\n";
   return out.str();
 }
@@ -48,8 +122,76 @@ std::optional<CliOptions> ParseCli(int argc, char** argv, std::string* error_out
       opts.local_only = false;
       continue;
     }
+    if (arg == "--hybrid") {
+      opts.hybrid = true;
+      continue;
+    }
+    if (arg == "--no-kv-state") {
+      opts.kv_state = false;
+      continue;
+    }
+    if (arg == "--no-idle-prefill") {
+      opts.idle_prefill = false;
+      continue;
+    }
+    if (arg == "--daemon") {
+      opts.daemon = true;
+      continue;
+    }
+    if (arg == "--connect") {
+      opts.connect = true;
+      continue;
+    }
+    if (arg == "--convert") {
+      opts.convert = true;
+      continue;
+    }
+    if (arg == "--no-kv-offload") {
+      opts.kv_offload = false;
+      continue;
+    }
+    if (arg == "--retrieval") {
+      opts.retrieval = true;
+      continue;
+    }
+    if (arg == "--optimistic-gate") {
+      opts.optimistic_gate = true;
+      continue;
+    }
+    if (arg == "--all-to-all") {
+      opts.all_to_all = true;
+      continue;
+    }
+    if (arg == "--stable-prefix") {
+      opts.stable_prefix = true;
+      continue;
+    }
+    if (arg == "--no-summarize") {
+      opts.summarize = false;
+      continue;
+    }
+    if (arg == "--numa") {
+      opts.numa = true;
+      continue;
+    }
+    if (arg == "--autotune") {
+      opts.autotune = true;
+      continue;
+    }
+    if (arg == "--metrics-summary") {
+      opts.metrics_summary = true;
+      continue;
+    }
     if (arg == "--topic" || arg == "--model" || arg == "--rounds" || arg == "--gpu-layers" ||
-        arg == "--n-gpu-layers" || arg == "--load" || arg == "--save") {
+        arg == "--n-gpu-layers" || arg == "--load" || arg == "--save" || arg == "--history" ||
+        arg == "--socket" || arg == "--session" || arg == "--contexts" || arg == "--ctx-size" ||
+        arg == "--cache-type-k" || arg == "--cache-type-v" || arg == "--flash-attn" ||
+        arg == "--context-budget" || arg == "--retrieval-k" || arg == "--embed-model" ||
+        arg == "--semantic-cache" || arg == "--metrics" || arg == "--trace" ||
+        arg == "--batch" || arg == "--concurrency" || arg == "--deadline-ms" ||
+        arg == "--prefix-cache-mb" || arg == "--draft-model" || arg == "--draft-max" ||
+        arg == "--local-prompt-limit" || arg == "--cascade-model" ||
+        arg == "--cascade-threshold" || arg == "--fan-in") {
       if (i + 1 >= argc) {
         if (error_out) {
           *error_out = "Missing value for " + arg;
@@ -86,6 +228,233 @@ std::optional<CliOptions> ParseCli(int argc, char** argv, std::string* error_out
         opts.load_path = value;
       } else if (arg == "--save") {
         opts.save_path = value;
+      } else if (arg == "--socket") {
+        opts.socket_path = value;
+      } else if (arg == "--session") {
+        opts.session = value;
+      } else if (arg == "--cache-type-k" || arg == "--cache-type-v") {
+        if (!IsCacheType(value)) {
+          if (error_out) {
+            *error_out = "Invalid KV cache type: " + value;
+          }
+          return std::nullopt;
+        }
+        (arg == "--cache-type-k" ? opts.cache_type_k : opts.cache_type_v) = value;
+      } else if (arg == "--flash-attn") {
+        if (value != "auto" && value != "on" && value != "off") {
+          if (error_out) {
+            *error_out = "flash-attn must be auto, on or off";
+          }
+          return std::nullopt;
+        }
+        opts.flash_attn = value;
+      } else if (arg == "--ctx-size") {
+        try {
+          opts.ctx_size = std::stoi(value);
+        } catch (...) {
+          if (error_out) {
+            *error_out = "Invalid ctx-size value: " + value;
+          }
+          return std::nullopt;
+        }
+        if (opts.ctx_size < 256) {
+          if (error_out) {
+            *error_out = "ctx-size must be >= 256";
+          }
+          return std::nullopt;
+        }
+      } else if (arg == "--semantic-cache") {
+        try {
+          opts.semantic_cache = std::stof(value);
+        } catch (...) {
+          if (error_out) {
+            *error_out = "Invalid semantic-cache value: " + value;
+          }
+          return std::nullopt;
+        }
+        if (opts.semantic_cache <= 0.0f || opts.semantic_cache > 1.0f) {
+          if (error_out) {
+            *error_out = "semantic-cache must be in (0, 1]";
+          }
+          return std::nullopt;
+        }
+      } else if (arg == "--embed-model") {
+        opts.embed_model = value;
+      } else if (arg == "--metrics") {
+        opts.metrics_path = value;
+      } else if (arg == "--trace") {
+        opts.trace_path = value;
+      } else if (arg == "--batch") {
+        opts.batch_path = value;
+      } else if (arg == "--concurrency") {
+        try {
+          opts.concurrency = std::stoi(value);
+        } catch (...) {
+          if (error_out) {
+            *error_out = "Invalid concurrency value: " + value;
+          }
+          return std::nullopt;
+        }
+        if (opts.concurrency <= 0) {
+          if (error_out) {
+            *error_out = "concurrency must be > 0";
+          }
+          return std::nullopt;
+        }
+      } else if (arg == "--deadline-ms") {
+        try {
+          opts.deadline_ms = std::stoi(value);
+        } catch (...) {
+          if (error_out) {
+            *error_out = "Invalid deadline-ms value: " + value;
+          }
+          return std::nullopt;
+        }
+        if (opts.deadline_ms <= 0) {
+          if (error_out) {
+            *error_out = "deadline-ms must be > 0";
+          }
+          return std::nullopt;
+        }
+      } else if (arg == "--prefix-cache-mb") {
+        try {
+          opts.prefix_cache_mb = std::stoi(value);
+        } catch (...) {
+          if (error_out) {
+            *error_out = "Invalid prefix-cache-mb value: " + value;
+          }
+          return std::nullopt;
+        }
+        if (opts.prefix_cache_mb < 0) {
+          if (error_out) {
+            *error_out = "prefix-cache-mb must be >= 0";
+          }
+          return std::nullopt;
+        }
+      } else if (arg == "--local-prompt-limit") {
+        try {
+          opts.local_prompt_limit = std::stoi(value);
+        } catch (...) {
+          if (error_out) {
+            *error_out = "Invalid local-prompt-limit value: " + value;
+          }
+          return std::nullopt;
+        }
+        if (opts.local_prompt_limit <= 0) {
+          if (error_out) {
+            *error_out = "local-prompt-limit must be > 0";
+          }
+          return std::nullopt;
+        }
+      } else if (arg == "--fan-in") {
+        try {
+          opts.fan_in = std::stoi(value);
+        } catch (...) {
+          if (error_out) {
+            *error_out = "Invalid fan-in value: " + value;
+          }
+          return std::nullopt;
+        }
+        if (opts.fan_in <= 0) {
+          if (error_out) {
+            *error_out = "fan-in must be > 0";
+          }
+          return std::nullopt;
+        }
+      } else if (arg == "--cascade-model") {
+        opts.cascade_model = value;
+      } else if (arg == "--cascade-threshold") {
+        try {
+          opts.cascade_threshold = std::stof(value);
+        } catch (...) {
+          if (error_out) {
+            *error_out = "Invalid cascade-threshold value: " + value;
+          }
+          return std::nullopt;
+        }
+        if (opts.cascade_threshold <= 0.0f || opts.cascade_threshold > 1.0f) {
+          if (error_out) {
+            *error_out = "cascade-threshold must be in (0, 1]";
+          }
+          return std::nullopt;
+        }
+      } else if (arg == "--draft-model") {
+        opts.draft_model = value;
+      } else if (arg == "--draft-max") {
+        try {
+          opts.draft_max = std::stoi(value);
+        } catch (...) {
+          if (error_out) {
+            *error_out = "Invalid draft-max value: " + value;
+          }
+          return std::nullopt;
+        }
+        if (opts.draft_max <= 0) {
+          if (error_out) {
+            *error_out = "draft-max must be > 0";
+          }
+          return std::nullopt;
+        }
+      } else if (arg == "--retrieval-k") {
+        try {
+          opts.retrieval_k = std::stoi(value);
+        } catch (...) {
+          if (error_out) {
+            *error_out = "Invalid retrieval-k value: " + value;
+          }
+          return std::nullopt;
+        }
+        if (opts.retrieval_k < 0) {
+          if (error_out) {
+            *error_out = "retrieval-k must be >= 0";
+          }
+          return std::nullopt;
+        }
+      } else if (arg == "--context-budget") {
+        try {
+          opts.context_budget = std::stoi(value);
+        } catch (...) {
+          if (error_out) {
+            *error_out = "Invalid context-budget value: " + value;
+          }
+          return std::nullopt;
+        }
+        if (opts.context_budget < 256) {
+          if (error_out) {
+            *error_out = "context-budget must be >= 256";
+          }
+          return std::nullopt;
+        }
+      } else if (arg == "--contexts") {
+        try {
+          opts.contexts = std::stoi(value);
+        } catch (...) {
+          if (error_out) {
+            *error_out = "Invalid contexts value: " + value;
+          }
+          return std::nullopt;
+        }
+        if (opts.contexts <= 0) {
+          if (error_out) {
+            *error_out = "contexts must be > 0";
+          }
+          return std::nullopt;
+        }
+      } else if (arg == "--history") {
+        try {
+          opts.history = std::stoi(value);
+        } catch (...) {
+          if (error_out) {
+            *error_out = "Invalid history value: " + value;
+          }
+          return std::nullopt;
+        }
+        if (opts.history < 0) {
+          if (error_out) {
+            *error_out = "history must be >= 0";
+          }
+          return std::nullopt;
+        }
       } else {
         try {
           opts.rounds = std::stoi(value);
@@ -109,6 +478,75 @@ std::optional<CliOptions> ParseCli(int argc, char** argv, std::string* error_out
     }
     return std::nullopt;
   }
+  if (opts.daemon && opts.connect) {
+    if (error_out) {
+      *error_out = "--daemon and --connect are mutually exclusive";
+    }
+    return std::nullopt;
+  }
+  if (!opts.batch_path.empty() && (opts.daemon || opts.connect || opts.topic_set)) {
+    if (error_out) {
+      *error_out = "--batch cannot be combined with --daemon, --connect or --topic";
+    }
+    return std::nullopt;
+  }
+  if (opts.convert && (opts.load_path.empty() || opts.save_path.empty())) {
+    if (error_out) {
+      *error_out = "--convert requires --load and --save";
+    }
+    return std::nullopt;
+  }
+  const bool quantized_v = opts.cache_type_v != "f16" && opts.cache_type_v != "f32" &&
+                           opts.cache_type_v != "bf16";
+  if (quantized_v && opts.flash_attn == "off") {
+    if (error_out) {
+      *error_out = "A quantized --cache-type-v requires flash attention";
+    }
+    return std::nullopt;
+  }
+  if ((opts.retrieval || opts.semantic_cache > 0.0f) && !opts.local_only &&
+      opts.embed_model.empty()) {
+    if (error_out) {
+      *error_out = "--retrieval and --semantic-cache with --remote require --embed-model";
+    }
+    return std::nullopt;
+  }
+  if (opts.stable_prefix && !opts.retrieval) {
+    if (error_out) {
+      *error_out = "--stable-prefix requires --retrieval";
+    }
+    return std::nullopt;
+  }
+  if (opts.fan_in > 0 && !opts.all_to_all) {
+    if (error_out) {
+      *error_out = "--fan-in requires --all-to-all";
+    }
+    return std::nullopt;
+  }
+  if (opts.hybrid && !opts.local_only) {
+    if (error_out) {
+      *error_out = "--hybrid already uses the API; drop --remote";
+    }
+    return std::nullopt;
+  }
+  if (opts.local_prompt_limit > 0 && !opts.hybrid) {
+    if (error_out) {
+      *error_out = "--local-prompt-limit requires --hybrid";
+    }
+    return std::nullopt;
+  }
+  if (!opts.draft_model.empty() && !opts.local_only) {
+    if (error_out) {
+      *error_out = "--draft-model requires the local backend";
+    }
+    return std::nullopt;
+  }
+  if (opts.autotune && !opts.local_only) {
+    if (error_out) {
+      *error_out = "--autotune requires the local backend";
+    }
+    return std::nullopt;
+  }
   return opts;
 }
 
@@ -0,0 +1,211 @@
+#include "ContextManager.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <exception>
+#include <iterator>
+#include <limits>
+#include <optional>
+#include <utility>
+
+namespace app {
+namespace {
+
+// Role tags and separators the backends add around each message.
+constexpr size_t kMessageOverhead = 4;
+// Bounds the per-message count cache in very long sessions.
+constexpr size_t kMaxCachedCounts = 1 << 16;
+
+// The headings and length instruction around the turns of a summary request.
+constexpr size_t kSummaryRequestOverhead = 32;
+
+constexpr char kSummaryPrompt[] =
+    "You compress conversation history. Summarize the conversation below so it can replace the"
+    " original turns: keep facts, decisions, open questions and who argued what. Reply with"
+    " the summary only.";
+
+uint64_t Hash(uint64_t hash, std::string_view text) {
+  // FNV-1a; the terminator keeps ("ab", "c") and ("a", "bc") apart.
+  for (unsigned char c : text) {
+    hash ^= c;
+    hash *= 1099511628211ull;
+  }
+  hash ^= 0xff;
+  hash *= 1099511628211ull;
+  return hash;
+}
+
+uint64_t HashMessage(uint64_t hash, const deepseek::Message& message) {
+  return Hash(Hash(hash, message.role), message.content);
+}
+
+constexpr uint64_t kHashSeed = 1469598103934665603ull;
+
+}  // namespace
+
+ContextManager::ContextManager(ContextBudget budget, ChatBackend* summarizer)
+    : budget_(budget), summarizer_(summarizer) {}
+
+size_t ContextManager::CountTokens(const ChatBackend& backend, const deepseek::Message& message) {
+  const uint64_t key = HashMessage(kHashSeed, message);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = token_counts_.find(key);
+    if (it != token_counts_.end()) {
+      return it->second;
+    }
+  }
+  const size_t tokens = (backend.count_tokens ? backend.count_tokens(message.content)
+                                              : (message.content.size() + 3) / 4) +
+                        kMessageOverhead;
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (token_counts_.size() >= kMaxCachedCounts) {
+    token_counts_.clear();
+  }
+  token_counts_.emplace(key, tokens);
+  return tokens;
+}
+
+std::vector<deepseek::Message> ContextManager::Fit(const ChatBackend& backend,
+                                                   std::string_view system_prompt,
+                                                   std::vector<deepseek::Message> messages,
+                                                   ContextStats* stats) {
+  ContextStats local;
+  ContextStats& s = stats ? *stats : local;
+  s = ContextStats{};
+
+  const size_t system_tokens = CountTokens(backend, {"system", std::string(system_prompt), ""});
+  std::vector<size_t> counts(messages.size());
+  s.tokens = system_tokens;
+  for (size_t i = 0; i < messages.size(); ++i) {
+    counts[i] = CountTokens(backend, messages[i]);
+    s.tokens += counts[i];
+  }
+  if (budget_.max_tokens == 0 || s.tokens <= budget_.max_tokens) {
+    return messages;
+  }
+
+  const size_t keep = std::min(messages.size(), std::max<size_t>(1, budget_.keep_recent));
+  const size_t last_cut = messages.size() - keep;
+  const size_t step = std::max<size_t>(1, budget_.compact_step);
+  const bool summarize = budget_.summarize && summarizer_;
+  const size_t reserve = summarize ? budget_.summary_tokens : 0;
+  size_t cut = 0;
+  while (cut < last_cut && s.tokens + reserve > budget_.max_tokens) {
+    const size_t next = std::min(last_cut, cut + step);
+    for (size_t i = cut; i < next; ++i) {
+      s.tokens -= counts[i];
+    }
+    cut = next;
+  }
+  if (cut == 0) {
+    return messages;
+  }
+
+  std::vector<deepseek::Message> fitted;
+  fitted.reserve(messages.size() - cut + 1);
+  if (summarize) {
+    std::string summary = Summary(backend, system_prompt, messages, counts, cut, &s.unsummarized);
+    if (!summary.empty()) {
+      fitted.push_back({"system", "Summary of the earlier conversation: " + summary, ""});
+      s.tokens += CountTokens(backend, fitted.back());
+      s.summarized = true;
+    }
+  }
+  std::move(messages.begin() + static_cast<std::ptrdiff_t>(cut), messages.end(),
+            std::back_inserter(fitted));
+  s.compacted = cut;
+  return fitted;
+}
+
+std::string ContextManager::Summary(const ChatBackend& backend,
+                                    std::string_view system_prompt,
+                                    const std::vector<deepseek::Message>& messages,
+                                    const std::vector<size_t>& counts,
+                                    size_t cut,
+                                    size_t* unsummarized) {
+  *unsummarized = 0;
+  std::vector<uint64_t> prefix(cut + 1);
+  prefix[0] = Hash(kHashSeed, system_prompt);
+  for (size_t i = 0; i < cut; ++i) {
+    prefix[i + 1] = HashMessage(prefix[i], messages[i]);
+  }
+
+  // Roll forward from the longest prefix that already has a summary.
+  size_t from = 0;
+  std::string previous;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t n = cut; n > 0; --n) {
+      auto it = summaries_.find(prefix[n]);
+      if (it != summaries_.end()) {
+        if (n == cut) {
+          return it->second;
+        }
+        from = n;
+        previous = it->second;
+        break;
+      }
+    }
+  }
+
+  // A long (e.g. freshly loaded) history does not fit one request; fold it
+  // in chunks that fit next to the instructions and the summary so far.
+  const size_t limit = budget_.summarizer_tokens;
+  const size_t fixed =
+      CountTokens(backend, {"system", kSummaryPrompt, ""}) + kSummaryRequestOverhead;
+  while (from < cut) {
+    const size_t used =
+        fixed + (previous.empty() ? 0 : CountTokens(backend, {"system", previous, ""}));
+    if (limit > 0 && used >= limit) {
+      break;
+    }
+    const size_t room = limit > 0 ? limit - used : std::numeric_limits<size_t>::max();
+
+    std::string request;
+    if (!previous.empty()) {
+      request.append("Summary so far:\n").append(previous).append("\n\n");
+    }
+    request.append("Conversation:\n");
+    size_t end = from;
+    size_t tokens = 0;
+    while (end < cut && tokens + counts[end] <= room) {
+      tokens += counts[end];
+      request.append(messages[end].role).append(": ").append(messages[end].content).append("\n");
+      ++end;
+    }
+    if (end == from) {
+      // A single message longer than the summarizer's context: keep its start.
+      const auto& message = messages[from];
+      const size_t bytes = message.content.size() * room / counts[from];
+      request.append(message.role)
+          .append(": ")
+          .append(message.content, 0, bytes)
+          .append(" [...]\n");
+      end = from + 1;
+    }
+    request.append("\nKeep the summary under ")
+        .append(std::to_string(budget_.summary_tokens * 3 / 4))
+        .append(" words.");
+
+    std::optional<deepseek::ChatResponse> response;
+    try {
+      std::string error;
+      response = summarizer_->chat({{"user", request, ""}}, kSummaryPrompt, nullptr, &error);
+    } catch (const std::exception&) {
+      // Same as a failed reply: the turns are dropped for this call.
+    }
+    if (!response || response->content.empty()) {
+      break;
+    }
+    previous = std::move(response->content);
+    from = end;
+    std::lock_guard<std::mutex> lock(mutex_);
+    summaries_[prefix[from]] = previous;
+  }
+  // Keep the older summary (or none) for now; the next call retries the rest.
+  *unsummarized = cut - from;
+  return previous;
+}
+
+}  // namespace app
@@ -0,0 +1,468 @@
+#include "Daemon.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <utility>
+
+#if !defined(_WIN32)
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace app {
+namespace {
+
+constexpr size_t kMaxRequestBytes = 1 << 20;
+constexpr int kAcceptPollMs = 200;
+constexpr int kRequestTimeoutSec = 10;
+
+#if !defined(_WIN32)
+
+bool MakeAddress(std::string_view path, sockaddr_un* addr, std::string* error_out) {
+  std::memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr->sun_path)) {
+    if (error_out) {
+      *error_out = "Socket path too long: " + std::string(path);
+    }
+    return false;
+  }
+  std::memcpy(addr->sun_path, path.data(), path.size());
+  return true;
+}
+
+bool WriteAll(int fd, std::string_view data) {
+  while (!data.empty()) {
+    const ssize_t n = ::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+    if (n <= 0) {
+      return false;
+    }
+    data.remove_prefix(static_cast<size_t>(n));
+  }
+  return true;
+}
+
+// Reads newline-delimited lines from a socket.
+class LineReader {
+ public:
+  explicit LineReader(int fd) : fd_(fd) {}
+
+  bool Next(std::string* line) {
+    while (true) {
+      const size_t nl = buffer_.find('\n');
+      if (nl != std::string::npos) {
+        line->assign(buffer_, 0, nl);
+        buffer_.erase(0, nl + 1);
+        return true;
+      }
+      if (buffer_.size() > kMaxRequestBytes) {
+        return false;
+      }
+      char chunk[4096];
+      const ssize_t n = ::recv(fd_, chunk, sizeof(chunk), 0);
+      if (n <= 0) {
+        return false;
+      }
+      buffer_.append(chunk, static_cast<size_t>(n));
+    }
+  }
+
+ private:
+  int fd_;
+  std::string buffer_;
+};
+
+// Length of the longest prefix of `text` that does not end inside a UTF-8
+// sequence. Invalid bytes count as complete; the JSON dump replaces them.
+size_t CompleteUtf8Length(std::string_view text) {
+  for (size_t back = 1; back <= std::min<size_t>(4, text.size()); ++back) {
+    const auto c = static_cast<unsigned char>(text[text.size() - back]);
+    if ((c & 0xC0) == 0x80) {
+      continue;
+    }
+    const size_t need = (c & 0xE0) == 0xC0   ? 2
+                        : (c & 0xF0) == 0xE0 ? 3
+                        : (c & 0xF8) == 0xF0 ? 4
+                                             : 1;
+    return back >= need ? text.size() : text.size() - back;
+  }
+  return text.size();
+}
+
+// Appends `piece` to `pending` and takes out everything up to the last
+// complete character.
+std::string TakeCompleteUtf8(std::string* pending, std::string_view piece) {
+  pending->append(piece);
+  const size_t n = CompleteUtf8Length(*pending);
+  std::string out = pending->substr(0, n);
+  pending->erase(0, n);
+  return out;
+}
+
+#endif
+
+}  // namespace
+
+DaemonServer::DaemonServer(std::string socket_path,
+                           std::function<std::vector<Agent>()> make_agents,
+                           DaemonHandler handler)
+    : socket_path_(std::move(socket_path)),
+      make_agents_(std::move(make_agents)),
+      handler_(std::move(handler)) {}
+
+DaemonServer::~DaemonServer() { Stop(); }
+
+#if !defined(_WIN32)
+
+bool DaemonServer::Start(std::string* error_out) {
+  sockaddr_un addr{};
+  if (!MakeAddress(socket_path_, &addr, error_out)) {
+    return false;
+  }
+
+  // A socket file nobody accepts on is left over from a crashed daemon.
+  const int probe = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (probe >= 0) {
+    const bool live = ::connect(probe, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+    ::close(probe);
+    if (live) {
+      if (error_out) {
+        *error_out = "A daemon is already listening on " + socket_path_;
+      }
+      return false;
+    }
+  }
+  ::unlink(socket_path_.c_str());
+
+  listen_fd_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listen_fd_ < 0 || ::bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+      ::chmod(socket_path_.c_str(), 0600) != 0 || ::listen(listen_fd_, 16) != 0) {
+    if (error_out) {
+      *error_out = "Failed to listen on " + socket_path_ + ": " + std::strerror(errno);
+    }
+    if (listen_fd_ >= 0) {
+      ::close(listen_fd_);
+      listen_fd_ = -1;
+    }
+    return false;
+  }
+
+  stopping_ = false;
+  accept_thread_ = std::thread([this]() { AcceptLoop(); });
+  return true;
+}
+
+void DaemonServer::Stop() {
+  if (listen_fd_ < 0) {
+    return;
+  }
+  stopping_ = true;
+  if (accept_thread_.joinable()) {
+    accept_thread_.join();
+  }
+  {
+    std::unique_lock<std::mutex> lock(workers_mutex_);
+    workers_cv_.wait(lock, [this]() { return active_workers_ == 0; });
+  }
+  ::close(listen_fd_);
+  listen_fd_ = -1;
+  ::unlink(socket_path_.c_str());
+}
+
+void DaemonServer::AcceptLoop() {
+  while (!stopping_) {
+    pollfd pfd{listen_fd_, POLLIN, 0};
+    if (::poll(&pfd, 1, kAcceptPollMs) <= 0) {
+      continue;
+    }
+    const int fd = ::accept(listen_fd_, nullptr, nullptr);
+    if (fd < 0) {
+      continue;
+    }
+    // Don't let a client that never sends its request pin a worker (and Stop).
+    timeval timeout{kRequestTimeoutSec, 0};
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    {
+      std::lock_guard<std::mutex> lock(workers_mutex_);
+      ++active_workers_;
+    }
+    std::thread([this, fd]() {
+      Serve(fd);
+      ::close(fd);
+      std::lock_guard<std::mutex> lock(workers_mutex_);
+      --active_workers_;
+      workers_cv_.notify_all();
+    }).detach();
+  }
+}
+
+void DaemonServer::Serve(int fd) {
+  std::mutex write_mutex;
+  const auto send_event = [&](const nlohmann::json& event) {
+    std::lock_guard<std::mutex> lock(write_mutex);
+    WriteAll(fd, event.dump(-1, ' ', false, nlohmann::json::error_handler_t::replace) + "\n");
+  };
+
+  LineReader reader(fd);
+  std::string line;
+  if (!reader.Next(&line)) {
+    return;
+  }
+
+  DaemonRequest request;
+  try {
+    const auto j = nlohmann::json::parse(line);
+    request.session = j.value("session", request.session);
+    request.topic = j.value("topic", "");
+    request.rounds = j.value("rounds", request.rounds);
+    request.stream = j.value("stream", request.stream);
+    request.reset = j.value("reset", false);
+    request.deadline_ms = j.value("deadline_ms", 0);
+  } catch (const std::exception& ex) {
+    send_event({{"type", "done"}, {"ok", false}, {"error", std::string("Bad request: ") + ex.what()}});
+    return;
+  }
+
+  // Local token pieces can split a multi-byte character; hold the partial
+  // bytes back until the rest of the character arrives.
+  std::mutex pending_mutex;
+  std::map<std::string, std::pair<std::string, std::string>> pending;
+  DaemonEvents events;
+  events.on_delta = [&](const std::string& agent, std::string_view reasoning,
+                        std::string_view content) {
+    std::string reasoning_text;
+    std::string content_text;
+    {
+      std::lock_guard<std::mutex> lock(pending_mutex);
+      auto& [pending_reasoning, pending_content] = pending[agent];
+      reasoning_text = TakeCompleteUtf8(&pending_reasoning, reasoning);
+      content_text = TakeCompleteUtf8(&pending_content, content);
+    }
+    if (reasoning_text.empty() && content_text.empty() && !(reasoning.empty() && content.empty())) {
+      return;
+    }
+    send_event({{"type", "delta"},
+                {"agent", agent},
+                {"reasoning", reasoning_text},
+                {"content", content_text}});
+  };
+  events.on_result = [&](const AgentResult& result) {
+    {
+      std::lock_guard<std::mutex> lock(pending_mutex);
+      pending.erase(result.name);
+    }
+    nlohmann::json event{{"type", "result"},
+                         {"agent", result.name},
+                         {"reasoning", result.response.reasoning},
+                         {"content", result.response.content}};
+    if (result.cache_score) {
+      event["cache_score"] = *result.cache_score;
+    }
+    send_event(event);
+  };
+
+  // Clients send nothing after the request, so a readable socket means the
+  // client hung up: cancel the request instead of generating for nobody.
+  // Cancelled agents keep their memory unchanged.
+  CancelToken disconnected;
+  events.cancel = &disconnected;
+  std::atomic<bool> finished{false};
+  std::thread watcher([&]() {
+    pollfd pfd{fd, POLLIN, 0};
+    while (!finished.load()) {
+      if (::poll(&pfd, 1, kAcceptPollMs) > 0) {
+        char c = 0;
+        if (::recv(fd, &c, 1, MSG_PEEK) <= 0) {
+          disconnected.Cancel();
+        }
+        return;
+      }
+    }
+  });
+
+  auto session = GetSession(request.session);
+  std::string error;
+  bool ok = false;
+  bool cancelled = false;
+  {
+    std::lock_guard<std::mutex> lock(session->mutex);
+    if (request.reset) {
+      session->agents = make_agents_();
+    }
+    try {
+      ok = handler_(request, session->agents, events, &error);
+    } catch (const CancelledError& ex) {
+      error = ex.what();
+      cancelled = true;
+    } catch (const std::exception& ex) {
+      error = ex.what();
+      ok = false;
+    }
+  }
+  finished = true;
+  watcher.join();
+  nlohmann::json done{{"type", "done"}, {"ok", ok}};
+  if (!ok) {
+    done["error"] = error;
+  }
+  if (cancelled) {
+    done["cancelled"] = true;
+  }
+  send_event(done);
+}
+
+bool RunDaemonClient(std::string_view socket_path,
+                     const DaemonRequest& request,
+                     const DaemonEvents& events,
+                     std::string* error_out) {
+  sockaddr_un addr{};
+  if (!MakeAddress(socket_path, &addr, error_out)) {
+    return false;
+  }
+  const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+    if (error_out) {
+      *error_out = "Failed to connect to daemon at " + std::string(socket_path) + ": " +
+                   std::strerror(errno);
+    }
+    if (fd >= 0) {
+      ::close(fd);
+    }
+    return false;
+  }
+
+  const nlohmann::json j{{"session", request.session},
+                         {"topic", request.topic},
+                         {"rounds", request.rounds},
+                         {"stream", request.stream},
+                         {"reset", request.reset},
+                         {"deadline_ms", request.deadline_ms}};
+  if (!WriteAll(fd, j.dump() + "\n")) {
+    ::close(fd);
+    if (error_out) {
+      *error_out = "Failed to send request to daemon.";
+    }
+    return false;
+  }
+
+  LineReader reader(fd);
+  std::string line;
+  bool ok = false;
+  bool done = false;
+  while (!done && reader.Next(&line)) {
+    nlohmann::json event;
+    try {
+      event = nlohmann::json::parse(line);
+    } catch (const std::exception& ex) {
+      if (error_out) {
+        *error_out = std::string("Invalid daemon event: ") + ex.what();
+      }
+      break;
+    }
+    const std::string type = event.value("type", "");
+    if (type == "delta") {
+      if (events.on_delta) {
+        events.on_delta(event.value("agent", ""), event.value("reasoning", ""),
+                        event.value("content", ""));
+      }
+    } else if (type == "result") {
+      if (events.on_result) {
+        AgentResult result;
+        result.name = event.value("agent", "");
+        result.response.reasoning = event.value("reasoning", "");
+        result.response.content = event.value("content", "");
+        if (event.contains("cache_score")) {
+          result.cache_score = event.value("cache_score", 0.0f);
+        }
+        events.on_result(result);
+      }
+    } else if (type == "done") {
+      done = true;
+      ok = event.value("ok", false);
+      if (!ok && error_out) {
+        *error_out = event.value("error", "Request failed.");
+      }
+    }
+  }
+  ::close(fd);
+  if (!done && error_out && error_out->empty()) {
+    *error_out = "Daemon closed the connection.";
+  }
+  return ok;
+}
+
+std::string DefaultDaemonSocketPath() {
+  if (const char* runtime_dir = std::getenv("XDG_RUNTIME_DIR");
+      runtime_dir && std::string(runtime_dir).size() > 0) {
+    return std::string(runtime_dir) + "/cppdeepseek.sock";
+  }
+  return "/tmp/cppdeepseek-" + std::to_string(::getuid()) + ".sock";
+}
+
+#else
+
+bool DaemonServer::Start(std::string* error_out) {
+  if (error_out) {
+    *error_out = "Daemon mode requires Unix domain sockets.";
+  }
+  return false;
+}
+
+void DaemonServer::Stop() {}
+
+void DaemonServer::AcceptLoop() {}
+
+void DaemonServer::Serve(int) {}
+
+bool RunDaemonClient(std::string_view, const DaemonRequest&, const DaemonEvents&,
+                     std::string* error_out) {
+  if (error_out) {
+    *error_out = "Daemon mode requires Unix domain sockets.";
+  }
+  return false;
+}
+
+std::string DefaultDaemonSocketPath() { return {}; }
+
+#endif
+
+void DaemonServer::Wait(const std::atomic<bool>* stop_flag) {
+  while (!stopping_ && !(stop_flag && *stop_flag)) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(kAcceptPollMs));
+  }
+}
+
+void DaemonServer::SetAgents(const std::string& session, std::vector<Agent> agents) {
+  auto s = GetSession(session);
+  std::lock_guard<std::mutex> lock(s->mutex);
+  s->agents = std::move(agents);
+}
+
+std::vector<Agent> DaemonServer::Agents(const std::string& session) {
+  auto s = GetSession(session);
+  std::lock_guard<std::mutex> lock(s->mutex);
+  return s->agents;
+}
+
+std::shared_ptr<DaemonServer::Session> DaemonServer::GetSession(const std::string& name) {
+  std::lock_guard<std::mutex> lock(sessions_mutex_);
+  auto& session = sessions_[name];
+  if (!session) {
+    session = std::make_shared<Session>();
+    session->agents = make_agents_();
+  }
+  return session;
+}
+
+}  // namespace app
@@ -1,9 +1,12 @@
 #include "DeepSeekClient.hpp"
 #include "DeepSeekStreamParser.hpp"
+#include "Trace.hpp"
 
 #include <curl/curl.h>
 #include <nlohmann/json.hpp>
 
+#include <algorithm>
+#include <chrono>
 #include <string>
 
 namespace deepseek {
@@ -23,11 +26,46 @@ size_t WriteToString(void* ptr, size_t size, size_t nmemb, void* userdata) {
   return size * nmemb;
 }
 
+using Clock = std::chrono::steady_clock;
+
+double MsSince(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
 struct StreamState {
   DeepSeekStreamParser parser;
   std::string* error_out = nullptr;
 };
 
+void ReadTransfer(CURL* curl, CallMetrics* metrics) {
+  curl_off_t value = 0;
+  if (curl_easy_getinfo(curl, CURLINFO_SIZE_UPLOAD_T, &value) == CURLE_OK) {
+    metrics->bytes_sent = static_cast<size_t>(value);
+  }
+  if (curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &value) == CURLE_OK) {
+    metrics->bytes_received = static_cast<size_t>(value);
+  }
+}
+
+void ReadUsage(const nlohmann::json& usage, CallMetrics* metrics) {
+  if (!usage.is_object()) {
+    return;
+  }
+  metrics->prompt_tokens = usage.value("prompt_tokens", size_t{0});
+  metrics->completion_tokens = usage.value("completion_tokens", size_t{0});
+  metrics->cache_hit_tokens = usage.value("prompt_cache_hit_tokens", size_t{0});
+  metrics->cache_miss_tokens = usage.value("prompt_cache_miss_tokens", size_t{0});
+  if (usage.contains("completion_tokens_details") &&
+      usage["completion_tokens_details"].is_object()) {
+    metrics->reasoning_tokens =
+        usage["completion_tokens_details"].value("reasoning_tokens", size_t{0});
+  }
+  // The server only evaluates the part of the prompt missing from its cache.
+  metrics->prefill_tokens = usage.contains("prompt_cache_miss_tokens") ? metrics->cache_miss_tokens
+                                                                       : metrics->prompt_tokens;
+  metrics->decode_tokens = metrics->completion_tokens;
+}
+
 size_t StreamWriteCallback(void* ptr, size_t size, size_t nmemb, void* userdata) {
   auto* state = static_cast<StreamState*>(userdata);
   const size_t total = size * nmemb;
@@ -38,6 +76,40 @@ size_t StreamWriteCallback(void* ptr, size_t size, size_t nmemb, void* userdata)
   return total;
 }
 
+int AbortIfStopped(void* userdata, curl_off_t, curl_off_t, curl_off_t, curl_off_t) {
+  return static_cast<const CallControl*>(userdata)->should_stop() ? 1 : 0;
+}
+
+// The transfer timeout is capped by the deadline, and the progress callback
+// (called at least once a second, and on every chunk) polls for cancellation.
+void ApplyControl(CURL* curl, long timeout_ms, const CallControl* control) {
+  if (control && control->deadline) {
+    const long remaining = static_cast<long>(
+        std::chrono::duration_cast<std::chrono::milliseconds>(*control->deadline - Clock::now())
+            .count());
+    if (timeout_ms <= 0 || remaining < timeout_ms) {
+      timeout_ms = std::max(1L, remaining);
+    }
+  }
+  curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, timeout_ms);
+  if (control) {
+    curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, AbortIfStopped);
+    curl_easy_setopt(curl, CURLOPT_XFERINFODATA, control);
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+  }
+}
+
+// Replaces the transfer error of a call that was stopped on purpose.
+bool ReportStopped(const CallControl* control, std::string* error_out) {
+  if (!control || !control->should_stop()) {
+    return false;
+  }
+  if (error_out) {
+    *error_out = control->deadline_exceeded() ? "Deadline exceeded." : "Cancelled.";
+  }
+  return true;
+}
+
 bool CheckHttpStatus(long status, std::string* error_out) {
   if (status == 200) {
     return true;
@@ -59,6 +131,14 @@ bool CheckHttpStatus(long status, std::string* error_out) {
 
 }  // namespace
 
+bool CallControl::deadline_exceeded() const {
+  return deadline && Clock::now() >= *deadline;
+}
+
+bool CallControl::should_stop() const {
+  return (cancelled && cancelled()) || deadline_exceeded();
+}
+
 DeepSeekClient::DeepSeekClient(std::string api_key, std::string model, std::string base_url)
     : api_key_(std::move(api_key)),
       model_(std::move(model)),
@@ -68,7 +148,11 @@ void DeepSeekClient::set_timeout_ms(long timeout_ms) { timeout_ms_ = timeout_ms;
 
 std::optional<ChatResponse> DeepSeekClient::chat(const std::vector<Message>& messages,
                                                  std::string_view system_prompt,
+                                                 CallMetrics* metrics,
+                                                 const CallControl* control,
                                                  std::string* error_out) const {
+  app::TraceSpan span("DeepSeekClient::chat", model_);
+  const auto start = Clock::now();
   nlohmann::json payload;
   payload["model"] = model_;
   payload["messages"] = nlohmann::json::array();
@@ -95,18 +179,27 @@ std::optional<ChatResponse> DeepSeekClient::chat(const std::vector<Message>& mes
   curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
   curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
   curl_easy_setopt(curl, CURLOPT_POSTFIELDS, payload_str.c_str());
-  curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, timeout_ms_);
+  ApplyControl(curl, timeout_ms_, control);
   curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteToString);
   curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
 
   CURLcode res = curl_easy_perform(curl);
   long status = 0;
   curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+  if (metrics) {
+    metrics->backend = "remote";
+    ReadTransfer(curl, metrics);
+    curl_off_t first_byte_us = 0;
+    if (curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME_T, &first_byte_us) == CURLE_OK) {
+      metrics->ttft_ms = static_cast<double>(first_byte_us) / 1000.0;
+    }
+    metrics->total_ms = MsSince(start);
+  }
   curl_slist_free_all(headers);
   curl_easy_cleanup(curl);
 
   if (res != CURLE_OK) {
-    if (error_out) {
+    if (!ReportStopped(control, error_out) && error_out) {
       *error_out = std::string("CURL error: ") + curl_easy_strerror(res);
     }
     return std::nullopt;
@@ -137,6 +230,9 @@ std::optional<ChatResponse> DeepSeekClient::chat(const std::vector<Message>& mes
     out.reasoning = message.value("reasoning_content", "");
     out.content = message.value("content", "");
   }
+  if (metrics && j.contains("usage")) {
+    ReadUsage(j["usage"], metrics);
+  }
 
   return out;
 }
@@ -144,17 +240,33 @@ std::optional<ChatResponse> DeepSeekClient::chat(const std::vector<Message>& mes
 bool DeepSeekClient::stream_chat(const std::vector<Message>& messages,
                                  std::string_view system_prompt,
                                  const StreamCallback& on_delta,
+                                 CallMetrics* metrics,
+                                 const CallControl* control,
                                  std::string* error_out) const {
+  app::TraceSpan span("DeepSeekClient::stream_chat", model_);
+  const auto start = Clock::now();
   nlohmann::json payload;
   payload["model"] = model_;
   payload["stream"] = true;
+  if (metrics) {
+    payload["stream_options"] = {{"include_usage", true}};
+  }
   payload["messages"] = nlohmann::json::array();
   payload["messages"].push_back({{"role", "system"}, {"content", system_prompt}});
   for (const auto& msg : messages) {
     payload["messages"].push_back({{"role", msg.role}, {"content", msg.content}});
   }
 
-  StreamState state{DeepSeekStreamParser(on_delta), error_out};
+  std::optional<double> first_token_ms;
+  StreamState state{DeepSeekStreamParser([&](std::string_view reasoning_delta,
+                                             std::string_view content_delta) {
+                      if (!first_token_ms) {
+                        first_token_ms = MsSince(start);
+                      }
+                      on_delta(reasoning_delta, content_delta);
+                    },
+                    [control]() { return control && control->should_stop(); }),
+                    error_out};
 
   CURL* curl = curl_easy_init();
   if (!curl) {
@@ -174,18 +286,32 @@ bool DeepSeekClient::stream_chat(const std::vector<Message>& messages,
   curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
   curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
   curl_easy_setopt(curl, CURLOPT_POSTFIELDS, payload_str.c_str());
-  curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, timeout_ms_);
+  ApplyControl(curl, timeout_ms_, control);
   curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, StreamWriteCallback);
   curl_easy_setopt(curl, CURLOPT_WRITEDATA, &state);
 
   CURLcode res = curl_easy_perform(curl);
   long status = 0;
   curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+  if (metrics) {
+    metrics->backend = "remote";
+    ReadTransfer(curl, metrics);
+    metrics->total_ms = MsSince(start);
+    if (!state.parser.usage().empty()) {
+      ReadUsage(nlohmann::json::parse(state.parser.usage()), metrics);
+    }
+    if (first_token_ms) {
+      // Time to the first token is dominated by server-side prefill.
+      metrics->ttft_ms = *first_token_ms;
+      metrics->prefill_ms = *first_token_ms;
+      metrics->decode_ms = metrics->total_ms - *first_token_ms;
+    }
+  }
   curl_slist_free_all(headers);
   curl_easy_cleanup(curl);
 
   if (res != CURLE_OK) {
-    if (error_out && error_out->empty()) {
+    if (!ReportStopped(control, error_out) && error_out && error_out->empty()) {
       *error_out = std::string("CURL error: ") + curl_easy_strerror(res);
     }
     return false;
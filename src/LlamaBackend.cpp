@@ -1,18 +1,62 @@
 #include "LlamaBackend.hpp"
 
+#include "GgufInfo.hpp"
+#include "Trace.hpp"
+
+#include <ggml-cpu.h>
 #include <llama.h>
 
 #include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <optional>
 #include <thread>
 #include <stdexcept>
 #include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
 namespace app {
 namespace {
 
-std::string BuildPrompt(const std::vector<deepseek::Message>& messages,
-                        std::string_view system_prompt) {
+// Sequences of a context share its unified KV cache. Each holds the tokens of a recent
+// prompt so a follow-up prompt with the same prefix only decodes its tail.
+constexpr int kMaxSequences = 8;
+// Extra sequence id that holds retained history while ShiftCached moves it.
+constexpr llama_seq_id kShiftSequence = kMaxSequences;
+
+// Restoring a cached state costs a copy of the whole sequence, so it has to
+// save at least this many prefill tokens; shorter prompts are not stored.
+constexpr size_t kMinPrefixTokens = 64;
+
+// ShiftCached looks runs up by hashes of this many tokens and only moves
+// runs of at least kMinShiftRun tokens.
+constexpr size_t kShiftGram = 16;
+constexpr size_t kMinShiftRun = 64;
+
+// Tokens per embedded text; longer texts are truncated.
+constexpr uint32_t kEmbedContext = 512;
+
+constexpr char kStateMagic[4] = {'C', 'D', 'K', 'V'};
+constexpr uint32_t kStateVersion = 1;
+
+// Autotune workload: one prefill of this many tokens, then single-token
+// decode steps.
+constexpr size_t kTunePromptTokens = 512;
+constexpr int kTuneDecodeTokens = 32;
+
+std::string RenderHistory(const std::vector<deepseek::Message>& messages,
+                          std::string_view system_prompt) {
   std::string prompt;
   prompt.reserve(1024);
   // Minimal role-tagged prompt. Keep it predictable for local inference.
@@ -26,20 +70,394 @@ std::string BuildPrompt(const std::vector<deepseek::Message>& messages,
       prompt.append("Message: ").append(msg.content).append("\n");
     }
   }
-  prompt.append("Assistant:");
   return prompt;
 }
 
-std::string Generate(llama_context* ctx,
-                     llama_model* model,
-                     llama_sampler* sampler,
-                     std::string_view prompt,
-                     int max_tokens) {
-  std::vector<llama_token> tokens(prompt.size() + max_tokens + 4);
-  const llama_vocab* vocab = llama_model_get_vocab(model);
+std::string BuildPrompt(const std::vector<deepseek::Message>& messages,
+                        std::string_view system_prompt) {
+  return RenderHistory(messages, system_prompt).append("Assistant:");
+}
+
+uint64_t HashTokens(const llama_token* tokens, size_t n) {
+  // FNV-1a over the token ids.
+  uint64_t hash = 1469598103934665603ull;
+  const auto* bytes = reinterpret_cast<const unsigned char*>(tokens);
+  for (size_t i = 0; i < n * sizeof(llama_token); ++i) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+size_t CommonPrefix(const std::vector<llama_token>& a, const std::vector<llama_token>& b) {
+  const size_t n = std::min(a.size(), b.size());
+  size_t i = 0;
+  while (i < n && a[i] == b[i]) {
+    ++i;
+  }
+  return i;
+}
+
+class Batch {
+ public:
+  explicit Batch(int32_t capacity) : batch_(llama_batch_init(capacity, 0, 1)) {}
+  ~Batch() { llama_batch_free(batch_); }
+  Batch(const Batch&) = delete;
+  Batch& operator=(const Batch&) = delete;
+
+  llama_batch& get() { return batch_; }
+
+ private:
+  llama_batch batch_;
+};
+
+// Decodes tokens[from, to) into sequence 0 of `ctx` at their own positions,
+// with logits for the last one. On failure the sequence is cut back to `from`.
+bool DecodeRange(llama_context* ctx,
+                 const std::vector<llama_token>& tokens,
+                 size_t from,
+                 size_t to) {
+  const size_t n_batch = llama_n_batch(ctx);
+  Batch batch((int32_t)n_batch);
+  for (size_t start = from; start < to; start += n_batch) {
+    const size_t end = std::min(to, start + n_batch);
+    llama_batch& b = batch.get();
+    b.n_tokens = 0;
+    for (size_t i = start; i < end; ++i) {
+      const int32_t j = b.n_tokens++;
+      b.token[j] = tokens[i];
+      b.pos[j] = (llama_pos)i;
+      b.n_seq_id[j] = 1;
+      b.seq_id[j][0] = 0;
+      b.logits[j] = (i + 1 == to);
+    }
+    if (llama_decode(ctx, b) != 0) {
+      llama_memory_seq_rm(llama_get_memory(ctx), 0, (llama_pos)from, -1);
+      return false;
+    }
+  }
+  return true;
+}
+
+// Natural log of the probability the logits at batch index `idx` give
+// `token`.
+double TokenLogProb(llama_context* ctx, int32_t idx, llama_token token, int32_t n_vocab) {
+  const float* logits = llama_get_logits_ith(ctx, idx);
+  const float max = *std::max_element(logits, logits + n_vocab);
+  double sum = 0.0;
+  for (int32_t i = 0; i < n_vocab; ++i) {
+    sum += std::exp(static_cast<double>(logits[i] - max));
+  }
+  return static_cast<double>(logits[token] - max) - std::log(sum);
+}
+
+// Draft proposals are compared by token id, so both models need the same
+// vocabulary.
+bool SameVocab(const llama_model* a, const llama_model* b) {
+  const llama_vocab* va = llama_model_get_vocab(a);
+  const llama_vocab* vb = llama_model_get_vocab(b);
+  return llama_vocab_type(va) == llama_vocab_type(vb) &&
+         llama_vocab_n_tokens(va) == llama_vocab_n_tokens(vb) &&
+         llama_vocab_bos(va) == llama_vocab_bos(vb) && llama_vocab_eos(va) == llama_vocab_eos(vb);
+}
+
+template <typename T>
+void WritePod(std::ostream& out, const T& value) {
+  out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+bool ReadPod(std::istream& in, T* value) {
+  return static_cast<bool>(in.read(reinterpret_cast<char*>(value), sizeof(T)));
+}
+
+// A threadpool whose workers are bound to the first `n_threads` of `cpus`
+// (unpinned if `cpus` is empty). Returns nullptr on failure.
+ggml_threadpool* NewThreadpool(int n_threads, const std::vector<int>& cpus) {
+  ggml_threadpool_params params = ggml_threadpool_params_default(n_threads);
+  for (int i = 0; i < n_threads && i < (int)cpus.size(); ++i) {
+    if (cpus[i] < GGML_MAX_N_THREADS) {
+      params.cpumask[cpus[i]] = true;
+      params.strict_cpu = true;
+    }
+  }
+  // Decode and prefill pools alternate; don't let the idle one spin.
+  params.poll = 0;
+  return ggml_threadpool_new(&params);
+}
+
+// Fills the settings the caller left at zero from a saved profile.
+void ApplyProfile(const ThreadProfile& profile, LlamaOptions* options) {
+  if (options->n_threads <= 0 && profile.n_threads > 0) {
+    options->n_threads = profile.n_threads;
+    options->pin_threads = profile.pin_threads;
+  }
+  if (options->n_threads_batch <= 0 && profile.n_threads_batch > 0) {
+    options->n_threads_batch = profile.n_threads_batch;
+    options->pin_threads_batch = profile.pin_threads_batch;
+  }
+  if (options->n_batch <= 0) {
+    options->n_batch = profile.n_batch;
+  }
+  if (options->n_ubatch <= 0) {
+    options->n_ubatch = profile.n_ubatch;
+  }
+}
+
+ggml_type CacheType(const std::string& name) {
+  const auto type = deepseek::GgmlTypeFromName(name);
+  if (!type) {
+    throw std::runtime_error("Unknown KV cache type: " + name);
+  }
+  return static_cast<ggml_type>(*type);
+}
+
+llama_flash_attn_type FlashAttnType(const std::string& mode) {
+  if (mode == "on") {
+    return LLAMA_FLASH_ATTN_TYPE_ENABLED;
+  }
+  if (mode == "off") {
+    return LLAMA_FLASH_ATTN_TYPE_DISABLED;
+  }
+  return LLAMA_FLASH_ATTN_TYPE_AUTO;
+}
+
+LlamaOptions MakeOptions(int n_ctx, int n_threads, int n_gpu_layers) {
+  LlamaOptions options;
+  options.n_ctx = n_ctx;
+  options.n_threads = n_threads;
+  options.n_gpu_layers = n_gpu_layers;
+  return options;
+}
+
+// Runs `fn` on a thread bound to `cpus`, so the buffers it first touches
+// (a new context's KV cache and compute buffers) land on their NUMA node.
+void RunPinned(const std::vector<int>& cpus, const std::function<void()>& fn) {
+#if defined(__linux__)
+  if (!cpus.empty()) {
+    std::exception_ptr error;
+    std::thread worker([&]() {
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      for (int cpu : cpus) {
+        CPU_SET(cpu, &set);
+      }
+      pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+      try {
+        fn();
+      } catch (...) {
+        error = std::current_exception();
+      }
+    });
+    worker.join();
+    if (error) {
+      std::rethrow_exception(error);
+    }
+    return;
+  }
+#endif
+  (void)cpus;
+  fn();
+}
+
+}  // namespace
+
+LlamaBackend::LlamaBackend(std::string model_path,
+                           int n_ctx,
+                           int n_threads,
+                           int n_gpu_layers)
+    : LlamaBackend(std::move(model_path), MakeOptions(n_ctx, n_threads, n_gpu_layers)) {}
+
+LlamaBackend::LlamaBackend(std::string model_path, const LlamaOptions& options)
+    : model_path_(std::move(model_path)), options_(options), topology_(DetectCpuTopology()) {
+  // Silence llama.cpp logs to keep demo output readable.
+  llama_log_set([](ggml_log_level, const char*, void*) {}, nullptr);
+  llama_backend_init();
+  if (options_.numa && topology_.numa_nodes.size() > 1) {
+    // Interleave the shared weights across nodes instead of filling node 0.
+    llama_numa_init(GGML_NUMA_STRATEGY_DISTRIBUTE);
+  }
+
+  llama_model_params mparams = llama_model_default_params();
+  mparams.n_gpu_layers = options_.n_gpu_layers;
+  model_ = llama_model_load_from_file(model_path_.c_str(), mparams);
+  if (!model_) {
+    throw std::runtime_error("Failed to load model: " + model_path_);
+  }
+  // The destructor does not run when the constructor throws, so release
+  // what was created so far here.
+  try {
+    if (!options_.draft_model.empty()) {
+      draft_model_ = llama_model_load_from_file(options_.draft_model.c_str(), mparams);
+      if (!draft_model_) {
+        throw std::runtime_error("Failed to load draft model: " + options_.draft_model);
+      }
+      if (!SameVocab(model_, draft_model_)) {
+        throw std::runtime_error("Draft model vocabulary differs from the chat model: " +
+                                 options_.draft_model);
+      }
+      options_.draft_max = std::max(1, options_.draft_max);
+    }
+
+    if (options_.use_thread_profile) {
+      const std::string profile_path = ThreadProfilePath(topology_, model_path_);
+      if (auto profile = LoadThreadProfile(profile_path, model_path_)) {
+        ApplyProfile(*profile, &options_);
+      }
+    }
+    // SMT siblings share execution units; decode is usually fastest with one
+    // thread per physical core.
+    if (options_.n_threads <= 0) {
+      options_.n_threads = topology_.physical_cores();
+    }
+    if (options_.n_threads_batch <= 0) {
+      options_.n_threads_batch = options_.n_threads;
+    }
+    options_.n_contexts = std::max(1, options_.n_contexts);
+    contexts_ = std::vector<Context>(options_.n_contexts);
+    CreateContexts();
+    if (options_.prefix_cache_bytes > 0) {
+      prefix_cache_ = std::make_unique<PrefixCache>(options_.prefix_cache_bytes);
+    }
+  } catch (...) {
+    for (auto& c : contexts_) {
+      DestroyContext(c);
+    }
+    if (draft_model_) {
+      llama_model_free(draft_model_);
+    }
+    llama_model_free(model_);
+    throw;
+  }
+}
+
+LlamaBackend::~LlamaBackend() {
+  embedder_.reset();
+  for (auto& c : contexts_) {
+    DestroyContext(c);
+  }
+  if (draft_model_) {
+    llama_model_free(draft_model_);
+  }
+  if (model_) {
+    llama_model_free(model_);
+  }
+  llama_backend_free();
+}
+
+void LlamaBackend::CreateContexts() {
+  const auto placements =
+      PlanContextPlacement(topology_, options_.n_contexts, options_.n_threads,
+                           options_.n_threads_batch, options_.numa);
+  for (size_t i = 0; i < contexts_.size(); ++i) {
+    Context& c = contexts_[i];
+    c.placement = placements[i];
+    if (options_.numa) {
+      RunPinned(c.placement.cpus, [&]() { CreateContext(c); });
+    } else {
+      CreateContext(c);
+    }
+  }
+}
+
+void LlamaBackend::CreateContext(Context& c) {
+  llama_context_params cparams = llama_context_default_params();
+  cparams.n_ctx = options_.n_ctx;
+  if (options_.n_batch > 0) {
+    cparams.n_batch = options_.n_batch;
+  }
+  if (options_.n_ubatch > 0) {
+    cparams.n_ubatch = std::min<uint32_t>(options_.n_ubatch, cparams.n_batch);
+  }
+  cparams.n_seq_max = kMaxSequences + 1;
+  cparams.kv_unified = true;
+  cparams.type_k = CacheType(options_.cache_type_k);
+  cparams.type_v = CacheType(options_.cache_type_v);
+  cparams.flash_attn_type = FlashAttnType(options_.flash_attn);
+  cparams.offload_kqv = options_.offload_kqv;
+  cparams.n_threads = c.placement.n_threads;
+  cparams.n_threads_batch = c.placement.n_threads_batch;
+  c.ctx = llama_init_from_model(model_, cparams);
+  if (!c.ctx) {
+    throw std::runtime_error("Failed to create llama context (n_ctx " +
+                             std::to_string(options_.n_ctx) + ", KV " + options_.cache_type_k +
+                             "/" + options_.cache_type_v + ").");
+  }
+  c.slots.assign(kMaxSequences, Slot{});
+  c.sampler = llama_sampler_init_greedy();
+  if (!c.sampler) {
+    throw std::runtime_error("Failed to create sampler.");
+  }
+
+  // NUMA placement always pins: unpinned workers would migrate off the node.
+  const bool pin = options_.pin_threads || options_.numa;
+  const bool pin_batch = options_.pin_threads_batch || options_.numa;
+  if (pin || pin_batch) {
+    const std::vector<int> none;
+    const auto& cpus = c.placement.cpus;
+    c.threadpool = NewThreadpool(c.placement.n_threads, pin ? cpus : none);
+    if (c.placement.n_threads_batch != c.placement.n_threads || pin_batch != pin) {
+      c.threadpool_batch = NewThreadpool(c.placement.n_threads_batch, pin_batch ? cpus : none);
+    }
+    if (c.threadpool) {
+      llama_attach_threadpool(c.ctx, c.threadpool, c.threadpool_batch);
+    }
+  }
+
+  if (draft_model_) {
+    llama_context_params dparams = cparams;
+    dparams.n_seq_max = 1;
+    dparams.kv_unified = false;
+    c.draft_ctx = llama_init_from_model(draft_model_, dparams);
+    if (!c.draft_ctx) {
+      throw std::runtime_error("Failed to create draft model context.");
+    }
+    // Draft and main model never run at once, so they share the threads.
+    if (c.threadpool) {
+      llama_attach_threadpool(c.draft_ctx, c.threadpool, c.threadpool_batch);
+    }
+    c.draft_sampler = llama_sampler_init_greedy();
+    if (!c.draft_sampler) {
+      throw std::runtime_error("Failed to create sampler.");
+    }
+  }
+  c.draft_tokens.clear();
+}
+
+void LlamaBackend::DestroyContext(Context& c) {
+  if (c.draft_sampler) {
+    llama_sampler_free(c.draft_sampler);
+    c.draft_sampler = nullptr;
+  }
+  if (c.draft_ctx) {
+    llama_free(c.draft_ctx);
+    c.draft_ctx = nullptr;
+  }
+  if (c.sampler) {
+    llama_sampler_free(c.sampler);
+    c.sampler = nullptr;
+  }
+  if (c.ctx) {
+    llama_free(c.ctx);
+    c.ctx = nullptr;
+  }
+  if (c.threadpool_batch) {
+    ggml_threadpool_free(c.threadpool_batch);
+    c.threadpool_batch = nullptr;
+  }
+  if (c.threadpool) {
+    ggml_threadpool_free(c.threadpool);
+    c.threadpool = nullptr;
+  }
+  c.slots.clear();
+}
+
+std::vector<llama_token> LlamaBackend::Tokenize(std::string_view text) const {
+  const llama_vocab* vocab = llama_model_get_vocab(model_);
+  std::vector<llama_token> tokens(text.size() + 4);
   int n_tokens = llama_tokenize(vocab,
-                                prompt.data(),
-                                (int)prompt.size(),
+                                text.data(),
+                                (int)text.size(),
                                 tokens.data(),
                                 (int)tokens.size(),
                                 true,
@@ -48,105 +466,1313 @@ std::string Generate(llama_context* ctx,
     throw std::runtime_error("Failed to tokenize prompt.");
   }
   tokens.resize(n_tokens);
+  return tokens;
+}
 
-  llama_batch batch = llama_batch_get_one(tokens.data(), n_tokens);
-  if (llama_decode(ctx, batch) != 0) {
-    throw std::runtime_error("Failed to decode prompt.");
+LlamaBackend::Context& LlamaBackend::Lease(const std::vector<llama_token>& tokens) {
+  std::unique_lock<std::mutex> lock(pool_mutex_);
+  ++lease_waiters_;
+  pool_cv_.wait(lock, [this]() {
+    return std::any_of(contexts_.begin(), contexts_.end(), [](const Context& c) { return !c.busy; });
+  });
+  --lease_waiters_;
+  return *IdleContext(tokens);
+}
+
+LlamaBackend::Context* LlamaBackend::TryLease(const std::vector<llama_token>& tokens) {
+  std::lock_guard<std::mutex> lock(pool_mutex_);
+  if (lease_waiters_ > 0) {
+    return nullptr;
   }
+  return IdleContext(tokens);
+}
 
+LlamaBackend::Context* LlamaBackend::IdleContext(const std::vector<llama_token>& tokens) {
+  // Prefer the idle context that already caches the longest prefix of the
+  // prompt, then the one idle the longest.
+  Context* best = nullptr;
+  size_t best_prefix = 0;
+  for (auto& c : contexts_) {
+    if (c.busy) {
+      continue;
+    }
+    size_t prefix = 0;
+    for (const auto& slot : c.slots) {
+      prefix = std::max(prefix, CommonPrefix(slot.tokens, tokens));
+    }
+    if (!best || prefix > best_prefix ||
+        (prefix == best_prefix && c.last_leased < best->last_leased)) {
+      best = &c;
+      best_prefix = prefix;
+    }
+  }
+  if (best) {
+    best->busy = true;
+    best->last_leased = ++lease_clock_;
+  }
+  return best;
+}
+
+void LlamaBackend::Release(Context& c) {
+  {
+    std::lock_guard<std::mutex> lock(pool_mutex_);
+    c.busy = false;
+  }
+  pool_cv_.notify_one();
+}
+
+size_t LlamaBackend::LeastRecentSlot(const Context& c, size_t exclude) const {
+  size_t lru = c.slots.size();
+  for (size_t i = 0; i < c.slots.size(); ++i) {
+    if (i != exclude && (lru == c.slots.size() || c.slots[i].last_used < c.slots[lru].last_used)) {
+      lru = i;
+    }
+  }
+  return lru;
+}
+
+size_t LlamaBackend::AcquireSlot(Context& c, const std::vector<llama_token>& tokens, size_t* reuse) {
+  size_t best = 0;
+  size_t best_prefix = 0;
+  for (size_t i = 0; i < c.slots.size(); ++i) {
+    const size_t prefix = CommonPrefix(c.slots[i].tokens, tokens);
+    if (prefix > best_prefix ||
+        (prefix == best_prefix && c.slots[i].last_used < c.slots[best].last_used)) {
+      best = i;
+      best_prefix = prefix;
+    }
+  }
+
+  size_t slot = best;
+  if (best_prefix > 0 && best_prefix < c.slots[best].tokens.size()) {
+    // A prompt that only dropped or summarized older turns keeps the rest of
+    // `best`; shift that history into place. The old form is not sent again.
+    const size_t shifted = ShiftCached(c, best, tokens, best_prefix);
+    if (shifted > best_prefix) {
+      c.slots[best].last_used = ++c.clock;
+      *reuse = shifted;
+      return best;
+    }
+    // Reusing `best` in place would truncate a sequence another prompt may
+    // still extend (another agent, or this agent's previous reply). Share the
+    // prefix cells with the least recently used sequence instead.
+    slot = LeastRecentSlot(c, best);
+    llama_memory_t mem = llama_get_memory(c.ctx);
+    llama_memory_seq_rm(mem, (llama_seq_id)slot, -1, -1);
+    llama_memory_seq_cp(mem, (llama_seq_id)best, (llama_seq_id)slot, 0, (llama_pos)best_prefix);
+    c.slots[slot].tokens.assign(c.slots[best].tokens.begin(),
+                                c.slots[best].tokens.begin() + best_prefix);
+  }
+  c.slots[slot].last_used = ++c.clock;
+  *reuse = best_prefix;
+  return slot;
+}
+
+void LlamaBackend::ReserveCells(Context& c, size_t slot, size_t needed) {
+  const size_t capacity = llama_n_ctx(c.ctx);
+  if (needed > capacity) {
+    throw std::runtime_error("Prompt exceeds the context window (" + std::to_string(needed) +
+                             " > " + std::to_string(capacity) + " tokens).");
+  }
+  size_t used = needed;
+  for (size_t i = 0; i < c.slots.size(); ++i) {
+    if (i != slot) {
+      used += c.slots[i].tokens.size();
+    }
+  }
+  while (used > capacity) {
+    size_t victim = c.slots.size();
+    for (size_t i = 0; i < c.slots.size(); ++i) {
+      if (i != slot && !c.slots[i].tokens.empty() &&
+          (victim == c.slots.size() || c.slots[i].last_used < c.slots[victim].last_used)) {
+        victim = i;
+      }
+    }
+    if (victim == c.slots.size()) {
+      break;
+    }
+    llama_memory_seq_rm(llama_get_memory(c.ctx), (llama_seq_id)victim, -1, -1);
+    used -= c.slots[victim].tokens.size();
+    c.slots[victim].tokens.clear();
+  }
+}
+
+size_t LlamaBackend::ShiftCached(Context& c,
+                                 size_t slot,
+                                 const std::vector<llama_token>& tokens,
+                                 size_t n_past) {
+  llama_memory_t mem = llama_get_memory(c.ctx);
+  auto& cached = c.slots[slot].tokens;
+  if (!options_.kv_shift || cached.size() < n_past + kMinShiftRun ||
+      !llama_memory_can_shift(mem)) {
+    return n_past;
+  }
+
+  // Cells below `shared` may belong to other sequences as well (seq_cp shares
+  // them), and shifting them would move them there too.
+  size_t shared = n_past;
+  for (size_t i = 0; i < c.slots.size(); ++i) {
+    if (i != slot) {
+      shared = std::max(shared, CommonPrefix(c.slots[i].tokens, cached));
+    }
+  }
+  std::unordered_map<uint64_t, std::vector<size_t>> index;
+  for (size_t p = shared; p + kShiftGram <= cached.size(); ++p) {
+    index[HashTokens(cached.data() + p, kShiftGram)].push_back(p);
+  }
+
+  // Runs of the prompt, in order, that the slot caches at a later position.
+  struct Run {
+    size_t from;
+    size_t to;
+    size_t n;
+  };
+  std::vector<Run> runs;
+  size_t next = shared;
+  for (size_t p = n_past; p + kShiftGram <= tokens.size();) {
+    Run best{0, p, 0};
+    auto it = index.find(HashTokens(tokens.data() + p, kShiftGram));
+    if (it != index.end()) {
+      for (size_t from : it->second) {
+        if (from < next || from <= p) {
+          continue;
+        }
+        size_t n = 0;
+        while (from + n < cached.size() && p + n < tokens.size() &&
+               cached[from + n] == tokens[p + n]) {
+          ++n;
+        }
+        if (n > best.n) {
+          best = {from, p, n};
+        }
+      }
+    }
+    if (best.n >= kMinShiftRun) {
+      runs.push_back(best);
+      next = best.from + best.n;
+      p += best.n;
+    } else {
+      ++p;
+    }
+  }
+  if (runs.empty()) {
+    return n_past;
+  }
+
+  ReserveCells(c, slot, tokens.size());
+  // Park the runs on a spare sequence and truncate the slot. Positions must
+  // stay consecutive within a sequence, so the tokens between runs (e.g. a
+  // new summary) are decoded on the slot before each run moves back behind
+  // them.
+  const auto seq = (llama_seq_id)slot;
+  llama_memory_seq_rm(mem, kShiftSequence, -1, -1);
+  for (const auto& run : runs) {
+    llama_memory_seq_cp(mem, seq, kShiftSequence, (llama_pos)run.from,
+                        (llama_pos)(run.from + run.n));
+  }
+  llama_memory_seq_rm(mem, seq, (llama_pos)n_past, -1);
+  cached.resize(n_past);
+  try {
+    for (const auto& run : runs) {
+      DecodeTokens(c, slot, tokens, cached.size(), run.to);
+      llama_memory_seq_add(mem, kShiftSequence, (llama_pos)run.from,
+                           (llama_pos)(run.from + run.n), (llama_pos)run.to - (llama_pos)run.from);
+      llama_memory_seq_cp(mem, kShiftSequence, seq, (llama_pos)run.to,
+                          (llama_pos)(run.to + run.n));
+      llama_memory_seq_rm(mem, kShiftSequence, (llama_pos)run.to, (llama_pos)(run.to + run.n));
+      cached.insert(cached.end(), tokens.begin() + run.to, tokens.begin() + run.to + run.n);
+    }
+  } catch (...) {
+    llama_memory_seq_rm(mem, kShiftSequence, -1, -1);
+    throw;
+  }
+  return cached.size();
+}
+
+void LlamaBackend::DecodeTokens(Context& c,
+                                size_t slot,
+                                const std::vector<llama_token>& tokens,
+                                size_t from,
+                                size_t to) {
+  auto& cached = c.slots[slot].tokens;
+  const size_t n_batch = llama_n_batch(c.ctx);
+  Batch batch((int32_t)n_batch);
+  for (size_t start = from; start < to; start += n_batch) {
+    const size_t end = std::min(to, start + n_batch);
+    llama_batch& b = batch.get();
+    b.n_tokens = 0;
+    for (size_t i = start; i < end; ++i) {
+      const int32_t j = b.n_tokens++;
+      b.token[j] = tokens[i];
+      b.pos[j] = (llama_pos)i;
+      b.n_seq_id[j] = 1;
+      b.seq_id[j][0] = (llama_seq_id)slot;
+      b.logits[j] = (i + 1 == to);
+    }
+    if (llama_decode(c.ctx, b) != 0) {
+      // Keep the cache consistent with the tokens recorded for this slot.
+      llama_memory_seq_rm(llama_get_memory(c.ctx), (llama_seq_id)slot, (llama_pos)start, -1);
+      throw std::runtime_error("Failed to decode prompt.");
+    }
+    cached.insert(cached.end(), tokens.begin() + start, tokens.begin() + end);
+  }
+}
+
+size_t LlamaBackend::RestorePrefix(Context& c,
+                                   size_t slot,
+                                   const std::vector<llama_token>& tokens,
+                                   size_t reuse) {
+  if (!prefix_cache_ || tokens.empty()) {
+    return reuse;
+  }
+  auto match = prefix_cache_->Lookup(tokens);
+  if (!match) {
+    return reuse;
+  }
+  // Like the slot cache, keep the last prompt token for fresh logits.
+  const size_t usable = std::min(match->prefix, tokens.size() - 1);
+  const PrefixCache::Entry& entry = *match->entry;
+  if (usable < reuse + kMinPrefixTokens || entry.tokens.size() > llama_n_ctx(c.ctx)) {
+    return reuse;
+  }
+  TraceSpan span("restore_prefix");
+  ReserveCells(c, slot, entry.tokens.size());
+  llama_memory_t mem = llama_get_memory(c.ctx);
+  llama_memory_seq_rm(mem, (llama_seq_id)slot, -1, -1);
+  if (llama_state_seq_set_data(c.ctx, entry.state.data(), entry.state.size(),
+                               (llama_seq_id)slot) == 0) {
+    llama_memory_seq_rm(mem, (llama_seq_id)slot, -1, -1);
+    c.slots[slot].tokens.clear();
+    return 0;
+  }
+  // The stored sequence may continue past the shared prefix.
+  llama_memory_seq_rm(mem, (llama_seq_id)slot, (llama_pos)usable, -1);
+  c.slots[slot].tokens.assign(entry.tokens.begin(), entry.tokens.begin() + usable);
+  return usable;
+}
+
+void LlamaBackend::StorePrefix(Context& c, size_t slot, size_t prefilled) {
+  if (!prefix_cache_ || prefilled < kMinPrefixTokens) {
+    return;
+  }
+  const size_t size = llama_state_seq_get_size(c.ctx, (llama_seq_id)slot);
+  if (size > prefix_cache_->budget_bytes()) {
+    return;
+  }
+  TraceSpan span("store_prefix");
+  std::vector<uint8_t> state(size);
+  const size_t written =
+      llama_state_seq_get_data(c.ctx, state.data(), state.size(), (llama_seq_id)slot);
+  if (written == 0) {
+    return;
+  }
+  state.resize(written);
+  prefix_cache_->Insert(c.slots[slot].tokens, std::move(state));
+}
+
+bool LlamaBackend::Prefill(std::string_view text, const CancelToken* cancel) {
+  const std::vector<llama_token> tokens = Tokenize(text);
+  if (tokens.empty()) {
+    return false;
+  }
+  Context* c = TryLease(tokens);
+  if (!c) {
+    return false;
+  }
+  LeaseGuard guard{this, c};
+  // Leave room for the input and the reply of the turn this prepares.
+  if (tokens.size() >= llama_n_ctx(c->ctx)) {
+    return false;
+  }
+
+  const bool cached = std::any_of(c->slots.begin(), c->slots.end(), [&](const Slot& s) {
+    return CommonPrefix(s.tokens, tokens) == tokens.size();
+  });
+  if (cached) {
+    return true;
+  }
+
+  TraceSpan span("prefill_ahead");
+  size_t reuse = 0;
+  const size_t slot = AcquireSlot(*c, tokens, &reuse);
+  reuse = RestorePrefix(*c, slot, tokens, reuse);
+  llama_memory_seq_rm(llama_get_memory(c->ctx), (llama_seq_id)slot, (llama_pos)reuse, -1);
+  c->slots[slot].tokens.resize(reuse);
+  ReserveCells(*c, slot, tokens.size());
+
+  // One batch at a time, so a waiting call gets the context back within a
+  // batch. Whatever was decoded stays cached for the next turn.
+  ++prefill_calls_;
+  const size_t n_batch = llama_n_batch(c->ctx);
+  size_t done = reuse;
+  while (done < tokens.size()) {
+    if ((cancel && cancel->cancelled()) || lease_waiters_ > 0) {
+      ++prefill_preempted_;
+      break;
+    }
+    const size_t end = std::min(tokens.size(), done + n_batch);
+    DecodeTokens(*c, slot, tokens, done, end);
+    prefill_tokens_ += end - done;
+    done = end;
+  }
+  if (done < tokens.size()) {
+    return false;
+  }
+  StorePrefix(*c, slot, done - reuse);
+  return true;
+}
+
+std::string LlamaBackend::Generate(std::string_view prompt,
+                                   int max_tokens,
+                                   const std::function<void(std::string_view)>& on_piece,
+                                   CallContext* call) {
+  using Clock = std::chrono::steady_clock;
+  const auto ms = [](Clock::time_point from, Clock::time_point to) {
+    return std::chrono::duration<double, std::milli>(to - from).count();
+  };
+  const auto start = Clock::now();
+  const std::vector<llama_token> tokens = Tokenize(prompt);
+  if (tokens.empty()) {
+    throw std::runtime_error("Failed to tokenize prompt.");
+  }
+
+  TraceSpan lease_span("lease");
+  Context& c = Lease(tokens);
+  lease_span.End();
+  LeaseGuard guard{this, &c};
+  const auto leased = Clock::now();
+  if (call && call->cancelled()) {
+    call->stopped = true;
+    return {};
+  }
+
+  TraceSpan prefill_span("prefill");
+  size_t reuse = 0;
+  const size_t slot = AcquireSlot(c, tokens, &reuse);
+  // Re-decode at least the last prompt token so fresh logits are available.
+  reuse = std::min(reuse, tokens.size() - 1);
+  reuse = RestorePrefix(c, slot, tokens, reuse);
+  llama_memory_seq_rm(llama_get_memory(c.ctx), (llama_seq_id)slot, (llama_pos)reuse, -1);
+  c.slots[slot].tokens.resize(reuse);
+
+  const size_t capacity = llama_n_ctx(c.ctx);
+  ReserveCells(c, slot, std::min(capacity, tokens.size() + (size_t)max_tokens));
+  DecodeTokens(c, slot, tokens, reuse, tokens.size());
+  StorePrefix(c, slot, tokens.size() - reuse);
+
+  const llama_vocab* vocab = llama_model_get_vocab(model_);
+  llama_sampler_reset(c.sampler);
+  auto& cached = c.slots[slot].tokens;
   std::string output;
   output.reserve(max_tokens * 4);
-  for (int i = 0; i < max_tokens; ++i) {
-    llama_token id = llama_sampler_sample(sampler, ctx, -1);
-    if (id == llama_vocab_eos(vocab)) {
-      break;
+  // Sampling waits for the prompt's logits, so the first sample ends prefill.
+  Clock::time_point first_token{};
+  int generated = 0;
+  std::optional<TraceSpan> decode_span;
+  // Log-probabilities of the sampled tokens, when the caller wants a
+  // confidence.
+  std::vector<float> logprobs;
+  std::vector<float>* scores = call && call->want_confidence ? &logprobs : nullptr;
+  const int32_t n_vocab = llama_vocab_n_tokens(vocab);
+  if (c.draft_ctx) {
+    if (max_tokens > 0 && cached.size() < capacity) {
+      const llama_token id = llama_sampler_sample(c.sampler, c.ctx, -1);
+      first_token = Clock::now();
+      prefill_span.End();
+      decode_span.emplace("decode");
+      if (scores && !llama_vocab_is_eog(vocab, id)) {
+        scores->push_back((float)TokenLogProb(c.ctx, -1, id, n_vocab));
+      }
+      generated = DecodeSpeculative(c, slot, id, max_tokens, on_piece, call, &output, scores);
     }
-    llama_sampler_accept(sampler, id);
+  } else {
+    for (int i = 0; i < max_tokens && cached.size() < capacity; ++i) {
+      // Checked once per token so a cancelled call frees the context quickly.
+      if (call && call->cancelled()) {
+        call->stopped = true;
+        break;
+      }
+      llama_token id = llama_sampler_sample(c.sampler, c.ctx, -1);
+      if (i == 0) {
+        first_token = Clock::now();
+        prefill_span.End();
+        decode_span.emplace("decode");
+      }
+      if (llama_vocab_is_eog(vocab, id)) {
+        break;
+      }
+      if (scores) {
+        scores->push_back((float)TokenLogProb(c.ctx, -1, id, n_vocab));
+      }
+      llama_sampler_accept(c.sampler, id);
 
+      char buf[128];
+      const int n = llama_token_to_piece(vocab, id, buf, sizeof(buf), 0, true);
+      if (n > 0) {
+        output.append(buf, buf + n);
+        if (on_piece) {
+          on_piece(std::string_view(buf, n));
+        }
+      }
+
+      Batch batch(1);
+      llama_batch& b = batch.get();
+      b.n_tokens = 1;
+      b.token[0] = id;
+      b.pos[0] = (llama_pos)cached.size();
+      b.n_seq_id[0] = 1;
+      b.seq_id[0][0] = (llama_seq_id)slot;
+      b.logits[0] = true;
+      if (llama_decode(c.ctx, b) != 0) {
+        llama_memory_seq_rm(llama_get_memory(c.ctx), (llama_seq_id)slot,
+                            (llama_pos)cached.size(), -1);
+        throw std::runtime_error("Failed to decode token.");
+      }
+      cached.push_back(id);
+      ++generated;
+    }
+  }
+  if (call) {
+    deepseek::CallMetrics* metrics = &call->metrics;
+    const auto end = Clock::now();
+    if (first_token == Clock::time_point{}) {
+      first_token = end;
+    }
+    metrics->backend = "local";
+    metrics->queue_ms = ms(start, leased);
+    metrics->ttft_ms = ms(start, first_token);
+    metrics->prefill_tokens = tokens.size() - reuse;
+    metrics->prefill_ms = ms(leased, first_token);
+    metrics->decode_tokens = static_cast<size_t>(generated);
+    metrics->decode_ms = ms(first_token, end);
+    metrics->total_ms = ms(start, end);
+    if (scores && !logprobs.empty()) {
+      double sum = 0.0;
+      for (float lp : logprobs) {
+        sum += lp;
+      }
+      call->confidence = std::exp(sum / static_cast<double>(logprobs.size()));
+    }
+  }
+  return output;
+}
+
+int LlamaBackend::DecodeSpeculative(Context& c,
+                                    size_t slot,
+                                    llama_token id,
+                                    int max_tokens,
+                                    const std::function<void(std::string_view)>& on_piece,
+                                    CallContext* call,
+                                    std::string* output,
+                                    std::vector<float>* scores) {
+  const llama_vocab* vocab = llama_model_get_vocab(model_);
+  auto& cached = c.slots[slot].tokens;
+  auto& drafted = c.draft_tokens;
+  const size_t capacity = llama_n_ctx(c.ctx);
+  const size_t draft_max = static_cast<size_t>(options_.draft_max);
+  llama_memory_t mem = llama_get_memory(c.ctx);
+  llama_memory_t draft_mem = llama_get_memory(c.draft_ctx);
+  const int32_t n_vocab = llama_vocab_n_tokens(vocab);
+  const auto score = [&](int32_t idx, llama_token token) {
+    if (scores && !llama_vocab_is_eog(vocab, token)) {
+      scores->push_back((float)TokenLogProb(c.ctx, idx, token, n_vocab));
+    }
+  };
+  const auto emit = [&](llama_token token) {
+    llama_sampler_accept(c.sampler, token);
     char buf[128];
-    const int n = llama_token_to_piece(vocab, id, buf, sizeof(buf), 0, true);
+    const int n = llama_token_to_piece(vocab, token, buf, sizeof(buf), 0, true);
     if (n > 0) {
-      output.append(buf, buf + n);
+      output->append(buf, buf + n);
+      if (on_piece) {
+        on_piece(std::string_view(buf, n));
+      }
     }
+  };
 
-    llama_token next_tokens[1] = {id};
-    llama_batch batch_next = llama_batch_get_one(next_tokens, 1);
-    if (llama_decode(ctx, batch_next) != 0) {
+  // The draft sequence always holds a prefix of the slot's tokens; drop what
+  // belonged to an earlier prompt.
+  const size_t keep = CommonPrefix(drafted, cached);
+  llama_memory_seq_rm(draft_mem, 0, (llama_pos)keep, -1);
+  drafted.resize(keep);
+
+  Batch batch((int32_t)draft_max + 1);
+  std::vector<llama_token> proposal;
+  proposal.reserve(draft_max);
+  size_t steps = 0;
+  size_t proposed = 0;
+  size_t accepted = 0;
+  int generated = 0;
+  while (generated < max_tokens && cached.size() < capacity) {
+    if (call && call->cancelled()) {
+      call->stopped = true;
       break;
     }
+    if (llama_vocab_is_eog(vocab, id)) {
+      break;
+    }
+    emit(id);
+    cached.push_back(id);
+    ++generated;
+
+    // Let the draft model continue greedily from `id`, within the token
+    // limit and the context.
+    proposal.clear();
+    const size_t room = std::min<size_t>(max_tokens - generated, capacity - cached.size());
+    const size_t k = std::min(draft_max, room);
+    if (k > 0 && DecodeRange(c.draft_ctx, cached, drafted.size(), cached.size())) {
+      drafted.insert(drafted.end(), cached.begin() + drafted.size(), cached.end());
+      while (true) {
+        const llama_token next = llama_sampler_sample(c.draft_sampler, c.draft_ctx, -1);
+        proposal.push_back(next);
+        if (proposal.size() == k || llama_vocab_is_eog(vocab, next)) {
+          break;
+        }
+        drafted.push_back(next);
+        if (!DecodeRange(c.draft_ctx, drafted, drafted.size() - 1, drafted.size())) {
+          drafted.pop_back();
+          break;
+        }
+      }
+    }
+
+    // One main-model batch: `id` and the proposals, with logits for each.
+    llama_batch& b = batch.get();
+    b.n_tokens = 0;
+    for (size_t i = 0; i <= proposal.size(); ++i) {
+      const int32_t j = b.n_tokens++;
+      b.token[j] = i == 0 ? id : proposal[i - 1];
+      b.pos[j] = (llama_pos)(cached.size() - 1 + i);
+      b.n_seq_id[j] = 1;
+      b.seq_id[j][0] = (llama_seq_id)slot;
+      b.logits[j] = true;
+    }
+    if (llama_decode(c.ctx, b) != 0) {
+      // `id` was already emitted, so the reply cannot be cut back to the
+      // cache; fail the call like the plain decode loop.
+      llama_memory_seq_rm(mem, (llama_seq_id)slot, (llama_pos)(cached.size() - 1), -1);
+      cached.pop_back();
+      if (drafted.size() > cached.size()) {
+        llama_memory_seq_rm(draft_mem, 0, (llama_pos)cached.size(), -1);
+        drafted.resize(cached.size());
+      }
+      draft_steps_ += steps;
+      drafted_ += proposed;
+      draft_accepted_ += accepted;
+      throw std::runtime_error("Failed to decode token.");
+    }
+    ++steps;
+    proposed += proposal.size();
+
+    // Keep proposals while they match the main model's own greedy pick after
+    // the previous token; the first mismatch is replaced by that pick.
+    size_t n_accepted = 0;
+    id = llama_sampler_sample(c.sampler, c.ctx, 0);
+    score(0, id);
+    while (n_accepted < proposal.size() && id == proposal[n_accepted] &&
+           !llama_vocab_is_eog(vocab, id)) {
+      emit(id);
+      cached.push_back(id);
+      ++generated;
+      ++n_accepted;
+      id = llama_sampler_sample(c.sampler, c.ctx, (int32_t)n_accepted);
+      score((int32_t)n_accepted, id);
+    }
+    accepted += n_accepted;
+    // Rejected proposals leave both caches; `id` is decoded next step.
+    llama_memory_seq_rm(mem, (llama_seq_id)slot, (llama_pos)cached.size(), -1);
+    if (drafted.size() > cached.size()) {
+      llama_memory_seq_rm(draft_mem, 0, (llama_pos)cached.size(), -1);
+      drafted.resize(cached.size());
+    }
   }
-  return output;
+
+  draft_steps_ += steps;
+  drafted_ += proposed;
+  draft_accepted_ += accepted;
+  if (call) {
+    call->metrics.draft_tokens = proposed;
+    call->metrics.draft_accepted_tokens = accepted;
+  }
+  return generated;
 }
 
-}  // namespace
+LlamaBackend::DraftStats LlamaBackend::draft_stats() const {
+  return {draft_steps_.load(), drafted_.load(), draft_accepted_.load()};
+}
 
-LlamaBackend::LlamaBackend(std::string model_path,
-                           int n_ctx,
-                           int n_threads,
-                           int n_gpu_layers)
-    : model_path_(std::move(model_path)),
-      n_ctx_(n_ctx),
-      n_threads_(n_threads),
-      n_gpu_layers_(n_gpu_layers) {
-  // Silence llama.cpp logs to keep demo output readable.
+LlamaBackend::PrefillStats LlamaBackend::prefill_stats() const {
+  return {prefill_calls_.load(), prefill_tokens_.load(), prefill_preempted_.load()};
+}
+
+std::vector<std::string> LlamaBackend::GenerateBranches(const std::vector<std::string>& prompts,
+                                                        int max_tokens,
+                                                        std::vector<CallContext>* calls) {
+  using Clock = std::chrono::steady_clock;
+  using SamplerPtr = std::unique_ptr<llama_sampler, decltype(&llama_sampler_free)>;
+  const auto ms = [](Clock::time_point from, Clock::time_point to) {
+    return std::chrono::duration<double, std::milli>(to - from).count();
+  };
+  const auto start = Clock::now();
+  std::vector<std::vector<llama_token>> tokens;
+  tokens.reserve(prompts.size());
+  for (const auto& prompt : prompts) {
+    tokens.push_back(Tokenize(prompt));
+    if (tokens.back().empty()) {
+      throw std::runtime_error("Failed to tokenize prompt.");
+    }
+  }
+
+  const llama_vocab* vocab = llama_model_get_vocab(model_);
+  std::vector<std::string> outputs(prompts.size());
+  for (size_t first = 0; first < prompts.size(); first += kMaxSequences) {
+    const size_t count = std::min<size_t>(kMaxSequences, prompts.size() - first);
+    // Every branch keeps at least its last token out of the shared prefix so
+    // it gets logits of its own.
+    size_t shared = tokens[first].size() - 1;
+    for (size_t b = 1; b < count; ++b) {
+      shared = std::min({shared, CommonPrefix(tokens[first], tokens[first + b]),
+                         tokens[first + b].size() - 1});
+    }
+    const std::vector<llama_token> prefix(tokens[first].begin(), tokens[first].begin() + shared);
+
+    TraceSpan lease_span("lease");
+    Context& c = Lease(tokens[first]);
+    lease_span.End();
+    LeaseGuard guard{this, &c};
+    const auto leased = Clock::now();
+    llama_memory_t mem = llama_get_memory(c.ctx);
+    const size_t capacity = llama_n_ctx(c.ctx);
+
+    TraceSpan prefill_span("prefill", "branches");
+    size_t needed = shared;
+    for (size_t b = 0; b < count; ++b) {
+      needed += tokens[first + b].size() - shared + (size_t)max_tokens;
+    }
+    size_t reuse = 0;
+    const size_t root = AcquireSlot(c, prefix, &reuse);
+    reuse = RestorePrefix(c, root, prefix, reuse);
+    llama_memory_seq_rm(mem, (llama_seq_id)root, (llama_pos)reuse, -1);
+    c.slots[root].tokens.resize(reuse);
+    ReserveCells(c, root, std::min(capacity, needed));
+    DecodeTokens(c, root, prefix, reuse, shared);
+    StorePrefix(c, root, shared - reuse);
+
+    struct Branch {
+      size_t slot = 0;
+      SamplerPtr sampler{nullptr, &llama_sampler_free};
+      llama_token next = 0;
+      bool active = true;
+      size_t generated = 0;
+      Clock::time_point first_token{};
+    };
+    std::vector<Branch> branches(count);
+    branches[0].slot = root;
+    for (size_t b = 1; b < count; ++b) {
+      // The least recently used sequence not already taken by this group.
+      size_t slot = c.slots.size();
+      for (size_t i = 0; i < c.slots.size(); ++i) {
+        const bool taken = std::any_of(branches.begin(), branches.begin() + b,
+                                       [i](const Branch& br) { return br.slot == i; });
+        if (!taken && (slot == c.slots.size() || c.slots[i].last_used < c.slots[slot].last_used)) {
+          slot = i;
+        }
+      }
+      llama_memory_seq_rm(mem, (llama_seq_id)slot, -1, -1);
+      llama_memory_seq_cp(mem, (llama_seq_id)root, (llama_seq_id)slot, 0, (llama_pos)shared);
+      c.slots[slot].tokens = prefix;
+      c.slots[slot].last_used = ++c.clock;
+      branches[b].slot = slot;
+    }
+
+    const auto call_at = [&](size_t b) { return calls ? &(*calls)[first + b] : nullptr; };
+    for (size_t b = 0; b < count; ++b) {
+      Branch& br = branches[b];
+      CallContext* call = call_at(b);
+      if (call && call->cancelled()) {
+        call->stopped = true;
+        br.active = false;
+        continue;
+      }
+      // Each suffix overwrites the logits, so sample its first token now.
+      DecodeTokens(c, br.slot, tokens[first + b], shared, tokens[first + b].size());
+      br.sampler.reset(llama_sampler_clone(c.sampler));
+      llama_sampler_reset(br.sampler.get());
+      br.next = llama_sampler_sample(br.sampler.get(), c.ctx, -1);
+      br.first_token = Clock::now();
+    }
+    prefill_span.End();
+
+    // One token per active branch per step, all in the same batch.
+    TraceSpan decode_span("decode", "branches");
+    Batch batch((int32_t)count);
+    std::vector<size_t> in_batch;
+    for (int step = 0; step < max_tokens; ++step) {
+      llama_batch& bt = batch.get();
+      bt.n_tokens = 0;
+      in_batch.clear();
+      for (size_t b = 0; b < count; ++b) {
+        Branch& br = branches[b];
+        if (!br.active) {
+          continue;
+        }
+        CallContext* call = call_at(b);
+        if (call && call->cancelled()) {
+          call->stopped = true;
+          br.active = false;
+          continue;
+        }
+        const auto& cached = c.slots[br.slot].tokens;
+        if (llama_vocab_is_eog(vocab, br.next) || cached.size() >= capacity) {
+          br.active = false;
+          continue;
+        }
+        llama_sampler_accept(br.sampler.get(), br.next);
+        char buf[128];
+        const int n = llama_token_to_piece(vocab, br.next, buf, sizeof(buf), 0, true);
+        if (n > 0) {
+          outputs[first + b].append(buf, buf + n);
+        }
+        const int32_t j = bt.n_tokens++;
+        bt.token[j] = br.next;
+        bt.pos[j] = (llama_pos)cached.size();
+        bt.n_seq_id[j] = 1;
+        bt.seq_id[j][0] = (llama_seq_id)br.slot;
+        bt.logits[j] = true;
+        in_batch.push_back(b);
+      }
+      if (in_batch.empty()) {
+        break;
+      }
+      if (llama_decode(c.ctx, bt) != 0) {
+        // Keep the cache consistent with the tokens recorded for each slot;
+        // the truncated replies are not returned as answers.
+        for (size_t b : in_batch) {
+          const size_t slot = branches[b].slot;
+          llama_memory_seq_rm(mem, (llama_seq_id)slot, (llama_pos)c.slots[slot].tokens.size(), -1);
+        }
+        throw std::runtime_error("Failed to decode branches.");
+      }
+      for (size_t j = 0; j < in_batch.size(); ++j) {
+        Branch& br = branches[in_batch[j]];
+        c.slots[br.slot].tokens.push_back(br.next);
+        ++br.generated;
+        br.next = llama_sampler_sample(br.sampler.get(), c.ctx, (int32_t)j);
+      }
+    }
+    decode_span.End();
+
+    if (calls) {
+      const auto end = Clock::now();
+      for (size_t b = 0; b < count; ++b) {
+        const Branch& br = branches[b];
+        const auto first_token = br.first_token == Clock::time_point{} ? end : br.first_token;
+        deepseek::CallMetrics& m = (*calls)[first + b].metrics;
+        m.backend = "local";
+        m.queue_ms = ms(start, leased);
+        m.ttft_ms = ms(start, first_token);
+        // The shared prefix is charged to the first branch.
+        m.prefill_tokens = tokens[first + b].size() - shared + (b == 0 ? shared - reuse : 0);
+        m.prefill_ms = ms(leased, first_token);
+        m.decode_tokens = br.generated;
+        m.decode_ms = ms(first_token, end);
+        m.total_ms = ms(start, end);
+      }
+    }
+  }
+  return outputs;
+}
+
+std::string LlamaBackend::ModelIdentity() const {
+  std::error_code ec;
+  const auto size = std::filesystem::file_size(model_path_, ec);
+  const auto mtime = std::filesystem::last_write_time(model_path_, ec);
+  char desc[256] = {};
+  llama_model_desc(model_, desc, sizeof(desc));
+  // Sequence state blobs are only valid for the same KV cache types.
+  return model_path_ + "|" + std::to_string(ec ? 0 : size) + "|" +
+         std::to_string(mtime.time_since_epoch().count()) + "|" + desc + "|" +
+         options_.cache_type_k + "/" + options_.cache_type_v;
+}
+
+TuneSample LlamaBackend::Measure(Context& c, const TuneCandidate& candidate, bool measure_decode) {
+  using Clock = std::chrono::steady_clock;
+  TuneSample sample;
+  sample.candidate = candidate;
+
+  ggml_threadpool* pool = candidate.pin ? NewThreadpool(candidate.threads, topology_.core_cpus)
+                                        : nullptr;
+  if (pool) {
+    llama_attach_threadpool(c.ctx, pool, nullptr);
+  } else {
+    llama_detach_threadpool(c.ctx);
+  }
+  llama_set_n_threads(c.ctx, candidate.threads, candidate.threads);
+
+  std::string text;
+  while (text.size() < kTunePromptTokens * 8) {
+    text += "The quick brown fox jumps over the lazy dog while agents debate tradeoffs. ";
+  }
+  std::vector<llama_token> tokens = Tokenize(text);
+  tokens.resize(std::min({tokens.size(), kTunePromptTokens, (size_t)llama_n_ctx(c.ctx) / 2}));
+
+  llama_memory_clear(llama_get_memory(c.ctx), true);
+  c.slots[0].tokens.clear();
+  const auto prefill_start = Clock::now();
+  DecodeTokens(c, 0, tokens, 0, tokens.size());
+  llama_synchronize(c.ctx);
+  const std::chrono::duration<double> prefill = Clock::now() - prefill_start;
+  sample.prefill_tps = tokens.size() / std::max(prefill.count(), 1e-9);
+
+  if (measure_decode) {
+    Batch batch(1);
+    llama_batch& b = batch.get();
+    const auto decode_start = Clock::now();
+    int decoded = 0;
+    for (; decoded < kTuneDecodeTokens; ++decoded) {
+      b.n_tokens = 1;
+      b.token[0] = tokens[decoded % tokens.size()];
+      b.pos[0] = (llama_pos)(tokens.size() + decoded);
+      b.n_seq_id[0] = 1;
+      b.seq_id[0][0] = 0;
+      b.logits[0] = true;
+      if (llama_decode(c.ctx, b) != 0) {
+        break;
+      }
+    }
+    llama_synchronize(c.ctx);
+    const std::chrono::duration<double> decode = Clock::now() - decode_start;
+    sample.decode_tps = decoded / std::max(decode.count(), 1e-9);
+  }
+
+  llama_memory_clear(llama_get_memory(c.ctx), true);
+  c.slots[0].tokens.clear();
+  llama_detach_threadpool(c.ctx);
+  if (pool) {
+    ggml_threadpool_free(pool);
+  }
+  return sample;
+}
+
+ThreadProfile LlamaBackend::Autotune(const std::function<void(const TuneSample&)>& on_sample) {
+  std::unique_lock<std::mutex> lock(pool_mutex_);
+  pool_cv_.wait(lock, [this]() {
+    return std::none_of(contexts_.begin(), contexts_.end(), [](const Context& c) { return c.busy; });
+  });
+  // Measure a single context with the whole machine, then re-split the pool.
+  for (auto& c : contexts_) {
+    DestroyContext(c);
+  }
+  Context& c = contexts_.front();
+  c.placement = ContextPlacement{};
+  c.placement.cpus = topology_.core_cpus;
+
+  const std::vector<TuneCandidate> candidates = TuneCandidates(topology_, options_.n_ctx);
+  std::vector<TuneSample> samples;
+  samples.reserve(candidates.size());
+  int context_batch = 0;
+  for (const auto& candidate : candidates) {
+    if (candidate.n_batch != context_batch) {
+      DestroyContext(c);
+      options_.n_batch = candidate.n_batch;
+      options_.n_ubatch = candidate.n_batch;
+      const bool numa = std::exchange(options_.numa, false);
+      const bool pin = std::exchange(options_.pin_threads, false);
+      const bool pin_batch = std::exchange(options_.pin_threads_batch, false);
+      CreateContext(c);
+      options_.numa = numa;
+      options_.pin_threads = pin;
+      options_.pin_threads_batch = pin_batch;
+      context_batch = candidate.n_batch;
+      // Warm caches and page in the weights before the first timed run.
+      Measure(c, candidate, false);
+    }
+    // Decode speed does not depend on the batch size; measure it once.
+    samples.push_back(Measure(c, candidate, candidate.n_batch == candidates.front().n_batch));
+    if (on_sample) {
+      on_sample(samples.back());
+    }
+  }
+  DestroyContext(c);
+
+  const ThreadProfile profile = SelectThreadProfile(samples, topology_, model_path_);
+  if (profile.n_threads > 0 && profile.n_threads_batch > 0) {
+    options_.n_threads = profile.n_threads;
+    options_.n_threads_batch = profile.n_threads_batch;
+    options_.n_batch = profile.n_batch;
+    options_.n_ubatch = profile.n_ubatch;
+    options_.pin_threads = profile.pin_threads;
+    options_.pin_threads_batch = profile.pin_threads_batch;
+  }
+  CreateContexts();
+  return profile;
+}
+
+bool LlamaBackend::SaveAgentStates(const std::vector<Agent>& agents,
+                                   std::string_view path,
+                                   std::string* error_out) {
+  std::unique_lock<std::mutex> lock(pool_mutex_);
+  pool_cv_.wait(lock, [this]() {
+    return std::none_of(contexts_.begin(), contexts_.end(), [](const Context& c) { return c.busy; });
+  });
+
+  // The longest agent history each (context, slot) pair holds. Matching
+  // leaves the slots alone, so one agent's match cannot cut another's.
+  std::map<std::pair<size_t, size_t>, size_t> matched;
+  for (const auto& agent : agents) {
+    const auto history = Tokenize(RenderHistory(agent.memory, agent.system_prompt));
+    size_t best_ctx = 0;
+    size_t best = 0;
+    size_t best_prefix = 0;
+    for (size_t ci = 0; ci < contexts_.size(); ++ci) {
+      const auto& slots = contexts_[ci].slots;
+      for (size_t i = 0; i < slots.size(); ++i) {
+        const size_t prefix = CommonPrefix(slots[i].tokens, history);
+        if (prefix > best_prefix) {
+          best_ctx = ci;
+          best = i;
+          best_prefix = prefix;
+        }
+      }
+    }
+    if (best_prefix == 0) {
+      continue;
+    }
+    size_t& length = matched[{best_ctx, best}];
+    length = std::max(length, best_prefix);
+  }
+
+  // Write next to the target and rename over it, like SaveAgents, so a
+  // failed save never leaves a torn state file beside a good agent store.
+  const std::string final_path(path);
+  const std::string tmp_path = final_path + ".tmp";
+  {
+    std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+      if (error_out) {
+        *error_out = "Failed to open file for write: " + final_path;
+      }
+      return false;
+    }
+
+    const std::string identity = ModelIdentity();
+    out.write(kStateMagic, sizeof(kStateMagic));
+    WritePod(out, kStateVersion);
+    WritePod(out, (uint32_t)identity.size());
+    out.write(identity.data(), (std::streamsize)identity.size());
+
+    WritePod(out, (uint32_t)matched.size());
+    std::vector<uint8_t> state;
+    for (const auto& [key, length] : matched) {
+      const auto [ci, slot] = key;
+      llama_context* ctx = contexts_[ci].ctx;
+      const auto& cached = contexts_[ci].slots[slot].tokens;
+      // Anything past the shared history is a reply the next prompt
+      // re-renders; save a trimmed copy and leave the live sequence as is.
+      llama_seq_id seq = (llama_seq_id)slot;
+      llama_memory_t mem = llama_get_memory(ctx);
+      if (length < cached.size()) {
+        llama_memory_seq_rm(mem, kShiftSequence, -1, -1);
+        llama_memory_seq_cp(mem, seq, kShiftSequence, 0, (llama_pos)length);
+        seq = kShiftSequence;
+      }
+      state.resize(llama_state_seq_get_size(ctx, seq));
+      const size_t written = llama_state_seq_get_data(ctx, state.data(), state.size(), seq);
+      if (seq == kShiftSequence) {
+        llama_memory_seq_rm(mem, kShiftSequence, -1, -1);
+      }
+      WritePod(out, HashTokens(cached.data(), length));
+      WritePod(out, (uint64_t)length);
+      out.write(reinterpret_cast<const char*>(cached.data()),
+                (std::streamsize)(length * sizeof(llama_token)));
+      WritePod(out, (uint64_t)written);
+      out.write(reinterpret_cast<const char*>(state.data()), (std::streamsize)written);
+    }
+
+    out.close();
+    if (!out) {
+      if (error_out) {
+        *error_out = "Failed to write file: " + final_path;
+      }
+      std::filesystem::remove(tmp_path);
+      return false;
+    }
+  }
+  std::error_code ec;
+  std::filesystem::rename(tmp_path, final_path, ec);
+  if (ec) {
+    if (error_out) {
+      *error_out = "Failed to replace file: " + final_path + " (" + ec.message() + ")";
+    }
+    std::filesystem::remove(tmp_path);
+    return false;
+  }
+  return true;
+}
+
+int LlamaBackend::LoadAgentStates(const std::vector<Agent>& agents,
+                                  std::string_view path,
+                                  std::string* error_out) {
+  std::unique_lock<std::mutex> lock(pool_mutex_);
+  pool_cv_.wait(lock, [this]() {
+    return std::none_of(contexts_.begin(), contexts_.end(), [](const Context& c) { return c.busy; });
+  });
+  std::ifstream in(std::string(path), std::ios::binary);
+  if (!in) {
+    if (error_out) {
+      *error_out = "Failed to open file for read: " + std::string(path);
+    }
+    return 0;
+  }
+
+  char magic[sizeof(kStateMagic)] = {};
+  uint32_t version = 0;
+  uint32_t identity_size = 0;
+  in.read(magic, sizeof(magic));
+  if (!in || std::memcmp(magic, kStateMagic, sizeof(magic)) != 0 || !ReadPod(in, &version) ||
+      version != kStateVersion || !ReadPod(in, &identity_size)) {
+    if (error_out) {
+      *error_out = "Invalid KV state file: " + std::string(path);
+    }
+    return 0;
+  }
+  std::string identity(identity_size, '\0');
+  if (!in.read(identity.data(), identity_size) || identity != ModelIdentity()) {
+    if (error_out) {
+      *error_out = "KV state was saved for a different model file.";
+    }
+    return 0;
+  }
+
+  // Index the records; state blobs are read only for records that are used.
+  struct Record {
+    uint64_t hash = 0;
+    std::vector<llama_token> tokens;
+    std::streamoff state_offset = 0;
+    uint64_t state_size = 0;
+  };
+  std::vector<Record> records;
+  uint32_t count = 0;
+  ReadPod(in, &count);
+  for (uint32_t r = 0; r < count; ++r) {
+    Record rec;
+    uint64_t n_tokens = 0;
+    if (!ReadPod(in, &rec.hash) || !ReadPod(in, &n_tokens) ||
+        n_tokens > (uint64_t)options_.n_ctx) {
+      break;
+    }
+    rec.tokens.resize(n_tokens);
+    in.read(reinterpret_cast<char*>(rec.tokens.data()),
+            (std::streamsize)(n_tokens * sizeof(llama_token)));
+    if (!in || !ReadPod(in, &rec.state_size)) {
+      break;
+    }
+    rec.state_offset = in.tellg();
+    in.seekg((std::streamoff)rec.state_size, std::ios::cur);
+    if (HashTokens(rec.tokens.data(), rec.tokens.size()) == rec.hash) {
+      records.push_back(std::move(rec));
+    }
+  }
+  in.clear();
+
+  int restored = 0;
+  size_t next_context = 0;
+  std::vector<uint8_t> state;
+  for (const auto& agent : agents) {
+    const auto history = Tokenize(RenderHistory(agent.memory, agent.system_prompt));
+    const Record* best = nullptr;
+    for (const auto& rec : records) {
+      if (rec.tokens.size() <= history.size() &&
+          HashTokens(history.data(), rec.tokens.size()) == rec.hash &&
+          std::equal(rec.tokens.begin(), rec.tokens.end(), history.begin()) &&
+          (!best || rec.tokens.size() > best->tokens.size())) {
+        best = &rec;
+      }
+    }
+    if (!best) {
+      continue;
+    }
+
+    const bool resident = std::any_of(contexts_.begin(), contexts_.end(), [&](const Context& c) {
+      return std::any_of(c.slots.begin(), c.slots.end(), [&](const Slot& s) {
+        return CommonPrefix(s.tokens, best->tokens) == best->tokens.size();
+      });
+    });
+    if (resident) {
+      ++restored;  // Already restored for an agent sharing this history.
+      continue;
+    }
+    // Spread agents over the pool so they can run in parallel.
+    Context& c = contexts_[next_context++ % contexts_.size()];
+    const size_t slot = LeastRecentSlot(c, c.slots.size());
+    c.slots[slot].last_used = ++c.clock;
+    ReserveCells(c, slot, best->tokens.size());
+    state.resize(best->state_size);
+    in.seekg(best->state_offset);
+    if (!in.read(reinterpret_cast<char*>(state.data()), (std::streamsize)state.size()) ||
+        llama_state_seq_set_data(c.ctx, state.data(), state.size(), (llama_seq_id)slot) == 0) {
+      in.clear();
+      llama_memory_seq_rm(llama_get_memory(c.ctx), (llama_seq_id)slot, -1, -1);
+      c.slots[slot].tokens.clear();
+      continue;
+    }
+    c.slots[slot].tokens = best->tokens;
+    ++restored;
+  }
+  return restored;
+}
+
+LlamaEmbedder::LlamaEmbedder(const std::string& model_path, int n_threads) : owns_model_(true) {
   llama_log_set([](ggml_log_level, const char*, void*) {}, nullptr);
   llama_backend_init();
-
   llama_model_params mparams = llama_model_default_params();
-  mparams.n_gpu_layers = n_gpu_layers_;
-  model_ = llama_model_load_from_file(model_path_.c_str(), mparams);
+  mparams.n_gpu_layers = 0;
+  model_ = llama_model_load_from_file(model_path.c_str(), mparams);
   if (!model_) {
-    throw std::runtime_error("Failed to load model: " + model_path_);
+    llama_backend_free();
+    throw std::runtime_error("Failed to load embedding model: " + model_path);
+  }
+  CreateContext(n_threads);
+}
+
+LlamaEmbedder::LlamaEmbedder(llama_model* model, int n_threads) : model_(model) {
+  CreateContext(n_threads);
+}
+
+LlamaEmbedder::~LlamaEmbedder() {
+  if (ctx_) {
+    llama_free(ctx_);
+  }
+  if (owns_model_) {
+    llama_model_free(model_);
+    llama_backend_free();
   }
+}
 
+void LlamaEmbedder::CreateContext(int n_threads) {
+  if (n_threads <= 0) {
+    n_threads = DetectCpuTopology().physical_cores();
+  }
   llama_context_params cparams = llama_context_default_params();
-  cparams.n_ctx = n_ctx_;
-  cparams.n_threads = n_threads_ > 0 ? n_threads_ : (int)std::thread::hardware_concurrency();
-  cparams.n_threads_batch = cparams.n_threads;
+  // Pooling needs the whole text in one ubatch.
+  cparams.n_ctx = kEmbedContext;
+  cparams.n_batch = kEmbedContext;
+  cparams.n_ubatch = kEmbedContext;
+  cparams.n_seq_max = 1;
+  cparams.embeddings = true;
+  cparams.pooling_type = LLAMA_POOLING_TYPE_MEAN;
+  cparams.n_threads = n_threads;
+  cparams.n_threads_batch = n_threads;
   ctx_ = llama_init_from_model(model_, cparams);
   if (!ctx_) {
-    throw std::runtime_error("Failed to create llama context.");
+    if (owns_model_) {
+      llama_model_free(model_);
+      llama_backend_free();
+    }
+    throw std::runtime_error("Failed to create embedding context.");
   }
+}
 
-  sampler_ = llama_sampler_init_greedy();
-  if (!sampler_) {
-    throw std::runtime_error("Failed to create sampler.");
+std::vector<float> LlamaEmbedder::Embed(std::string_view text) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const llama_vocab* vocab = llama_model_get_vocab(model_);
+  std::vector<llama_token> tokens(text.size() + 4);
+  const int n_tokens = llama_tokenize(vocab, text.data(), (int)text.size(), tokens.data(),
+                                      (int)tokens.size(), true, false);
+  if (n_tokens <= 0) {
+    throw std::runtime_error("Failed to tokenize text for embedding.");
   }
-}
+  tokens.resize(std::min<size_t>(n_tokens, kEmbedContext));
 
-LlamaBackend::~LlamaBackend() {
-  if (sampler_) {
-    llama_sampler_free(sampler_);
+  llama_memory_clear(llama_get_memory(ctx_), true);
+  Batch batch((int32_t)tokens.size());
+  llama_batch& b = batch.get();
+  b.n_tokens = (int32_t)tokens.size();
+  for (size_t i = 0; i < tokens.size(); ++i) {
+    b.token[i] = tokens[i];
+    b.pos[i] = (llama_pos)i;
+    b.n_seq_id[i] = 1;
+    b.seq_id[i][0] = 0;
+    b.logits[i] = true;
   }
-  if (ctx_) {
-    llama_free(ctx_);
+  if (llama_decode(ctx_, b) != 0) {
+    throw std::runtime_error("Failed to compute embedding.");
   }
-  if (model_) {
-    llama_model_free(model_);
+  const float* embd = llama_get_embeddings_seq(ctx_, 0);
+  if (!embd) {
+    throw std::runtime_error("Model returned no pooled embedding.");
   }
-  llama_backend_free();
+  return std::vector<float>(embd, embd + llama_model_n_embd(model_));
+}
+
+LlamaEmbedder& LlamaBackend::Embedder() {
+  std::lock_guard<std::mutex> lock(embedder_mutex_);
+  if (!embedder_) {
+    embedder_ = options_.embedding_model.empty()
+                    ? std::make_unique<LlamaEmbedder>(model_, options_.n_threads_batch)
+                    : std::make_unique<LlamaEmbedder>(options_.embedding_model,
+                                                      options_.n_threads_batch);
+  }
+  return *embedder_;
 }
 
 ChatBackend LlamaBackend::Backend() {
   ChatBackend backend;
   backend.chat = [this](const std::vector<deepseek::Message>& messages,
                         std::string_view system_prompt,
+                        CallContext* call,
                         std::string* /*error_out*/) -> std::optional<deepseek::ChatResponse> {
     deepseek::ChatResponse resp;
     std::string prompt = BuildPrompt(messages, system_prompt);
-    resp.content = Generate(ctx_, model_, sampler_, prompt, 256);
+    resp.content = Generate(prompt, 256, nullptr, call);
     return resp;
   };
+  backend.chat_batch = [this](const std::vector<std::vector<deepseek::Message>>& prompts,
+                              std::string_view system_prompt,
+                              std::vector<CallContext>* calls,
+                              std::string* /*error_out*/)
+      -> std::optional<std::vector<deepseek::ChatResponse>> {
+    std::vector<std::string> rendered;
+    rendered.reserve(prompts.size());
+    for (const auto& messages : prompts) {
+      rendered.push_back(BuildPrompt(messages, system_prompt));
+    }
+    auto outputs = GenerateBranches(rendered, 256, calls);
+    std::vector<deepseek::ChatResponse> responses(outputs.size());
+    for (size_t i = 0; i < outputs.size(); ++i) {
+      responses[i].content = std::move(outputs[i]);
+    }
+    return responses;
+  };
+  backend.count_tokens = [this](std::string_view text) { return Tokenize(text).size(); };
+  backend.prefill = [this](const std::vector<deepseek::Message>& messages,
+                           std::string_view system_prompt,
+                           const CancelToken* cancel) {
+    try {
+      return Prefill(RenderHistory(messages, system_prompt), cancel);
+    } catch (const std::exception&) {
+      // Only an optimization; the next call prefills as usual.
+      return false;
+    }
+  };
+  backend.embed = [this](std::string_view text,
+                         std::string* error_out) -> std::optional<std::vector<float>> {
+    try {
+      return Embedder().Embed(text);
+    } catch (const std::exception& ex) {
+      if (error_out) {
+        *error_out = ex.what();
+      }
+      return std::nullopt;
+    }
+  };
   backend.stream = [this](const std::vector<deepseek::Message>& messages,
                           std::string_view system_prompt,
                           const ChatBackend::StreamCallback& on_delta,
+                          CallContext* call,
                           std::string* /*error_out*/) {
     std::string prompt = BuildPrompt(messages, system_prompt);
-    std::string text = Generate(ctx_, model_, sampler_, prompt, 256);
-    const size_t chunk = 16;
-    for (size_t i = 0; i < text.size(); i += chunk) {
-      on_delta("", std::string_view(text.data() + i, std::min(chunk, text.size() - i)));
-    }
+    Generate(prompt, 256, [&](std::string_view piece) { on_delta("", piece); }, call);
     return true;
   };
   return backend;
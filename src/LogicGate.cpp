@@ -1,7 +1,9 @@
 #include "LogicGate.hpp"
+#include "Trace.hpp"
 
 #include <algorithm>
 #include <cctype>
+#include <cstdint>
 
 namespace app {
 namespace {
@@ -15,6 +17,66 @@ std::string BuildGatePrompt(std::string_view rule, std::string_view input) {
   return prompt;
 }
 
+uint64_t HashRule(std::string_view rule) {
+  // FNV-1a.
+  uint64_t hash = 1469598103934665603ull;
+  for (unsigned char c : rule) {
+    hash ^= c;
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+std::optional<GateResult> AskBackend(ChatBackend& backend,
+                                     std::string_view rule,
+                                     std::string_view input,
+                                     bool stream,
+                                     std::string* error_out) {
+  std::vector<deepseek::Message> messages;
+  messages.push_back({"user", BuildGatePrompt(rule, input), ""});
+  CallContext call;
+  call.kind = CallKind::kGate;
+
+  if (stream) {
+    std::string reasoning_accum;
+    std::string content_accum;
+    bool ok = backend.stream(
+        messages, "You are a strict logic gate. Output YES or NO only.",
+        [&](std::string_view reasoning_delta, std::string_view content_delta) {
+          reasoning_accum.append(reasoning_delta);
+          content_accum.append(content_delta);
+        },
+        &call, error_out);
+    if (!ok) {
+      return std::nullopt;
+    }
+    auto decision = ParseDecision(content_accum);
+    if (!decision) {
+      if (error_out) {
+        *error_out = "Gate did not return YES/NO.";
+      }
+      return std::nullopt;
+    }
+    return GateResult{*decision, content_accum, reasoning_accum, std::nullopt, {}, call.metrics};
+  }
+
+  auto resp = backend.chat(messages, "You are a strict logic gate. Output YES or NO only.",
+                           &call, error_out);
+  if (!resp) {
+    return std::nullopt;
+  }
+  auto decision = ParseDecision(resp->content);
+  if (!decision) {
+    if (error_out) {
+      *error_out = "Gate did not return YES/NO.";
+    }
+    return std::nullopt;
+  }
+  return GateResult{*decision, resp->content, resp->reasoning, std::nullopt, {}, call.metrics};
+}
+
+}  // namespace
+
 std::optional<bool> ParseDecision(std::string_view content) {
   auto to_upper = [](std::string_view s) {
     std::string out(s);
@@ -54,53 +116,33 @@ std::optional<bool> ParseDecision(std::string_view content) {
   return std::nullopt;
 }
 
-}  // namespace
-
 LogicGate::LogicGate(std::string rule) : rule_(std::move(rule)) {}
 
 std::optional<GateResult> LogicGate::Evaluate(ChatBackend& backend,
                                               std::string_view input,
                                               bool stream,
                                               std::string* error_out) const {
-  std::vector<deepseek::Message> messages;
-  messages.push_back({"user", BuildGatePrompt(rule_, input), ""});
-
-  if (stream) {
-    std::string reasoning_accum;
-    std::string content_accum;
-    bool ok = backend.stream(
-        messages, "You are a strict logic gate. Output YES or NO only.",
-        [&](std::string_view reasoning_delta, std::string_view content_delta) {
-          reasoning_accum.append(reasoning_delta);
-          content_accum.append(content_delta);
-        },
-        error_out);
-    if (!ok) {
-      return std::nullopt;
-    }
-    auto decision = ParseDecision(content_accum);
-    if (!decision) {
-      if (error_out) {
-        *error_out = "Gate did not return YES/NO.";
+  TraceSpan span("LogicGate::Evaluate");
+  std::optional<std::vector<float>> embedding;
+  const uint64_t scope = HashRule(rule_);
+  if (cache_ && backend.embed) {
+    // Without an embedding the gate is simply evaluated uncached.
+    embedding = backend.embed(input, nullptr);
+    if (embedding) {
+      if (auto hit = cache_->Lookup(*embedding, scope)) {
+        GateResult result = std::move(hit->value);
+        result.cache_score = hit->score;
+        result.cached_input = std::move(hit->input);
+        result.metrics = {};
+        return result;
       }
-      return std::nullopt;
     }
-    return GateResult{*decision, content_accum, reasoning_accum};
-  }
-
-  auto resp = backend.chat(messages, "You are a strict logic gate. Output YES or NO only.",
-                           error_out);
-  if (!resp) {
-    return std::nullopt;
   }
-  auto decision = ParseDecision(resp->content);
-  if (!decision) {
-    if (error_out) {
-      *error_out = "Gate did not return YES/NO.";
-    }
-    return std::nullopt;
+  auto result = AskBackend(backend, rule_, input, stream, error_out);
+  if (result && embedding) {
+    cache_->Insert(*embedding, scope, std::string(input), *result);
   }
-  return GateResult{*decision, resp->content, resp->reasoning};
+  return result;
 }
 
 }  // namespace app
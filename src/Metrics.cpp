@@ -0,0 +1,277 @@
+#include "Metrics.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+
+namespace app {
+namespace {
+
+const std::vector<double> kMsBounds{1,    2.5,  5,    10,    25,    50,    100,   250,
+                                    500,  1000, 2500, 5000, 10000, 30000, 60000, 120000};
+const std::vector<double> kRateBounds{1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000};
+
+struct HistogramSpec {
+  const char* name;
+  const char* help;
+  const std::vector<double>* bounds;
+};
+
+// Index order matches HistogramValues().
+const HistogramSpec kHistograms[] = {
+    {"queue_ms", "Time waiting for a free backend context.", &kMsBounds},
+    {"ttft_ms", "Time to the first generated token.", &kMsBounds},
+    {"prefill_ms", "Time spent evaluating the prompt.", &kMsBounds},
+    {"decode_ms", "Time spent generating tokens.", &kMsBounds},
+    {"total_ms", "Wall time of the whole call.", &kMsBounds},
+    {"prefill_tokens_per_second", "Prompt evaluation throughput.", &kRateBounds},
+    {"decode_tokens_per_second", "Generation throughput.", &kRateBounds},
+};
+constexpr size_t kHistogramCount = sizeof(kHistograms) / sizeof(kHistograms[0]);
+
+struct CounterSpec {
+  const char* name;
+  const char* help;
+  size_t deepseek::CallMetrics::*field;
+};
+
+const CounterSpec kCounters[] = {
+    {"prefill_tokens", "Prompt tokens evaluated.", &deepseek::CallMetrics::prefill_tokens},
+    {"decode_tokens", "Tokens generated.", &deepseek::CallMetrics::decode_tokens},
+    {"draft_tokens", "Tokens proposed by the draft model.",
+     &deepseek::CallMetrics::draft_tokens},
+    {"draft_accepted_tokens", "Draft tokens accepted by the main model.",
+     &deepseek::CallMetrics::draft_accepted_tokens},
+    {"failovers", "Calls retried on the other backend after an error.",
+     &deepseek::CallMetrics::failovers},
+    {"escalations", "Answers passed to a larger model for low confidence.",
+     &deepseek::CallMetrics::escalations},
+    {"bytes_sent", "Request bytes sent.", &deepseek::CallMetrics::bytes_sent},
+    {"bytes_received", "Response bytes received.", &deepseek::CallMetrics::bytes_received},
+    {"prompt_tokens", "Prompt tokens reported by the API.", &deepseek::CallMetrics::prompt_tokens},
+    {"completion_tokens", "Completion tokens reported by the API.",
+     &deepseek::CallMetrics::completion_tokens},
+    {"reasoning_tokens", "Reasoning tokens reported by the API.",
+     &deepseek::CallMetrics::reasoning_tokens},
+    {"cache_hit_tokens", "Prompt tokens served from the API prefix cache.",
+     &deepseek::CallMetrics::cache_hit_tokens},
+    {"cache_miss_tokens", "Prompt tokens missing from the API prefix cache.",
+     &deepseek::CallMetrics::cache_miss_tokens},
+};
+
+double Rate(size_t tokens, double ms) {
+  return tokens > 0 && ms > 0.0 ? tokens * 1000.0 / ms : 0.0;
+}
+
+// Values to observe, in kHistograms order. Zero means "not measured" and is
+// skipped, except for the queue time.
+std::vector<double> HistogramValues(const deepseek::CallMetrics& m) {
+  return {m.queue_ms,
+          m.ttft_ms,
+          m.prefill_ms,
+          m.decode_ms,
+          m.total_ms,
+          Rate(m.prefill_tokens, m.prefill_ms),
+          Rate(m.decode_tokens, m.decode_ms)};
+}
+
+std::string FormatNumber(double value) {
+  char buf[32];
+  std::snprintf(buf, sizeof(buf), "%.6g", value);
+  return buf;
+}
+
+std::string Labels(const std::pair<std::string, std::string>& key, std::string_view extra = {}) {
+  std::string labels = "{kind=\"" + key.first + "\",backend=\"" + key.second + "\"";
+  if (!extra.empty()) {
+    labels += ",";
+    labels += extra;
+  }
+  return labels + "}";
+}
+
+bool EndsWith(std::string_view text, std::string_view suffix) {
+  return text.size() >= suffix.size() && text.substr(text.size() - suffix.size()) == suffix;
+}
+
+}  // namespace
+
+Histogram::Histogram(std::vector<double> bounds)
+    : bounds_(std::move(bounds)), counts_(bounds_.size() + 1, 0) {}
+
+void Histogram::Observe(double value) {
+  const size_t bucket =
+      std::lower_bound(bounds_.begin(), bounds_.end(), value) - bounds_.begin();
+  ++counts_[bucket];
+  ++count_;
+  sum_ += value;
+}
+
+double Histogram::Quantile(double q) const {
+  if (count_ == 0) {
+    return 0.0;
+  }
+  const double rank = std::clamp(q, 0.0, 1.0) * static_cast<double>(count_);
+  uint64_t seen = 0;
+  for (size_t i = 0; i < counts_.size(); ++i) {
+    if (counts_[i] == 0 || seen + counts_[i] < rank) {
+      seen += counts_[i];
+      continue;
+    }
+    if (i == bounds_.size()) {
+      // Beyond the last bound: the best estimate is the bound itself.
+      return bounds_.empty() ? 0.0 : bounds_.back();
+    }
+    const double lower = i == 0 ? 0.0 : bounds_[i - 1];
+    const double fraction = (rank - static_cast<double>(seen)) / static_cast<double>(counts_[i]);
+    return lower + (bounds_[i] - lower) * fraction;
+  }
+  return bounds_.empty() ? 0.0 : bounds_.back();
+}
+
+void MetricsRegistry::Record(std::string_view kind, const deepseek::CallMetrics& metrics) {
+  const std::string backend = metrics.backend.empty() ? "unknown" : metrics.backend;
+  const std::vector<double> values = HistogramValues(metrics);
+  std::lock_guard<std::mutex> lock(mutex_);
+  Series& series = series_[{std::string(kind), backend}];
+  if (series.histograms.empty()) {
+    for (const auto& spec : kHistograms) {
+      series.histograms.emplace_back(*spec.bounds);
+    }
+    series.counters.assign(std::size(kCounters), 0);
+  }
+  ++series.calls;
+  for (size_t i = 0; i < kHistogramCount; ++i) {
+    if (values[i] > 0.0 || i == 0) {
+      series.histograms[i].Observe(values[i]);
+    }
+  }
+  for (size_t i = 0; i < std::size(kCounters); ++i) {
+    series.counters[i] += metrics.*kCounters[i].field;
+  }
+}
+
+uint64_t MetricsRegistry::calls() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  uint64_t total = 0;
+  for (const auto& [key, series] : series_) {
+    total += series.calls;
+  }
+  return total;
+}
+
+uint64_t MetricsRegistry::counter(std::string_view name) const {
+  const auto spec = std::find_if(std::begin(kCounters), std::end(kCounters),
+                                 [&](const CounterSpec& c) { return name == c.name; });
+  if (spec == std::end(kCounters)) {
+    return 0;
+  }
+  const size_t index = static_cast<size_t>(spec - std::begin(kCounters));
+  std::lock_guard<std::mutex> lock(mutex_);
+  uint64_t total = 0;
+  for (const auto& [key, series] : series_) {
+    total += series.counters[index];
+  }
+  return total;
+}
+
+std::string MetricsRegistry::ToPrometheus() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::ostringstream out;
+  out << "# HELP cppdeepseek_calls_total Backend calls.\n"
+      << "# TYPE cppdeepseek_calls_total counter\n";
+  for (const auto& [key, series] : series_) {
+    out << "cppdeepseek_calls_total" << Labels(key) << " " << series.calls << "\n";
+  }
+  for (size_t c = 0; c < std::size(kCounters); ++c) {
+    const std::string name = std::string("cppdeepseek_") + kCounters[c].name + "_total";
+    out << "# HELP " << name << " " << kCounters[c].help << "\n"
+        << "# TYPE " << name << " counter\n";
+    for (const auto& [key, series] : series_) {
+      out << name << Labels(key) << " " << series.counters[c] << "\n";
+    }
+  }
+  for (size_t h = 0; h < kHistogramCount; ++h) {
+    const std::string name = std::string("cppdeepseek_") + kHistograms[h].name;
+    out << "# HELP " << name << " " << kHistograms[h].help << "\n"
+        << "# TYPE " << name << " histogram\n";
+    for (const auto& [key, series] : series_) {
+      const Histogram& histogram = series.histograms[h];
+      uint64_t cumulative = 0;
+      for (size_t b = 0; b < histogram.counts().size(); ++b) {
+        cumulative += histogram.counts()[b];
+        const std::string le =
+            b < histogram.bounds().size() ? FormatNumber(histogram.bounds()[b]) : "+Inf";
+        out << name << "_bucket" << Labels(key, "le=\"" + le + "\"") << " " << cumulative
+            << "\n";
+      }
+      out << name << "_sum" << Labels(key) << " " << FormatNumber(histogram.sum()) << "\n";
+      out << name << "_count" << Labels(key) << " " << histogram.count() << "\n";
+    }
+  }
+  return out.str();
+}
+
+std::string MetricsRegistry::ToJson() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  nlohmann::json root;
+  root["series"] = nlohmann::json::array();
+  for (const auto& [key, series] : series_) {
+    nlohmann::json s{{"kind", key.first}, {"backend", key.second}, {"calls", series.calls}};
+    for (size_t c = 0; c < std::size(kCounters); ++c) {
+      s["counters"][kCounters[c].name] = series.counters[c];
+    }
+    for (size_t h = 0; h < kHistogramCount; ++h) {
+      const Histogram& histogram = series.histograms[h];
+      nlohmann::json buckets = nlohmann::json::array();
+      for (size_t b = 0; b < histogram.bounds().size(); ++b) {
+        buckets.push_back({{"le", histogram.bounds()[b]}, {"count", histogram.counts()[b]}});
+      }
+      buckets.push_back({{"le", "+Inf"}, {"count", histogram.counts().back()}});
+      const double count = static_cast<double>(histogram.count());
+      s["histograms"][kHistograms[h].name] = {
+          {"count", histogram.count()},
+          {"sum", histogram.sum()},
+          {"mean", count > 0 ? histogram.sum() / count : 0.0},
+          {"p50", histogram.Quantile(0.5)},
+          {"p90", histogram.Quantile(0.9)},
+          {"p99", histogram.Quantile(0.99)},
+          {"buckets", buckets}};
+    }
+    root["series"].push_back(std::move(s));
+  }
+  return root.dump(2);
+}
+
+bool MetricsRegistry::Write(std::string_view path, std::string* error_out) const {
+  const bool prometheus = EndsWith(path, ".prom") || EndsWith(path, ".txt");
+  const std::string text = prometheus ? ToPrometheus() : ToJson() + "\n";
+  const std::filesystem::path file{std::string(path)};
+  const std::filesystem::path tmp = file.string() + ".tmp";
+  {
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    if (!out || !out.write(text.data(), static_cast<std::streamsize>(text.size()))) {
+      if (error_out) {
+        *error_out = "Failed to write file: " + tmp.string();
+      }
+      return false;
+    }
+  }
+  // Scrapers reading the file never see a partial export.
+  std::error_code ec;
+  std::filesystem::rename(tmp, file, ec);
+  if (ec) {
+    if (error_out) {
+      *error_out = "Failed to replace " + file.string() + ": " + ec.message();
+    }
+    return false;
+  }
+  return true;
+}
+
+}  // namespace app
@@ -0,0 +1,175 @@
+#include "PrefixCache.hpp"
+
+#include <map>
+
+namespace app {
+
+struct PrefixCache::Node {
+  // Tokens on the edge from the parent to this node.
+  std::vector<int32_t> edge;
+  Node* parent = nullptr;
+  // Keyed by the first token of the child's edge.
+  std::map<int32_t, std::unique_ptr<Node>> children;
+  // The state whose tokens end exactly at this node.
+  std::shared_ptr<const Entry> entry;
+  uint64_t last_used = 0;
+};
+
+namespace {
+
+// The most recently used entry at or below `node`.
+template <typename NodeT>
+NodeT* NewestEntry(NodeT* node) {
+  NodeT* best = node->entry ? node : nullptr;
+  for (auto& [token, child] : node->children) {
+    NodeT* found = NewestEntry(child.get());
+    if (found && (!best || found->last_used > best->last_used)) {
+      best = found;
+    }
+  }
+  return best;
+}
+
+// The least recently used entry at or below `node`, other than `keep`.
+template <typename NodeT>
+NodeT* OldestEntry(NodeT* node, const NodeT* keep) {
+  NodeT* best = node->entry && node != keep ? node : nullptr;
+  for (auto& [token, child] : node->children) {
+    NodeT* found = OldestEntry(child.get(), keep);
+    if (found && (!best || found->last_used < best->last_used)) {
+      best = found;
+    }
+  }
+  return best;
+}
+
+}  // namespace
+
+PrefixCache::PrefixCache(size_t budget_bytes)
+    : budget_bytes_(budget_bytes), root_(std::make_unique<Node>()) {}
+
+PrefixCache::~PrefixCache() = default;
+
+std::optional<PrefixCache::Match> PrefixCache::Lookup(const std::vector<int32_t>& tokens) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++stats_.lookups;
+  Node* node = root_.get();
+  size_t matched = 0;
+  while (matched < tokens.size()) {
+    auto it = node->children.find(tokens[matched]);
+    if (it == node->children.end()) {
+      break;
+    }
+    Node* child = it->second.get();
+    size_t k = 0;
+    while (k < child->edge.size() && matched + k < tokens.size() &&
+           child->edge[k] == tokens[matched + k]) {
+      ++k;
+    }
+    matched += k;
+    node = child;
+    if (k < child->edge.size()) {
+      break;
+    }
+  }
+  if (matched == 0) {
+    return std::nullopt;
+  }
+  // Every entry below the point where the walk stopped starts with the
+  // matched tokens.
+  Node* holder = NewestEntry(node);
+  if (!holder) {
+    return std::nullopt;
+  }
+  holder->last_used = ++clock_;
+  ++stats_.hits;
+  stats_.hit_tokens += matched;
+  return Match{matched, holder->entry};
+}
+
+void PrefixCache::Insert(std::vector<int32_t> tokens, std::vector<uint8_t> state) {
+  if (tokens.empty() || state.size() > budget_bytes_) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  Node* node = root_.get();
+  size_t i = 0;
+  while (i < tokens.size()) {
+    auto it = node->children.find(tokens[i]);
+    if (it == node->children.end()) {
+      auto child = std::make_unique<Node>();
+      child->edge.assign(tokens.begin() + i, tokens.end());
+      child->parent = node;
+      Node* raw = child.get();
+      node->children.emplace(tokens[i], std::move(child));
+      node = raw;
+      break;
+    }
+    Node* child = it->second.get();
+    size_t k = 0;
+    while (k < child->edge.size() && i + k < tokens.size() && child->edge[k] == tokens[i + k]) {
+      ++k;
+    }
+    if (k < child->edge.size()) {
+      // Split the edge where the new tokens diverge (or end).
+      auto mid = std::make_unique<Node>();
+      mid->edge.assign(child->edge.begin(), child->edge.begin() + k);
+      mid->parent = node;
+      auto owned = std::move(it->second);
+      owned->edge.erase(owned->edge.begin(), owned->edge.begin() + k);
+      owned->parent = mid.get();
+      mid->children.emplace(owned->edge.front(), std::move(owned));
+      child = mid.get();
+      it->second = std::move(mid);
+    }
+    node = child;
+    i += k;
+    if (node->entry && i < tokens.size()) {
+      RemoveEntry(node, false);
+    }
+  }
+
+  if (node->entry) {
+    RemoveEntry(node, false);
+  }
+  auto entry = std::make_shared<Entry>();
+  entry->tokens = std::move(tokens);
+  entry->state = std::move(state);
+  stats_.bytes += entry->state.size();
+  ++stats_.entries;
+  node->entry = std::move(entry);
+  node->last_used = ++clock_;
+  EvictTo(budget_bytes_, node);
+}
+
+PrefixCache::Stats PrefixCache::stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+void PrefixCache::RemoveEntry(Node* node, bool prune) {
+  stats_.bytes -= node->entry->state.size();
+  --stats_.entries;
+  node->entry.reset();
+  if (!prune) {
+    return;
+  }
+  while (node != root_.get() && !node->entry && node->children.empty()) {
+    Node* parent = node->parent;
+    parent->children.erase(node->edge.front());
+    node = parent;
+  }
+}
+
+void PrefixCache::EvictTo(size_t budget, const Node* keep) {
+  while (stats_.bytes > budget) {
+    Node* victim = OldestEntry(root_.get(), keep);
+    if (!victim) {
+      break;
+    }
+    RemoveEntry(victim, true);
+    ++stats_.evictions;
+  }
+}
+
+}  // namespace app
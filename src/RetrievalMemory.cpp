@@ -0,0 +1,258 @@
+#include "RetrievalMemory.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <utility>
+
+namespace app {
+namespace {
+
+constexpr char kMagic[4] = {'C', 'D', 'V', 'M'};
+constexpr uint32_t kVersion = 1;
+
+uint64_t HashMessage(const deepseek::Message& message) {
+  // FNV-1a over role and content.
+  uint64_t hash = 1469598103934665603ull;
+  for (const std::string* part : {&message.role, &message.content}) {
+    for (unsigned char c : *part) {
+      hash ^= c;
+      hash *= 1099511628211ull;
+    }
+    hash ^= 0xff;
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+template <typename T>
+void WritePod(std::ostream& out, const T& value) {
+  out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+bool ReadPod(std::istream& in, T* value) {
+  return static_cast<bool>(in.read(reinterpret_cast<char*>(value), sizeof(T)));
+}
+
+}  // namespace
+
+RetrievalMemory::RetrievalMemory(RetrievalOptions options) : options_(options) {}
+
+bool RetrievalMemory::Index(const ChatBackend& backend, const Agent& agent, std::string* error_out) {
+  if (!backend.embed) {
+    if (error_out) {
+      *error_out = "Backend does not support embeddings.";
+    }
+    return false;
+  }
+  const auto& memory = agent.memory;
+  size_t next = 0;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& entry = agents_[agent.name];
+    while (next < entry.hashes.size() && next < memory.size() &&
+           entry.hashes[next] == HashMessage(memory[next])) {
+      ++next;
+    }
+    entry.hashes.resize(next);
+    entry.index.Truncate(next);
+  }
+
+  bool restarted = false;
+  while (next < memory.size()) {
+    std::string error;
+    auto vector = backend.embed(memory[next].content, &error);
+    if (!vector) {
+      if (error_out) {
+        *error_out = "Embedding failed: " + error;
+      }
+      return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& entry = agents_[agent.name];
+    if (entry.hashes.size() != next) {
+      // Another call is indexing the same agent.
+      return true;
+    }
+    if (!entry.index.Add(next, *vector)) {
+      if (restarted) {
+        if (error_out) {
+          *error_out = "Embeddings have inconsistent dimensions.";
+        }
+        return false;
+      }
+      // Loaded vectors from a different embedding model: start over.
+      entry.index.Clear();
+      entry.hashes.clear();
+      next = 0;
+      restarted = true;
+      continue;
+    }
+    entry.hashes.push_back(HashMessage(memory[next]));
+    ++next;
+  }
+  return true;
+}
+
+std::vector<deepseek::Message> RetrievalMemory::BuildPrompt(const ChatBackend& backend,
+                                                            const Agent& agent,
+                                                            std::string_view user_input,
+                                                            std::string* error_out) {
+  const auto& memory = agent.memory;
+  if (memory.size() <= options_.recent) {
+    return app::BuildPrompt(agent, user_input);
+  }
+  std::string error;
+  std::optional<std::vector<float>> query;
+  if (Index(backend, agent, &error)) {
+    query = backend.embed(user_input, &error);
+  }
+  if (!query) {
+    if (error_out) {
+      *error_out = error;
+    }
+    return app::BuildPrompt(agent, user_input);
+  }
+
+  size_t older = memory.size() - options_.recent;
+  if (options_.stable_prefix && options_.recent > 0) {
+    older -= older % options_.recent;
+  }
+  std::vector<VectorMatch> matches;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = agents_.find(agent.name);
+    if (it != agents_.end()) {
+      matches = it->second.index.Search(*query, options_.top_k, options_.min_score,
+                                        [older](uint64_t id) { return id < older; });
+    }
+  }
+  std::vector<size_t> picked;
+  for (const auto& match : matches) {
+    picked.push_back(static_cast<size_t>(match.id));
+  }
+  std::sort(picked.begin(), picked.end());
+
+  std::vector<deepseek::Message> messages;
+  messages.reserve(picked.size() + memory.size() - older + 1);
+  if (options_.stable_prefix) {
+    messages.assign(memory.begin() + static_cast<std::ptrdiff_t>(older), memory.end());
+    std::string input;
+    if (!picked.empty()) {
+      input = "Relevant earlier messages:\n";
+      for (size_t i : picked) {
+        input.append(memory[i].role).append(": ").append(memory[i].content).append("\n");
+      }
+      input.append("\n");
+    }
+    input.append(user_input);
+    messages.push_back({"user", std::move(input), ""});
+    return messages;
+  }
+  for (size_t i : picked) {
+    messages.push_back(memory[i]);
+  }
+  messages.insert(messages.end(), memory.begin() + static_cast<std::ptrdiff_t>(older), memory.end());
+  messages.push_back({"user", std::string(user_input), ""});
+  return messages;
+}
+
+size_t RetrievalMemory::Indexed(const std::string& agent_name) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = agents_.find(agent_name);
+  return it == agents_.end() ? 0 : it->second.hashes.size();
+}
+
+bool RetrievalMemory::Save(std::string_view path, std::string* error_out) const {
+  const std::filesystem::path file{std::string(path)};
+  const std::filesystem::path tmp = file.string() + ".tmp";
+  {
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    if (!out) {
+      if (error_out) {
+        *error_out = "Failed to open file for write: " + tmp.string();
+      }
+      return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    out.write(kMagic, sizeof(kMagic));
+    WritePod(out, kVersion);
+    WritePod(out, static_cast<uint32_t>(agents_.size()));
+    for (const auto& [name, entry] : agents_) {
+      WritePod(out, static_cast<uint32_t>(name.size()));
+      out.write(name.data(), static_cast<std::streamsize>(name.size()));
+      WritePod(out, static_cast<uint64_t>(entry.hashes.size()));
+      out.write(reinterpret_cast<const char*>(entry.hashes.data()),
+                static_cast<std::streamsize>(entry.hashes.size() * sizeof(uint64_t)));
+      entry.index.Write(out);
+    }
+    if (!out) {
+      if (error_out) {
+        *error_out = "Failed to write file: " + tmp.string();
+      }
+      return false;
+    }
+  }
+  std::error_code ec;
+  std::filesystem::rename(tmp, file, ec);
+  if (ec) {
+    if (error_out) {
+      *error_out = "Failed to replace " + file.string() + ": " + ec.message();
+    }
+    return false;
+  }
+  return true;
+}
+
+bool RetrievalMemory::Load(std::string_view path, std::string* error_out) {
+  std::ifstream in{std::string(path), std::ios::binary};
+  if (!in) {
+    if (error_out) {
+      *error_out = "Failed to open file for read: " + std::string(path);
+    }
+    return false;
+  }
+  char magic[sizeof(kMagic)] = {};
+  uint32_t version = 0;
+  uint32_t count = 0;
+  if (!in.read(magic, sizeof(magic)) || std::memcmp(magic, kMagic, sizeof(magic)) != 0 ||
+      !ReadPod(in, &version) || version != kVersion || !ReadPod(in, &count)) {
+    if (error_out) {
+      *error_out = "Not a retrieval index: " + std::string(path);
+    }
+    return false;
+  }
+  std::map<std::string, AgentIndex> agents;
+  for (uint32_t i = 0; i < count; ++i) {
+    uint32_t name_size = 0;
+    uint64_t n = 0;
+    std::string name;
+    AgentIndex entry;
+    bool ok = ReadPod(in, &name_size) && name_size <= 4096;
+    if (ok) {
+      name.resize(name_size);
+      ok = in.read(name.data(), name_size) && ReadPod(in, &n) && n <= (uint64_t{1} << 28);
+    }
+    if (ok) {
+      entry.hashes.resize(n);
+      ok = in.read(reinterpret_cast<char*>(entry.hashes.data()),
+                   static_cast<std::streamsize>(n * sizeof(uint64_t))) &&
+           entry.index.Read(in) && entry.index.size() == n;
+    }
+    if (!ok) {
+      if (error_out) {
+        *error_out = "Corrupt retrieval index: " + std::string(path);
+      }
+      return false;
+    }
+    agents[name] = std::move(entry);
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  agents_ = std::move(agents);
+  return true;
+}
+
+}  // namespace app
@@ -0,0 +1,325 @@
+#include "ThreadTuning.hpp"
+
+#include "ModelStore.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <utility>
+
+namespace app {
+namespace {
+
+namespace fs = std::filesystem;
+
+constexpr int kBatchSizes[] = {256, 512, 1024};
+
+bool ReadInt(const fs::path& path, int* value) {
+  std::ifstream in(path);
+  return static_cast<bool>(in >> *value);
+}
+
+std::string Slug(std::string_view text) {
+  std::string slug;
+  for (char c : text) {
+    const auto u = static_cast<unsigned char>(c);
+    if (std::isalnum(u)) {
+      slug.push_back(static_cast<char>(std::tolower(u)));
+    } else if (!slug.empty() && slug.back() != '-') {
+      slug.push_back('-');
+    }
+  }
+  while (!slug.empty() && slug.back() == '-') {
+    slug.pop_back();
+  }
+  return slug.empty() ? "unknown" : slug;
+}
+
+// Model files are usually <home>/<model>/model.gguf, so the directory name
+// is part of the identity.
+std::string ModelName(std::string_view model_path) {
+  const fs::path path(model_path);
+  const std::string parent = path.parent_path().filename().string();
+  return parent.empty() ? path.filename().string() : parent + "/" + path.filename().string();
+}
+
+uint64_t ModelBytes(std::string_view model_path) {
+  std::error_code ec;
+  const auto size = fs::file_size(fs::path(model_path), ec);
+  return ec ? 0 : static_cast<uint64_t>(size);
+}
+
+// Parses a sysfs cpulist such as "0-3,8-11".
+std::vector<int> ParseCpuList(const std::string& list) {
+  std::vector<int> cpus;
+  std::stringstream in(list);
+  std::string range;
+  while (std::getline(in, range, ',')) {
+    int first = 0;
+    int last = 0;
+    const int n = std::sscanf(range.c_str(), "%d-%d", &first, &last);
+    if (n == 1) {
+      last = first;
+    } else if (n != 2) {
+      continue;
+    }
+    for (int cpu = first; cpu <= last; ++cpu) {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+}  // namespace
+
+CpuTopology DetectCpuTopology(const std::string& sysfs_cpu_dir, const std::string& cpuinfo_path) {
+  CpuTopology topology;
+  topology.logical_cpus = static_cast<int>(std::thread::hardware_concurrency());
+
+  std::ifstream cpuinfo(cpuinfo_path);
+  std::string line;
+  while (std::getline(cpuinfo, line)) {
+    if (line.rfind("model name", 0) == 0 || line.rfind("Model", 0) == 0) {
+      const size_t colon = line.find(':');
+      if (colon != std::string::npos) {
+        topology.cpu_model = line.substr(line.find_first_not_of(" \t", colon + 1));
+        break;
+      }
+    }
+  }
+
+  // (package, core) -> lowest logical CPU id on that core.
+  std::map<std::pair<int, int>, int> cores;
+  int logical = 0;
+  std::error_code ec;
+  for (const auto& entry : fs::directory_iterator(sysfs_cpu_dir, ec)) {
+    const std::string name = entry.path().filename().string();
+    if (name.size() <= 3 || name.compare(0, 3, "cpu") != 0 ||
+        !std::all_of(name.begin() + 3, name.end(), [](char c) { return std::isdigit(c); })) {
+      continue;
+    }
+    const int cpu = std::stoi(name.substr(3));
+    int core = 0;
+    int package = 0;
+    if (!ReadInt(entry.path() / "topology" / "core_id", &core)) {
+      continue;
+    }
+    ReadInt(entry.path() / "topology" / "physical_package_id", &package);
+    ++logical;
+    auto [it, inserted] = cores.emplace(std::make_pair(package, core), cpu);
+    if (!inserted) {
+      it->second = std::min(it->second, cpu);
+    }
+  }
+  if (logical > 0) {
+    topology.logical_cpus = logical;
+    for (const auto& [key, cpu] : cores) {
+      topology.core_cpus.push_back(cpu);
+    }
+    std::sort(topology.core_cpus.begin(), topology.core_cpus.end());
+  }
+  if (topology.logical_cpus <= 0) {
+    topology.logical_cpus = 1;
+  }
+
+  std::map<int, std::vector<int>> nodes;
+  const fs::path node_dir = fs::path(sysfs_cpu_dir).parent_path() / "node";
+  for (const auto& entry : fs::directory_iterator(node_dir, ec)) {
+    const std::string name = entry.path().filename().string();
+    if (name.size() <= 4 || name.compare(0, 4, "node") != 0 ||
+        !std::all_of(name.begin() + 4, name.end(), [](char c) { return std::isdigit(c); })) {
+      continue;
+    }
+    std::ifstream cpulist(entry.path() / "cpulist");
+    std::string list;
+    if (!std::getline(cpulist, list)) {
+      continue;
+    }
+    const std::vector<int> cpus = ParseCpuList(list);
+    auto& node_cores = nodes[std::stoi(name.substr(4))];
+    for (int cpu : topology.core_cpus) {
+      if (std::find(cpus.begin(), cpus.end(), cpu) != cpus.end()) {
+        node_cores.push_back(cpu);
+      }
+    }
+  }
+  for (auto& [node, cores] : nodes) {
+    if (!cores.empty()) {
+      topology.numa_nodes.push_back(std::move(cores));
+    }
+  }
+  if (topology.cpu_model.empty()) {
+    topology.cpu_model = "unknown-cpu";
+  }
+  return topology;
+}
+
+std::vector<TuneCandidate> TuneCandidates(const CpuTopology& topology, int n_ctx) {
+  const int physical = topology.physical_cores();
+  std::set<int> threads = {std::max(1, physical / 2), std::max(1, physical * 3 / 4), physical,
+                           topology.logical_cpus};
+  std::vector<TuneCandidate> candidates;
+  for (int n_batch : kBatchSizes) {
+    if (n_batch > n_ctx) {
+      break;
+    }
+    for (int t : threads) {
+      candidates.push_back({t, n_batch, false});
+      // Pinning is only meaningful with one thread per physical core.
+      if (!topology.core_cpus.empty() && t <= physical) {
+        candidates.push_back({t, n_batch, true});
+      }
+    }
+  }
+  return candidates;
+}
+
+std::vector<ContextPlacement> PlanContextPlacement(const CpuTopology& topology,
+                                                   int n_contexts,
+                                                   int n_threads,
+                                                   int n_threads_batch,
+                                                   bool numa) {
+  std::vector<std::vector<int>> groups;
+  if (numa && topology.numa_nodes.size() > 1) {
+    groups = topology.numa_nodes;
+  } else {
+    groups.push_back(topology.core_cpus);
+  }
+  const int n_groups = static_cast<int>(groups.size());
+  n_contexts = std::max(1, n_contexts);
+
+  std::vector<ContextPlacement> placements(n_contexts);
+  for (int i = 0; i < n_contexts; ++i) {
+    const int group = i % n_groups;
+    const int rank = i / n_groups;
+    const int members = n_contexts / n_groups + (group < n_contexts % n_groups ? 1 : 0);
+    const auto& cores = groups[group];
+    auto& placement = placements[i];
+    placement.numa_node = n_groups > 1 ? group : -1;
+    if (!cores.empty()) {
+      const size_t share = std::max<size_t>(1, cores.size() / members);
+      const size_t begin = std::min(cores.size() - 1, rank * share);
+      const size_t end = std::min(cores.size(), begin + share);
+      placement.cpus.assign(cores.begin() + begin, cores.begin() + end);
+    }
+    placement.n_threads = std::max(1, n_threads / n_contexts);
+    placement.n_threads_batch = std::max(1, n_threads_batch / n_contexts);
+    if (n_groups > 1) {
+      // Stay on the node: never more threads than it has cores.
+      placement.n_threads = std::min<int>(placement.n_threads, placement.cpus.size());
+      placement.n_threads_batch = std::min<int>(placement.n_threads_batch, placement.cpus.size());
+    }
+  }
+  return placements;
+}
+
+ThreadProfile SelectThreadProfile(const std::vector<TuneSample>& samples,
+                                  const CpuTopology& topology,
+                                  std::string_view model_path) {
+  ThreadProfile profile;
+  profile.cpu_model = topology.cpu_model;
+  profile.model = ModelName(model_path);
+  profile.model_bytes = ModelBytes(model_path);
+  for (const auto& sample : samples) {
+    if (sample.decode_tps > profile.decode_tps) {
+      profile.decode_tps = sample.decode_tps;
+      profile.n_threads = sample.candidate.threads;
+      profile.pin_threads = sample.candidate.pin;
+    }
+    if (sample.prefill_tps > profile.prefill_tps) {
+      profile.prefill_tps = sample.prefill_tps;
+      profile.n_threads_batch = sample.candidate.threads;
+      profile.n_batch = sample.candidate.n_batch;
+      profile.n_ubatch = sample.candidate.n_batch;
+      profile.pin_threads_batch = sample.candidate.pin;
+    }
+  }
+  return profile;
+}
+
+std::string ThreadProfilePath(const CpuTopology& topology, std::string_view model_path) {
+  return (fs::path(deepseek::ModelStore::ResolveModelHome()) / "profiles" /
+          (Slug(topology.cpu_model) + "--" + Slug(ModelName(model_path)) + ".json"))
+      .string();
+}
+
+bool SaveThreadProfile(const ThreadProfile& profile, std::string_view path, std::string* error_out) {
+  const fs::path file(path);
+  std::error_code ec;
+  fs::create_directories(file.parent_path(), ec);
+  std::ofstream out(file);
+  if (!out) {
+    if (error_out) {
+      *error_out = "Failed to open file for write: " + file.string();
+    }
+    return false;
+  }
+  const nlohmann::json j{{"cpu_model", profile.cpu_model},
+                         {"model", profile.model},
+                         {"model_bytes", profile.model_bytes},
+                         {"n_threads", profile.n_threads},
+                         {"n_threads_batch", profile.n_threads_batch},
+                         {"n_batch", profile.n_batch},
+                         {"n_ubatch", profile.n_ubatch},
+                         {"pin_threads", profile.pin_threads},
+                         {"pin_threads_batch", profile.pin_threads_batch},
+                         {"decode_tps", profile.decode_tps},
+                         {"prefill_tps", profile.prefill_tps}};
+  out << j.dump(2) << "\n";
+  if (!out) {
+    if (error_out) {
+      *error_out = "Failed to write file: " + file.string();
+    }
+    return false;
+  }
+  return true;
+}
+
+std::optional<ThreadProfile> LoadThreadProfile(std::string_view path,
+                                               std::string_view model_path,
+                                               std::string* error_out) {
+  std::ifstream in{std::string(path)};
+  if (!in) {
+    if (error_out) {
+      *error_out = "Failed to open file for read: " + std::string(path);
+    }
+    return std::nullopt;
+  }
+  ThreadProfile profile;
+  try {
+    const auto j = nlohmann::json::parse(in);
+    profile.cpu_model = j.value("cpu_model", "");
+    profile.model = j.value("model", "");
+    profile.model_bytes = j.value("model_bytes", uint64_t{0});
+    profile.n_threads = j.value("n_threads", 0);
+    profile.n_threads_batch = j.value("n_threads_batch", 0);
+    profile.n_batch = j.value("n_batch", 0);
+    profile.n_ubatch = j.value("n_ubatch", 0);
+    profile.pin_threads = j.value("pin_threads", false);
+    profile.pin_threads_batch = j.value("pin_threads_batch", false);
+    profile.decode_tps = j.value("decode_tps", 0.0);
+    profile.prefill_tps = j.value("prefill_tps", 0.0);
+  } catch (const std::exception& ex) {
+    if (error_out) {
+      *error_out = std::string("Invalid JSON: ") + ex.what();
+    }
+    return std::nullopt;
+  }
+  if (profile.model != ModelName(model_path) || profile.model_bytes != ModelBytes(model_path)) {
+    if (error_out) {
+      *error_out = "Profile was measured for a different model file.";
+    }
+    return std::nullopt;
+  }
+  return profile;
+}
+
+}  // namespace app
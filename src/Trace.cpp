@@ -0,0 +1,198 @@
+#include "Trace.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <unistd.h>
+#endif
+
+namespace app {
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Per-thread cap; later spans are counted as dropped.
+constexpr size_t kMaxEventsPerThread = size_t{1} << 20;
+
+struct Event {
+  const char* name;
+  std::string detail;
+  Clock::time_point start;
+  Clock::time_point end;
+};
+
+struct ThreadBuffer {
+  uint64_t generation = 0;
+  uint32_t tid = 0;
+  // Only contended while the trace is written.
+  std::mutex mutex;
+  std::string name;
+  std::vector<Event> events;
+  size_t dropped = 0;
+};
+
+struct Tracer {
+  std::atomic<bool> enabled{false};
+  std::atomic<uint64_t> generation{0};
+  std::mutex mutex;
+  Clock::time_point origin;
+  std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+  uint32_t next_tid = 1;
+};
+
+Tracer& GetTracer() {
+  static Tracer tracer;
+  return tracer;
+}
+
+// Buffers stay owned by the tracer, so spans of threads that already exited
+// are still written.
+ThreadBuffer& LocalBuffer() {
+  thread_local std::shared_ptr<ThreadBuffer> local;
+  Tracer& tracer = GetTracer();
+  const uint64_t generation = tracer.generation.load(std::memory_order_acquire);
+  if (!local || local->generation != generation) {
+    auto buffer = std::make_shared<ThreadBuffer>();
+    buffer->generation = generation;
+    std::lock_guard<std::mutex> lock(tracer.mutex);
+    buffer->tid = tracer.next_tid++;
+    if (local && !local->name.empty()) {
+      buffer->name = local->name;
+    }
+    tracer.buffers.push_back(buffer);
+    local = std::move(buffer);
+  }
+  return *local;
+}
+
+double Micros(Clock::time_point origin, Clock::time_point t) {
+  return std::chrono::duration<double, std::micro>(t - origin).count();
+}
+
+}  // namespace
+
+void StartTracing() {
+  Tracer& tracer = GetTracer();
+  {
+    std::lock_guard<std::mutex> lock(tracer.mutex);
+    tracer.buffers.clear();
+    tracer.next_tid = 1;
+    tracer.origin = Clock::now();
+    tracer.generation.fetch_add(1, std::memory_order_acq_rel);
+  }
+  tracer.enabled.store(true, std::memory_order_release);
+}
+
+void StopTracing() { GetTracer().enabled.store(false, std::memory_order_release); }
+
+bool TracingEnabled() { return GetTracer().enabled.load(std::memory_order_relaxed); }
+
+void SetTraceThreadName(std::string_view name) {
+  if (!TracingEnabled()) {
+    return;
+  }
+  ThreadBuffer& buffer = LocalBuffer();
+  std::lock_guard<std::mutex> lock(buffer.mutex);
+  buffer.name = std::string(name);
+}
+
+TraceSpan::TraceSpan(const char* name, std::string_view detail) {
+  if (TracingEnabled()) {
+    name_ = name;
+    detail_ = std::string(detail);
+    start_ = Clock::now();
+  }
+}
+
+void TraceSpan::End() {
+  if (!name_) {
+    return;
+  }
+  const auto end = Clock::now();
+  const char* name = std::exchange(name_, nullptr);
+  if (!TracingEnabled()) {
+    return;
+  }
+  ThreadBuffer& buffer = LocalBuffer();
+  std::lock_guard<std::mutex> lock(buffer.mutex);
+  if (buffer.events.size() >= kMaxEventsPerThread) {
+    ++buffer.dropped;
+    return;
+  }
+  buffer.events.push_back({name, std::move(detail_), start_, end});
+}
+
+bool WriteTrace(std::string_view path, std::string* error_out) {
+  Tracer& tracer = GetTracer();
+  std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+  Clock::time_point origin;
+  {
+    std::lock_guard<std::mutex> lock(tracer.mutex);
+    buffers = tracer.buffers;
+    origin = tracer.origin;
+  }
+#if defined(_WIN32)
+  const int pid = 1;
+#else
+  const int pid = static_cast<int>(::getpid());
+#endif
+
+  nlohmann::json events = nlohmann::json::array();
+  events.push_back({{"ph", "M"},
+                    {"pid", pid},
+                    {"tid", 0},
+                    {"name", "process_name"},
+                    {"args", {{"name", "CppDeepSeek"}}}});
+  for (const auto& buffer : buffers) {
+    std::lock_guard<std::mutex> lock(buffer->mutex);
+    const std::string thread_name =
+        buffer->name.empty() ? "thread " + std::to_string(buffer->tid) : buffer->name;
+    events.push_back({{"ph", "M"},
+                      {"pid", pid},
+                      {"tid", buffer->tid},
+                      {"name", "thread_name"},
+                      {"args", {{"name", thread_name}}}});
+    for (const auto& event : buffer->events) {
+      nlohmann::json e{{"ph", "X"},
+                       {"pid", pid},
+                       {"tid", buffer->tid},
+                       {"name", event.name},
+                       {"ts", Micros(origin, event.start)},
+                       {"dur", Micros(event.start, event.end)}};
+      if (!event.detail.empty()) {
+        e["args"] = {{"detail", event.detail}};
+      }
+      events.push_back(std::move(e));
+    }
+    if (buffer->dropped > 0) {
+      events.push_back({{"ph", "i"},
+                        {"pid", pid},
+                        {"tid", buffer->tid},
+                        {"s", "t"},
+                        {"name", "dropped " + std::to_string(buffer->dropped) + " spans"},
+                        {"ts", Micros(origin, buffer->events.back().end)}});
+    }
+  }
+
+  const nlohmann::json root{{"traceEvents", std::move(events)}, {"displayTimeUnit", "ms"}};
+  const std::string text = root.dump();
+  std::ofstream out{std::filesystem::path(std::string(path)), std::ios::binary | std::ios::trunc};
+  if (!out || !out.write(text.data(), static_cast<std::streamsize>(text.size()))) {
+    if (error_out) {
+      *error_out = "Failed to write file: " + std::string(path);
+    }
+    return false;
+  }
+  return true;
+}
+
+}  // namespace app
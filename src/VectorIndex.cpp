@@ -0,0 +1,207 @@
+#include "VectorIndex.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <istream>
+#include <ostream>
+#include <utility>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define VECTOR_INDEX_X86 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define VECTOR_INDEX_NEON 1
+#endif
+
+namespace app {
+namespace {
+
+using DotFn = int32_t (*)(const int8_t*, const int8_t*, size_t);
+
+int32_t DotScalar(const int8_t* a, const int8_t* b, size_t n) {
+  int32_t sum = 0;
+  for (size_t i = 0; i < n; ++i) {
+    sum += int32_t{a[i]} * int32_t{b[i]};
+  }
+  return sum;
+}
+
+#if defined(VECTOR_INDEX_X86)
+// Built for AVX2 regardless of the compile flags; only called after a CPU check.
+__attribute__((target("avx2"))) int32_t DotAvx2(const int8_t* a, const int8_t* b, size_t n) {
+  __m256i acc = _mm256_setzero_si256();
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    const __m256i va = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)));
+    const __m256i vb = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i)));
+    acc = _mm256_add_epi32(acc, _mm256_madd_epi16(va, vb));
+  }
+  __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4e));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xb1));
+  return _mm_cvtsi128_si32(sum) + DotScalar(a + i, b + i, n - i);
+}
+#endif
+
+#if defined(VECTOR_INDEX_NEON)
+int32_t DotNeon(const int8_t* a, const int8_t* b, size_t n) {
+  int32x4_t acc = vdupq_n_s32(0);
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    const int8x16_t va = vld1q_s8(a + i);
+    const int8x16_t vb = vld1q_s8(b + i);
+    acc = vpadalq_s16(acc, vmull_s8(vget_low_s8(va), vget_low_s8(vb)));
+    acc = vpadalq_s16(acc, vmull_s8(vget_high_s8(va), vget_high_s8(vb)));
+  }
+  return vaddvq_s32(acc) + DotScalar(a + i, b + i, n - i);
+}
+#endif
+
+DotFn SelectDot() {
+#if defined(VECTOR_INDEX_X86)
+  if (__builtin_cpu_supports("avx2")) {
+    return DotAvx2;
+  }
+#elif defined(VECTOR_INDEX_NEON)
+  return DotNeon;
+#endif
+  return DotScalar;
+}
+
+// Normalizes `v` and quantizes it into `out`; returns the row scale (0 for a
+// zero vector).
+float Quantize(const std::vector<float>& v, int8_t* out) {
+  double norm = 0.0;
+  float max_abs = 0.0f;
+  for (float x : v) {
+    norm += double{x} * x;
+    max_abs = std::max(max_abs, std::fabs(x));
+  }
+  if (norm <= 0.0 || max_abs <= 0.0f) {
+    std::fill(out, out + v.size(), int8_t{0});
+    return 0.0f;
+  }
+  const float inv_norm = static_cast<float>(1.0 / std::sqrt(norm));
+  const float scale = max_abs * inv_norm / 127.0f;
+  for (size_t i = 0; i < v.size(); ++i) {
+    out[i] = static_cast<int8_t>(std::lround(v[i] * inv_norm / scale));
+  }
+  return scale;
+}
+
+template <typename T>
+void WritePod(std::ostream& out, const T& value) {
+  out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+bool ReadPod(std::istream& in, T* value) {
+  return static_cast<bool>(in.read(reinterpret_cast<char*>(value), sizeof(T)));
+}
+
+}  // namespace
+
+VectorIndex::VectorIndex(size_t dim) : dim_(dim) {}
+
+bool VectorIndex::Add(uint64_t id, const std::vector<float>& vector) {
+  if (vector.empty() || (dim_ != 0 && vector.size() != dim_)) {
+    return false;
+  }
+  dim_ = vector.size();
+  rows_.resize(rows_.size() + dim_);
+  scales_.push_back(Quantize(vector, rows_.data() + rows_.size() - dim_));
+  ids_.push_back(id);
+  return true;
+}
+
+void VectorIndex::Truncate(size_t rows) {
+  if (rows < ids_.size()) {
+    ids_.resize(rows);
+    scales_.resize(rows);
+    rows_.resize(rows * dim_);
+  }
+}
+
+void VectorIndex::EraseFront(size_t rows) {
+  rows = std::min(rows, ids_.size());
+  ids_.erase(ids_.begin(), ids_.begin() + static_cast<std::ptrdiff_t>(rows));
+  scales_.erase(scales_.begin(), scales_.begin() + static_cast<std::ptrdiff_t>(rows));
+  rows_.erase(rows_.begin(), rows_.begin() + static_cast<std::ptrdiff_t>(rows * dim_));
+}
+
+void VectorIndex::Clear() {
+  Truncate(0);
+  dim_ = 0;
+}
+
+std::vector<VectorMatch> VectorIndex::Search(const std::vector<float>& query,
+                                             size_t k,
+                                             float min_score,
+                                             const std::function<bool(uint64_t id)>& accept) const {
+  static const DotFn dot = SelectDot();
+  std::vector<VectorMatch> best;
+  if (k == 0 || query.size() != dim_ || ids_.empty()) {
+    return best;
+  }
+  std::vector<int8_t> q(dim_);
+  const float q_scale = Quantize(query, q.data());
+
+  // Min-heap on score holding the current best k.
+  const auto worse = [](const VectorMatch& a, const VectorMatch& b) { return a.score > b.score; };
+  best.reserve(k + 1);
+  for (size_t row = 0; row < ids_.size(); ++row) {
+    const float score =
+        static_cast<float>(dot(q.data(), rows_.data() + row * dim_, dim_)) * q_scale * scales_[row];
+    if (score < min_score || (best.size() == k && score <= best.front().score)) {
+      continue;
+    }
+    if (accept && !accept(ids_[row])) {
+      continue;
+    }
+    best.push_back({ids_[row], score});
+    std::push_heap(best.begin(), best.end(), worse);
+    if (best.size() > k) {
+      std::pop_heap(best.begin(), best.end(), worse);
+      best.pop_back();
+    }
+  }
+  std::sort_heap(best.begin(), best.end(), worse);
+  return best;
+}
+
+bool VectorIndex::Write(std::ostream& out) const {
+  WritePod(out, static_cast<uint32_t>(dim_));
+  WritePod(out, static_cast<uint64_t>(ids_.size()));
+  out.write(reinterpret_cast<const char*>(ids_.data()),
+            static_cast<std::streamsize>(ids_.size() * sizeof(uint64_t)));
+  out.write(reinterpret_cast<const char*>(scales_.data()),
+            static_cast<std::streamsize>(scales_.size() * sizeof(float)));
+  out.write(reinterpret_cast<const char*>(rows_.data()), static_cast<std::streamsize>(rows_.size()));
+  return static_cast<bool>(out);
+}
+
+bool VectorIndex::Read(std::istream& in) {
+  uint32_t dim = 0;
+  uint64_t n = 0;
+  if (!ReadPod(in, &dim) || !ReadPod(in, &n) || (n > 0 && dim == 0) ||
+      n > (uint64_t{1} << 32) / std::max<uint32_t>(dim, 1)) {
+    return false;
+  }
+  std::vector<uint64_t> ids(n);
+  std::vector<float> scales(n);
+  std::vector<int8_t> rows(n * dim);
+  if (!in.read(reinterpret_cast<char*>(ids.data()), static_cast<std::streamsize>(n * sizeof(uint64_t))) ||
+      !in.read(reinterpret_cast<char*>(scales.data()), static_cast<std::streamsize>(n * sizeof(float))) ||
+      !in.read(reinterpret_cast<char*>(rows.data()), static_cast<std::streamsize>(rows.size()))) {
+    return false;
+  }
+  dim_ = dim;
+  ids_ = std::move(ids);
+  scales_ = std::move(scales);
+  rows_ = std::move(rows);
+  return true;
+}
+
+}  // namespace app
@@ -1,18 +1,35 @@
 #include "AgentRuntime.hpp"
+#include "BackendRouter.hpp"
+#include "BatchRunner.hpp"
+#include "CascadeBackend.hpp"
 #include "CliOptions.hpp"
+#include "ContextManager.hpp"
+#include "Daemon.hpp"
 #include "DeepSeekClient.hpp"
 #include "LogicGate.hpp"
 #include "LlamaBackend.hpp"
+#include "Metrics.hpp"
 #include "ModelStore.hpp"
+#include "ResourcePlanner.hpp"
+#include "RetrievalMemory.hpp"
+#include "SemanticCache.hpp"
+#include "Trace.hpp"
 #include "rang.hpp"
 
 #include <cstdlib>
 #include <cctype>
 #include <algorithm>
-#include <cmath>
+#include <atomic>
+#include <chrono>
+#include <csignal>
 #include <filesystem>
+#include <fstream>
+#include <future>
 #include <iostream>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
 #include <vector>
 
@@ -22,6 +39,14 @@
 
 namespace {
 
+std::atomic<bool> g_stop_requested{false};
+
+constexpr int kDefaultContext = 4096;
+// Prompt budget for API calls when --context-budget is not given.
+constexpr int kRemoteContextBudget = 32768;
+// Tokens a local reply may add on top of the prompt.
+constexpr int kLocalReplyTokens = 256;
+
 uint64_t TotalSystemMemoryBytes() {
 #if defined(_WIN32)
   return 0;
@@ -35,55 +60,27 @@ uint64_t TotalSystemMemoryBytes() {
 #endif
 }
 
-int EstimateLayerCountFromModelSize(double model_gb) {
-  if (model_gb <= 5.5) {
-    return 32;
-  }
-  if (model_gb <= 9.5) {
-    return 40;
-  }
-  if (model_gb <= 18.0) {
-    return 60;
-  }
-  return 80;
-}
-
-int EstimateGpuLayersAuto(const std::string& model_path) {
-  std::error_code ec;
-  const uint64_t model_size = std::filesystem::file_size(model_path, ec);
-  if (ec || model_size == 0) {
-    return 0;
+// Sizes the context and GPU offload from the model's GGUF metadata.
+std::optional<deepseek::ResourcePlan> PlanLocalModel(const std::string& model_path,
+                                                     const app::CliOptions& options,
+                                                     std::string* error_out) {
+  auto info = deepseek::ReadGgufInfo(model_path, error_out);
+  if (!info) {
+    return std::nullopt;
   }
   const uint64_t total_mem = TotalSystemMemoryBytes();
-  if (total_mem == 0) {
-    return 0;
-  }
-
-  const double model_gb = static_cast<double>(model_size) / (1024.0 * 1024.0 * 1024.0);
-  const double mem_gb = static_cast<double>(total_mem) / (1024.0 * 1024.0 * 1024.0);
-
-  // Keep generous headroom for OS + KV cache.
-  const double usable_gb = mem_gb * 0.6;
-  if (usable_gb < model_gb * 1.1) {
-    return 0;
-  }
-
-  const int total_layers = EstimateLayerCountFromModelSize(model_gb);
-  double fraction = usable_gb / (model_gb * 1.1);
-  if (fraction > 1.0) {
-    fraction = 1.0;
-  }
-  if (fraction < 0.1) {
-    fraction = 0.1;
-  }
-  int layers = static_cast<int>(std::lround(total_layers * fraction));
-  if (layers < 1) {
-    layers = 1;
-  }
-  if (layers > total_layers) {
-    layers = total_layers;
-  }
-  return layers;
+  deepseek::ResourceBudget budget;
+  budget.host_memory_bytes = total_mem;
+  // Offload budget assumes unified memory: at most 60% of RAM for layers.
+  budget.device_memory_bytes = options.gpu_layers_auto ? total_mem / 10 * 6 : 0;
+  budget.requested_ctx = options.ctx_size;
+  budget.k_bytes_per_element = deepseek::GgmlTypeElementBytes(
+      deepseek::GgmlTypeFromName(options.cache_type_k).value_or(1));
+  budget.v_bytes_per_element = deepseek::GgmlTypeElementBytes(
+      deepseek::GgmlTypeFromName(options.cache_type_v).value_or(1));
+  budget.offload_kv = options.kv_offload;
+  budget.kv_caches = options.contexts;
+  return deepseek::PlanResources(*info, budget);
 }
 
 bool ContainsToken(std::string_view text, std::string_view token) {
@@ -100,6 +97,207 @@ bool IsEngineeringTopic(std::string_view text) {
          ContainsToken(text, "agent") || ContainsToken(text, "program");
 }
 
+void PrintAgentName(const std::string& name) {
+  if (name == "Researcher") {
+    std::cout << rang::fg::blue << name << rang::fg::reset << ":\n";
+  } else if (name == "Critic") {
+    std::cout << rang::fg::magenta << name << rang::fg::reset << ":\n";
+  } else {
+    std::cout << rang::fg::green << name << rang::fg::reset << ":\n";
+  }
+}
+
+// One line per call: "TTFT 412 ms, prefill 900 tok @ 2100 tok/s, decode 120 tok @ 18.2 tok/s".
+void PrintCallMetrics(const deepseek::CallMetrics& m) {
+  const auto rate = [](size_t tokens, double ms) { return ms > 0.0 ? tokens * 1000.0 / ms : 0.0; };
+  std::cout << rang::fg::gray << "TTFT " << static_cast<long>(m.ttft_ms) << " ms";
+  if (m.queue_ms >= 1.0) {
+    std::cout << " (queued " << static_cast<long>(m.queue_ms) << " ms)";
+  }
+  std::cout << ", prefill " << m.prefill_tokens << " tok";
+  if (m.prefill_tokens > 0 && m.prefill_ms > 0.0) {
+    std::cout << " @ " << static_cast<long>(rate(m.prefill_tokens, m.prefill_ms)) << " tok/s";
+  }
+  std::cout << ", decode " << m.decode_tokens << " tok";
+  if (m.decode_tokens > 0 && m.decode_ms > 0.0) {
+    std::cout << " @ " << rate(m.decode_tokens, m.decode_ms) << " tok/s";
+  }
+  if (m.cache_hit_tokens + m.cache_miss_tokens > 0) {
+    std::cout << ", API cache " << m.cache_hit_tokens << "/"
+              << m.cache_hit_tokens + m.cache_miss_tokens << " tok";
+  }
+  if (!m.tier.empty()) {
+    std::cout << ", answered by " << m.tier;
+    if (m.escalations > 0) {
+      std::cout << " (escalated)";
+    }
+  }
+  if (!m.route.empty()) {
+    std::cout << ", routed " << m.route;
+  }
+  if (m.draft_tokens > 0) {
+    std::cout << ", draft " << m.draft_accepted_tokens << "/" << m.draft_tokens << " accepted";
+  }
+  std::cout << ", total " << static_cast<long>(m.total_ms) << " ms" << rang::fg::reset << "\n";
+}
+
+// Lets the remote client abort a call its context has cancelled.
+deepseek::CallControl ControlFor(const app::CallContext* call) {
+  deepseek::CallControl control;
+  if (call) {
+    control.cancelled = [call]() { return call->cancelled(); };
+    control.deadline = call->deadline;
+  }
+  return control;
+}
+
+std::optional<std::chrono::steady_clock::time_point> DeadlineIn(int ms) {
+  if (ms <= 0) {
+    return std::nullopt;
+  }
+  return std::chrono::steady_clock::now() + std::chrono::milliseconds(ms);
+}
+
+// --draft-model and --cascade-model take a GGUF path or the name of a model
+// in the model home.
+std::string ResolveModelFile(const std::string& model) {
+  if (std::filesystem::is_regular_file(model)) {
+    return model;
+  }
+  return deepseek::ModelStore::ResolveModelPath(model) + "/model.gguf";
+}
+
+// Thin client: forwards topics to a resident daemon and prints its replies.
+int RunClient(const app::CliOptions& options) {
+  const std::string socket_path =
+      options.socket_path.empty() ? app::DefaultDaemonSocketPath() : options.socket_path;
+
+  std::string current_agent;
+  app::DaemonEvents events;
+  events.on_delta = [&](const std::string& agent, std::string_view reasoning,
+                        std::string_view content) {
+    if (agent != current_agent) {
+      current_agent = agent;
+      std::cout << "\n" << rang::fg::cyan << "[" << agent << "] " << rang::fg::reset;
+    }
+    if (!reasoning.empty()) {
+      std::cout << rang::fg::gray << reasoning << rang::fg::reset;
+    }
+    std::cout << content << std::flush;
+  };
+  std::vector<app::AgentResult> results;
+  events.on_result = [&](const app::AgentResult& result) { results.push_back(result); };
+
+  auto send = [&](const std::string& topic) -> bool {
+    app::DaemonRequest request;
+    request.session = options.session;
+    request.topic = topic;
+    request.rounds = options.rounds;
+    request.stream = options.stream;
+    request.deadline_ms = options.deadline_ms;
+    results.clear();
+    current_agent.clear();
+    std::string error;
+    if (!app::RunDaemonClient(socket_path, request, events, &error)) {
+      std::cerr << rang::fg::red << "Daemon request failed: " << rang::fg::reset << error << "\n";
+      return false;
+    }
+    std::cout << "\n\n" << rang::style::bold << "--- Summary ---" << rang::style::reset << "\n";
+    for (const auto& result : results) {
+      PrintAgentName(result.name);
+      std::cout << result.response.content << "\n\n";
+    }
+    return true;
+  };
+
+  if (options.topic_set) {
+    return send(options.topic) ? 0 : 1;
+  }
+  std::string line;
+  while (std::getline(std::cin, line)) {
+    if (line == "exit" || line == "quit") {
+      break;
+    }
+    if (!line.empty()) {
+      send(line);
+    }
+  }
+  return 0;
+}
+
+int RunAutotune(app::LlamaBackend* backend, const std::string& model_path) {
+  const app::CpuTopology topology = app::DetectCpuTopology();
+  std::cout << rang::fg::yellow << "CPU: " << rang::fg::reset << topology.cpu_model << " ("
+            << topology.physical_cores() << " cores, " << topology.logical_cpus << " threads)\n";
+  const auto profile = backend->Autotune([](const app::TuneSample& sample) {
+    std::cout << "  threads " << sample.candidate.threads << " batch " << sample.candidate.n_batch
+              << (sample.candidate.pin ? " pinned" : "") << ": prefill "
+              << static_cast<int>(sample.prefill_tps) << " tok/s";
+    if (sample.decode_tps > 0) {
+      std::cout << ", decode " << static_cast<int>(sample.decode_tps) << " tok/s";
+    }
+    std::cout << "\n";
+  });
+  if (profile.n_threads <= 0) {
+    std::cerr << "Autotune produced no measurements.\n";
+    return 1;
+  }
+  const std::string path = app::ThreadProfilePath(topology, model_path);
+  std::string error;
+  if (!app::SaveThreadProfile(profile, path, &error)) {
+    std::cerr << "Failed to save profile: " << error << "\n";
+    return 1;
+  }
+  std::cout << rang::fg::green << "Decode: " << rang::fg::reset << profile.n_threads << " threads"
+            << (profile.pin_threads ? " (pinned)" : "") << ", "
+            << static_cast<int>(profile.decode_tps) << " tok/s\n";
+  std::cout << rang::fg::green << "Prefill: " << rang::fg::reset << profile.n_threads_batch
+            << " threads" << (profile.pin_threads_batch ? " (pinned)" : "") << ", batch "
+            << profile.n_batch << ", " << static_cast<int>(profile.prefill_tps) << " tok/s\n";
+  std::cout << "Saved profile: " << path << "\n";
+  return 0;
+}
+
+// Prefills the agents' histories in the background while the CLI waits for
+// the user. Stop() must be called before the agents change or the backend is
+// needed for whole-pool work.
+class IdlePrefill {
+ public:
+  IdlePrefill(app::ChatBackend& backend, const std::vector<app::Agent>& agents, bool enabled)
+      : backend_(backend), agents_(agents), enabled_(enabled && backend.prefill) {}
+  ~IdlePrefill() { Stop(); }
+
+  IdlePrefill(const IdlePrefill&) = delete;
+  IdlePrefill& operator=(const IdlePrefill&) = delete;
+
+  // No-op while a prefill is already running.
+  void Start() {
+    if (!enabled_ || work_.valid()) {
+      return;
+    }
+    cancel_ = std::make_unique<app::CancelToken>();
+    work_ = std::async(std::launch::async, [this, cancel = cancel_.get()]() {
+      app::SetTraceThreadName("idle prefill");
+      app::PrefillAgents(backend_, agents_, cancel);
+    });
+  }
+
+  void Stop() {
+    if (!work_.valid()) {
+      return;
+    }
+    cancel_->Cancel();
+    work_.get();
+  }
+
+ private:
+  app::ChatBackend& backend_;
+  const std::vector<app::Agent>& agents_;
+  bool enabled_;
+  std::unique_ptr<app::CancelToken> cancel_;
+  std::future<void> work_;
+};
+
 }  // namespace
 
 int main(int argc, char** argv) {
@@ -113,66 +311,316 @@ int main(int argc, char** argv) {
     std::cout << app::Usage();
     return 0;
   }
+  // Batch results own stdout; everything else goes to stderr.
+  std::streambuf* const stdout_buf = std::cout.rdbuf();
+  if (!options->batch_path.empty()) {
+    std::cout.rdbuf(std::cerr.rdbuf());
+  }
+  if (!options->trace_path.empty()) {
+    app::StartTracing();
+    app::SetTraceThreadName("main");
+  }
+  if (options->convert) {
+    std::string convert_error;
+    if (!app::ConvertAgentStore(options->load_path, options->save_path, &convert_error)) {
+      std::cerr << "Failed to convert agents: " << convert_error << "\n";
+      return 1;
+    }
+    std::cout << "Converted " << options->load_path << " -> " << options->save_path << "\n";
+    return 0;
+  }
+  if (options->connect) {
+    return RunClient(*options);
+  }
 
   app::ChatBackend backend;
   std::unique_ptr<deepseek::DeepSeekClient> client;
   std::unique_ptr<app::LlamaBackend> local_backend;
   int resolved_gpu_layers = options->gpu_layers;
   bool resolved_gpu_auto = options->gpu_layers_auto;
+  int context_budget = options->context_budget > 0 ? options->context_budget : kRemoteContextBudget;
+  // Summaries are written by the local model, or by the cheaper chat model.
+  app::ChatBackend summary_backend;
+  size_t summarizer_tokens = kRemoteContextBudget;
+  std::unique_ptr<deepseek::DeepSeekClient> summary_client;
+  std::unique_ptr<app::LlamaEmbedder> embedder;
+  app::ChatBackend remote_backend;
+  std::unique_ptr<app::BackendRouter> router;
+  const char* api_key = std::getenv("DEEPSEEK_API_KEY");
+  if (!options->local_only || options->hybrid) {
+    if (!api_key || std::string(api_key).empty()) {
+      std::cerr << "Set DEEPSEEK_API_KEY in your environment.\n";
+      return 1;
+    }
+    client = std::make_unique<deepseek::DeepSeekClient>(api_key, options->model);
+    remote_backend.chat = [&](const std::vector<deepseek::Message>& messages,
+                              std::string_view system_prompt,
+                              app::CallContext* call,
+                              std::string* error_out) {
+      const deepseek::CallControl control = ControlFor(call);
+      return client->chat(messages, system_prompt, call ? &call->metrics : nullptr, &control,
+                          error_out);
+    };
+    remote_backend.stream = [&](const std::vector<deepseek::Message>& messages,
+                                std::string_view system_prompt,
+                                const app::ChatBackend::StreamCallback& on_delta,
+                                app::CallContext* call,
+                                std::string* error_out) {
+      const deepseek::CallControl control = ControlFor(call);
+      return client->stream_chat(messages, system_prompt, on_delta,
+                                 call ? &call->metrics : nullptr, &control, error_out);
+    };
+  }
   if (options->local_only) {
     const std::string model_path =
         deepseek::ModelStore::ResolveModelPath("deepseek-r1") + "/model.gguf";
-    if (options->gpu_layers_auto) {
-      resolved_gpu_layers = EstimateGpuLayersAuto(model_path);
+    int n_ctx = options->ctx_size > 0 ? options->ctx_size : kDefaultContext;
+    std::string plan_error;
+    if (auto plan = PlanLocalModel(model_path, *options, &plan_error)) {
+      n_ctx = plan->n_ctx;
+      if (options->gpu_layers_auto) {
+        resolved_gpu_layers = plan->gpu_layers;
+      }
+      std::cout << rang::fg::yellow << "Context: " << rang::fg::reset << n_ctx << " tokens, KV "
+                << options->cache_type_k << "/" << options->cache_type_v << " "
+                << plan->KvBytes() * options->contexts / (1024 * 1024) << " MiB";
+      if (options->contexts > 1) {
+        std::cout << " (" << options->contexts << " contexts)";
+      }
+      std::cout << ", weights " << plan->weight_bytes / (1024 * 1024) << " MiB\n";
+    } else if (options->gpu_layers_auto) {
+      resolved_gpu_layers = 0;
+      std::cerr << "Could not read model metadata (" << plan_error << "); using CPU only.\n";
+    }
+    app::LlamaOptions llama_options;
+    llama_options.n_ctx = n_ctx;
+    llama_options.n_gpu_layers = resolved_gpu_layers;
+    llama_options.use_thread_profile = !options->autotune;
+    llama_options.n_contexts = options->contexts;
+    llama_options.numa = options->numa;
+    llama_options.cache_type_k = options->cache_type_k;
+    llama_options.cache_type_v = options->cache_type_v;
+    llama_options.flash_attn = options->flash_attn;
+    llama_options.offload_kqv = options->kv_offload;
+    llama_options.embedding_model = options->embed_model;
+    llama_options.prefix_cache_bytes = static_cast<size_t>(options->prefix_cache_mb) << 20;
+    if (!options->draft_model.empty()) {
+      llama_options.draft_model = ResolveModelFile(options->draft_model);
+      llama_options.draft_max = options->draft_max;
     }
     try {
-      local_backend =
-          std::make_unique<app::LlamaBackend>(model_path, 4096, 0, resolved_gpu_layers);
+      local_backend = std::make_unique<app::LlamaBackend>(model_path, llama_options);
     } catch (const std::exception& ex) {
       std::cerr << rang::fg::red << "Failed to initialize local model: " << rang::fg::reset
                 << ex.what() << "\n";
       std::cerr << "Expected model at: " << model_path << "\n";
       return 1;
     }
+    if (options->autotune) {
+      return RunAutotune(local_backend.get(), model_path);
+    }
     backend = local_backend->Backend();
+    summary_backend = backend;
+    if (options->context_budget <= 0) {
+      context_budget = std::max(n_ctx / 2, n_ctx - kLocalReplyTokens);
+    }
+    // The summarizer gets the same room as a default agent prompt.
+    summarizer_tokens = static_cast<size_t>(std::max(n_ctx / 2, n_ctx - kLocalReplyTokens));
+    if (options->hybrid) {
+      app::RouterOptions router_options;
+      router_options.local_slots = static_cast<size_t>(local_backend->Options().n_contexts);
+      router_options.max_local_prompt_tokens = static_cast<size_t>(options->local_prompt_limit);
+      router = std::make_unique<app::BackendRouter>(backend, remote_backend, router_options);
+      backend = router->Backend();
+    }
   } else {
-    const char* api_key = std::getenv("DEEPSEEK_API_KEY");
-    if (!api_key || std::string(api_key).empty()) {
-      std::cerr << "Set DEEPSEEK_API_KEY in your environment.\n";
+    backend = remote_backend;
+    summary_client = std::make_unique<deepseek::DeepSeekClient>(api_key, "deepseek-chat");
+    summary_backend.chat = [&](const std::vector<deepseek::Message>& messages,
+                               std::string_view system_prompt,
+                               app::CallContext* call,
+                               std::string* error_out) {
+      const deepseek::CallControl control = ControlFor(call);
+      return summary_client->chat(messages, system_prompt, call ? &call->metrics : nullptr,
+                                  &control, error_out);
+    };
+    if (!options->embed_model.empty()) {
+      try {
+        embedder = std::make_unique<app::LlamaEmbedder>(options->embed_model);
+      } catch (const std::exception& ex) {
+        std::cerr << rang::fg::red << "Failed to load embedding model: " << rang::fg::reset
+                  << ex.what() << "\n";
+        return 1;
+      }
+      backend.embed = [&](std::string_view text,
+                          std::string* error_out) -> std::optional<std::vector<float>> {
+        try {
+          return embedder->Embed(text);
+        } catch (const std::exception& ex) {
+          if (error_out) {
+            *error_out = ex.what();
+          }
+          return std::nullopt;
+        }
+      };
+    }
+  }
+
+  std::unique_ptr<app::LlamaBackend> cascade_model;
+  std::unique_ptr<app::CascadeBackend> cascade;
+  if (!options->cascade_model.empty()) {
+    const std::string small_path = ResolveModelFile(options->cascade_model);
+    app::LlamaOptions small_options;
+    // Prompts are fitted to the main backend's budget, so the small model
+    // must hold any of them plus a reply.
+    small_options.n_ctx = std::max(options->ctx_size > 0 ? options->ctx_size : kDefaultContext,
+                                   context_budget + kLocalReplyTokens);
+    small_options.n_gpu_layers = resolved_gpu_layers;
+    small_options.n_contexts = options->contexts;
+    try {
+      cascade_model = std::make_unique<app::LlamaBackend>(small_path, small_options);
+    } catch (const std::exception& ex) {
+      std::cerr << rang::fg::red << "Failed to load cascade model: " << rang::fg::reset
+                << ex.what() << "\n";
       return 1;
     }
-    client = std::make_unique<deepseek::DeepSeekClient>(api_key, options->model);
-    backend.chat = [&](const std::vector<deepseek::Message>& messages,
-                       std::string_view system_prompt,
-                       std::string* error_out) {
-      return client->chat(messages, system_prompt, error_out);
-    };
-    backend.stream = [&](const std::vector<deepseek::Message>& messages,
-                         std::string_view system_prompt,
-                         const app::ChatBackend::StreamCallback& on_delta,
-                         std::string* error_out) {
-      return client->stream_chat(messages, system_prompt, on_delta, error_out);
-    };
+    cascade = std::make_unique<app::CascadeBackend>(std::vector<app::CascadeTier>{
+        {"small", cascade_model->Backend(), options->cascade_threshold},
+        {"main", backend, 0.0}});
+    backend = cascade->Backend();
   }
 
-  app::Agent researcher{
-      "Researcher",
-      "You are a research-oriented agent. Provide evidence, tradeoffs, and cite real engineering"
-      " constraints. Be concise.",
-      {}};
-  app::Agent critic{
-      "Critic",
-      "You are a critical agent. Challenge assumptions, probe weaknesses, and seek counterexamples."
-      " Be concise.",
-      {}};
+  app::ContextBudget budget;
+  budget.max_tokens = static_cast<size_t>(context_budget);
+  budget.summarize = options->summarize;
+  budget.summarizer_tokens = summarizer_tokens;
+  app::ContextManager context(budget, &summary_backend);
+  std::unique_ptr<app::SemanticCache<app::GateResult>> gate_cache;
+  std::unique_ptr<app::SemanticCache<std::vector<app::AgentResult>>> answer_cache;
+  if (options->semantic_cache > 0.0f) {
+    app::SemanticCacheOptions cache_options;
+    cache_options.threshold = options->semantic_cache;
+    gate_cache = std::make_unique<app::SemanticCache<app::GateResult>>(cache_options);
+    answer_cache =
+        std::make_unique<app::SemanticCache<std::vector<app::AgentResult>>>(cache_options);
+  }
+  const app::DebateMode debate_mode =
+      options->all_to_all ? app::DebateMode::kAllToAll : app::DebateMode::kSequential;
+  const size_t fan_in = static_cast<size_t>(options->fan_in);
+  std::unique_ptr<app::MetricsRegistry> metrics;
+  if (!options->metrics_path.empty() || options->metrics_summary) {
+    metrics = std::make_unique<app::MetricsRegistry>();
+  }
+  const auto write_reports = [&]() {
+    std::string report_error;
+    if (metrics && !options->metrics_path.empty() &&
+        !metrics->Write(options->metrics_path, &report_error)) {
+      std::cerr << "Failed to write metrics: " << report_error << "\n";
+    }
+    if (!options->trace_path.empty() && !app::WriteTrace(options->trace_path, &report_error)) {
+      std::cerr << "Failed to write trace: " << report_error << "\n";
+    }
+    if (options->metrics_summary && local_backend && local_backend->prefix_cache()) {
+      const auto stats = local_backend->prefix_cache()->stats();
+      std::cerr << rang::fg::gray << "Prefix cache: " << stats.hits << "/" << stats.lookups
+                << " hits, " << stats.hit_tokens << " prompt tokens matched, " << stats.entries
+                << " entries (" << stats.bytes / (1024 * 1024) << " MiB), " << stats.evictions
+                << " evicted" << rang::fg::reset << "\n";
+    }
+    if (options->metrics_summary && metrics) {
+      const uint64_t hit = metrics->counter("cache_hit_tokens");
+      const uint64_t miss = metrics->counter("cache_miss_tokens");
+      if (hit + miss > 0) {
+        std::cerr << rang::fg::gray << "API prompt cache: " << hit << "/" << hit + miss
+                  << " prompt tokens hit (" << static_cast<long>(hit * 100.0 / (hit + miss))
+                  << "%)" << rang::fg::reset << "\n";
+      }
+    }
+    if (options->metrics_summary && cascade) {
+      std::cerr << rang::fg::gray << "Cascade:";
+      for (const auto& tier : cascade->stats()) {
+        std::cerr << " " << tier.name << " answered " << tier.answered << "/" << tier.calls;
+      }
+      std::cerr << rang::fg::reset << "\n";
+    }
+    if (options->metrics_summary && router) {
+      const auto stats = router->stats();
+      std::cerr << rang::fg::gray << "Routing: " << stats.local << " local, " << stats.remote
+                << " remote calls, " << stats.failovers << " failovers, " << stats.failed
+                << " failed" << rang::fg::reset << "\n";
+    }
+    if (options->metrics_summary && local_backend && !local_backend->Options().draft_model.empty()) {
+      const auto stats = local_backend->draft_stats();
+      std::cerr << rang::fg::gray << "Draft model: " << stats.accepted << "/" << stats.drafted
+                << " proposed tokens accepted";
+      if (stats.drafted > 0) {
+        std::cerr << " (" << static_cast<long>(stats.accepted * 100.0 / stats.drafted) << "%)";
+      }
+      if (stats.steps > 0) {
+        std::cerr << ", " << static_cast<double>(stats.accepted + stats.steps) / stats.steps
+                  << " tokens per main-model decode";
+      }
+      std::cerr << rang::fg::reset << "\n";
+    }
+    if (options->metrics_summary && local_backend && local_backend->prefill_stats().calls > 0) {
+      const auto stats = local_backend->prefill_stats();
+      std::cerr << rang::fg::gray << "Idle prefill: " << stats.tokens << " tokens in " << stats.calls
+                << " calls, " << stats.preempted << " preempted" << rang::fg::reset << "\n";
+    }
+  };
+  std::unique_ptr<app::RetrievalMemory> retrieval;
+  if (options->retrieval) {
+    app::RetrievalOptions retrieval_options;
+    retrieval_options.top_k = static_cast<size_t>(options->retrieval_k);
+    retrieval_options.stable_prefix = options->stable_prefix;
+    retrieval = std::make_unique<app::RetrievalMemory>(retrieval_options);
+  }
 
-  std::vector<app::Agent> agents{researcher, critic};
+  const auto make_default_agents = []() {
+    app::Agent researcher{
+        "Researcher",
+        "You are a research-oriented agent. Provide evidence, tradeoffs, and cite real engineering"
+        " constraints. Be concise.",
+        {}};
+    app::Agent critic{
+        "Critic",
+        "You are a critical agent. Challenge assumptions, probe weaknesses, and seek"
+        " counterexamples. Be concise.",
+        {}};
+    return std::vector<app::Agent>{researcher, critic};
+  };
+
+  std::vector<app::Agent> agents = make_default_agents();
   if (!options->load_path.empty()) {
     std::string load_error;
-    if (!app::LoadAgents(&agents, options->load_path, &load_error)) {
+    const bool loaded =
+        options->history >= 0
+            ? app::LoadAgentsRecent(&agents, options->load_path,
+                                    static_cast<size_t>(options->history), &load_error)
+            : app::LoadAgents(&agents, options->load_path, &load_error);
+    if (!loaded) {
       std::cerr << "Failed to load agents: " << load_error << "\n";
       return 1;
     }
+    const std::string vec_path = options->load_path + ".vec";
+    if (retrieval && std::filesystem::exists(vec_path)) {
+      std::string vec_error;
+      if (!retrieval->Load(vec_path, &vec_error)) {
+        // The index is rebuilt from the messages as needed.
+        std::cerr << "Ignoring retrieval index: " << vec_error << "\n";
+      }
+    }
+    const std::string kv_path = options->load_path + ".kv";
+    if (local_backend && options->kv_state && std::filesystem::exists(kv_path)) {
+      std::string kv_error;
+      const int restored = local_backend->LoadAgentStates(agents, kv_path, &kv_error);
+      std::cout << rang::fg::yellow << "KV state: " << rang::fg::reset << "restored " << restored
+                << "/" << agents.size() << " agents";
+      if (!kv_error.empty()) {
+        std::cout << " (" << kv_error << ")";
+      }
+      std::cout << "\n";
+    }
   }
 
   const std::string topic = options->topic;
@@ -181,9 +629,30 @@ int main(int argc, char** argv) {
               << topic << "\n";
   }
   std::cout << rang::fg::yellow << "Model: " << rang::fg::reset << options->model << "\n";
-  std::cout << rang::fg::yellow << "Rounds: " << rang::fg::reset << options->rounds << "\n";
+  std::cout << rang::fg::yellow << "Rounds: " << rang::fg::reset << options->rounds;
+  if (options->all_to_all) {
+    std::cout << " (all-to-all, fan-in ";
+    if (options->fan_in > 0) {
+      std::cout << options->fan_in;
+    } else {
+      std::cout << "all";
+    }
+    std::cout << ")";
+  }
+  std::cout << "\n";
+  if (options->optimistic_gate) {
+    std::cout << rang::fg::yellow << "Gate: " << rang::fg::reset
+              << "optimistic (the first turn starts before the gate decides)\n";
+  }
   std::cout << rang::fg::yellow << "Streaming: " << rang::fg::reset
             << (options->stream ? "on" : "off") << "\n";
+  std::cout << rang::fg::yellow << "Context budget: " << rang::fg::reset << context_budget
+            << " tokens (" << (options->summarize ? "summarize" : "drop") << " old turns)\n";
+  if (retrieval) {
+    std::cout << rang::fg::yellow << "Retrieval: " << rang::fg::reset << "last "
+              << retrieval->options().recent << " messages + top " << retrieval->options().top_k
+              << " relevant\n";
+  }
   if (options->local_only) {
     std::cout << rang::fg::yellow << "GPU layers: " << rang::fg::reset;
     if (resolved_gpu_auto) {
@@ -191,6 +660,31 @@ int main(int argc, char** argv) {
     } else {
       std::cout << resolved_gpu_layers << "\n";
     }
+    const app::LlamaOptions& llama = local_backend->Options();
+    std::cout << rang::fg::yellow << "Threads: " << rang::fg::reset << "decode "
+              << llama.n_threads << (llama.pin_threads ? " (pinned)" : "") << ", prefill "
+              << llama.n_threads_batch << (llama.pin_threads_batch ? " (pinned)" : "");
+    if (llama.n_contexts > 1 || llama.numa) {
+      std::cout << " across " << llama.n_contexts << " contexts" << (llama.numa ? " (NUMA)" : "");
+    }
+    std::cout << "\n";
+    if (llama.prefix_cache_bytes > 0) {
+      std::cout << rang::fg::yellow << "Prefix cache: " << rang::fg::reset
+                << llama.prefix_cache_bytes / (1024 * 1024) << " MiB\n";
+    }
+    if (router) {
+      std::cout << rang::fg::yellow << "Routing: " << rang::fg::reset << "local first, "
+                << options->model << " via the API when local contexts are busy or fail\n";
+    }
+    if (!llama.draft_model.empty()) {
+      std::cout << rang::fg::yellow << "Draft model: " << rang::fg::reset << llama.draft_model
+                << " (up to " << llama.draft_max << " tokens per step)\n";
+    }
+  }
+  if (cascade) {
+    std::cout << rang::fg::yellow << "Cascade: " << rang::fg::reset << options->cascade_model
+              << " first, answers under " << options->cascade_threshold
+              << " confidence go to the main backend\n";
   }
   std::cout << "Model home (shared across projects): "
             << deepseek::ModelStore::ResolveModelHome() << "\n";
@@ -201,39 +695,96 @@ int main(int argc, char** argv) {
               << deepseek::ModelStore::ResolveModelPath("deepseek-r1") << "\n";
   }
 
-  auto run_topic = [&](std::string_view t) -> bool {
+  auto gate_topic = [&](std::string_view t, std::string* reason) -> bool {
     app::LogicGate gate("Allow only software engineering topics.");
-    if (options->local_only) {
+    if (options->local_only && !options->hybrid) {
       // Local gate is deterministic for demo reliability.
       if (!IsEngineeringTopic(t)) {
-        std::cerr << rang::fg::red << "Gate rejected the topic." << rang::fg::reset << "\n";
-        return false;
-      }
-    } else {
-      std::string gate_error;
-      auto gate_result = gate.Evaluate(backend, t, false, &gate_error);
-      if (!gate_result) {
-        std::cerr << rang::fg::red << "Gate evaluation failed: " << rang::fg::reset << gate_error
-                  << "\n";
+        *reason = "Gate rejected the topic.";
         return false;
       }
-      if (!gate_result->allow) {
-        std::cerr << rang::fg::red << "Gate rejected the topic." << rang::fg::reset << "\n";
-        return false;
+      return true;
+    }
+    gate.SetCache(gate_cache.get());
+    std::string gate_error;
+    auto gate_result = gate.Evaluate(backend, t, false, &gate_error);
+    if (!gate_result) {
+      *reason = "Gate evaluation failed: " + gate_error;
+      return false;
+    }
+    if (gate_result->cache_score) {
+      std::cout << rang::fg::gray << "Gate: reused the decision for \"" << gate_result->cached_input
+                << "\" (similarity " << *gate_result->cache_score << ")" << rang::fg::reset
+                << "\n";
+    } else if (metrics) {
+      metrics->Record("gate", gate_result->metrics);
+    }
+    if (!gate_result->allow) {
+      *reason = "Gate rejected the topic.";
+      return false;
+    }
+    return true;
+  };
+
+  // Gates `t` and debates it, both at once with --optimistic-gate. Returns
+  // std::nullopt with `reason` set when the gate rejects the topic.
+  auto gated_debate = [&](std::vector<app::Agent>& debate_agents, std::string_view t, int rounds,
+                          const app::RunOptions& run,
+                          std::string* reason) -> std::optional<std::vector<app::AgentResult>> {
+    if (!options->optimistic_gate) {
+      if (!gate_topic(t, reason)) {
+        return std::nullopt;
       }
+      return app::RunDebateRounds(backend, debate_agents, t, rounds, run);
     }
+    return app::RunDebateRoundsSpeculative(
+        backend, debate_agents, t, rounds, [&]() { return gate_topic(t, reason); }, run);
+  };
+
+  // Retrieval prompts depend on the next input, so their history cannot be
+  // prefilled ahead.
+  IdlePrefill idle_prefill(backend, agents, options->idle_prefill && !retrieval);
 
-    auto results = app::RunDebateRounds(backend, agents, t, options->rounds, options->stream);
+  auto run_topic = [&](std::string_view t) -> bool {
+    app::TraceSpan span("run_topic", t);
+    const auto deadline = DeadlineIn(options->deadline_ms);
+    std::string reason;
+
+    app::RunOptions run;
+    run.stream = options->stream;
+    run.context = &context;
+    run.retrieval = retrieval.get();
+    run.answer_cache = answer_cache.get();
+    run.metrics = metrics.get();
+    run.deadline = deadline;
+    run.debate_mode = debate_mode;
+    run.fan_in = fan_in;
+    std::optional<std::vector<app::AgentResult>> debated;
+    try {
+      debated = gated_debate(agents, t, options->rounds, run, &reason);
+    } catch (const app::CancelledError& ex) {
+      std::cerr << rang::fg::yellow << ex.what() << rang::fg::reset << "\n";
+      return false;
+    }
+    if (!debated) {
+      std::cerr << rang::fg::red << reason << rang::fg::reset << "\n";
+      return false;
+    }
+    const std::vector<app::AgentResult> results = std::move(*debated);
+    if (!results.empty() && results.front().cache_score) {
+      std::cout << rang::fg::gray << "Answers replayed from a similar earlier topic (similarity "
+                << *results.front().cache_score << ")" << rang::fg::reset << "\n";
+    }
+    span.End();
+    // The user reads the summary and types the next topic meanwhile.
+    idle_prefill.Start();
     std::cout << "\n\n" << rang::style::bold << "--- Summary ---" << rang::style::reset << "\n";
     for (const auto& result : results) {
-      if (result.name == "Researcher") {
-        std::cout << rang::fg::blue << result.name << rang::fg::reset << ":\n";
-      } else if (result.name == "Critic") {
-        std::cout << rang::fg::magenta << result.name << rang::fg::reset << ":\n";
-      } else {
-        std::cout << rang::fg::green << result.name << rang::fg::reset << ":\n";
-      }
+      PrintAgentName(result.name);
       std::cout << result.response.content << "\n\n";
+      if (options->metrics_summary && !result.cache_score) {
+        PrintCallMetrics(result.metrics);
+      }
       std::cout << rang::fg::gray << "Press ENTER to continue..." << rang::fg::reset;
       std::cout.flush();
       std::string line;
@@ -242,6 +793,140 @@ int main(int argc, char** argv) {
     return true;
   };
 
+  if (options->daemon) {
+    const std::string socket_path =
+        options->socket_path.empty() ? app::DefaultDaemonSocketPath() : options->socket_path;
+    // Retrieval indexes are keyed by agent name, which every session shares,
+    // so each session gets its own. The --session one starts from the --load
+    // index and is the one saved.
+    std::mutex session_retrieval_mutex;
+    std::map<std::string, std::unique_ptr<app::RetrievalMemory>> session_retrieval;
+    const auto retrieval_for = [&](const std::string& session) -> app::RetrievalMemory* {
+      if (!retrieval || session == options->session) {
+        return retrieval.get();
+      }
+      std::lock_guard<std::mutex> lock(session_retrieval_mutex);
+      auto& index = session_retrieval[session];
+      if (!index) {
+        index = std::make_unique<app::RetrievalMemory>(retrieval->options());
+      }
+      return index.get();
+    };
+    app::DaemonServer server(
+        socket_path, make_default_agents,
+        [&](const app::DaemonRequest& request, std::vector<app::Agent>& session_agents,
+            const app::DaemonEvents& events, std::string* error_out) {
+          app::SetTraceThreadName("daemon session " + request.session);
+          app::TraceSpan span("daemon_request", request.topic);
+          app::RunOptions run;
+          run.stream = request.stream;
+          run.on_delta = events.on_delta;
+          run.context = &context;
+          // Requests of one session run one at a time, so its index is not shared.
+          run.retrieval = retrieval_for(request.session);
+          run.answer_cache = answer_cache.get();
+          run.metrics = metrics.get();
+          run.cancel = events.cancel;
+          run.deadline = DeadlineIn(request.deadline_ms > 0 ? request.deadline_ms
+                                                            : options->deadline_ms);
+          run.debate_mode = debate_mode;
+          run.fan_in = fan_in;
+          auto results = gated_debate(session_agents, request.topic, std::max(1, request.rounds),
+                                      run, error_out);
+          if (!results) {
+            return false;
+          }
+          for (const auto& result : *results) {
+            events.on_result(result);
+          }
+          return true;
+        });
+    server.SetAgents(options->session, agents);
+    std::string daemon_error;
+    if (!server.Start(&daemon_error)) {
+      std::cerr << rang::fg::red << "Failed to start daemon: " << rang::fg::reset << daemon_error
+                << "\n";
+      return 1;
+    }
+    std::signal(SIGINT, [](int) { g_stop_requested = true; });
+    std::signal(SIGTERM, [](int) { g_stop_requested = true; });
+    std::cout << rang::fg::cyan << "Daemon listening on " << socket_path << rang::fg::reset
+              << "\n";
+    server.Wait(&g_stop_requested);
+    server.Stop();
+    write_reports();
+    if (!options->save_path.empty()) {
+      const auto session_agents = server.Agents(options->session);
+      std::string save_error;
+      if (!app::SaveAgents(session_agents, options->save_path, &save_error)) {
+        std::cerr << "Failed to save agents: " << save_error << "\n";
+        return 1;
+      }
+      if (local_backend && options->kv_state &&
+          !local_backend->SaveAgentStates(session_agents, options->save_path + ".kv",
+                                          &save_error)) {
+        std::cerr << "Failed to save KV state: " << save_error << "\n";
+      }
+      if (retrieval && !retrieval->Save(options->save_path + ".vec", &save_error)) {
+        std::cerr << "Failed to save retrieval index: " << save_error << "\n";
+      }
+    }
+    return 0;
+  }
+
+  if (!options->batch_path.empty()) {
+    std::ifstream batch_file;
+    if (options->batch_path != "-") {
+      batch_file.open(options->batch_path);
+      if (!batch_file) {
+        std::cerr << "Failed to open batch file: " << options->batch_path << "\n";
+        return 1;
+      }
+    }
+    std::istream& batch_in = options->batch_path == "-" ? std::cin : batch_file;
+    std::ostream results_out(stdout_buf);
+    app::BatchOptions batch_options;
+    batch_options.concurrency = static_cast<size_t>(options->concurrency);
+    batch_options.rounds = options->rounds;
+    // Every item starts from the default (or --load) agents; their memory
+    // is not carried between items or saved.
+    const auto stats = app::RunBatch(
+        batch_in, results_out, batch_options, [&]() { return agents; },
+        [&](const app::BatchItem& item, std::vector<app::Agent>& item_agents,
+            std::vector<app::AgentResult>* results, std::string* error_out) {
+          app::SetTraceThreadName("batch worker");
+          app::TraceSpan span("batch_item", item.id);
+          const auto deadline = DeadlineIn(options->deadline_ms);
+          app::RunOptions run;
+          run.context = &context;
+          run.answer_cache = answer_cache.get();
+          run.metrics = metrics.get();
+          run.deadline = deadline;
+          run.debate_mode = debate_mode;
+          run.fan_in = fan_in;
+          // No retrieval: its index is keyed by agent name, which concurrent
+          // items share.
+          auto debated = gated_debate(item_agents, item.topic, item.rounds, run, error_out);
+          if (!debated) {
+            return false;
+          }
+          *results = std::move(*debated);
+          return true;
+        });
+    std::cerr << rang::fg::yellow << "Batch: " << rang::fg::reset << stats.items << " topics, "
+              << stats.failed << " failed";
+    if (stats.cancelled > 0) {
+      std::cerr << " (" << stats.cancelled << " cancelled)";
+    }
+    std::cerr << " in " << stats.elapsed_ms / 1000.0 << " s";
+    if (stats.elapsed_ms > 0.0) {
+      std::cerr << " (" << stats.items * 1000.0 / stats.elapsed_ms << " topics/s)";
+    }
+    std::cerr << "\n";
+    write_reports();
+    return stats.failed == 0 ? 0 : 1;
+  }
+
   try {
     if (options->topic_set) {
       if (!run_topic(topic)) {
@@ -251,9 +936,12 @@ int main(int argc, char** argv) {
       std::cout << rang::fg::cyan << "Interactive mode. Type a topic, or 'exit' to quit."
                 << rang::fg::reset << "\n";
       while (true) {
+        idle_prefill.Start();
         std::cout << rang::fg::green << "> " << rang::fg::reset;
         std::string line;
-        if (!std::getline(std::cin, line)) {
+        const bool read = static_cast<bool>(std::getline(std::cin, line));
+        idle_prefill.Stop();
+        if (!read) {
           break;
         }
         if (line == "exit" || line == "quit") {
@@ -269,17 +957,28 @@ int main(int argc, char** argv) {
       }
     }
 
+    idle_prefill.Stop();
     if (!options->save_path.empty()) {
       std::string save_error;
       if (!app::SaveAgents(agents, options->save_path, &save_error)) {
         std::cerr << "Failed to save agents: " << save_error << "\n";
         return 1;
       }
+      if (local_backend && options->kv_state &&
+          !local_backend->SaveAgentStates(agents, options->save_path + ".kv", &save_error)) {
+        // Message text is saved; the next run only loses the prefill shortcut.
+        std::cerr << "Failed to save KV state: " << save_error << "\n";
+      }
+      if (retrieval && !retrieval->Save(options->save_path + ".vec", &save_error)) {
+        std::cerr << "Failed to save retrieval index: " << save_error << "\n";
+      }
     }
   } catch (const std::exception& ex) {
     std::cerr << rang::fg::red << "Error: " << rang::fg::reset << ex.what() << "\n";
+    write_reports();
     return 1;
   }
 
+  write_reports();
   return 0;
 }
@@ -29,3 +29,41 @@ TEST(AgentPersistenceTests, SaveAndLoadRoundTrip) {
 
   std::filesystem::remove(path);
 }
+
+TEST(AgentPersistenceTests, SnapshotLoadsRecentHistoryLazily) {
+  std::vector<app::Agent> agents{
+      {"A", "System A", {{"user", "q1", ""}, {"assistant", "a1", "r1"}, {"user", "q2", ""},
+                         {"assistant", "a2", "r2"}}},
+      {"B", "System B", {}},
+  };
+
+  const std::string snap = "/tmp/agent_memory_test.snap";
+  const std::string json = "/tmp/agent_memory_test_converted.json";
+  std::string error;
+  ASSERT_TRUE(app::SaveAgents(agents, snap, &error)) << error;
+
+  std::vector<app::Agent> recent;
+  ASSERT_TRUE(app::LoadAgentsRecent(&recent, snap, 1, &error)) << error;
+  ASSERT_EQ(recent.size(), 2u);
+  EXPECT_EQ(recent[0].name, "A");
+  ASSERT_EQ(recent[0].memory.size(), 1u);
+  EXPECT_EQ(recent[0].memory[0].content, "a2");
+  EXPECT_EQ(recent[0].archived_messages, 3u);
+  EXPECT_TRUE(recent[1].memory.empty());
+  EXPECT_FALSE(recent[1].archive);
+
+  // New turns append after the archive; saving over the mapped file keeps both.
+  recent[0].memory.push_back({"user", "q3", ""});
+  ASSERT_TRUE(app::SaveAgents(recent, snap, &error)) << error;
+  ASSERT_TRUE(app::ConvertAgentStore(snap, json, &error)) << error;
+
+  std::vector<app::Agent> full;
+  ASSERT_TRUE(app::LoadAgents(&full, json, &error)) << error;
+  ASSERT_EQ(full[0].memory.size(), 5u);
+  EXPECT_EQ(full[0].memory[1].reasoning, "r1");
+  EXPECT_EQ(full[0].memory[4].content, "q3");
+  EXPECT_EQ(full[1].system_prompt, "System B");
+
+  std::filesystem::remove(snap);
+  std::filesystem::remove(json);
+}
@@ -1,7 +1,14 @@
 #include "AgentRuntime.hpp"
+#include "SemanticCache.hpp"
 
 #include <gtest/gtest.h>
 
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <thread>
+
 TEST(AgentRuntimeTests, MultiTurnDebateUpdatesMemoryAndOrder) {
   std::vector<app::Agent> agents{
       {"Researcher", "Research prompt", {}},
@@ -15,6 +22,7 @@ TEST(AgentRuntimeTests, MultiTurnDebateUpdatesMemoryAndOrder) {
   app::ChatBackend backend;
   backend.chat = [&](const std::vector<deepseek::Message>& messages,
                      std::string_view /*system_prompt*/,
+                     app::CallContext*,
                      std::string* /*error_out*/) -> std::optional<deepseek::ChatResponse> {
     if (messages.empty()) {
       return std::nullopt;
@@ -27,6 +35,7 @@ TEST(AgentRuntimeTests, MultiTurnDebateUpdatesMemoryAndOrder) {
   backend.stream = [&](const std::vector<deepseek::Message>&,
                        std::string_view,
                        const app::ChatBackend::StreamCallback&,
+                       app::CallContext*,
                        std::string*) { return false; };
 
   auto results = app::RunDebateRounds(backend, agents, "topic", 2, false);
@@ -46,3 +55,285 @@ TEST(AgentRuntimeTests, MultiTurnDebateUpdatesMemoryAndOrder) {
   EXPECT_EQ(agents[0].memory.size(), 2u);
   EXPECT_EQ(agents[1].memory.size(), 2u);
 }
+
+TEST(AgentRuntimeTests, ReplaysDebateForSimilarTopic) {
+  std::vector<app::Agent> agents{
+      {"Researcher", "Research prompt", {}},
+      {"Critic", "Critic prompt", {}},
+  };
+  size_t call = 0;
+  app::ChatBackend backend;
+  backend.chat = [&](const std::vector<deepseek::Message>&,
+                     std::string_view,
+                     app::CallContext*,
+                     std::string*) -> std::optional<deepseek::ChatResponse> {
+    deepseek::ChatResponse resp;
+    resp.content = "answer " + std::to_string(call++);
+    return resp;
+  };
+  backend.embed = [](std::string_view text, std::string*) -> std::optional<std::vector<float>> {
+    return std::vector<float>{text.find("locks") != std::string_view::npos ? 1.0f : 0.0f, 0.2f};
+  };
+
+  app::SemanticCache<std::vector<app::AgentResult>> cache({0.95f, 16});
+  app::RunOptions options;
+  options.answer_cache = &cache;
+  auto first = app::RunDebateRounds(backend, agents, "Are locks slow?", 1, options);
+  ASSERT_EQ(first.size(), 2u);
+  EXPECT_FALSE(first[0].cache_score.has_value());
+
+  auto replayed = app::RunDebateRounds(backend, agents, "Are locks really slow", 1, options);
+  ASSERT_EQ(replayed.size(), 2u);
+  EXPECT_EQ(call, 2u);
+  ASSERT_TRUE(replayed[1].cache_score.has_value());
+  EXPECT_EQ(replayed[1].response.content, "answer 1");
+  EXPECT_EQ(agents[1].memory.size(), 2u);
+
+  // Other round counts are a different debate.
+  app::RunDebateRounds(backend, agents, "Are locks slow?", 2, options);
+  EXPECT_EQ(call, 6u);
+}
+
+TEST(AgentRuntimeTests, AllToAllRoundsAnswerThePreviousRound) {
+  std::vector<app::Agent> agents{{"A", "a", {}}, {"B", "b", {}}, {"C", "c", {}}};
+  std::mutex mutex;
+  std::map<std::string, std::vector<std::string>> inputs;
+  app::ChatBackend backend;
+  // Answers "<system prompt><round>".
+  backend.chat = [&](const std::vector<deepseek::Message>& messages,
+                     std::string_view system_prompt,
+                     app::CallContext*,
+                     std::string*) -> std::optional<deepseek::ChatResponse> {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      inputs[std::string(system_prompt)].push_back(messages.back().content);
+    }
+    deepseek::ChatResponse resp;
+    resp.content = std::string(system_prompt) + std::to_string(messages.size());
+    return resp;
+  };
+
+  app::RunOptions options;
+  options.debate_mode = app::DebateMode::kAllToAll;
+  auto results = app::RunDebateRounds(backend, agents, "topic", 2, options);
+  ASSERT_EQ(results.size(), 6u);
+  EXPECT_EQ(results[0].response.content, "a1");
+  EXPECT_EQ(results[5].response.content, "c2");
+  EXPECT_EQ(inputs["a"], (std::vector<std::string>{"topic", "B: b1\n\nC: c1"}));
+  EXPECT_EQ(inputs["c"], (std::vector<std::string>{"topic", "A: a1\n\nB: b1"}));
+  EXPECT_EQ(agents[1].memory.size(), 2u);
+
+  for (auto& agent : agents) {
+    agent.memory.clear();
+  }
+  inputs.clear();
+  options.fan_in = 1;
+  app::RunDebateRounds(backend, agents, "topic", 2, options);
+  EXPECT_EQ(inputs["b"], (std::vector<std::string>{"topic", "C: c1"}));
+  EXPECT_EQ(inputs["c"], (std::vector<std::string>{"topic", "A: a1"}));
+}
+
+TEST(AgentRuntimeTests, SpeculativeDebateCommitsOnlyAdmittedTopics) {
+  std::vector<app::Agent> agents{{"A", "a", {}}, {"B", "b", {}}};
+  std::atomic<int> calls{0};
+  app::ChatBackend backend;
+  backend.stream = [&](const std::vector<deepseek::Message>&,
+                       std::string_view system_prompt,
+                       const app::ChatBackend::StreamCallback& on_delta,
+                       app::CallContext*,
+                       std::string*) {
+    ++calls;
+    on_delta("", system_prompt);
+    return true;
+  };
+  std::vector<std::string> delivered;
+  app::RunOptions options;
+  options.stream = true;
+  options.on_delta = [&](const std::string& agent, std::string_view, std::string_view) {
+    delivered.push_back(agent);
+  };
+  // The gate decides only after the first turn has started.
+  const auto gate = [&](bool allow) {
+    return [&calls, allow]() {
+      while (calls == 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+      return allow;
+    };
+  };
+
+  auto rejected = app::RunDebateRoundsSpeculative(backend, agents, "topic", 2, gate(false), options);
+  EXPECT_FALSE(rejected.has_value());
+  EXPECT_EQ(calls, 1);
+  EXPECT_TRUE(agents[0].memory.empty());
+  EXPECT_TRUE(delivered.empty());
+
+  calls = 0;
+  auto admitted = app::RunDebateRoundsSpeculative(backend, agents, "topic", 2, gate(true), options);
+  ASSERT_TRUE(admitted.has_value());
+  EXPECT_EQ(admitted->size(), 4u);
+  EXPECT_EQ(agents[0].memory.size(), 2u);
+  EXPECT_EQ(delivered, (std::vector<std::string>{"A", "B", "A", "B"}));
+}
+
+TEST(AgentRuntimeTests, PrefillAgentsStopsWhenCancelled) {
+  std::vector<app::Agent> agents{{"A", "a", {{"assistant", "hi", ""}}}, {"B", "b", {}}};
+  app::CancelToken cancel;
+  // Set to cancel the run from inside the first prefill.
+  app::CancelToken* cancel_after_first = nullptr;
+  std::vector<std::string> prefilled;
+  app::ChatBackend backend;
+  backend.prefill = [&](const std::vector<deepseek::Message>& messages,
+                        std::string_view system_prompt,
+                        const app::CancelToken*) {
+    prefilled.push_back(std::string(system_prompt) + std::to_string(messages.size()));
+    if (cancel_after_first) {
+      cancel_after_first->Cancel();
+    }
+    return true;
+  };
+
+  EXPECT_EQ(app::PrefillAgents(backend, agents, &cancel), 2u);
+  EXPECT_EQ(prefilled, (std::vector<std::string>{"a1", "b0"}));
+
+  prefilled.clear();
+  cancel_after_first = &cancel;
+  EXPECT_EQ(app::PrefillAgents(backend, agents, &cancel), 1u);
+  EXPECT_EQ(prefilled, (std::vector<std::string>{"a1"}));
+}
+
+namespace {
+
+// Answers with the agent's system prompt; "slow" agents block until their
+// call is cancelled.
+app::ChatBackend QuorumBackend() {
+  app::ChatBackend backend;
+  backend.chat = [](const std::vector<deepseek::Message>&,
+                    std::string_view system_prompt,
+                    app::CallContext* call,
+                    std::string*) -> std::optional<deepseek::ChatResponse> {
+    if (system_prompt == "slow") {
+      while (!call->cancelled()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+      return std::nullopt;
+    }
+    deepseek::ChatResponse resp;
+    resp.content = std::string(system_prompt);
+    return resp;
+  };
+  return backend;
+}
+
+}  // namespace
+
+TEST(AgentRuntimeTests, QuorumStopsAtMajorityAndCancelsTheRest) {
+  std::vector<app::Agent> agents{
+      {"A", "Yes.", {}}, {"B", "slow", {}}, {"C", " yes", {}}, {"D", "slow", {}},
+      {"E", "YES!", {}}, {"F", "slow", {}}, {"G", "Yes", {}},
+  };
+  app::ChatBackend backend = QuorumBackend();
+
+  app::QuorumPolicy policy;
+  policy.mode = app::QuorumPolicy::Mode::kMajority;
+  const auto quorum = app::RunAgentsQuorum(backend, agents, "Agree?", policy);
+
+  EXPECT_TRUE(quorum.satisfied);
+  ASSERT_TRUE(quorum.consensus.has_value());
+  EXPECT_EQ(*quorum.consensus, "yes");
+  EXPECT_EQ(quorum.votes, 4u);
+  EXPECT_EQ(quorum.results.size(), 4u);
+  EXPECT_EQ(quorum.cancelled, 3u);
+  EXPECT_EQ(quorum.failed, 0u);
+  for (const auto& agent : agents) {
+    EXPECT_EQ(agent.memory.size(), agent.system_prompt == "slow" ? 0u : 1u) << agent.name;
+  }
+}
+
+TEST(AgentRuntimeTests, QuorumDeadlineCancelsUnfinishedAgents) {
+  std::vector<app::Agent> agents{
+      {"A", "done", {}}, {"B", "slow", {}}, {"C", "slow", {}},
+  };
+  app::ChatBackend backend = QuorumBackend();
+
+  app::QuorumPolicy policy;
+  policy.mode = app::QuorumPolicy::Mode::kFirstK;
+  policy.k = 2;
+  policy.deadline = std::chrono::milliseconds(20);
+  const auto quorum = app::RunAgentsQuorum(backend, agents, "Go", policy);
+
+  EXPECT_FALSE(quorum.satisfied);
+  ASSERT_EQ(quorum.results.size(), 1u);
+  EXPECT_EQ(quorum.results[0].name, "A");
+  EXPECT_EQ(quorum.cancelled, 2u);
+  EXPECT_EQ(app::NormalizeAnswer("  The answer:\n\n 42. "), "the answer: 42");
+}
+
+TEST(AgentRuntimeTests, DeadlineCancelsCallAndKeepsMemory) {
+  app::Agent agent{"A", "slow", {}};
+  app::ChatBackend backend = QuorumBackend();
+
+  app::RunOptions options;
+  options.deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(10);
+  EXPECT_THROW(app::RunAgent(backend, agent, "Go", options), app::DeadlineExceededError);
+  EXPECT_TRUE(agent.memory.empty());
+
+  app::CancelToken cancel;
+  cancel.Cancel();
+  options.deadline.reset();
+  options.cancel = &cancel;
+  agent.system_prompt = "done";
+  try {
+    app::RunAgent(backend, agent, "Go", options);
+    ADD_FAILURE() << "expected CancelledError";
+  } catch (const app::DeadlineExceededError&) {
+    ADD_FAILURE() << "cancelled, not past the deadline";
+  } catch (const app::CancelledError&) {
+  }
+  EXPECT_TRUE(agent.memory.empty());
+}
+
+TEST(AgentRuntimeTests, BranchesForkHistoryAndAnswerTogether) {
+  app::Agent root{"Researcher", "Research prompt",
+                  {{"assistant", "A1", ""}, {"assistant", "A2", ""}, {"assistant", "A3", ""}}};
+  auto branches = app::ForkAgent(root, 2, 2);
+  ASSERT_EQ(branches.size(), 2u);
+  EXPECT_EQ(branches[1].name, "Researcher/2");
+  EXPECT_EQ(branches[0].memory.size(), 2u);
+
+  size_t batch_calls = 0;
+  app::ChatBackend backend;
+  backend.chat_batch = [&](const std::vector<std::vector<deepseek::Message>>& prompts,
+                           std::string_view, std::vector<app::CallContext>* calls,
+                           std::string*) -> std::optional<std::vector<deepseek::ChatResponse>> {
+    ++batch_calls;
+    EXPECT_EQ(calls->size(), prompts.size());
+    std::vector<deepseek::ChatResponse> out(prompts.size());
+    for (size_t i = 0; i < prompts.size(); ++i) {
+      out[i].content = prompts[i][1].content + "+" + prompts[i].back().content;
+    }
+    return out;
+  };
+
+  const auto results = app::RunBranches(backend, branches, {"left", "right"});
+  EXPECT_EQ(batch_calls, 1u);
+  ASSERT_EQ(results.size(), 2u);
+  EXPECT_EQ(results[0].response.content, "A2+left");
+  EXPECT_EQ(results[1].response.content, "A2+right");
+  EXPECT_EQ(branches[1].memory.back().content, "A2+right");
+  EXPECT_EQ(root.memory.size(), 3u);
+
+  // Without chat_batch each branch is a separate call.
+  backend.chat_batch = nullptr;
+  backend.chat = [](const std::vector<deepseek::Message>& messages, std::string_view,
+                    app::CallContext*, std::string*) -> std::optional<deepseek::ChatResponse> {
+    deepseek::ChatResponse resp;
+    resp.content = messages.back().content;
+    return resp;
+  };
+  auto again = app::ForkAgent(branches[0], 2);
+  const auto serial = app::RunBranches(backend, again, {"x", "y"});
+  EXPECT_EQ(serial[1].response.content, "y");
+  EXPECT_EQ(again[0].name, "Researcher/1/1");
+  EXPECT_EQ(again[0].memory.size(), 4u);
+}
@@ -0,0 +1,181 @@
+#include "BackendRouter.hpp"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+
+// Answers with `name`, or fails when `fail` is set. While `hold` is set,
+// calls wait for it to clear.
+app::ChatBackend NamedBackend(const std::string& name,
+                              bool fail = false,
+                              std::atomic<bool>* hold = nullptr,
+                              std::atomic<int>* entered = nullptr) {
+  app::ChatBackend backend;
+  backend.chat = [=](const std::vector<deepseek::Message>&,
+                     std::string_view,
+                     app::CallContext* call,
+                     std::string* error_out) -> std::optional<deepseek::ChatResponse> {
+    if (entered) {
+      ++*entered;
+    }
+    while (hold && *hold) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    if (fail) {
+      *error_out = name + " failed";
+      return std::nullopt;
+    }
+    call->metrics.backend = name;
+    deepseek::ChatResponse resp;
+    resp.content = name;
+    return resp;
+  };
+  backend.stream = [](const std::vector<deepseek::Message>&,
+                      std::string_view,
+                      const app::ChatBackend::StreamCallback&,
+                      app::CallContext*,
+                      std::string*) { return false; };
+  return backend;
+}
+
+}  // namespace
+
+TEST(BackendRouterTests, BurstsToRemoteWhenLocalContextsAreBusy) {
+  std::atomic<bool> hold{true};
+  std::atomic<int> entered{0};
+  app::BackendRouter router(NamedBackend("local", false, &hold, &entered), NamedBackend("remote"));
+  app::ChatBackend backend = router.Backend();
+
+  auto first = std::async(std::launch::async, [&]() {
+    app::CallContext call;
+    auto resp = backend.chat({{"user", "topic", ""}}, "system", &call, nullptr);
+    return resp ? resp->content : std::string();
+  });
+  while (entered == 0) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  app::CallContext call;
+  auto resp = backend.chat({{"user", "topic", ""}}, "system", &call, nullptr);
+  ASSERT_TRUE(resp.has_value());
+  EXPECT_EQ(resp->content, "remote");
+  EXPECT_EQ(call.metrics.route, "remote: local queue");
+
+  hold = false;
+  EXPECT_EQ(first.get(), "local");
+  const auto stats = router.stats();
+  EXPECT_EQ(stats.local, 1u);
+  EXPECT_EQ(stats.remote, 1u);
+}
+
+TEST(BackendRouterTests, FailsOverAndAvoidsTheFailedBackend) {
+  app::BackendRouter router(NamedBackend("local", true), NamedBackend("remote"));
+  app::ChatBackend backend = router.Backend();
+
+  app::CallContext call;
+  std::string error;
+  auto resp = backend.chat({{"user", "topic", ""}}, "system", &call, &error);
+  ASSERT_TRUE(resp.has_value()) << error;
+  EXPECT_EQ(resp->content, "remote");
+  EXPECT_EQ(call.metrics.route, "remote: failover");
+  EXPECT_EQ(call.metrics.failovers, 1u);
+
+  app::CallContext next;
+  resp = backend.chat({{"user", "topic", ""}}, "system", &next, &error);
+  ASSERT_TRUE(resp.has_value()) << error;
+  EXPECT_EQ(next.metrics.route, "remote: local unavailable");
+  EXPECT_EQ(router.stats().failovers, 1u);
+}
+
+TEST(BackendRouterTests, LongPromptsGoRemote) {
+  app::RouterOptions options;
+  options.max_local_prompt_tokens = 100;
+  app::BackendRouter router(NamedBackend("local"), NamedBackend("remote"), options);
+
+  std::string reason;
+  EXPECT_EQ(router.Choose(50, app::CallKind::kAgent, &reason), app::Route::kLocal);
+  EXPECT_EQ(reason, "local: context free");
+  EXPECT_EQ(router.Choose(500, app::CallKind::kGate, &reason), app::Route::kRemote);
+  EXPECT_EQ(reason, "remote: long prompt");
+}
+
+TEST(BackendRouterTests, ThrowingLocalBackendFailsOver) {
+  app::ChatBackend local = NamedBackend("local");
+  local.chat = [](const std::vector<deepseek::Message>&,
+                  std::string_view,
+                  app::CallContext*,
+                  std::string*) -> std::optional<deepseek::ChatResponse> {
+    throw std::runtime_error("Failed to decode prompt.");
+  };
+  app::RouterOptions options;
+  options.failure_cooldown = std::chrono::milliseconds(0);
+  app::BackendRouter router(std::move(local), NamedBackend("remote"), options);
+  app::ChatBackend backend = router.Backend();
+
+  app::CallContext call;
+  std::string error;
+  auto resp = backend.chat({{"user", "topic", ""}}, "system", &call, &error);
+  ASSERT_TRUE(resp.has_value()) << error;
+  EXPECT_EQ(resp->content, "remote");
+  EXPECT_EQ(call.metrics.route, "remote: failover");
+  EXPECT_EQ(router.stats().failovers, 1u);
+
+  // The failed call no longer counts as running locally.
+  std::string reason;
+  EXPECT_EQ(router.Choose(10, app::CallKind::kAgent, &reason), app::Route::kLocal);
+  EXPECT_EQ(reason, "local: context free");
+}
+
+TEST(BackendRouterTests, RoutesBatchesAndFailsOverToPerPromptCalls) {
+  int batches = 0;
+  bool fail_batch = false;
+  app::ChatBackend local = NamedBackend("local");
+  local.chat_batch = [&](const std::vector<std::vector<deepseek::Message>>& prompts,
+                         std::string_view,
+                         std::vector<app::CallContext>* calls,
+                         std::string*) -> std::optional<std::vector<deepseek::ChatResponse>> {
+    ++batches;
+    if (fail_batch) {
+      throw std::runtime_error("Failed to decode branches.");
+    }
+    std::vector<deepseek::ChatResponse> responses(prompts.size());
+    for (size_t i = 0; i < prompts.size(); ++i) {
+      responses[i].content = "local batch";
+      (*calls)[i].metrics.backend = "local";
+    }
+    return responses;
+  };
+  app::RouterOptions options;
+  options.failure_cooldown = std::chrono::milliseconds(0);
+  app::BackendRouter router(local, NamedBackend("remote"), options);
+  app::ChatBackend backend = router.Backend();
+  ASSERT_TRUE(backend.chat_batch);
+
+  const std::vector<std::vector<deepseek::Message>> prompts{{{"user", "a", ""}},
+                                                            {{"user", "b", ""}}};
+  std::vector<app::CallContext> calls(2);
+  auto responses = backend.chat_batch(prompts, "system", &calls, nullptr);
+  ASSERT_TRUE(responses.has_value());
+  ASSERT_EQ(responses->size(), 2u);
+  EXPECT_EQ((*responses)[1].content, "local batch");
+  EXPECT_EQ(calls[1].metrics.route, "local: context free");
+  EXPECT_EQ(batches, 1);
+  EXPECT_EQ(router.stats().local, 1u);
+
+  // The remote side has no chat_batch and answers each prompt on its own.
+  fail_batch = true;
+  calls.assign(2, app::CallContext{});
+  responses = backend.chat_batch(prompts, "system", &calls, nullptr);
+  ASSERT_TRUE(responses.has_value());
+  EXPECT_EQ((*responses)[0].content, "remote");
+  EXPECT_EQ((*responses)[1].content, "remote");
+  EXPECT_EQ(calls[0].metrics.route, "remote: failover");
+  EXPECT_EQ(calls[0].metrics.failovers, 1u);
+  EXPECT_EQ(router.stats().failovers, 1u);
+}
@@ -0,0 +1,131 @@
+#include "BatchRunner.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+
+TEST(BatchRunnerTests, ParsesJsonAndPlainLines) {
+  app::BatchItem item;
+  std::string error;
+  ASSERT_TRUE(app::ParseBatchItem(
+      R"({"id":"q1","topic":"Lock-free queues","rounds":2,)"
+      R"("agents":[{"name":"Skeptic","system_prompt":"Doubt it."}]})",
+      3, &item, &error))
+      << error;
+  EXPECT_EQ(item.id, "q1");
+  EXPECT_EQ(item.line, 3u);
+  EXPECT_EQ(item.rounds, 2);
+  ASSERT_EQ(item.agents.size(), 1u);
+  EXPECT_EQ(item.agents[0].name, "Skeptic");
+  EXPECT_EQ(item.agents[0].system_prompt, "Doubt it.");
+
+  ASSERT_TRUE(app::ParseBatchItem("C++ coroutines in agents", 7, &item, &error));
+  EXPECT_EQ(item.id, "7");
+  EXPECT_EQ(item.topic, "C++ coroutines in agents");
+  EXPECT_TRUE(item.agents.empty());
+
+  EXPECT_FALSE(app::ParseBatchItem(R"({"id":1})", 1, &item, &error));
+  EXPECT_FALSE(app::ParseBatchItem(R"({"topic":)", 1, &item, &error));
+}
+
+TEST(BatchRunnerTests, RunsConcurrentlyAndReportsInCompletionOrder) {
+  // The first item is slow; the others finish while it runs.
+  std::istringstream in(
+      "{\"id\":\"slow\",\"topic\":\"slow topic\"}\n"
+      "\n"
+      "fast one\n"
+      "{\"topic\":\"custom\",\"agents\":[{\"name\":\"Solo\"}],\"rounds\":3}\n"
+      "{\"topic\":\"rejected\"}\n"
+      "{\"topic\":\n");
+  std::ostringstream out;
+  std::atomic<int> in_flight{0};
+  std::atomic<int> max_in_flight{0};
+
+  app::BatchOptions options;
+  options.concurrency = 2;
+  options.rounds = 1;
+  const auto make_agents = []() {
+    return std::vector<app::Agent>{{"Researcher", "r", {}}, {"Critic", "c", {}}};
+  };
+  const auto stats = app::RunBatch(
+      in, out, options, make_agents,
+      [&](const app::BatchItem& item, std::vector<app::Agent>& agents,
+          std::vector<app::AgentResult>* results, std::string* error_out) {
+        const int now = ++in_flight;
+        int seen = max_in_flight.load();
+        while (now > seen && !max_in_flight.compare_exchange_weak(seen, now)) {
+        }
+        if (item.topic == "slow topic") {
+          std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        --in_flight;
+        if (item.topic == "rejected") {
+          *error_out = "Gate rejected the topic.";
+          return false;
+        }
+        for (int r = 0; r < item.rounds; ++r) {
+          for (const auto& agent : agents) {
+            app::AgentResult result;
+            result.name = agent.name;
+            result.response.content = item.topic;
+            results->push_back(result);
+          }
+        }
+        return true;
+      });
+
+  EXPECT_EQ(stats.items, 5u);
+  EXPECT_EQ(stats.failed, 2u);
+  EXPECT_EQ(max_in_flight.load(), 2);
+
+  std::vector<nlohmann::json> lines;
+  std::istringstream produced(out.str());
+  std::string line;
+  while (std::getline(produced, line)) {
+    lines.push_back(nlohmann::json::parse(line));
+  }
+  ASSERT_EQ(lines.size(), 5u);
+  EXPECT_EQ(lines.back()["id"], "slow");
+  EXPECT_GE(lines.back()["elapsed_ms"].get<double>(), 100.0);
+
+  std::map<std::string, nlohmann::json> by_id;
+  for (const auto& j : lines) {
+    by_id[j["id"].get<std::string>()] = j;
+  }
+  EXPECT_EQ(by_id["3"]["results"].size(), 2u);
+  EXPECT_EQ(by_id["4"]["results"].size(), 3u);
+  EXPECT_EQ(by_id["4"]["results"][0]["agent"], "Solo");
+  EXPECT_FALSE(by_id["5"]["ok"].get<bool>());
+  EXPECT_EQ(by_id["5"]["error"], "Gate rejected the topic.");
+  EXPECT_FALSE(by_id["6"]["ok"].get<bool>());
+}
+
+TEST(BatchRunnerTests, ReplacesTruncatedMultiByteReplies) {
+  std::istringstream in("cut off\n");
+  std::ostringstream out;
+  const auto make_agents = []() { return std::vector<app::Agent>{{"Solo", "s", {}}}; };
+  const auto stats = app::RunBatch(
+      in, out, app::BatchOptions{}, make_agents,
+      [](const app::BatchItem&, std::vector<app::Agent>& agents,
+         std::vector<app::AgentResult>* results, std::string*) {
+        app::AgentResult result;
+        result.name = agents[0].name;
+        // "café" cut after the first byte of the two-byte "é".
+        result.response.content = "caf\xC3";
+        results->push_back(result);
+        return true;
+      });
+
+  EXPECT_EQ(stats.items, 1u);
+  EXPECT_EQ(stats.failed, 0u);
+  const auto j = nlohmann::json::parse(out.str());
+  EXPECT_TRUE(j["ok"].get<bool>());
+  EXPECT_EQ(j["results"][0]["content"], "caf\xEF\xBF\xBD");
+}
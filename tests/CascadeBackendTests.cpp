@@ -0,0 +1,155 @@
+#include "CascadeBackend.hpp"
+
+#include <gtest/gtest.h>
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Answers with `name` and reports `confidence` when asked for one.
+app::ChatBackend ScoredBackend(const std::string& name, double confidence, int* calls) {
+  app::ChatBackend backend;
+  backend.chat = [=](const std::vector<deepseek::Message>&,
+                     std::string_view,
+                     app::CallContext* call,
+                     std::string*) -> std::optional<deepseek::ChatResponse> {
+    ++*calls;
+    if (call->want_confidence) {
+      call->confidence = confidence;
+    }
+    call->metrics.total_ms = 10.0;
+    deepseek::ChatResponse resp;
+    resp.content = name;
+    return resp;
+  };
+  backend.stream = [=](const std::vector<deepseek::Message>&,
+                       std::string_view,
+                       const app::ChatBackend::StreamCallback& on_delta,
+                       app::CallContext* call,
+                       std::string*) {
+    ++*calls;
+    call->metrics.total_ms = 10.0;
+    on_delta("", name);
+    return true;
+  };
+  return backend;
+}
+
+}  // namespace
+
+TEST(CascadeBackendTests, ConfidentSmallModelAnswers) {
+  int small_calls = 0;
+  int large_calls = 0;
+  app::CascadeBackend cascade({{"small", ScoredBackend("small", 0.95, &small_calls), 0.8},
+                               {"large", ScoredBackend("large", 0.99, &large_calls), 0.0}});
+  app::ChatBackend backend = cascade.Backend();
+
+  app::CallContext call;
+  auto resp = backend.chat({{"user", "topic", ""}}, "system", &call, nullptr);
+  ASSERT_TRUE(resp.has_value());
+  EXPECT_EQ(resp->content, "small");
+  EXPECT_EQ(call.metrics.tier, "small");
+  EXPECT_EQ(call.metrics.escalations, 0u);
+  EXPECT_EQ(large_calls, 0);
+
+  const auto stats = cascade.stats();
+  ASSERT_EQ(stats.size(), 2u);
+  EXPECT_EQ(stats[0].answered, 1u);
+  EXPECT_EQ(stats[1].calls, 0u);
+}
+
+TEST(CascadeBackendTests, EscalatesUnsureAnswersWithoutStreamingThem) {
+  int small_calls = 0;
+  int large_calls = 0;
+  app::CascadeBackend cascade({{"small", ScoredBackend("small", 0.4, &small_calls), 0.8},
+                               {"large", ScoredBackend("large", 0.99, &large_calls), 0.0}});
+  app::ChatBackend backend = cascade.Backend();
+
+  std::string streamed;
+  app::CallContext call;
+  ASSERT_TRUE(backend.stream(
+      {{"user", "topic", ""}}, "system",
+      [&](std::string_view, std::string_view content) { streamed.append(content); }, &call,
+      nullptr));
+  EXPECT_EQ(streamed, "large");
+  EXPECT_EQ(call.metrics.tier, "large");
+  EXPECT_EQ(call.metrics.escalations, 1u);
+  EXPECT_DOUBLE_EQ(call.metrics.total_ms, 20.0);
+  EXPECT_EQ(small_calls, 1);
+  EXPECT_EQ(large_calls, 1);
+  EXPECT_EQ(cascade.stats()[1].answered, 1u);
+}
+
+TEST(CascadeBackendTests, ThrowingTierEscalates) {
+  int small_calls = 0;
+  int large_calls = 0;
+  app::ChatBackend small = ScoredBackend("small", 0.95, &small_calls);
+  small.chat = [](const std::vector<deepseek::Message>&,
+                  std::string_view,
+                  app::CallContext*,
+                  std::string*) -> std::optional<deepseek::ChatResponse> {
+    throw std::runtime_error("Prompt exceeds the context window.");
+  };
+  app::CascadeBackend cascade({{"small", small, 0.8},
+                               {"large", ScoredBackend("large", 0.99, &large_calls), 0.0}});
+  app::ChatBackend backend = cascade.Backend();
+
+  app::CallContext call;
+  std::string error;
+  auto resp = backend.chat({{"user", "topic", ""}}, "system", &call, &error);
+  ASSERT_TRUE(resp.has_value()) << error;
+  EXPECT_EQ(resp->content, "large");
+  EXPECT_EQ(call.metrics.escalations, 1u);
+  EXPECT_EQ(large_calls, 1);
+}
+
+TEST(CascadeBackendTests, BatchesOnlyEscalatedPromptsOnTheLastTier) {
+  app::ChatBackend small;
+  small.chat = [](const std::vector<deepseek::Message>& messages,
+                  std::string_view,
+                  app::CallContext* call,
+                  std::string*) -> std::optional<deepseek::ChatResponse> {
+    // Sure about "easy" only.
+    call->confidence = messages.back().content == "easy" ? 0.95 : 0.4;
+    call->metrics.total_ms = 10.0;
+    deepseek::ChatResponse resp;
+    resp.content = "small";
+    return resp;
+  };
+  int large_calls = 0;
+  app::ChatBackend large = ScoredBackend("large", 0.99, &large_calls);
+  std::vector<std::string> batched;
+  large.chat_batch = [&](const std::vector<std::vector<deepseek::Message>>& prompts,
+                         std::string_view,
+                         std::vector<app::CallContext>* calls,
+                         std::string*) -> std::optional<std::vector<deepseek::ChatResponse>> {
+    std::vector<deepseek::ChatResponse> responses(prompts.size());
+    for (size_t i = 0; i < prompts.size(); ++i) {
+      batched.push_back(prompts[i].back().content);
+      responses[i].content = "large";
+      (*calls)[i].metrics.total_ms = 20.0;
+    }
+    return responses;
+  };
+  app::CascadeBackend cascade({{"small", small, 0.8}, {"large", large, 0.0}});
+  app::ChatBackend backend = cascade.Backend();
+  ASSERT_TRUE(backend.chat_batch);
+
+  std::vector<app::CallContext> calls(3);
+  auto responses = backend.chat_batch(
+      {{{"user", "easy", ""}}, {{"user", "hard", ""}}, {{"user", "harder", ""}}}, "system",
+      &calls, nullptr);
+  ASSERT_TRUE(responses.has_value());
+  ASSERT_EQ(responses->size(), 3u);
+  EXPECT_EQ((*responses)[0].content, "small");
+  EXPECT_EQ((*responses)[1].content, "large");
+  EXPECT_EQ((*responses)[2].content, "large");
+  EXPECT_EQ(batched, (std::vector<std::string>{"hard", "harder"}));
+  EXPECT_EQ(large_calls, 0);
+  EXPECT_EQ(calls[0].metrics.tier, "small");
+  EXPECT_EQ(calls[1].metrics.tier, "large");
+  EXPECT_EQ(calls[1].metrics.escalations, 1u);
+  EXPECT_DOUBLE_EQ(calls[1].metrics.total_ms, 30.0);
+}
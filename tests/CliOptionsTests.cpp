@@ -15,6 +15,7 @@ TEST(CliOptionsTests, Defaults) {
   EXPECT_FALSE(opts->topic_set);
   EXPECT_EQ(opts->gpu_layers, 0);
   EXPECT_FALSE(opts->gpu_layers_auto);
+  EXPECT_TRUE(opts->kv_state);
 }
 
 TEST(CliOptionsTests, ParsesValues) {
@@ -71,3 +72,189 @@ TEST(CliOptionsTests, ParsesAutoGpuLayers) {
   EXPECT_TRUE(opts->gpu_layers_auto);
   EXPECT_EQ(opts->gpu_layers, 0);
 }
+
+TEST(CliOptionsTests, ConvertRequiresLoadAndSave) {
+  const char* argv[] = {"CppDeepSeek", "--convert", "--load", "in.json", "--save", "out.snap",
+                        "--history", "8"};
+  int argc = 8;
+  std::string error;
+  auto opts = app::ParseCli(argc, const_cast<char**>(argv), &error);
+  ASSERT_TRUE(opts.has_value()) << error;
+  EXPECT_TRUE(opts->convert);
+  EXPECT_EQ(opts->history, 8);
+
+  const char* missing[] = {"CppDeepSeek", "--convert", "--load", "in.json"};
+  EXPECT_FALSE(app::ParseCli(4, const_cast<char**>(missing), &error).has_value());
+}
+
+TEST(CliOptionsTests, AutotuneRequiresLocalBackend) {
+  const char* argv[] = {"CppDeepSeek", "--autotune", "--remote"};
+  std::string error;
+  EXPECT_FALSE(app::ParseCli(3, const_cast<char**>(argv), &error).has_value());
+  EXPECT_FALSE(error.empty());
+
+  auto opts = app::ParseCli(2, const_cast<char**>(argv), &error);
+  ASSERT_TRUE(opts.has_value());
+  EXPECT_TRUE(opts->autotune);
+}
+
+TEST(CliOptionsTests, ParsesKvCacheOptions) {
+  const char* argv[] = {"CppDeepSeek", "--ctx-size", "16384", "--cache-type-k", "q8_0",
+                        "--cache-type-v", "q8_0", "--flash-attn", "on", "--no-kv-offload"};
+  std::string error;
+  auto opts = app::ParseCli(10, const_cast<char**>(argv), &error);
+  ASSERT_TRUE(opts.has_value()) << error;
+  EXPECT_EQ(opts->ctx_size, 16384);
+  EXPECT_EQ(opts->cache_type_k, "q8_0");
+  EXPECT_EQ(opts->cache_type_v, "q8_0");
+  EXPECT_EQ(opts->flash_attn, "on");
+  EXPECT_FALSE(opts->kv_offload);
+
+  const char* no_fa[] = {"CppDeepSeek", "--cache-type-v", "q4_0", "--flash-attn", "off"};
+  EXPECT_FALSE(app::ParseCli(5, const_cast<char**>(no_fa), &error).has_value());
+  const char* bad_type[] = {"CppDeepSeek", "--cache-type-k", "q3_K"};
+  EXPECT_FALSE(app::ParseCli(3, const_cast<char**>(bad_type), &error).has_value());
+}
+
+TEST(CliOptionsTests, ParsesContextBudget) {
+  const char* argv[] = {"CppDeepSeek", "--context-budget", "2048", "--no-summarize"};
+  std::string error;
+  auto opts = app::ParseCli(4, const_cast<char**>(argv), &error);
+  ASSERT_TRUE(opts.has_value()) << error;
+  EXPECT_EQ(opts->context_budget, 2048);
+  EXPECT_FALSE(opts->summarize);
+
+  const char* too_small[] = {"CppDeepSeek", "--context-budget", "100"};
+  EXPECT_FALSE(app::ParseCli(3, const_cast<char**>(too_small), &error).has_value());
+}
+
+TEST(CliOptionsTests, EmbeddingFeaturesNeedEmbeddingModelRemotely) {
+  const char* argv[] = {"CppDeepSeek", "--remote", "--retrieval", "--retrieval-k", "6"};
+  std::string error;
+  EXPECT_FALSE(app::ParseCli(5, const_cast<char**>(argv), &error).has_value());
+
+  const char* with_model[] = {"CppDeepSeek", "--remote",      "--retrieval", "--retrieval-k",
+                              "6",           "--embed-model", "embed.gguf"};
+  auto opts = app::ParseCli(7, const_cast<char**>(with_model), &error);
+  ASSERT_TRUE(opts.has_value()) << error;
+  EXPECT_TRUE(opts->retrieval);
+  EXPECT_EQ(opts->retrieval_k, 6);
+  EXPECT_EQ(opts->embed_model, "embed.gguf");
+
+  const char* cache[] = {"CppDeepSeek", "--semantic-cache", "0.9"};
+  opts = app::ParseCli(3, const_cast<char**>(cache), &error);
+  ASSERT_TRUE(opts.has_value()) << error;
+  EXPECT_FLOAT_EQ(opts->semantic_cache, 0.9f);
+  const char* bad_cache[] = {"CppDeepSeek", "--semantic-cache", "1.5"};
+  EXPECT_FALSE(app::ParseCli(3, const_cast<char**>(bad_cache), &error).has_value());
+}
+
+TEST(CliOptionsTests, ParsesBatchMode) {
+  const char* argv[] = {"CppDeepSeek", "--batch", "topics.jsonl", "--concurrency", "8"};
+  std::string error;
+  auto opts = app::ParseCli(5, const_cast<char**>(argv), &error);
+  ASSERT_TRUE(opts.has_value()) << error;
+  EXPECT_EQ(opts->batch_path, "topics.jsonl");
+  EXPECT_EQ(opts->concurrency, 8);
+
+  const char* with_topic[] = {"CppDeepSeek", "--batch", "-", "--topic", "x"};
+  EXPECT_FALSE(app::ParseCli(5, const_cast<char**>(with_topic), &error).has_value());
+  const char* zero[] = {"CppDeepSeek", "--batch", "-", "--concurrency", "0"};
+  EXPECT_FALSE(app::ParseCli(5, const_cast<char**>(zero), &error).has_value());
+}
+
+TEST(CliOptionsTests, ParsesDeadline) {
+  const char* argv[] = {"CppDeepSeek", "--deadline-ms", "1500"};
+  std::string error;
+  auto opts = app::ParseCli(3, const_cast<char**>(argv), &error);
+  ASSERT_TRUE(opts.has_value()) << error;
+  EXPECT_EQ(opts->deadline_ms, 1500);
+
+  const char* negative[] = {"CppDeepSeek", "--deadline-ms", "-1"};
+  EXPECT_FALSE(app::ParseCli(3, const_cast<char**>(negative), &error).has_value());
+}
+
+TEST(CliOptionsTests, ParsesDraftModel) {
+  const char* argv[] = {"CppDeepSeek", "--draft-model", "draft.gguf", "--draft-max", "4"};
+  std::string error;
+  auto opts = app::ParseCli(5, const_cast<char**>(argv), &error);
+  ASSERT_TRUE(opts.has_value()) << error;
+  EXPECT_EQ(opts->draft_model, "draft.gguf");
+  EXPECT_EQ(opts->draft_max, 4);
+
+  const char* remote[] = {"CppDeepSeek", "--remote", "--draft-model", "draft.gguf"};
+  EXPECT_FALSE(app::ParseCli(4, const_cast<char**>(remote), &error).has_value());
+  const char* zero[] = {"CppDeepSeek", "--draft-model", "draft.gguf", "--draft-max", "0"};
+  EXPECT_FALSE(app::ParseCli(5, const_cast<char**>(zero), &error).has_value());
+}
+
+TEST(CliOptionsTests, ParsesHybridRouting) {
+  const char* argv[] = {"CppDeepSeek", "--hybrid", "--local-prompt-limit", "2000"};
+  std::string error;
+  auto opts = app::ParseCli(4, const_cast<char**>(argv), &error);
+  ASSERT_TRUE(opts.has_value()) << error;
+  EXPECT_TRUE(opts->hybrid);
+  EXPECT_TRUE(opts->local_only);
+  EXPECT_EQ(opts->local_prompt_limit, 2000);
+
+  const char* remote[] = {"CppDeepSeek", "--hybrid", "--remote"};
+  EXPECT_FALSE(app::ParseCli(3, const_cast<char**>(remote), &error).has_value());
+  const char* limit_only[] = {"CppDeepSeek", "--local-prompt-limit", "2000"};
+  EXPECT_FALSE(app::ParseCli(3, const_cast<char**>(limit_only), &error).has_value());
+}
+
+TEST(CliOptionsTests, ParsesCascade) {
+  const char* argv[] = {"CppDeepSeek", "--remote", "--cascade-model", "small.gguf",
+                        "--cascade-threshold", "0.7"};
+  std::string error;
+  auto opts = app::ParseCli(6, const_cast<char**>(argv), &error);
+  ASSERT_TRUE(opts.has_value()) << error;
+  EXPECT_EQ(opts->cascade_model, "small.gguf");
+  EXPECT_FLOAT_EQ(opts->cascade_threshold, 0.7f);
+
+  const char* bad[] = {"CppDeepSeek", "--cascade-threshold", "0"};
+  EXPECT_FALSE(app::ParseCli(3, const_cast<char**>(bad), &error).has_value());
+}
+
+TEST(CliOptionsTests, StablePrefixNeedsRetrieval) {
+  const char* argv[] = {"CppDeepSeek", "--retrieval", "--stable-prefix"};
+  std::string error;
+  auto opts = app::ParseCli(3, const_cast<char**>(argv), &error);
+  ASSERT_TRUE(opts.has_value()) << error;
+  EXPECT_TRUE(opts->stable_prefix);
+
+  const char* alone[] = {"CppDeepSeek", "--stable-prefix"};
+  EXPECT_FALSE(app::ParseCli(2, const_cast<char**>(alone), &error).has_value());
+}
+
+TEST(CliOptionsTests, ParsesAllToAllFanIn) {
+  const char* argv[] = {"CppDeepSeek", "--all-to-all", "--fan-in", "3"};
+  std::string error;
+  auto opts = app::ParseCli(4, const_cast<char**>(argv), &error);
+  ASSERT_TRUE(opts.has_value()) << error;
+  EXPECT_TRUE(opts->all_to_all);
+  EXPECT_EQ(opts->fan_in, 3);
+
+  const char* alone[] = {"CppDeepSeek", "--fan-in", "3"};
+  EXPECT_FALSE(app::ParseCli(3, const_cast<char**>(alone), &error).has_value());
+}
+
+TEST(CliOptionsTests, ParsesOptimisticGate) {
+  const char* argv[] = {"CppDeepSeek", "--optimistic-gate"};
+  std::string error;
+  auto opts = app::ParseCli(2, const_cast<char**>(argv), &error);
+  ASSERT_TRUE(opts.has_value()) << error;
+  EXPECT_TRUE(opts->optimistic_gate);
+}
+
+TEST(CliOptionsTests, IdlePrefillIsOnByDefault) {
+  const char* argv[] = {"CppDeepSeek", "--no-idle-prefill"};
+  std::string error;
+  auto opts = app::ParseCli(1, const_cast<char**>(argv), &error);
+  ASSERT_TRUE(opts.has_value()) << error;
+  EXPECT_TRUE(opts->idle_prefill);
+
+  opts = app::ParseCli(2, const_cast<char**>(argv), &error);
+  ASSERT_TRUE(opts.has_value()) << error;
+  EXPECT_FALSE(opts->idle_prefill);
+}
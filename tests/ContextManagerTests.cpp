@@ -0,0 +1,179 @@
+#include "ContextManager.hpp"
+
+#include <gtest/gtest.h>
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+// One token per word.
+app::ChatBackend WordCountingBackend() {
+  app::ChatBackend backend;
+  backend.count_tokens = [](std::string_view text) {
+    size_t words = 0;
+    bool in_word = false;
+    for (char c : text) {
+      if (c == ' ') {
+        in_word = false;
+      } else if (!in_word) {
+        in_word = true;
+        ++words;
+      }
+    }
+    return words;
+  };
+  return backend;
+}
+
+// Ten tokens each: six words plus the per-message overhead.
+std::vector<deepseek::Message> Turns(size_t n) {
+  std::vector<deepseek::Message> messages;
+  for (size_t i = 0; i < n; ++i) {
+    messages.push_back({i % 2 ? "assistant" : "user", "m" + std::to_string(i) + " w w w w w", ""});
+  }
+  return messages;
+}
+
+}  // namespace
+
+TEST(ContextManagerTests, DropsOldestTurnsInStepsToFitBudget) {
+  const auto backend = WordCountingBackend();
+  app::ContextBudget budget;
+  budget.max_tokens = 60;
+  budget.keep_recent = 2;
+  budget.compact_step = 4;
+  app::ContextManager manager(budget);
+
+  app::ContextStats stats;
+  auto fitted = manager.Fit(backend, "sys", Turns(12), &stats);
+  ASSERT_EQ(fitted.size(), 4u);
+  EXPECT_EQ(fitted.front().content, "m8 w w w w w");
+  EXPECT_EQ(stats.compacted, 8u);
+  EXPECT_EQ(stats.tokens, 45u);
+  EXPECT_FALSE(stats.summarized);
+
+  // Under budget: untouched.
+  EXPECT_EQ(manager.Fit(backend, "sys", Turns(5), &stats).size(), 5u);
+  EXPECT_EQ(stats.compacted, 0u);
+
+  // The most recent turns are always kept, even over budget.
+  budget.max_tokens = 10;
+  app::ContextManager tight(budget);
+  fitted = tight.Fit(backend, "sys", Turns(12), &stats);
+  ASSERT_EQ(fitted.size(), 2u);
+  EXPECT_EQ(fitted.back().content, "m11 w w w w w");
+}
+
+TEST(ContextManagerTests, CachesSummariesAndRollsThemForward) {
+  std::vector<std::string> requests;
+  app::ChatBackend summarizer;
+  summarizer.chat = [&](const std::vector<deepseek::Message>& messages,
+                        std::string_view,
+                        app::CallContext*,
+                        std::string*) -> std::optional<deepseek::ChatResponse> {
+    requests.push_back(messages.back().content);
+    deepseek::ChatResponse resp;
+    resp.content = "S" + std::to_string(requests.size());
+    return resp;
+  };
+
+  const auto backend = WordCountingBackend();
+  app::ContextBudget budget;
+  budget.max_tokens = 60;
+  budget.keep_recent = 2;
+  budget.compact_step = 4;
+  budget.summary_tokens = 10;
+  app::ContextManager manager(budget, &summarizer);
+
+  app::ContextStats stats;
+  auto fitted = manager.Fit(backend, "sys", Turns(12), &stats);
+  ASSERT_EQ(fitted.size(), 5u);
+  EXPECT_EQ(fitted.front().role, "system");
+  EXPECT_NE(fitted.front().content.find("S1"), std::string::npos);
+  EXPECT_TRUE(stats.summarized);
+  ASSERT_EQ(requests.size(), 1u);
+  EXPECT_NE(requests[0].find("m0 w"), std::string::npos);
+  EXPECT_NE(requests[0].find("m7 w"), std::string::npos);
+  EXPECT_EQ(requests[0].find("m8 w"), std::string::npos);
+
+  // Same history: the cached summary is reused.
+  fitted = manager.Fit(backend, "sys", Turns(12), &stats);
+  EXPECT_EQ(requests.size(), 1u);
+  EXPECT_NE(fitted.front().content.find("S1"), std::string::npos);
+
+  // Longer history: only the newly compacted turns are summarized, on top
+  // of the previous summary.
+  fitted = manager.Fit(backend, "sys", Turns(16), &stats);
+  ASSERT_EQ(requests.size(), 2u);
+  EXPECT_EQ(stats.compacted, 12u);
+  EXPECT_NE(requests[1].find("Summary so far:\nS1"), std::string::npos);
+  EXPECT_EQ(requests[1].find("m0 w"), std::string::npos);
+  EXPECT_NE(requests[1].find("m8 w"), std::string::npos);
+  EXPECT_NE(fitted.front().content.find("S2"), std::string::npos);
+}
+
+TEST(ContextManagerTests, SummarizesInChunksAndDropsTurnsWhenSummarizerFails) {
+  std::vector<std::string> requests;
+  bool fail = false;
+  app::ChatBackend summarizer;
+  summarizer.chat = [&](const std::vector<deepseek::Message>& messages,
+                        std::string_view,
+                        app::CallContext*,
+                        std::string*) -> std::optional<deepseek::ChatResponse> {
+    if (fail) {
+      throw std::runtime_error("Prompt exceeds the context window");
+    }
+    requests.push_back(messages.back().content);
+    deepseek::ChatResponse resp;
+    resp.content = "S" + std::to_string(requests.size());
+    return resp;
+  };
+
+  const auto backend = WordCountingBackend();
+  app::ContextBudget budget;
+  budget.max_tokens = 60;
+  budget.keep_recent = 2;
+  budget.compact_step = 4;
+  budget.summary_tokens = 10;
+  // Room for four turns next to the instructions and a short summary.
+  budget.summarizer_tokens = 110;
+  app::ContextManager manager(budget, &summarizer);
+
+  // Eight compacted turns take two requests, the second on top of the first.
+  app::ContextStats stats;
+  auto fitted = manager.Fit(backend, "sys", Turns(12), &stats);
+  ASSERT_EQ(requests.size(), 2u);
+  EXPECT_NE(requests[0].find("m3 w"), std::string::npos);
+  EXPECT_EQ(requests[0].find("m4 w"), std::string::npos);
+  EXPECT_NE(requests[1].find("Summary so far:\nS1"), std::string::npos);
+  EXPECT_NE(requests[1].find("m7 w"), std::string::npos);
+  EXPECT_NE(fitted.front().content.find("S2"), std::string::npos);
+  EXPECT_EQ(stats.unsummarized, 0u);
+
+  // A failing summarizer keeps the last summary and reports the turns it
+  // does not cover instead of failing the call.
+  fail = true;
+  fitted = manager.Fit(backend, "sys", Turns(16), &stats);
+  ASSERT_EQ(fitted.size(), 5u);
+  EXPECT_NE(fitted.front().content.find("S2"), std::string::npos);
+  EXPECT_EQ(stats.compacted, 12u);
+  EXPECT_EQ(stats.unsummarized, 4u);
+
+  // The next call retries only the missing turns.
+  fail = false;
+  fitted = manager.Fit(backend, "sys", Turns(16), &stats);
+  ASSERT_EQ(requests.size(), 3u);
+  EXPECT_NE(requests[2].find("m8 w"), std::string::npos);
+  EXPECT_NE(fitted.front().content.find("S3"), std::string::npos);
+  EXPECT_EQ(stats.unsummarized, 0u);
+
+  // Without any summary the compacted turns are dropped.
+  fail = true;
+  app::ContextManager fresh(budget, &summarizer);
+  fitted = fresh.Fit(backend, "sys", Turns(12), &stats);
+  ASSERT_EQ(fitted.size(), 4u);
+  EXPECT_FALSE(stats.summarized);
+  EXPECT_EQ(stats.unsummarized, 8u);
+}
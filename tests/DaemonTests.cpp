@@ -0,0 +1,162 @@
+#include "Daemon.hpp"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+std::string TestSocketPath() {
+  return "/tmp/cppdeepseek_daemon_test_" + std::to_string(::getpid()) + ".sock";
+}
+
+std::vector<app::Agent> DefaultAgents() {
+  return {{"Researcher", "Research prompt", {}}, {"Critic", "Critic prompt", {}}};
+}
+
+}  // namespace
+
+TEST(DaemonTests, StreamsDeltasAndKeepsSessionMemory) {
+  const std::string path = TestSocketPath();
+  app::DaemonServer server(
+      path, DefaultAgents,
+      [](const app::DaemonRequest& request, std::vector<app::Agent>& agents,
+         const app::DaemonEvents& events, std::string*) {
+        for (auto& agent : agents) {
+          events.on_delta(agent.name, "", request.topic);
+          app::AgentResult result;
+          result.name = agent.name;
+          result.response.content = agent.name + ":" + std::to_string(agent.memory.size());
+          agent.memory.push_back({"assistant", result.response.content, ""});
+          events.on_result(result);
+        }
+        return true;
+      });
+  std::string error;
+  ASSERT_TRUE(server.Start(&error)) << error;
+
+  std::vector<std::string> deltas;
+  std::vector<std::string> contents;
+  app::DaemonEvents events;
+  events.on_delta = [&](const std::string& agent, std::string_view, std::string_view content) {
+    deltas.push_back(agent + "/" + std::string(content));
+  };
+  events.on_result = [&](const app::AgentResult& result) {
+    contents.push_back(result.response.content);
+  };
+
+  app::DaemonRequest request;
+  request.topic = "C++ agents";
+  ASSERT_TRUE(app::RunDaemonClient(path, request, events, &error)) << error;
+  ASSERT_TRUE(app::RunDaemonClient(path, request, events, &error)) << error;
+
+  ASSERT_EQ(deltas.size(), 4u);
+  EXPECT_EQ(deltas[0], "Researcher/C++ agents");
+  ASSERT_EQ(contents.size(), 4u);
+  EXPECT_EQ(contents[0], "Researcher:0");
+  // The second request sees the memory the first one left in the session.
+  EXPECT_EQ(contents[2], "Researcher:1");
+  EXPECT_EQ(server.Agents("default")[1].memory.size(), 2u);
+
+  server.Stop();
+  EXPECT_FALSE(app::RunDaemonClient(path, request, events, &error));
+}
+
+TEST(DaemonTests, HoldsBackSplitMultiByteCharacters) {
+  const std::string path = TestSocketPath();
+  app::DaemonServer server(
+      path, DefaultAgents,
+      [](const app::DaemonRequest&, std::vector<app::Agent>&, const app::DaemonEvents& events,
+         std::string*) {
+        // "café ok" with the two-byte "é" split across pieces, then a reply
+        // truncated after the first byte of "é".
+        events.on_delta("Researcher", "", "caf\xC3");
+        events.on_delta("Researcher", "", "\xA9 ok");
+        app::AgentResult result;
+        result.name = "Researcher";
+        result.response.content = "caf\xC3";
+        events.on_result(result);
+        return true;
+      });
+  std::string error;
+  ASSERT_TRUE(server.Start(&error)) << error;
+
+  std::vector<std::string> deltas;
+  std::vector<std::string> contents;
+  app::DaemonEvents events;
+  events.on_delta = [&](const std::string&, std::string_view, std::string_view content) {
+    deltas.emplace_back(content);
+  };
+  events.on_result = [&](const app::AgentResult& result) {
+    contents.push_back(result.response.content);
+  };
+
+  app::DaemonRequest request;
+  request.topic = "C++ agents";
+  ASSERT_TRUE(app::RunDaemonClient(path, request, events, &error)) << error;
+  ASSERT_EQ(deltas.size(), 2u);
+  EXPECT_EQ(deltas[0], "caf");
+  EXPECT_EQ(deltas[1], "\xC3\xA9 ok");
+  ASSERT_EQ(contents.size(), 1u);
+  EXPECT_EQ(contents[0], "caf\xEF\xBF\xBD");
+}
+
+TEST(DaemonTests, ReportsHandlerErrors) {
+  const std::string path = TestSocketPath();
+  app::DaemonServer server(path, DefaultAgents,
+                           [](const app::DaemonRequest&, std::vector<app::Agent>&,
+                              const app::DaemonEvents&, std::string* error_out) {
+                             *error_out = "Gate rejected the topic.";
+                             return false;
+                           });
+  std::string error;
+  ASSERT_TRUE(server.Start(&error)) << error;
+
+  app::DaemonRequest request;
+  request.topic = "cooking";
+  EXPECT_FALSE(app::RunDaemonClient(path, request, {}, &error));
+  EXPECT_EQ(error, "Gate rejected the topic.");
+}
+
+TEST(DaemonTests, CancelsRequestWhenClientDisconnects) {
+  const std::string path = TestSocketPath();
+  std::atomic<bool> saw_cancel{false};
+  std::atomic<bool> handled{false};
+  app::DaemonServer server(
+      path, DefaultAgents,
+      [&](const app::DaemonRequest&, std::vector<app::Agent>&, const app::DaemonEvents& events,
+          std::string*) -> bool {
+        const auto give_up = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (!events.cancel->cancelled() && std::chrono::steady_clock::now() < give_up) {
+          std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        saw_cancel = events.cancel->cancelled();
+        handled = true;
+        throw app::CancelledError("Cancelled");
+      });
+  std::string error;
+  ASSERT_TRUE(server.Start(&error)) << error;
+
+  const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+  ASSERT_EQ(::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)), 0);
+  const std::string request = "{\"topic\":\"C++ agents\"}\n";
+  ASSERT_EQ(::send(fd, request.data(), request.size(), 0), (ssize_t)request.size());
+  ::close(fd);
+
+  const auto give_up = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (!handled && std::chrono::steady_clock::now() < give_up) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  server.Stop();
+  EXPECT_TRUE(saw_cancel.load());
+}
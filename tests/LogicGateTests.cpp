@@ -6,6 +6,7 @@ TEST(LogicGateTests, AcceptsYesResponse) {
   app::ChatBackend backend;
   backend.chat = [&](const std::vector<deepseek::Message>&,
                      std::string_view,
+                     app::CallContext*,
                      std::string*) -> std::optional<deepseek::ChatResponse> {
     deepseek::ChatResponse resp;
     resp.content = "YES";
@@ -14,6 +15,7 @@ TEST(LogicGateTests, AcceptsYesResponse) {
   backend.stream = [&](const std::vector<deepseek::Message>&,
                        std::string_view,
                        const app::ChatBackend::StreamCallback&,
+                       app::CallContext*,
                        std::string*) { return false; };
 
   app::LogicGate gate("Allow only safe content.");
@@ -26,6 +28,7 @@ TEST(LogicGateTests, RejectsInvalidResponse) {
   app::ChatBackend backend;
   backend.chat = [&](const std::vector<deepseek::Message>&,
                      std::string_view,
+                     app::CallContext*,
                      std::string*) -> std::optional<deepseek::ChatResponse> {
     deepseek::ChatResponse resp;
     resp.content = "MAYBE";
@@ -34,6 +37,7 @@ TEST(LogicGateTests, RejectsInvalidResponse) {
   backend.stream = [&](const std::vector<deepseek::Message>&,
                        std::string_view,
                        const app::ChatBackend::StreamCallback&,
+                       app::CallContext*,
                        std::string*) { return false; };
 
   app::LogicGate gate("Allow only safe content.");
@@ -42,3 +46,50 @@ TEST(LogicGateTests, RejectsInvalidResponse) {
   EXPECT_FALSE(result.has_value());
   EXPECT_FALSE(error.empty());
 }
+
+TEST(LogicGateTests, ReusesDecisionForSimilarInput) {
+  int calls = 0;
+  app::ChatBackend backend;
+  backend.chat = [&](const std::vector<deepseek::Message>&,
+                     std::string_view,
+                     app::CallContext*,
+                     std::string*) -> std::optional<deepseek::ChatResponse> {
+    ++calls;
+    deepseek::ChatResponse resp;
+    resp.content = "YES";
+    return resp;
+  };
+  // Inputs mentioning "cache" embed close together, everything else apart.
+  backend.embed = [](std::string_view text, std::string*) -> std::optional<std::vector<float>> {
+    if (text.find("cache") != std::string_view::npos) {
+      return std::vector<float>{1.0f, 0.05f * static_cast<float>(text.size() % 3), 0.0f};
+    }
+    return std::vector<float>{0.0f, 0.0f, 1.0f};
+  };
+
+  app::SemanticCache<app::GateResult> cache({0.9f, 16});
+  app::LogicGate gate("Allow only software engineering topics.");
+  gate.SetCache(&cache);
+
+  auto first = gate.Evaluate(backend, "how do I size a cache", false);
+  ASSERT_TRUE(first.has_value());
+  EXPECT_FALSE(first->cache_score.has_value());
+
+  auto second = gate.Evaluate(backend, "sizing a cache, how?", false);
+  ASSERT_TRUE(second.has_value());
+  EXPECT_TRUE(second->allow);
+  ASSERT_TRUE(second->cache_score.has_value());
+  EXPECT_GT(*second->cache_score, 0.9f);
+  EXPECT_EQ(second->cached_input, "how do I size a cache");
+  EXPECT_EQ(calls, 1);
+
+  // A different rule never reuses another rule's decisions.
+  app::LogicGate other("Allow only cooking topics.");
+  other.SetCache(&cache);
+  ASSERT_TRUE(other.Evaluate(backend, "sizing a cache, how?", false).has_value());
+  EXPECT_EQ(calls, 2);
+
+  ASSERT_TRUE(gate.Evaluate(backend, "unrelated input", false).has_value());
+  EXPECT_EQ(calls, 3);
+  EXPECT_EQ(cache.size(), 3u);
+}
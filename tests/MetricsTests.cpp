@@ -0,0 +1,100 @@
+#include "AgentRuntime.hpp"
+#include "Metrics.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+TEST(MetricsTests, HistogramBucketsAndQuantiles) {
+  app::Histogram histogram({10, 100, 1000});
+  for (int i = 0; i < 90; ++i) {
+    histogram.Observe(50);
+  }
+  for (int i = 0; i < 10; ++i) {
+    histogram.Observe(500);
+  }
+  histogram.Observe(10);
+  histogram.Observe(5000);
+
+  ASSERT_EQ(histogram.counts().size(), 4u);
+  EXPECT_EQ(histogram.counts()[0], 1u);
+  EXPECT_EQ(histogram.counts()[1], 90u);
+  EXPECT_EQ(histogram.counts()[2], 10u);
+  EXPECT_EQ(histogram.counts()[3], 1u);
+  EXPECT_EQ(histogram.count(), 102u);
+  EXPECT_DOUBLE_EQ(histogram.sum(), 90 * 50 + 10 * 500 + 10 + 5000);
+
+  const double p50 = histogram.Quantile(0.5);
+  EXPECT_GT(p50, 10.0);
+  EXPECT_LE(p50, 100.0);
+  EXPECT_GT(histogram.Quantile(0.95), 100.0);
+  EXPECT_DOUBLE_EQ(histogram.Quantile(1.0), 1000.0);
+  EXPECT_DOUBLE_EQ(app::Histogram({1}).Quantile(0.5), 0.0);
+}
+
+TEST(MetricsTests, RunAgentAttachesAndRecordsCallMetrics) {
+  app::ChatBackend backend;
+  backend.chat = [](const std::vector<deepseek::Message>&,
+                    std::string_view,
+                    app::CallContext* call,
+                    std::string*) -> std::optional<deepseek::ChatResponse> {
+    call->metrics.backend = "local";
+    call->metrics.queue_ms = 3;
+    call->metrics.ttft_ms = 40;
+    call->metrics.prefill_tokens = 200;
+    call->metrics.prefill_ms = 37;
+    call->metrics.decode_tokens = 50;
+    call->metrics.decode_ms = 1000;
+    call->metrics.total_ms = 1040;
+    deepseek::ChatResponse resp;
+    resp.content = "answer";
+    return resp;
+  };
+
+  app::MetricsRegistry registry;
+  app::RunOptions options;
+  options.metrics = &registry;
+  app::Agent agent{"Researcher", "prompt", {}};
+  auto result = app::RunAgent(backend, agent, "topic", options);
+  EXPECT_EQ(result.metrics.backend, "local");
+  EXPECT_EQ(result.metrics.decode_tokens, 50u);
+  app::RunAgent(backend, agent, "again", options);
+
+  // A gate call that only reported transfer and usage figures.
+  deepseek::CallMetrics remote;
+  remote.backend = "remote";
+  remote.bytes_sent = 1200;
+  remote.cache_hit_tokens = 64;
+  registry.Record("gate", remote);
+  EXPECT_EQ(registry.calls(), 3u);
+  EXPECT_EQ(registry.counter("cache_hit_tokens"), 64u);
+  EXPECT_EQ(registry.counter("decode_tokens"), 100u);
+  EXPECT_EQ(registry.counter("no_such_counter"), 0u);
+
+  const std::string text = registry.ToPrometheus();
+  EXPECT_NE(text.find("# TYPE cppdeepseek_ttft_ms histogram"), std::string::npos);
+  EXPECT_NE(text.find("cppdeepseek_calls_total{kind=\"agent\",backend=\"local\"} 2"),
+            std::string::npos);
+  EXPECT_NE(text.find("cppdeepseek_ttft_ms_bucket{kind=\"agent\",backend=\"local\",le=\"50\"} 2"),
+            std::string::npos);
+  EXPECT_NE(text.find("cppdeepseek_decode_tokens_total{kind=\"agent\",backend=\"local\"} 100"),
+            std::string::npos);
+  EXPECT_NE(text.find("cppdeepseek_cache_hit_tokens_total{kind=\"gate\",backend=\"remote\"} 64"),
+            std::string::npos);
+
+  const auto json = nlohmann::json::parse(registry.ToJson());
+  ASSERT_EQ(json["series"].size(), 2u);
+  const auto& agent_series = json["series"][0];
+  EXPECT_EQ(agent_series["kind"], "agent");
+  EXPECT_EQ(agent_series["calls"], 2);
+  EXPECT_EQ(agent_series["counters"]["prefill_tokens"], 400);
+  const auto& decode_rate = agent_series["histograms"]["decode_tokens_per_second"];
+  EXPECT_EQ(decode_rate["count"], 2);
+  EXPECT_DOUBLE_EQ(decode_rate["mean"].get<double>(), 50.0);
+  // The gate series measured no time, so only its queue time was observed.
+  const auto& gate_series = json["series"][1];
+  EXPECT_EQ(gate_series["histograms"]["queue_ms"]["count"], 1);
+  EXPECT_EQ(gate_series["histograms"]["ttft_ms"]["count"], 0);
+}
@@ -0,0 +1,62 @@
+#include "PrefixCache.hpp"
+
+#include <gtest/gtest.h>
+
+namespace {
+
+std::vector<uint8_t> State(size_t bytes) { return std::vector<uint8_t>(bytes, 0x5a); }
+
+}  // namespace
+
+TEST(PrefixCacheTests, FindsLongestSharedPrefixAcrossEntries) {
+  app::PrefixCache cache(1 << 20);
+  cache.Insert({1, 2, 3, 4, 5}, State(10));
+  cache.Insert({1, 2, 7, 8}, State(20));
+
+  auto match = cache.Lookup({1, 2, 3, 4, 9, 9});
+  ASSERT_TRUE(match.has_value());
+  EXPECT_EQ(match->prefix, 4u);
+  EXPECT_EQ(match->entry->tokens, (std::vector<int32_t>{1, 2, 3, 4, 5}));
+
+  // Diverging inside a shared edge still finds an entry below it.
+  match = cache.Lookup({1, 2, 7, 0});
+  ASSERT_TRUE(match.has_value());
+  EXPECT_EQ(match->prefix, 3u);
+  EXPECT_EQ(match->entry->state.size(), 20u);
+
+  EXPECT_FALSE(cache.Lookup({9, 1, 2}).has_value());
+  const auto stats = cache.stats();
+  EXPECT_EQ(stats.lookups, 3u);
+  EXPECT_EQ(stats.hits, 2u);
+  EXPECT_EQ(stats.hit_tokens, 7u);
+}
+
+TEST(PrefixCacheTests, LongerEntrySupersedesItsPrefix) {
+  app::PrefixCache cache(1 << 20);
+  cache.Insert({1, 2}, State(10));
+  cache.Insert({1, 2, 3}, State(15));
+  EXPECT_EQ(cache.stats().entries, 1u);
+  EXPECT_EQ(cache.stats().bytes, 15u);
+
+  // A shorter prompt inserted later splits the edge and keeps both.
+  cache.Insert({1, 5}, State(5));
+  EXPECT_EQ(cache.stats().entries, 2u);
+  EXPECT_EQ(cache.Lookup({1, 2, 3})->prefix, 3u);
+}
+
+TEST(PrefixCacheTests, EvictsLeastRecentlyUsedUnderBudget) {
+  app::PrefixCache cache(100);
+  cache.Insert({1, 1}, State(40));
+  cache.Insert({2, 2}, State(40));
+  ASSERT_TRUE(cache.Lookup({1, 1}).has_value());  // {2,2} is now the oldest.
+  cache.Insert({3, 3}, State(40));
+
+  EXPECT_EQ(cache.stats().entries, 2u);
+  EXPECT_EQ(cache.stats().evictions, 1u);
+  EXPECT_LE(cache.stats().bytes, 100u);
+  EXPECT_TRUE(cache.Lookup({1, 1}).has_value());
+  EXPECT_FALSE(cache.Lookup({2, 2}).has_value());
+
+  cache.Insert({4}, State(101));
+  EXPECT_FALSE(cache.Lookup({4}).has_value());
+}
@@ -0,0 +1,154 @@
+#include "RetrievalMemory.hpp"
+#include "VectorIndex.hpp"
+
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const std::vector<std::string> kTopics{"cache", "thread", "network", "disk"};
+
+// One dimension per topic word, plus a constant so no vector is zero.
+std::vector<float> TopicVector(std::string_view text) {
+  std::vector<float> v(kTopics.size() + 1, 0.0f);
+  for (size_t i = 0; i < kTopics.size(); ++i) {
+    if (text.find(kTopics[i]) != std::string_view::npos) {
+      v[i] = 1.0f;
+    }
+  }
+  v.back() = 0.1f;
+  return v;
+}
+
+}  // namespace
+
+TEST(RetrievalMemoryTests, VectorIndexFindsNearestAndRoundTrips) {
+  // 67 dimensions exercise the SIMD tail.
+  const size_t dim = 67;
+  app::VectorIndex index;
+  for (uint64_t id = 0; id < 50; ++id) {
+    std::vector<float> v(dim);
+    for (size_t j = 0; j < dim; ++j) {
+      v[j] = static_cast<float>(((id * 31 + j * 17) % 23)) - 11.0f;
+    }
+    ASSERT_TRUE(index.Add(id, v));
+  }
+  EXPECT_FALSE(index.Add(99, std::vector<float>(dim + 1, 1.0f)));
+  ASSERT_EQ(index.size(), 50u);
+
+  std::vector<float> query(dim);
+  for (size_t j = 0; j < dim; ++j) {
+    query[j] = static_cast<float>(((7 * 31 + j * 17) % 23)) - 11.0f + 0.3f;
+  }
+  auto matches = index.Search(query, 3);
+  ASSERT_EQ(matches.size(), 3u);
+  EXPECT_EQ(matches[0].id, 7u);
+  EXPECT_GT(matches[0].score, 0.95f);
+  EXPECT_GE(matches[0].score, matches[1].score);
+
+  matches = index.Search(query, 1, -1.0f, [](uint64_t id) { return id != 7; });
+  ASSERT_EQ(matches.size(), 1u);
+  EXPECT_NE(matches[0].id, 7u);
+
+  std::stringstream buffer;
+  ASSERT_TRUE(index.Write(buffer));
+  app::VectorIndex loaded;
+  ASSERT_TRUE(loaded.Read(buffer));
+  EXPECT_EQ(loaded.size(), 50u);
+  EXPECT_EQ(loaded.Search(query, 1)[0].id, 7u);
+}
+
+TEST(RetrievalMemoryTests, SendsRecentWindowPlusRelevantHistory) {
+  size_t embed_calls = 0;
+  app::ChatBackend backend;
+  backend.embed = [&](std::string_view text, std::string*) -> std::optional<std::vector<float>> {
+    ++embed_calls;
+    return TopicVector(text);
+  };
+
+  app::Agent agent{"Researcher", "prompt", {}};
+  for (size_t i = 0; i < 12; ++i) {
+    agent.memory.push_back(
+        {"assistant", "turn " + std::to_string(i) + " about " + kTopics[i % kTopics.size()], ""});
+  }
+
+  app::RetrievalOptions options;
+  options.recent = 4;
+  options.top_k = 2;
+  options.min_score = 0.5f;
+  app::RetrievalMemory memory(options);
+
+  auto prompt = memory.BuildPrompt(backend, agent, "what about the disk layout?");
+  // Two older "disk" turns (3 and 7), the last four turns, then the input.
+  ASSERT_EQ(prompt.size(), 7u);
+  EXPECT_EQ(prompt[0].content, "turn 3 about disk");
+  EXPECT_EQ(prompt[1].content, "turn 7 about disk");
+  EXPECT_EQ(prompt[2].content, "turn 8 about cache");
+  EXPECT_EQ(prompt.back().content, "what about the disk layout?");
+  EXPECT_EQ(memory.Indexed("Researcher"), 12u);
+  EXPECT_EQ(embed_calls, 13u);
+
+  // Only new or changed messages are embedded again.
+  agent.memory.push_back({"assistant", "turn 12 about cache", ""});
+  memory.BuildPrompt(backend, agent, "cache?");
+  EXPECT_EQ(embed_calls, 15u);
+  agent.memory[11].content = "turn 11 rewritten";
+  memory.BuildPrompt(backend, agent, "cache?");
+  EXPECT_EQ(embed_calls, 18u);
+
+  const fs::path path = fs::temp_directory_path() / "retrieval_memory_test.vec";
+  std::string error;
+  ASSERT_TRUE(memory.Save(path.string(), &error)) << error;
+  app::RetrievalMemory restored(options);
+  ASSERT_TRUE(restored.Load(path.string(), &error)) << error;
+  EXPECT_EQ(restored.Indexed("Researcher"), 13u);
+  embed_calls = 0;
+  restored.BuildPrompt(backend, agent, "cache?");
+  EXPECT_EQ(embed_calls, 1u);
+  fs::remove(path);
+
+  // Without embeddings the full history is sent.
+  app::ChatBackend plain;
+  EXPECT_EQ(memory.BuildPrompt(plain, agent, "x").size(), agent.memory.size() + 1);
+}
+
+TEST(RetrievalMemoryTests, StablePrefixKeepsTheWindowStartBetweenTurns) {
+  app::ChatBackend backend;
+  backend.embed = [](std::string_view text, std::string*) -> std::optional<std::vector<float>> {
+    return TopicVector(text);
+  };
+  app::Agent agent{"Researcher", "prompt", {}};
+  for (size_t i = 0; i < 10; ++i) {
+    agent.memory.push_back(
+        {"assistant", "turn " + std::to_string(i) + " about " + kTopics[i % kTopics.size()], ""});
+  }
+
+  app::RetrievalOptions options;
+  options.recent = 4;
+  options.top_k = 1;
+  options.min_score = 0.5f;
+  options.stable_prefix = true;
+  app::RetrievalMemory memory(options);
+
+  // The window starts at message 4 (not 6) and the relevant turn 3 is quoted
+  // in the input.
+  auto prompt = memory.BuildPrompt(backend, agent, "what about the disk layout?");
+  ASSERT_EQ(prompt.size(), 7u);
+  EXPECT_EQ(prompt[0].content, "turn 4 about cache");
+  EXPECT_EQ(prompt.back().content,
+            "Relevant earlier messages:\nassistant: turn 3 about disk\n\n"
+            "what about the disk layout?");
+
+  agent.memory.push_back({"assistant", "turn 10 about network", ""});
+  auto next = memory.BuildPrompt(backend, agent, "cache?");
+  ASSERT_EQ(next.size(), 8u);
+  for (size_t i = 0; i + 1 < prompt.size(); ++i) {
+    EXPECT_EQ(next[i].content, prompt[i].content);
+  }
+}
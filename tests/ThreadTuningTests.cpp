@@ -0,0 +1,120 @@
+#include "ThreadTuning.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+void WriteFile(const fs::path& path, const std::string& text) {
+  fs::create_directories(path.parent_path());
+  std::ofstream(path) << text;
+}
+
+}  // namespace
+
+TEST(ThreadTuningTests, DetectsPhysicalCoresFromSysfs) {
+  const fs::path root = fs::temp_directory_path() / "thread_tuning_sysfs";
+  fs::remove_all(root);
+  // Two cores with two SMT siblings each: cpu0/cpu2 and cpu1/cpu3.
+  const int core_ids[] = {0, 1, 0, 1};
+  for (int cpu = 0; cpu < 4; ++cpu) {
+    const fs::path dir = root / "cpu" / ("cpu" + std::to_string(cpu)) / "topology";
+    WriteFile(dir / "core_id", std::to_string(core_ids[cpu]) + "\n");
+    WriteFile(dir / "physical_package_id", "0\n");
+  }
+  WriteFile(root / "cpu" / "cpufreq" / "boost", "1\n");
+  WriteFile(root / "node" / "node0" / "cpulist", "0,2\n");
+  WriteFile(root / "node" / "node1" / "cpulist", "1,3\n");
+  WriteFile(root / "cpuinfo", "processor\t: 0\nmodel name\t: Test CPU 9000\n");
+
+  const auto topology =
+      app::DetectCpuTopology((root / "cpu").string(), (root / "cpuinfo").string());
+  EXPECT_EQ(topology.cpu_model, "Test CPU 9000");
+  EXPECT_EQ(topology.logical_cpus, 4);
+  EXPECT_EQ(topology.physical_cores(), 2);
+  EXPECT_EQ(topology.core_cpus, (std::vector<int>{0, 1}));
+  ASSERT_EQ(topology.numa_nodes.size(), 2u);
+  EXPECT_EQ(topology.numa_nodes[0], (std::vector<int>{0}));
+  EXPECT_EQ(topology.numa_nodes[1], (std::vector<int>{1}));
+
+  const auto candidates = app::TuneCandidates(topology, 512);
+  ASSERT_FALSE(candidates.empty());
+  for (const auto& c : candidates) {
+    EXPECT_LE(c.n_batch, 512);
+    EXPECT_FALSE(c.pin && c.threads > 2);
+  }
+  fs::remove_all(root);
+}
+
+TEST(ThreadTuningTests, SelectsDecodeAndPrefillSeparatelyAndRoundTrips) {
+  const fs::path home = fs::temp_directory_path() / "thread_tuning_home";
+  fs::remove_all(home);
+  ::setenv("DEEPSEEK_MODEL_HOME", home.c_str(), 1);
+  const fs::path model = home / "tiny" / "model.gguf";
+  WriteFile(model, "GGUF-test-weights");
+
+  app::CpuTopology topology;
+  topology.cpu_model = "Test CPU";
+  topology.logical_cpus = 8;
+  topology.core_cpus = {0, 1, 2, 3};
+
+  const std::vector<app::TuneSample> samples{
+      {{4, 256, true}, 100.0, 20.0},
+      {{8, 256, false}, 150.0, 12.0},
+      {{8, 1024, false}, 180.0, 0.0},
+  };
+  const auto profile = app::SelectThreadProfile(samples, topology, model.string());
+  EXPECT_EQ(profile.n_threads, 4);
+  EXPECT_TRUE(profile.pin_threads);
+  EXPECT_EQ(profile.n_threads_batch, 8);
+  EXPECT_EQ(profile.n_batch, 1024);
+  EXPECT_FALSE(profile.pin_threads_batch);
+
+  const std::string path = app::ThreadProfilePath(topology, model.string());
+  EXPECT_EQ(fs::path(path).parent_path(), home / "profiles");
+  std::string error;
+  ASSERT_TRUE(app::SaveThreadProfile(profile, path, &error)) << error;
+  auto loaded = app::LoadThreadProfile(path, model.string(), &error);
+  ASSERT_TRUE(loaded.has_value()) << error;
+  EXPECT_EQ(loaded->n_threads, 4);
+  EXPECT_EQ(loaded->n_batch, 1024);
+  EXPECT_DOUBLE_EQ(loaded->decode_tps, 20.0);
+
+  // A replaced model file invalidates the profile.
+  WriteFile(model, "GGUF-different-weights");
+  EXPECT_FALSE(app::LoadThreadProfile(path, model.string(), &error).has_value());
+
+  ::unsetenv("DEEPSEEK_MODEL_HOME");
+  fs::remove_all(home);
+}
+
+TEST(ThreadTuningTests, SplitsCoresBetweenPooledContexts) {
+  app::CpuTopology topology;
+  topology.logical_cpus = 16;
+  topology.core_cpus = {0, 1, 2, 3, 4, 5, 6, 7};
+  topology.numa_nodes = {{0, 1, 2, 3}, {4, 5, 6, 7}};
+
+  auto placements = app::PlanContextPlacement(topology, 2, 8, 16, false);
+  ASSERT_EQ(placements.size(), 2u);
+  EXPECT_EQ(placements[0].numa_node, -1);
+  EXPECT_EQ(placements[0].cpus, (std::vector<int>{0, 1, 2, 3}));
+  EXPECT_EQ(placements[1].cpus, (std::vector<int>{4, 5, 6, 7}));
+  EXPECT_EQ(placements[1].n_threads, 4);
+  EXPECT_EQ(placements[1].n_threads_batch, 8);
+
+  // With NUMA, contexts alternate nodes and never use more threads than
+  // their node has cores.
+  placements = app::PlanContextPlacement(topology, 4, 8, 16, true);
+  ASSERT_EQ(placements.size(), 4u);
+  EXPECT_EQ(placements[0].numa_node, 0);
+  EXPECT_EQ(placements[1].numa_node, 1);
+  EXPECT_EQ(placements[2].cpus, (std::vector<int>{2, 3}));
+  EXPECT_EQ(placements[3].cpus, (std::vector<int>{6, 7}));
+  EXPECT_EQ(placements[3].n_threads, 2);
+  EXPECT_EQ(placements[3].n_threads_batch, 2);
+}
@@ -0,0 +1,61 @@
+#include "Trace.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <set>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+TEST(TraceTests, WritesSpansPerThread) {
+  { app::TraceSpan ignored("before start"); }
+
+  app::StartTracing();
+  app::SetTraceThreadName("main");
+  {
+    app::TraceSpan outer("outer", "topic");
+    app::TraceSpan inner("inner");
+    inner.End();
+    inner.End();
+  }
+  std::thread worker([] {
+    app::SetTraceThreadName("worker");
+    app::TraceSpan span("work");
+  });
+  worker.join();
+  app::StopTracing();
+  { app::TraceSpan ignored("after stop"); }
+
+  const fs::path path = fs::temp_directory_path() / "trace_test.json";
+  std::string error;
+  ASSERT_TRUE(app::WriteTrace(path.string(), &error)) << error;
+  std::ifstream in(path);
+  const auto root = nlohmann::json::parse(in);
+  fs::remove(path);
+
+  std::map<std::string, nlohmann::json> spans;
+  std::map<int, std::string> thread_names;
+  for (const auto& event : root["traceEvents"]) {
+    if (event["ph"] == "X") {
+      spans[event["name"].get<std::string>()] = event;
+    } else if (event["name"] == "thread_name") {
+      thread_names[event["tid"].get<int>()] = event["args"]["name"];
+    }
+  }
+  ASSERT_EQ(spans.size(), 3u);
+  const auto& outer = spans["outer"];
+  const auto& inner = spans["inner"];
+  EXPECT_EQ(outer["args"]["detail"], "topic");
+  EXPECT_LE(outer["ts"].get<double>(), inner["ts"].get<double>());
+  EXPECT_GE(outer["ts"].get<double>() + outer["dur"].get<double>(),
+            inner["ts"].get<double>() + inner["dur"].get<double>());
+  EXPECT_EQ(outer["tid"], inner["tid"]);
+  EXPECT_NE(spans["work"]["tid"], outer["tid"]);
+  EXPECT_EQ(thread_names[outer["tid"].get<int>()], "main");
+  EXPECT_EQ(thread_names[spans["work"]["tid"].get<int>()], "worker");
+}